@@ -1,12 +1,16 @@
 #include <iostream>
 #include <map>
 #include <vector>
+#include <algorithm>
+#include <cmath>
 #include <fstream>
 #include <iostream>
 #include <chrono>
 
 #include <list>
 #include <unordered_map>
+#include <unordered_set>
+#include <set>
 #include <iostream>
 #include <map>
 #include <string>
@@ -16,12 +20,30 @@
 #include <thread>
 #include <queue>
 #include <optional>
-#include <regex>
 #include <stdexcept>
 #include <cassert>
-
-
-enum FieldType { INT, FLOAT, STRING };
+#include <random>
+#include <cstring>
+#include <charconv>
+#include <mutex>
+#include <condition_variable>
+#include <shared_mutex>
+#include <numeric>
+#include <functional>
+#include <iterator>
+#include <atomic>
+#include <deque>
+#include <cstdlib>
+#include <cstddef>
+#include <new>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+
+// BIGINT only holds aggregates (SUM and COUNT of integers), tables
+// store INT, FLOAT and STRING
+enum FieldType { INT, FLOAT, STRING, BIGINT };
 
 // Define a basic Field variant class that can hold different types
 class Field {
@@ -43,6 +65,12 @@ public:
         std::memcpy(data.get(), &f, data_length);
     }
 
+    Field(int64_t l) : type(BIGINT) {
+        data_length = sizeof(int64_t);
+        data = std::make_unique<char[]>(data_length);
+        std::memcpy(data.get(), &l, data_length);
+    }
+
     Field(const std::string& s) : type(STRING) {
         data_length = s.size() + 1;  // include null-terminator
         data = std::make_unique<char[]>(data_length);
@@ -53,8 +81,7 @@ public:
         if (&other == this) {
             return *this;
         }
-        type = other.type;
-        data_length = other.data_length;
+        reshape(other.type, other.data_length);
         std::memcpy(data.get(), other.data.get(), data_length);
         return *this;
     }
@@ -76,21 +103,84 @@ public:
     float asFloat() const { 
         return *reinterpret_cast<float*>(data.get());
     }
+    int64_t asBigInt() const {
+        int64_t l;
+        std::memcpy(&l, data.get(), sizeof(l));
+        return l;
+    }
     std::string asString() const { 
         return std::string(data.get());
     }
 
+    // Overwrite the value of an INT or FLOAT field without reallocating
+    void setInt(int i) {
+        std::memcpy(data.get(), &i, sizeof(int));
+    }
+    void setFloat(float f) {
+        std::memcpy(data.get(), &f, sizeof(float));
+    }
+    void setBigInt(int64_t l) {
+        std::memcpy(data.get(), &l, sizeof(int64_t));
+    }
+
+    // Replace type and value, reusing the buffer when the size matches
+    void assign(int i) {
+        reshape(INT, sizeof(int));
+        setInt(i);
+    }
+    void assign(float f) {
+        reshape(FLOAT, sizeof(float));
+        setFloat(f);
+    }
+    void assign(int64_t l) {
+        reshape(BIGINT, sizeof(int64_t));
+        setBigInt(l);
+    }
+    void assign(std::string_view s) {
+        reshape(STRING, s.size() + 1);
+        std::memcpy(data.get(), s.data(), s.size());
+        data[s.size()] = '\0';
+    }
+
     std::string serialize() {
-        std::stringstream buffer;
-        buffer << type << ' ' << data_length << ' ';
+        std::string buffer;
+        appendSerialized(buffer);
+        return buffer;
+    }
+
+    // Append the serialized field to buffer without going through a
+    // stringstream. Floats use %g, the default ostream format.
+    void appendSerialized(std::string& buffer) const {
+        appendNumber(buffer, static_cast<size_t>(type));
+        appendNumber(buffer, data_length);
         if (type == STRING) {
-            buffer << data.get() << ' ';
+            buffer += data.get();
+            buffer += ' ';
         } else if (type == INT) {
-            buffer << *reinterpret_cast<int*>(data.get()) << ' ';
+            appendNumber(buffer, asInt());
+        } else if (type == BIGINT) {
+            appendNumber(buffer, asBigInt());
         } else if (type == FLOAT) {
-            buffer << *reinterpret_cast<float*>(data.get()) << ' ';
+            char number[32];
+            int length = std::snprintf(number, sizeof(number), "%g", asFloat());
+            buffer.append(number, length);
+            buffer += ' ';
         }
-        return buffer.str();
+    }
+
+    // Serialized form of Field(value) without constructing the Field
+    static void appendSerializedInt(std::string& buffer, int value) {
+        appendNumber(buffer, static_cast<size_t>(INT));
+        appendNumber(buffer, sizeof(int));
+        appendNumber(buffer, value);
+    }
+
+    template <typename T>
+    static void appendNumber(std::string& buffer, T value) {
+        char number[24];
+        auto result = std::to_chars(number, number + sizeof(number), value);
+        buffer.append(number, result.ptr - number);
+        buffer += ' ';
     }
 
     void serialize(std::ofstream& out) {
@@ -107,6 +197,9 @@ public:
         } else if (type == INT) {
             int val; in >> val;
             return std::make_unique<Field>(val);
+        } else if (type == BIGINT) {
+            int64_t val; in >> val;
+            return std::make_unique<Field>(val);
         } else if (type == FLOAT) {
             float val; in >> val;
             return std::make_unique<Field>(val);
@@ -125,6 +218,16 @@ public:
             case INT: std::cout << asInt(); break;
             case FLOAT: std::cout << asFloat(); break;
             case STRING: std::cout << asString(); break;
+            case BIGINT: std::cout << asBigInt(); break;
+        }
+    }
+
+private:
+    void reshape(FieldType new_type, size_t new_length) {
+        type = new_type;
+        if (new_length != data_length || !data) {
+            data = std::make_unique<char[]>(new_length);
+            data_length = new_length;
         }
     }
 };
@@ -139,11 +242,34 @@ bool operator==(const Field& lhs, const Field& rhs) {
             return *reinterpret_cast<const float*>(lhs.data.get()) == *reinterpret_cast<const float*>(rhs.data.get());
         case STRING:
             return std::string(lhs.data.get(), lhs.data_length - 1) == std::string(rhs.data.get(), rhs.data_length - 1);
+        case BIGINT:
+            return lhs.asBigInt() == rhs.asBigInt();
         default:
             throw std::runtime_error("Unsupported field type for comparison.");
     }
 }
 
+// splitmix64 finalizer: a bijection, so distinct keys never collide
+inline uint64_t hashInt(int key) {
+    uint64_t x = static_cast<uint32_t>(key);
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+    return x ^ (x >> 31);
+}
+
+// Hash of a single field by type, for hash maps keyed by Field
+struct FieldHasher {
+    size_t operator()(const Field& field) const {
+        switch (field.type) {
+            case INT: return std::hash<int>()(field.asInt());
+            case FLOAT: return std::hash<float>()(field.asFloat());
+            case STRING: return std::hash<std::string_view>()(std::string_view(field.data.get(), field.data_length - 1));
+            case BIGINT: return std::hash<int64_t>()(field.asBigInt());
+        }
+        return 0;
+    }
+};
+
 class Tuple {
 public:
     std::vector<std::unique_ptr<Field>> fields;
@@ -161,12 +287,12 @@ public:
     }
 
     std::string serialize() {
-        std::stringstream buffer;
-        buffer << fields.size() << ' ';
+        std::string buffer;
+        Field::appendNumber(buffer, fields.size());
         for (const auto& field : fields) {
-            buffer << field->serialize();
+            field->appendSerialized(buffer);
         }
-        return buffer.str();
+        return buffer;
     }
 
     void serialize(std::ofstream& out) {
@@ -183,6 +309,78 @@ public:
         return tuple;
     }
 
+    // Parse a serialized tuple straight from page bytes, without building
+    // an istringstream. Accepts exactly what serialize() produces.
+    static std::unique_ptr<Tuple> deserialize(const char* data, size_t length) {
+        auto tuple = std::make_unique<Tuple>();
+        parseSerialized(data, length, [&tuple](size_t, auto value) {
+            if constexpr (std::is_same_v<decltype(value), std::string_view>) {
+                tuple->addField(std::make_unique<Field>(std::string(value)));
+            } else {
+                tuple->addField(std::make_unique<Field>(value));
+            }
+        });
+        return tuple;
+    }
+
+    // Parse a serialized tuple into fields, overwriting the Fields already
+    // there in place so that steady-state parsing does not allocate
+    static void deserializeInto(std::vector<std::unique_ptr<Field>>& fields, const char* data, size_t length) {
+        size_t field_count = 0;
+        parseSerialized(data, length, [&fields, &field_count](size_t index, auto value) {
+            reuseField(fields, index).assign(value);
+            field_count = index + 1;
+        });
+        fields.resize(field_count);
+    }
+
+    // fields[index], created if missing
+    static Field& reuseField(std::vector<std::unique_ptr<Field>>& fields, size_t index) {
+        if (index >= fields.size()) {
+            fields.resize(index + 1);
+        }
+        if (!fields[index]) {
+            fields[index] = std::make_unique<Field>(0);
+        }
+        return *fields[index];
+    }
+
+    // Calls visit(field index, value) for every field of a serialized
+    // tuple, value being an int, a float, an int64_t or a std::string_view
+    // into data
+    template <typename Visitor>
+    static void parseSerialized(const char* data, size_t length, Visitor&& visit) {
+        const char* end = data + length;
+        auto token = [&data, end]() {
+            while (data < end && *data == ' ') ++data;
+            const char* start = data;
+            while (data < end && *data != ' ') ++data;
+            return std::string_view(start, data - start);
+        };
+        auto number = [&token](auto& value) {
+            auto text = token();
+            std::from_chars(text.data(), text.data() + text.size(), value);
+        };
+
+        size_t fieldCount = 0; number(fieldCount);
+        for (size_t i = 0; i < fieldCount; ++i) {
+            int type = 0; number(type);
+            size_t field_length = 0; number(field_length);
+            if (type == STRING) {
+                visit(i, token());
+            } else if (type == INT) {
+                int value = 0; number(value);
+                visit(i, value);
+            } else if (type == BIGINT) {
+                int64_t value = 0; number(value);
+                visit(i, value);
+            } else if (type == FLOAT) {
+                float value = 0; number(value);
+                visit(i, value);
+            }
+        }
+    }
+
     // Clone method
     std::unique_ptr<Tuple> clone() const {
         auto clonedTuple = std::make_unique<Tuple>();
@@ -201,10 +399,396 @@ public:
     }
 };
 
+// Number of tuples operators exchange per nextBatch() call
+static constexpr size_t BATCH_SIZE = 1024;
+
+// The values of one attribute for the tuples of a Batch. The type is set
+// by the first value appended after clear().
+class ColumnVector {
+public:
+    FieldType type = INT;
+    std::vector<int> ints;
+    std::vector<float> floats;
+    std::vector<std::string> strings;
+    std::vector<int64_t> bigints;
+
+    size_t size() const {
+        switch (type) {
+            case INT: return ints.size();
+            case FLOAT: return floats.size();
+            case STRING: return strings.size();
+            case BIGINT: return bigints.size();
+        }
+        return 0;
+    }
+
+    // Drop the values, keeping the allocated capacity
+    void clear() {
+        ints.clear();
+        floats.clear();
+        strings.clear();
+        bigints.clear();
+    }
+
+    void append(int value) {
+        setType(INT);
+        ints.push_back(value);
+    }
+    void append(float value) {
+        setType(FLOAT);
+        floats.push_back(value);
+    }
+    void append(std::string_view value) {
+        setType(STRING);
+        strings.emplace_back(value);
+    }
+    void append(int64_t value) {
+        setType(BIGINT);
+        bigints.push_back(value);
+    }
+
+    void append(const Field& field) {
+        switch (field.getType()) {
+            case INT: append(field.asInt()); break;
+            case FLOAT: append(field.asFloat()); break;
+            case STRING: append(std::string_view(field.data.get(), field.data_length - 1)); break;
+            case BIGINT: append(field.asBigInt()); break;
+        }
+    }
+
+    // Append count INT or FLOAT values stored back to back
+    void appendFixed(FieldType value_type, const char* values, size_t count) {
+        setType(value_type);
+        if (value_type == INT) {
+            size_t size = ints.size();
+            ints.resize(size + count);
+            std::memcpy(ints.data() + size, values, count * sizeof(int));
+        } else {
+            size_t size = floats.size();
+            floats.resize(size + count);
+            std::memcpy(floats.data() + size, values, count * sizeof(float));
+        }
+    }
+
+    // Append the given rows of another column of the same type
+    void appendRows(const ColumnVector& source, const std::vector<uint32_t>& rows) {
+        setType(source.type);
+        switch (type) {
+            case INT: gather(ints, source.ints, rows); break;
+            case FLOAT: gather(floats, source.floats, rows); break;
+            case STRING: gather(strings, source.strings, rows); break;
+            case BIGINT: gather(bigints, source.bigints, rows); break;
+        }
+    }
+
+    // Append one row of another column of the same type
+    void appendRow(const ColumnVector& source, size_t row) {
+        setType(source.type);
+        switch (type) {
+            case INT: ints.push_back(source.ints[row]); break;
+            case FLOAT: floats.push_back(source.floats[row]); break;
+            case STRING: strings.push_back(source.strings[row]); break;
+            case BIGINT: bigints.push_back(source.bigints[row]); break;
+        }
+    }
+
+    // <0, 0 or >0 as row a of this column sorts before, with or after
+    // row b of other, a column of the same type
+    int compare(size_t a, const ColumnVector& other, size_t b) const {
+        switch (type) {
+            case INT: return (ints[a] < other.ints[b]) ? -1 : (other.ints[b] < ints[a]);
+            case FLOAT: return (floats[a] < other.floats[b]) ? -1 : (other.floats[b] < floats[a]);
+            case STRING: return strings[a].compare(other.strings[b]);
+            case BIGINT: return (bigints[a] < other.bigints[b]) ? -1 : (other.bigints[b] < bigints[a]);
+        }
+        return 0;
+    }
+
+    // Binary encoding of a value: 4 bytes for INT and FLOAT, 8 for
+    // BIGINT, a 2 byte length and the bytes for STRING
+    size_t encodedSize(size_t row) const {
+        return (type == STRING) ? sizeof(uint16_t) + strings[row].size() : (type == BIGINT) ? 8 : 4;
+    }
+
+    char* encode(size_t row, char* out) const {
+        switch (type) {
+            case INT: std::memcpy(out, &ints[row], 4); return out + 4;
+            case FLOAT: std::memcpy(out, &floats[row], 4); return out + 4;
+            case STRING: {
+                uint16_t length = strings[row].size();
+                std::memcpy(out, &length, sizeof(length));
+                std::memcpy(out + sizeof(length), strings[row].data(), length);
+                return out + sizeof(length) + length;
+            }
+            case BIGINT: std::memcpy(out, &bigints[row], 8); return out + 8;
+        }
+        return out;
+    }
+
+    // Append the value encoded at in as value_type, returns the end of it
+    const char* decode(const char* in, FieldType value_type) {
+        switch (value_type) {
+            case INT: {
+                int value;
+                std::memcpy(&value, in, 4);
+                append(value);
+                return in + 4;
+            }
+            case FLOAT: {
+                float value;
+                std::memcpy(&value, in, 4);
+                append(value);
+                return in + 4;
+            }
+            case STRING: {
+                uint16_t length;
+                std::memcpy(&length, in, sizeof(length));
+                append(std::string_view(in + sizeof(length), length));
+                return in + sizeof(length) + length;
+            }
+            case BIGINT: {
+                int64_t value;
+                std::memcpy(&value, in, 8);
+                append(value);
+                return in + 8;
+            }
+        }
+        return in;
+    }
+
+    Field getField(size_t row) const {
+        switch (type) {
+            case INT: return Field(ints[row]);
+            case FLOAT: return Field(floats[row]);
+            case STRING: return Field(strings[row]);
+            case BIGINT: return Field(bigints[row]);
+        }
+        throw std::runtime_error("Unsupported field type in column.");
+    }
+
+    // Overwrite field with the value of row
+    void assignTo(size_t row, Field& field) const {
+        switch (type) {
+            case INT: field.assign(ints[row]); break;
+            case FLOAT: field.assign(floats[row]); break;
+            case STRING: field.assign(std::string_view(strings[row])); break;
+            case BIGINT: field.assign(bigints[row]); break;
+        }
+    }
+
+    // The typed value array, T being int, float, int64_t or std::string
+    template <typename T>
+    const std::vector<T>& values() const {
+        if constexpr (std::is_same_v<T, int>) {
+            return ints;
+        } else if constexpr (std::is_same_v<T, float>) {
+            return floats;
+        } else if constexpr (std::is_same_v<T, int64_t>) {
+            return bigints;
+        } else {
+            return strings;
+        }
+    }
+
+private:
+    void setType(FieldType value_type) {
+        if (size() == 0) {
+            type = value_type;
+        } else if (type != value_type) {
+            throw std::runtime_error("Mixed field types in column.");
+        }
+    }
+
+    template <typename T>
+    static void gather(std::vector<T>& target, const std::vector<T>& source, const std::vector<uint32_t>& rows) {
+        // Grow geometrically, an exact reserve per call is quadratic for
+        // columns that collect many batches
+        if (target.capacity() < target.size() + rows.size()) {
+            target.reserve(std::max(target.size() + rows.size(), 2 * target.capacity()));
+        }
+        for (uint32_t row : rows) {
+            target.push_back(source[row]);
+        }
+    }
+};
+
+// Up to BATCH_SIZE tuples stored column-wise, the unit of nextBatch()
+class Batch {
+public:
+    std::vector<ColumnVector> columns;
+
+    size_t size() const {
+        return num_rows;
+    }
+
+    void clear() {
+        for (auto& column : columns) {
+            column.clear();
+        }
+        num_rows = 0;
+    }
+
+    void appendTuple(const std::vector<std::unique_ptr<Field>>& fields) {
+        if (num_rows == 0) {
+            columns.resize(fields.size());
+        }
+        for (size_t i = 0; i < fields.size(); ++i) {
+            column(i).append(*fields[i]);
+        }
+        num_rows++;
+    }
+
+    // Append a tuple in the serialized page format without creating Fields
+    void appendSerialized(const char* data, size_t length) {
+        size_t field_count = 0;
+        Tuple::parseSerialized(data, length, [this, &field_count](size_t index, auto value) {
+            column(index).append(value);
+            field_count++;
+        });
+        if (num_rows == 0) {
+            columns.resize(field_count);
+        }
+        num_rows++;
+    }
+
+    // appendSerialized() keeping attribute i as column output[i], or
+    // dropping it if output[i] is -1 or i is past the end of output
+    void appendSerialized(const char* data, size_t length, const std::vector<int>& output) {
+        if (num_rows == 0) {
+            columns.resize(*std::max_element(output.begin(), output.end()) + 1);
+        }
+        Tuple::parseSerialized(data, length, [this, &output](size_t index, auto value) {
+            if (index < output.size() && output[index] >= 0) {
+                column(output[index]).append(value);
+            }
+        });
+        num_rows++;
+    }
+
+    // Append count rows a column at a time: fill(i, column) appends the
+    // count values of column i for i < width
+    template <typename Fill>
+    void appendColumns(size_t width, size_t count, Fill fill) {
+        if (num_rows == 0) {
+            columns.resize(width);
+        }
+        for (size_t i = 0; i < width; ++i) {
+            fill(i, column(i));
+        }
+        num_rows += count;
+    }
+
+    // Append the given rows of source, which has the same layout
+    void appendRows(const Batch& source, const std::vector<uint32_t>& rows) {
+        if (num_rows == 0) {
+            columns.resize(source.columns.size());
+        }
+        for (size_t i = 0; i < source.columns.size(); ++i) {
+            column(i).appendRows(source.columns[i], rows);
+        }
+        num_rows += rows.size();
+    }
+
+    // Append one row of source, which has the same layout
+    void appendRow(const Batch& source, size_t row) {
+        if (num_rows == 0) {
+            columns.resize(source.columns.size());
+        }
+        for (size_t i = 0; i < source.columns.size(); ++i) {
+            column(i).appendRow(source.columns[i], row);
+        }
+        num_rows++;
+    }
+
+    // Append a row encoded attribute by attribute (ColumnVector::encode)
+    // with the given types, returns the end of it
+    const char* appendEncoded(const char* data, const std::vector<FieldType>& types) {
+        if (num_rows == 0) {
+            columns.resize(types.size());
+        }
+        for (size_t i = 0; i < types.size(); ++i) {
+            data = column(i).decode(data, types[i]);
+        }
+        num_rows++;
+        return data;
+    }
+
+    // Append row left_rows[i] of left followed by row right_rows[i] of
+    // right as one tuple, for every i
+    void appendRowPairs(const Batch& left, const std::vector<uint32_t>& left_rows,
+                        const Batch& right, const std::vector<uint32_t>& right_rows) {
+        size_t left_width = left.columns.size();
+        if (num_rows == 0) {
+            columns.resize(left_width + right.columns.size());
+        }
+        for (size_t i = 0; i < left_width; ++i) {
+            column(i).appendRows(left.columns[i], left_rows);
+        }
+        for (size_t i = 0; i < right.columns.size(); ++i) {
+            column(left_width + i).appendRows(right.columns[i], right_rows);
+        }
+        num_rows += left_rows.size();
+    }
+
+    // The fields of one row, for consumers of the tuple interface
+    std::vector<std::unique_ptr<Field>> getTuple(size_t row) const {
+        std::vector<std::unique_ptr<Field>> fields;
+        fields.reserve(columns.size());
+        for (const auto& column : columns) {
+            fields.push_back(std::make_unique<Field>(column.getField(row)));
+        }
+        return fields;
+    }
+
+    // getTuple() into existing Fields, allocating only for new ones
+    void readTuple(size_t row, std::vector<std::unique_ptr<Field>>& fields) const {
+        for (size_t i = 0; i < columns.size(); ++i) {
+            columns[i].assignTo(row, Tuple::reuseField(fields, i));
+        }
+        fields.resize(columns.size());
+    }
+
+    void printRow(size_t row) const {
+        for (const auto& column : columns) {
+            column.getField(row).print();
+            std::cout << " ";
+        }
+        std::cout << std::endl;
+    }
+
+private:
+    size_t num_rows = 0;
+
+    ColumnVector& column(size_t index) {
+        if (index >= columns.size()) {
+            columns.resize(index + 1);
+        }
+        return columns[index];
+    }
+};
+
 static constexpr size_t PAGE_SIZE = 4096;  // Fixed page size
 static constexpr size_t MAX_SLOTS = 512;   // Fixed number of slots
 uint16_t INVALID_VALUE = std::numeric_limits<uint16_t>::max(); // Sentinel value
 
+// The last 8 bytes of every page hold the LSN of the latest log record
+// applied to it. Pages written before the WAL existed read back as LSN 0.
+using LSN = uint64_t;
+static constexpr size_t PAGE_LSN_OFFSET = PAGE_SIZE - sizeof(LSN);
+
+// 32-bit page ids so a relation can grow past 256 MB
+using PageID = uint32_t;
+constexpr PageID INVALID_PAGE_ID = std::numeric_limits<PageID>::max();
+
+// Location of a tuple: page id in the high bits, slot in the low 16 bits
+using TupleID = uint64_t;
+
+inline TupleID makeTupleID(PageID page_id, size_t slot) {
+    return (static_cast<TupleID>(page_id) << 16) | slot;
+}
+inline PageID tupleIDPage(TupleID tuple_id) { return tuple_id >> 16; }
+inline size_t tupleIDSlot(TupleID tuple_id) { return tuple_id & 0xFFFF; }
+
 struct Slot {
     bool empty = true;                 // Is the slot empty?    
     uint16_t offset = INVALID_VALUE;    // Offset of the slot within the page
@@ -227,84 +811,164 @@ public:
         }
     }
 
-    // Add a tuple, returns true if it fits, false otherwise.
-    bool addTuple(std::unique_ptr<Tuple> tuple) {
+    // Add a tuple, returns the slot it was stored in if it fits. The
+    // first deleted tuple's slot with room for it is reused, otherwise an
+    // unused slot gets the space behind the last tuple.
+    std::optional<size_t> addTuple(std::unique_ptr<Tuple> tuple) {
 
         // Serialize the tuple into a char array
         auto serializedTuple = tuple->serialize();
         size_t tuple_size = serializedTuple.size();
 
-        //std::cout << "Tuple size: " << tuple_size << " bytes\n";
-        assert(tuple_size == 38);
-
-        // Check for first slot with enough space
+        Slot* slot_array = reinterpret_cast<Slot*>(page_data.get());
         size_t slot_itr = 0;
-        Slot* slot_array = reinterpret_cast<Slot*>(page_data.get());        
         for (; slot_itr < MAX_SLOTS; slot_itr++) {
-            if (slot_array[slot_itr].empty == true and 
-                slot_array[slot_itr].length >= tuple_size) {
+            const Slot& slot = slot_array[slot_itr];
+            if (slot.empty && slot.offset != INVALID_VALUE && slot.length >= tuple_size) {
                 break;
             }
         }
-        if (slot_itr == MAX_SLOTS){
-            //std::cout << "Page does not contain an empty slot with sufficient space to store the tuple.";
-            return false;
+        if (slot_itr == MAX_SLOTS) {
+            size_t end = metadata_size;
+            for (size_t other = 0; other < MAX_SLOTS; other++) {
+                const Slot& slot = slot_array[other];
+                if (slot.offset != INVALID_VALUE) {
+                    end = std::max<size_t>(end, slot.offset + slot.length);
+                } else if (slot_itr == MAX_SLOTS) {
+                    slot_itr = other;
+                }
+            }
+            if (slot_itr == MAX_SLOTS || end + tuple_size >= PAGE_LSN_OFFSET) {
+                return std::nullopt;
+            }
+            slot_array[slot_itr].offset = end;
+            slot_array[slot_itr].length = tuple_size;
         }
 
-        // Identify the offset where the tuple will be placed in the page
-        // Update slot meta-data if needed
+        // A reused slot keeps its length, the tuple's field count tells
+        // readers where it ends
         slot_array[slot_itr].empty = false;
-        size_t offset = INVALID_VALUE;
-        if (slot_array[slot_itr].offset == INVALID_VALUE){
-            if(slot_itr != 0){
-                auto prev_slot_offset = slot_array[slot_itr - 1].offset;
-                auto prev_slot_length = slot_array[slot_itr - 1].length;
-                offset = prev_slot_offset + prev_slot_length;
+        size_t offset = slot_array[slot_itr].offset;
+        assert(offset >= metadata_size);
+        assert(offset + tuple_size < PAGE_LSN_OFFSET);
+
+        // Copy serialized data into the page
+        std::memcpy(page_data.get() + offset, 
+                    serializedTuple.c_str(), 
+                    tuple_size);
+
+        return slot_itr;
+    }
+
+    // Size of the largest tuple addTuple() can store
+    size_t getFreeSpace() const {
+        const Slot* slot_array = reinterpret_cast<const Slot*>(page_data.get());
+        size_t reusable = 0;
+        size_t end = metadata_size;
+        bool has_unused_slot = false;
+        for (size_t slot_itr = 0; slot_itr < MAX_SLOTS; slot_itr++) {
+            const Slot& slot = slot_array[slot_itr];
+            if (slot.offset == INVALID_VALUE) {
+                has_unused_slot = true;
+                continue;
             }
-            else{
-                offset = metadata_size;
+            end = std::max<size_t>(end, slot.offset + slot.length);
+            if (slot.empty) {
+                reusable = std::max<size_t>(reusable, slot.length);
             }
+        }
+        size_t tail = (has_unused_slot && end + 1 < PAGE_LSN_OFFSET) ? PAGE_LSN_OFFSET - end - 1 : 0;
+        return std::max(reusable, tail);
+    }
 
-            slot_array[slot_itr].offset = offset;
+    // Bytes of deleted tuples that compact() would reclaim, not counting
+    // the slack in reused slots
+    size_t getDeadSpace() const {
+        const Slot* slot_array = reinterpret_cast<const Slot*>(page_data.get());
+        size_t dead = 0;
+        for (size_t slot_itr = 0; slot_itr < MAX_SLOTS; slot_itr++) {
+            const Slot& slot = slot_array[slot_itr];
+            if (slot.empty && slot.offset != INVALID_VALUE) {
+                dead += slot.length;
+            }
         }
-        else{
-            offset = slot_array[slot_itr].offset;
+        return dead;
+    }
+
+    // Rewrite the live tuples back to back behind the slot array, in slot
+    // order, reserialized without the slack left in reused slots. Slots of
+    // deleted tuples become unused. Slot numbers, and so tuple ids, stay
+    // the same. Returns the number of bytes reclaimed.
+    size_t compact() {
+        Slot* slot_array = reinterpret_cast<Slot*>(page_data.get());
+        std::vector<std::string> tuples(MAX_SLOTS);
+        size_t end = metadata_size;
+        for (size_t slot_itr = 0; slot_itr < MAX_SLOTS; slot_itr++) {
+            const Slot& slot = slot_array[slot_itr];
+            if (slot.offset == INVALID_VALUE) {
+                continue;
+            }
+            end = std::max<size_t>(end, slot.offset + slot.length);
+            if (!slot.empty) {
+                tuples[slot_itr] = Tuple::deserialize(page_data.get() + slot.offset, slot.length)->serialize();
+            }
         }
 
-        if(offset + tuple_size >= PAGE_SIZE){
-            slot_array[slot_itr].empty = true;
-            slot_array[slot_itr].offset = INVALID_VALUE;
-            return false;
+        size_t offset = metadata_size;
+        for (size_t slot_itr = 0; slot_itr < MAX_SLOTS; slot_itr++) {
+            Slot& slot = slot_array[slot_itr];
+            if (!slot.empty) {
+                slot.offset = offset;
+                slot.length = tuples[slot_itr].size();
+                std::memcpy(page_data.get() + offset, tuples[slot_itr].data(), slot.length);
+                offset += slot.length;
+            } else {
+                slot.offset = INVALID_VALUE;
+                slot.length = INVALID_VALUE;
+            }
         }
+        return end - offset;
+    }
 
-        assert(offset != INVALID_VALUE);
-        assert(offset >= metadata_size);
-        assert(offset + tuple_size < PAGE_SIZE);
+    // Redo an insert exactly as it was logged: same slot, offset and bytes.
+    void restoreTuple(size_t slot_itr, uint16_t offset, const char* data, uint16_t length) {
+        assert(slot_itr < MAX_SLOTS);
+        assert(offset >= metadata_size && offset + length < PAGE_LSN_OFFSET);
+        Slot* slot_array = reinterpret_cast<Slot*>(page_data.get());
+        slot_array[slot_itr].empty = false;
+        slot_array[slot_itr].offset = offset;
+        slot_array[slot_itr].length = length;
+        std::memcpy(page_data.get() + offset, data, length);
+    }
 
-        if (slot_array[slot_itr].length == INVALID_VALUE){
-            slot_array[slot_itr].length = tuple_size;
-        }
+    const Slot& getSlot(size_t slot_itr) const {
+        return reinterpret_cast<const Slot*>(page_data.get())[slot_itr];
+    }
 
-        // Copy serialized data into the page
-        std::memcpy(page_data.get() + offset, 
-                    serializedTuple.c_str(), 
-                    tuple_size);
+    LSN getPageLSN() const {
+        LSN lsn;
+        std::memcpy(&lsn, page_data.get() + PAGE_LSN_OFFSET, sizeof(LSN));
+        return lsn;
+    }
 
-        return true;
+    void setPageLSN(LSN lsn) {
+        std::memcpy(page_data.get() + PAGE_LSN_OFFSET, &lsn, sizeof(LSN));
     }
 
-    void deleteTuple(size_t index) {
+    // Returns true if the slot held a tuple
+    bool deleteTuple(size_t index) {
         Slot* slot_array = reinterpret_cast<Slot*>(page_data.get());
         size_t slot_itr = 0;
         for (; slot_itr < MAX_SLOTS; slot_itr++) {
             if(slot_itr == index and
                slot_array[slot_itr].empty == false){
                 slot_array[slot_itr].empty = true;
-                break;
+                return true;
                }
         }
 
         //std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        return false;
     }
 
     void print() const{
@@ -326,84 +990,691 @@ public:
 
 const std::string database_filename = "buzzdb.dat";
 
-class StorageManager {
-public:    
-    std::fstream fileStream;
-    size_t num_pages = 0;
-
-public:
-    StorageManager(){
-        fileStream.open(database_filename, std::ios::in | std::ios::out);
-        if (!fileStream) {
-            // If file does not exist, create it
-            fileStream.clear(); // Reset the state
-            fileStream.open(database_filename, std::ios::out);
+// Positional read/write helpers that retry until the whole buffer is done
+bool readFully(int fd, char* buffer, size_t length, off_t offset) {
+    while (length > 0) {
+        ssize_t bytes = ::pread(fd, buffer, length, offset);
+        if (bytes <= 0) {
+            return false;
         }
-        fileStream.close(); 
-        fileStream.open(database_filename, std::ios::in | std::ios::out); 
-
-        fileStream.seekg(0, std::ios::end);
-        num_pages = fileStream.tellg() / PAGE_SIZE;
+        buffer += bytes;
+        length -= bytes;
+        offset += bytes;
+    }
+    return true;
+}
 
-        std::cout << "Storage Manager :: Num pages: " << num_pages << "\n";        
-        if(num_pages == 0){
-            extend();
+bool writeFully(int fd, const char* buffer, size_t length, off_t offset) {
+    while (length > 0) {
+        ssize_t bytes = ::pwrite(fd, buffer, length, offset);
+        if (bytes <= 0) {
+            return false;
         }
-
+        buffer += bytes;
+        length -= bytes;
+        offset += bytes;
     }
+    return true;
+}
 
-    ~StorageManager() {
-        if (fileStream.is_open()) {
-            fileStream.close();
+// Column names and types of a relation, written as "name:TYPE,..."
+struct Schema {
+    struct Column {
+        std::string name;
+        FieldType type;
+    };
+    std::vector<Column> columns;
+
+    static const char* typeName(FieldType type) {
+        switch (type) {
+            case INT: return "INT";
+            case FLOAT: return "FLOAT";
+            default: return "STRING";
         }
     }
 
-    // Read a page from disk
-    std::unique_ptr<SlottedPage> load(uint16_t page_id) {
-        fileStream.seekg(page_id * PAGE_SIZE, std::ios::beg);
-        auto page = std::make_unique<SlottedPage>();
-        // Read the content of the file into the page
-        if(fileStream.read(page->page_data.get(), PAGE_SIZE)){
-            //std::cout << "Page read successfully from file." << std::endl;
+    static Schema parse(const std::string& text) {
+        Schema schema;
+        std::stringstream stream(text);
+        std::string column;
+        while (std::getline(stream, column, ',')) {
+            size_t colon = column.find(':');
+            std::string type = (colon == std::string::npos) ? "" : column.substr(colon + 1);
+            if (colon == 0 || (type != "INT" && type != "FLOAT" && type != "STRING")) {
+                throw std::runtime_error("Invalid column " + column + ", expected name:INT|FLOAT|STRING.");
+            }
+            schema.columns.push_back({column.substr(0, colon),
+                                      (type == "INT") ? INT : (type == "FLOAT") ? FLOAT : STRING});
         }
-        else{
-            std::cerr << "Error: Unable to read data from the file. \n";
-            exit(-1);
+        if (schema.columns.empty()) {
+            throw std::runtime_error("A schema needs at least one column.");
         }
-        return page;
+        return schema;
     }
 
-    // Write a page to disk
-    void flush(uint16_t page_id, const std::unique_ptr<SlottedPage>& page) {
-        size_t page_offset = page_id * PAGE_SIZE;        
-
-        // Move the write pointer
-        fileStream.seekp(page_offset, std::ios::beg);
-        fileStream.write(page->page_data.get(), PAGE_SIZE);        
-        fileStream.flush();
+    std::string toString() const {
+        std::string text;
+        for (const auto& column : columns) {
+            text += (text.empty() ? "" : ",") + column.name + ":" + typeName(column.type);
+        }
+        return text;
     }
 
-    // Extend database file by one page
-    void extend() {
-        std::cout << "Extending database file \n";
+    // Index of the column called name, if any
+    std::optional<size_t> find(const std::string& name) const {
+        for (size_t i = 0; i < columns.size(); ++i) {
+            if (columns[i].name == name) {
+                return i;
+            }
+        }
+        return std::nullopt;
+    }
 
-        // Create a slotted page
-        auto empty_slotted_page = std::make_unique<SlottedPage>();
+    bool matches(const std::vector<std::unique_ptr<Field>>& fields) const {
+        if (fields.size() != columns.size()) {
+            return false;
+        }
+        for (size_t i = 0; i < fields.size(); ++i) {
+            if (fields[i]->getType() != columns[i].type) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // A tuple of this schema with 0 and empty values
+    std::unique_ptr<Tuple> makeTuple() const {
+        auto tuple = std::make_unique<Tuple>();
+        for (const auto& column : columns) {
+            switch (column.type) {
+                case INT: tuple->addField(std::make_unique<Field>(0)); break;
+                case FLOAT: tuple->addField(std::make_unique<Field>(0.0f)); break;
+                case STRING: tuple->addField(std::make_unique<Field>(std::string())); break;
+                case BIGINT: tuple->addField(std::make_unique<Field>(int64_t{0})); break;
+            }
+        }
+        return tuple;
+    }
+};
+
+// PAX page layout of a schema: the values of each attribute sit
+// together in a minipage, INT and FLOAT as 4 byte arrays and STRING as
+// (offset, length) pairs into a heap that grows down from the page LSN.
+// The header holds a magic number, the row count and the heap start.
+// Pages without the magic number, like fresh SlottedPages, are empty.
+// Rows are only appended.
+class PaxLayout {
+private:
+    struct Header {
+        uint32_t magic;
+        uint16_t num_rows;
+        uint16_t heap_start;
+    };
+    static constexpr uint32_t MAGIC = 0x31584150;  // "PAX1"
+    // Heap bytes planned per STRING value when sizing the minipages
+    static constexpr size_t STRING_RESERVE = 16;
+    static constexpr size_t VALUE_SIZE = 4;        // Also of (offset, length)
+
+    std::vector<FieldType> types;
+    std::vector<size_t> minipages;      // Offset of each attribute's minipage
+    size_t capacity = 0;                // Rows per page
+    size_t heap_limit = 0;              // End of the minipages
+
+    static Header& header(char* page) {
+        return *reinterpret_cast<Header*>(page);
+    }
+    static const Header& header(const char* page) {
+        return *reinterpret_cast<const Header*>(page);
+    }
+
+    std::string_view stringAt(const char* page, size_t attr, size_t row) const {
+        uint16_t entry[2];
+        std::memcpy(entry, page + minipages[attr] + row * VALUE_SIZE, VALUE_SIZE);
+        return std::string_view(page + entry[0], entry[1]);
+    }
+
+public:
+    explicit PaxLayout(const Schema& schema) {
+        size_t row_width = 0;
+        for (const auto& column : schema.columns) {
+            types.push_back(column.type);
+            row_width += VALUE_SIZE + ((column.type == STRING) ? STRING_RESERVE : 0);
+        }
+        capacity = (PAGE_LSN_OFFSET - sizeof(Header)) / row_width;
+        heap_limit = sizeof(Header);
+        for (size_t attr = 0; attr < types.size(); ++attr) {
+            minipages.push_back(heap_limit);
+            heap_limit += capacity * VALUE_SIZE;
+        }
+    }
+
+    size_t getCapacity() const {
+        return capacity;
+    }
+
+    size_t getNumColumns() const {
+        return types.size();
+    }
+
+    FieldType getType(size_t attr) const {
+        return types[attr];
+    }
+
+    size_t numRows(const char* page) const {
+        return (header(page).magic == MAGIC) ? header(page).num_rows : 0;
+    }
+
+    // The minipage of an INT or FLOAT attribute: one 4 byte value per row
+    const char* fixedValues(const char* page, size_t attr) const {
+        assert(types[attr] != STRING);
+        return page + minipages[attr];
+    }
+
+    // Append a row of the schema, returns its row number if it fits
+    std::optional<size_t> append(char* page, const std::vector<std::unique_ptr<Field>>& fields) const {
+        if (header(page).magic != MAGIC) {
+            header(page) = {MAGIC, 0, static_cast<uint16_t>(PAGE_LSN_OFFSET)};
+        }
+        Header& head = header(page);
+        size_t string_bytes = 0;
+        for (size_t attr = 0; attr < types.size(); ++attr) {
+            if (types[attr] == STRING) {
+                string_bytes += fields[attr]->data_length - 1;
+            }
+        }
+        if (head.num_rows == capacity || head.heap_start - heap_limit < string_bytes) {
+            return std::nullopt;
+        }
+        size_t row = head.num_rows;
+        for (size_t attr = 0; attr < types.size(); ++attr) {
+            char* value = page + minipages[attr] + row * VALUE_SIZE;
+            if (types[attr] != STRING) {
+                std::memcpy(value, fields[attr]->data.get(), VALUE_SIZE);
+                continue;
+            }
+            uint16_t length = fields[attr]->data_length - 1;
+            head.heap_start -= length;
+            std::memcpy(page + head.heap_start, fields[attr]->data.get(), length);
+            uint16_t entry[2] = {head.heap_start, length};
+            std::memcpy(value, entry, VALUE_SIZE);
+        }
+        head.num_rows++;
+        return row;
+    }
+
+    // Redo of the logged append of row, see serializeRow()
+    void restoreRow(char* page, size_t row, const char* data, size_t length) const {
+        if (row < numRows(page)) {
+            return;
+        }
+        assert(row == numRows(page));
+        auto tuple = Tuple::deserialize(data, length);
+        auto restored = append(page, tuple->fields);
+        assert(restored);
+    }
+
+    std::unique_ptr<Tuple> readTuple(const char* page, size_t row) const {
+        auto tuple = std::make_unique<Tuple>();
+        for (size_t attr = 0; attr < types.size(); ++attr) {
+            const char* value = page + minipages[attr] + row * VALUE_SIZE;
+            if (types[attr] == INT) {
+                int number;
+                std::memcpy(&number, value, VALUE_SIZE);
+                tuple->addField(std::make_unique<Field>(number));
+            } else if (types[attr] == FLOAT) {
+                float number;
+                std::memcpy(&number, value, VALUE_SIZE);
+                tuple->addField(std::make_unique<Field>(number));
+            } else {
+                tuple->addField(std::make_unique<Field>(std::string(stringAt(page, attr, row))));
+            }
+        }
+        return tuple;
+    }
+
+    // The row in the format of a slotted page, which the log records
+    std::string serializeRow(const char* page, size_t row) const {
+        return readTuple(page, row)->serialize();
+    }
+
+    // Append rows [begin, end) of attribute attr to column
+    void readColumn(const char* page, size_t attr, size_t begin, size_t end, ColumnVector& column) const {
+        if (types[attr] != STRING) {
+            column.appendFixed(types[attr], page + minipages[attr] + begin * VALUE_SIZE, end - begin);
+            return;
+        }
+        for (size_t row = begin; row < end; ++row) {
+            column.append(stringAt(page, attr, row));
+        }
+    }
+};
+
+// A built-in LZ77 codec for pages, in the spirit of LZ4. A compressed
+// page is a list of sequences: a token byte (literal count and match
+// length - 4 in 4 bits each, 15 meaning more length bytes of up to 255
+// follow), the literals, and the 2 byte offset back to the match. The
+// last sequence has literals only.
+class PageCodec {
+private:
+    static constexpr size_t MIN_MATCH = 4;
+    static constexpr int HASH_BITS = 12;
+
+    static void writeLength(std::string& output, size_t length) {
+        for (; length >= 255; length -= 255) {
+            output.push_back(static_cast<char>(255));
+        }
+        output.push_back(static_cast<char>(length));
+    }
+
+public:
+    static void compress(const char* input, size_t size, std::string& output) {
+        output.clear();
+        const uint8_t* in = reinterpret_cast<const uint8_t*>(input);
+        int32_t positions[1 << HASH_BITS];
+        std::fill(std::begin(positions), std::end(positions), -1);
+        auto hash = [in](size_t pos) {
+            uint32_t value;
+            std::memcpy(&value, in + pos, sizeof(value));
+            return (value * 2654435761u) >> (32 - HASH_BITS);
+        };
+        size_t anchor = 0;  // First literal not written yet
+        auto emit = [&](size_t literals_end, size_t match_length, size_t offset) {
+            size_t literals = literals_end - anchor;
+            size_t extra = match_length ? match_length - MIN_MATCH : 0;
+            output.push_back(static_cast<char>((std::min<size_t>(literals, 15) << 4) | std::min<size_t>(extra, 15)));
+            if (literals >= 15) {
+                writeLength(output, literals - 15);
+            }
+            output.append(input + anchor, literals);
+            if (match_length) {
+                output.push_back(static_cast<char>(offset & 0xFF));
+                output.push_back(static_cast<char>(offset >> 8));
+                if (extra >= 15) {
+                    writeLength(output, extra - 15);
+                }
+            }
+        };
+
+        for (size_t pos = 0; pos + MIN_MATCH <= size;) {
+            uint32_t slot = hash(pos);
+            int32_t candidate = positions[slot];
+            positions[slot] = static_cast<int32_t>(pos);
+            if (candidate < 0 || pos - candidate > 0xFFFF || std::memcmp(in + candidate, in + pos, MIN_MATCH) != 0) {
+                pos++;
+                continue;
+            }
+            size_t length = MIN_MATCH;
+            while (pos + length < size && in[candidate + length] == in[pos + length]) {
+                length++;
+            }
+            emit(pos, length, pos - candidate);
+            pos += length;
+            anchor = pos;
+        }
+        emit(size, 0, 0);
+    }
+
+    // False unless input is a compressed block of exactly size bytes
+    static bool decompress(const char* input, size_t input_size, char* output, size_t size) {
+        const uint8_t* in = reinterpret_cast<const uint8_t*>(input);
+        size_t ip = 0;
+        size_t op = 0;
+        auto readLength = [&](size_t& length) {
+            uint8_t byte;
+            do {
+                if (ip == input_size) {
+                    return false;
+                }
+                byte = in[ip++];
+                length += byte;
+            } while (byte == 255);
+            return true;
+        };
+        while (ip < input_size) {
+            uint8_t token = in[ip++];
+            size_t literals = token >> 4;
+            if ((literals == 15 && !readLength(literals)) || literals > input_size - ip || literals > size - op) {
+                return false;
+            }
+            std::memcpy(output + op, input + ip, literals);
+            ip += literals;
+            op += literals;
+            if (ip == input_size) {
+                break;
+            }
+            if (input_size - ip < 2) {
+                return false;
+            }
+            size_t offset = in[ip] | (in[ip + 1] << 8);
+            ip += 2;
+            size_t length = token & 15;
+            if ((length == 15 && !readLength(length)) || offset == 0 || offset > op ||
+                length + MIN_MATCH > size - op) {
+                return false;
+            }
+            length += MIN_MATCH;
+            if (offset >= length) {
+                std::memcpy(output + op, output + op - offset, length);
+            } else {
+                for (size_t i = 0; i < length; ++i) {  // Overlapping run
+                    output[op + i] = output[op - offset + i];
+                }
+            }
+            op += length;
+        }
+        return op == size;
+    }
+};
+
+// Granularity of the space a compressed page takes in its file
+constexpr size_t EXTENT_ALIGNMENT = 256;
+
+class StorageManager {
+public:    
+    int fd = -1;
+    size_t num_pages = 0;
+
+private:
+    // Compressed files hold every page in an extent of its own: a 2 byte
+    // length and a PageCodec block, or the raw page (length PAGE_SIZE) if
+    // it does not shrink. A page is rewritten in place while it fits. The
+    // mapping table in filename.map locates the extents; it is rewritten
+    // by sync(). Extents a page moved out of are reused only after that,
+    // so the pages the last mapping table points to stay intact.
+    struct Extent {
+        uint64_t offset = 0;
+        uint32_t capacity = 0;
+        uint32_t unused = 0;
+    };
+    using ExtentLength = uint16_t;
+    static constexpr uint64_t MAP_MAGIC = 0x3150414d5a5a5542;  // "BUZZMAP1"
+
+    bool compressed = false;
+    std::string map_filename;
+    std::vector<Extent> extents;                        // By page id
+    uint64_t file_end = 0;
+    std::multimap<uint32_t, uint64_t> free_extents;     // Capacity -> offset
+    std::vector<Extent> released_extents;
+    std::string scratch;
+
+    Extent allocate(size_t length) {
+        uint32_t capacity = static_cast<uint32_t>((length + EXTENT_ALIGNMENT - 1) / EXTENT_ALIGNMENT * EXTENT_ALIGNMENT);
+        auto it = free_extents.lower_bound(capacity);
+        if (it != free_extents.end()) {
+            Extent extent{it->second, it->first};
+            free_extents.erase(it);
+            return extent;
+        }
+        Extent extent{file_end, capacity};
+        file_end += capacity;
+        return extent;
+    }
+
+    void readExtent(const Extent& extent, const char* data, char* page) {
+        ExtentLength length;
+        std::memcpy(&length, data, sizeof(length));
+        data += sizeof(length);
+        if (length == PAGE_SIZE && sizeof(length) + PAGE_SIZE <= extent.capacity) {
+            std::memcpy(page, data, PAGE_SIZE);
+        } else if (sizeof(length) + length > extent.capacity || !PageCodec::decompress(data, length, page, PAGE_SIZE)) {
+            std::cerr << "Error: Corrupt compressed page at offset " << extent.offset << "\n";
+            exit(-1);
+        }
+    }
+
+    // The extent of a page: length and PageCodec block, or raw page
+    void encodeExtent(const char* page, std::string& extent) {
+        PageCodec::compress(page, PAGE_SIZE, scratch);
+        ExtentLength length = static_cast<ExtentLength>(std::min(scratch.size(), PAGE_SIZE));
+        extent.assign(reinterpret_cast<const char*>(&length), sizeof(length));
+        extent.append((length == PAGE_SIZE) ? page : scratch.data(), length);
+    }
+
+    void writeCompressed(PageID page_id, const char* page) {
+        std::string data;
+        encodeExtent(page, data);
+        if (page_id >= extents.size()) {
+            extents.resize(page_id + 1);
+        }
+        Extent& extent = extents[page_id];
+        if (data.size() > extent.capacity) {
+            if (extent.capacity) {
+                released_extents.push_back(extent);
+            }
+            extent = allocate(data.size());
+        }
+        data.resize(extent.capacity);   // So whole extents can be read
+        if (!writeFully(fd, data.data(), data.size(), static_cast<off_t>(extent.offset))) {
+            std::cerr << "Error: Unable to write page " << page_id << "\n";
+            exit(-1);
+        }
+    }
+
+    void readMap() {
+        std::ifstream input(map_filename, std::ios::binary);
+        uint64_t header[3];
+        if (!input.read(reinterpret_cast<char*>(header), sizeof(header)) || header[0] != MAP_MAGIC) {
+            return; // New file
+        }
+        extents.resize(header[1]);
+        file_end = header[2];
+        if (!input.read(reinterpret_cast<char*>(extents.data()), extents.size() * sizeof(Extent))) {
+            std::cerr << "Error: Corrupt mapping table " << map_filename << "\n";
+            exit(-1);
+        }
+        // The gaps between the extents in use are free
+        std::vector<Extent> used = extents;
+        std::sort(used.begin(), used.end(), [](const Extent& a, const Extent& b) { return a.offset < b.offset; });
+        uint64_t end = 0;
+        for (const auto& extent : used) {
+            if (extent.offset > end) {
+                free_extents.emplace(static_cast<uint32_t>(extent.offset - end), end);
+            }
+            end = std::max(end, extent.offset + extent.capacity);
+        }
+    }
+
+    // Replace the mapping table atomically
+    void writeMap() {
+        std::string temp_filename = map_filename + ".tmp";
+        int map_fd = ::open(temp_filename.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        uint64_t header[3] = {MAP_MAGIC, extents.size(), file_end};
+        if (map_fd < 0 || !writeFully(map_fd, reinterpret_cast<const char*>(header), sizeof(header), 0) ||
+            !writeFully(map_fd, reinterpret_cast<const char*>(extents.data()), extents.size() * sizeof(Extent),
+                        sizeof(header)) ||
+            ::fsync(map_fd) != 0 || ::close(map_fd) != 0 ||
+            std::rename(temp_filename.c_str(), map_filename.c_str()) != 0) {
+            std::cerr << "Error: Unable to write " << map_filename << "\n";
+            exit(-1);
+        }
+        for (const auto& extent : released_extents) {
+            free_extents.emplace(extent.capacity, extent.offset);
+        }
+        released_extents.clear();
+    }
+
+public:
+    // A compressed file needs its mapping table, filename.map
+    StorageManager(const std::string& filename = database_filename, bool compressed = false)
+        : compressed(compressed), map_filename(filename + ".map") {
+        // Open the file, creating it if it does not exist
+        fd = ::open(filename.c_str(), O_RDWR | O_CREAT, 0644);
+        if (fd < 0) {
+            std::cerr << "Error: Unable to open " << filename << "\n";
+            exit(-1);
+        }
+
+        if (compressed) {
+            readMap();
+            num_pages = extents.size();
+        } else {
+            num_pages = ::lseek(fd, 0, SEEK_END) / PAGE_SIZE;
+        }
+
+        std::cout << "Storage Manager :: Num pages: " << num_pages << "\n";        
+        if(num_pages == 0){
+            extend();
+        }
+
+    }
+
+    ~StorageManager() {
+        if (compressed && fd >= 0) {
+            writeMap();
+        }
+        if (fd >= 0) {
+            ::close(fd);
+        }
+    }
+
+    // Read a page from disk
+    std::unique_ptr<SlottedPage> load(PageID page_id) {
+        auto page = std::make_unique<SlottedPage>();
+        if (compressed) {
+            readPages(page_id, 1, page->page_data.get());
+            return page;
+        }
+        // Read the content of the file into the page
+        if (!readFully(fd, page->page_data.get(), PAGE_SIZE, static_cast<off_t>(page_id) * PAGE_SIZE)) {
+            std::cerr << "Error: Unable to read data from the file. \n";
+            exit(-1);
+        }
+        return page;
+    }
+
+    // Write a page to disk. The write is not forced to stable storage;
+    // durability comes from the log, see LogManager.
+    void flush(PageID page_id, const std::unique_ptr<SlottedPage>& page) {
+        if (compressed) {
+            writeCompressed(page_id, page->page_data.get());
+            return;
+        }
+        if (!writeFully(fd, page->page_data.get(), PAGE_SIZE, static_cast<off_t>(page_id) * PAGE_SIZE)) {
+            std::cerr << "Error: Unable to write page " << page_id << "\n";
+            exit(-1);
+        }
+    }
+
+    // Extend database file by one page
+    void extend() {
+        //std::cout << "Extending database file \n";
 
-        // Move the write pointer
-        fileStream.seekp(0, std::ios::end);
+        // Create a slotted page
+        auto empty_slotted_page = std::make_unique<SlottedPage>();
 
         // Write the page to the file, extending it
-        fileStream.write(empty_slotted_page->page_data.get(), PAGE_SIZE);
-        fileStream.flush();
+        flush(num_pages, empty_slotted_page);
 
         // Update number of pages
         num_pages += 1;
     }
 
-};
+    // Append count pages from a contiguous buffer with one large write
+    PageID appendPages(const char* pages, size_t count) {
+        PageID first_page = num_pages;
+        if (compressed) {
+            // Packed back to back at the end of the file
+            std::string extents_data;
+            std::string data;
+            extents.resize(num_pages + count);
+            uint64_t offset = file_end;
+            for (size_t i = 0; i < count; ++i) {
+                encodeExtent(pages + i * PAGE_SIZE, data);
+                Extent& extent = extents[num_pages + i];
+                extent = allocate(data.size());
+                data.resize(extent.capacity);
+                if (extent.offset != offset + extents_data.size()) {
+                    // Went to a free extent instead
+                    if (!writeFully(fd, data.data(), data.size(), static_cast<off_t>(extent.offset))) {
+                        std::cerr << "Error: Unable to append pages\n";
+                        exit(-1);
+                    }
+                    continue;
+                }
+                extents_data += data;
+            }
+            if (!writeFully(fd, extents_data.data(), extents_data.size(), static_cast<off_t>(offset))) {
+                std::cerr << "Error: Unable to append pages\n";
+                exit(-1);
+            }
+            num_pages += count;
+            return first_page;
+        }
+        if (!writeFully(fd, pages, count * PAGE_SIZE, static_cast<off_t>(num_pages) * PAGE_SIZE)) {
+            std::cerr << "Error: Unable to append pages\n";
+            exit(-1);
+        }
+        num_pages += count;
+        return first_page;
+    }
+
+    // Read count consecutive pages into a contiguous buffer
+    void readPages(PageID first_page, size_t count, char* pages) {
+        if (compressed) {
+            // One read if the extents lie close together, as after a bulk
+            // load, one per page otherwise
+            uint64_t begin = std::numeric_limits<uint64_t>::max();
+            uint64_t end = 0;
+            uint64_t total = 0;
+            for (size_t i = 0; i < count; ++i) {
+                const Extent& extent = extents[first_page + i];
+                begin = std::min(begin, extent.offset);
+                end = std::max(end, extent.offset + extent.capacity);
+                total += extent.capacity;
+            }
+            if (end - begin <= 2 * total + PAGE_SIZE) {
+                scratch.resize(end - begin);
+                if (!readFully(fd, scratch.data(), end - begin, static_cast<off_t>(begin))) {
+                    std::cerr << "Error: Unable to read data from the file. \n";
+                    exit(-1);
+                }
+                for (size_t i = 0; i < count; ++i) {
+                    const Extent& extent = extents[first_page + i];
+                    readExtent(extent, scratch.data() + (extent.offset - begin), pages + i * PAGE_SIZE);
+                }
+                return;
+            }
+            std::vector<char> data;
+            for (size_t i = 0; i < count; ++i) {
+                const Extent& extent = extents[first_page + i];
+                data.resize(extent.capacity);
+                if (!readFully(fd, data.data(), extent.capacity, static_cast<off_t>(extent.offset))) {
+                    std::cerr << "Error: Unable to read data from the file. \n";
+                    exit(-1);
+                }
+                readExtent(extent, data.data(), pages + i * PAGE_SIZE);
+            }
+            return;
+        }
+        if (!readFully(fd, pages, count * PAGE_SIZE, static_cast<off_t>(first_page) * PAGE_SIZE)) {
+            std::cerr << "Error: Unable to read data from the file. \n";
+            exit(-1);
+        }
+    }
 
-using PageID = uint16_t;
+    // Force all written pages to stable storage
+    void sync() {
+        ::fsync(fd);
+        if (compressed) {
+            writeMap();
+        }
+    }
+
+    // Bytes the pages take on disk, with the mapping table
+    uint64_t getFileSize() const {
+        if (compressed) {
+            return file_end + 3 * sizeof(uint64_t) + extents.size() * sizeof(Extent);
+        }
+        return num_pages * PAGE_SIZE;
+    }
+
+    // Evict the file from the OS page cache, for cold reads
+    void dropCache() {
+        ::fsync(fd);
+        ::posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+    }
+
+};
 
 class Policy {
 public:
@@ -461,7 +1732,7 @@ public:
 
     PageID evict() override {
         // Evict the least recently used page
-        PageID evictedPageId = INVALID_VALUE;
+        PageID evictedPageId = INVALID_PAGE_ID;
         if(lruList.size() != 0){
             evictedPageId = lruList.back();
             map.erase(evictedPageId);
@@ -472,1212 +1743,10370 @@ public:
 
 };
 
-constexpr size_t MAX_PAGES_IN_MEMORY = 10;
+const std::string log_filename = "buzzdb.log";
+
+enum class LogRecordType : uint16_t { INSERT = 1, DELETE = 2, COMPACT = 3 };
+
+// Fixed-size part of a redo record. INSERT records are followed by the
+// serialized tuple bytes, DELETE and COMPACT (SlottedPage::compact())
+// records carry no payload.
+struct LogRecordHeader {
+    LSN lsn = 0;
+    uint32_t checksum = 0;  // FNV-1a over the header (with checksum 0) and payload
+    uint16_t type = 0;
+    uint16_t slot = 0;
+    uint32_t page_id = 0;
+    uint16_t offset = 0;
+    uint16_t length = 0;    // Payload length
+    uint32_t segment_id = 0;    // File of the page, see Catalog
+    uint32_t reserved = 0;      // No padding, the checksum covers every byte
+};
 
-class BufferManager {
+struct LogRecord {
+    LogRecordHeader header;
+    std::string payload;
+};
+
+// Write-ahead log with group commit. Records are appended to an in-memory
+// buffer; flush(lsn) makes everything up to lsn durable. Whichever caller
+// finds no flush in progress becomes the leader and writes out the whole
+// buffer with a single fsync, so concurrent committers share one fsync.
+class LogManager {
 private:
-    using PageMap = std::unordered_map<PageID, std::unique_ptr<SlottedPage>>;
+    // The log file starts with the LSN of its first record so LSNs keep
+    // increasing across truncations.
+    static constexpr size_t LOG_HEADER_SIZE = sizeof(LSN);
+
+    int fd = -1;
+    off_t file_size = 0;
+
+    std::mutex mutex;
+    std::condition_variable flushed_cv;
+    std::string log_buffer;     // Records appended but not yet written
+    LSN next_lsn = 1;
+    LSN buffered_lsn = 0;       // LSN of the last appended record
+    LSN flushed_lsn = 0;        // Every record up to here is durable
+    bool flush_in_progress = false;
+    size_t num_fsyncs = 0;
+
+    static uint32_t checksum(const LogRecordHeader& header, const char* payload) {
+        LogRecordHeader copy = header;
+        copy.checksum = 0;
+        uint32_t hash = 2166136261u;
+        auto mix = [&hash](const char* data, size_t length) {
+            for (size_t i = 0; i < length; ++i) {
+                hash ^= static_cast<uint8_t>(data[i]);
+                hash *= 16777619u;
+            }
+        };
+        mix(reinterpret_cast<const char*>(&copy), sizeof(copy));
+        mix(payload, header.length);
+        return hash;
+    }
 
-    StorageManager storage_manager;
-    PageMap pageMap;
-    std::unique_ptr<Policy> policy;
+    LSN append(LogRecordHeader header, const char* payload) {
+        std::lock_guard<std::mutex> lock(mutex);
+        header.lsn = next_lsn++;
+        header.checksum = checksum(header, payload);
+        log_buffer.append(reinterpret_cast<const char*>(&header), sizeof(header));
+        log_buffer.append(payload, header.length);
+        buffered_lsn = header.lsn;
+        return header.lsn;
+    }
 
 public:
-    BufferManager(): 
-    policy(std::make_unique<LruPolicy>(MAX_PAGES_IN_MEMORY)) {}
-
-    std::unique_ptr<SlottedPage>& getPage(int page_id) {
-        auto it = pageMap.find(page_id);
-        if (it != pageMap.end()) {
-            policy->touch(page_id);
-            return pageMap.find(page_id)->second;
+    LogManager(const std::string& filename = log_filename) {
+        fd = ::open(filename.c_str(), O_RDWR | O_CREAT, 0644);
+        if (fd < 0) {
+            std::cerr << "Error: Unable to open " << filename << "\n";
+            exit(-1);
         }
 
-        if (pageMap.size() >= MAX_PAGES_IN_MEMORY) {
-            auto evictedPageId = policy->evict();
-            if(evictedPageId != INVALID_VALUE){
-                std::cout << "Evicting page " << evictedPageId << "\n";
-                storage_manager.flush(evictedPageId, 
-                                      pageMap[evictedPageId]);
-            }
+        LSN base_lsn = 1;
+        if (!readFully(fd, reinterpret_cast<char*>(&base_lsn), LOG_HEADER_SIZE, 0)) {
+            base_lsn = 1;
+            writeFully(fd, reinterpret_cast<const char*>(&base_lsn), LOG_HEADER_SIZE, 0);
         }
+        next_lsn = base_lsn;
+        file_size = LOG_HEADER_SIZE;
 
-        auto page = storage_manager.load(page_id);
-        policy->touch(page_id);
-        std::cout << "Loading page: " << page_id << "\n";
-        pageMap[page_id] = std::move(page);
-        return pageMap[page_id];
+        // Find the end of the valid log and drop a torn tail, if any
+        for (const auto& record : readLog()) {
+            next_lsn = record.header.lsn + 1;
+            file_size += sizeof(LogRecordHeader) + record.header.length;
+        }
+        if (::ftruncate(fd, file_size) != 0) {
+            std::cerr << "Error: Unable to truncate log\n";
+        }
+        buffered_lsn = flushed_lsn = next_lsn - 1;
     }
 
-    void flushPage(int page_id) {
-        //std::cout << "Flush page " << page_id << "\n";
-        storage_manager.flush(page_id, pageMap[page_id]);
+    ~LogManager() {
+        if (fd >= 0) {
+            ::close(fd);
+        }
     }
 
-    void extend(){
-        storage_manager.extend();
+    LSN appendInsert(uint32_t segment_id, uint32_t page_id, size_t slot, uint16_t offset, const char* data,
+                     uint16_t length) {
+        LogRecordHeader header;
+        header.type = static_cast<uint16_t>(LogRecordType::INSERT);
+        header.segment_id = segment_id;
+        header.page_id = page_id;
+        header.slot = static_cast<uint16_t>(slot);
+        header.offset = offset;
+        header.length = length;
+        return append(header, data);
     }
-    
-    size_t getNumPages(){
-        return storage_manager.num_pages;
+
+    LSN appendDelete(uint32_t segment_id, uint32_t page_id, size_t slot) {
+        LogRecordHeader header;
+        header.type = static_cast<uint16_t>(LogRecordType::DELETE);
+        header.segment_id = segment_id;
+        header.page_id = page_id;
+        header.slot = static_cast<uint16_t>(slot);
+        return append(header, nullptr);
     }
 
-};
+    LSN appendCompact(uint32_t segment_id, uint32_t page_id) {
+        LogRecordHeader header;
+        header.type = static_cast<uint16_t>(LogRecordType::COMPACT);
+        header.segment_id = segment_id;
+        header.page_id = page_id;
+        return append(header, nullptr);
+    }
 
-class HashIndex {
-private:
-    struct HashEntry {
-        int key;
-        int value;
-        int position; // Final position within the array
-        bool exists; // Flag to check if entry exists
+    // Group commit: block until every record up to lsn is durable
+    void flush(LSN lsn) {
+        std::unique_lock<std::mutex> lock(mutex);
+        while (flushed_lsn < lsn) {
+            if (flush_in_progress) {
+                // Another committer is writing; our record may be in its batch
+                flushed_cv.wait(lock);
+                continue;
+            }
 
-        // Default constructor
-        HashEntry() : key(0), value(0), position(-1), exists(false) {}
+            flush_in_progress = true;
+            std::string batch;
+            batch.swap(log_buffer);
+            LSN batch_lsn = buffered_lsn;
+            off_t batch_offset = file_size;
+            lock.unlock();
 
-        // Constructor for initializing with key, value, and exists flag
-        HashEntry(int k, int v, int pos) : key(k), value(v), position(pos), exists(true) {}    
-    };
+            if (!writeFully(fd, batch.data(), batch.size(), batch_offset) || ::fsync(fd) != 0) {
+                std::cerr << "Error: Unable to write log\n";
+                exit(-1);
+            }
 
-    static const size_t capacity = 100; // Hard-coded capacity
-    HashEntry hashTable[capacity]; // Static-sized array
+            lock.lock();
+            file_size += batch.size();
+            flushed_lsn = batch_lsn;
+            num_fsyncs++;
+            flush_in_progress = false;
+            flushed_cv.notify_all();
+        }
+    }
 
-    size_t hashFunction(int key) const {
-        return key % capacity; // Simple modulo hash function
+    void flushAll() {
+        flush(getLastLSN());
     }
 
-public:
-    HashIndex() {
-        // Initialize all entries as non-existing by default
-        for (size_t i = 0; i < capacity; ++i) {
-            hashTable[i] = HashEntry();
-        }
+    LSN getLastLSN() {
+        std::lock_guard<std::mutex> lock(mutex);
+        return buffered_lsn;
     }
 
-    void insertOrUpdate(int key, int value) {
-        size_t index = hashFunction(key);
-        size_t originalIndex = index;
-        bool inserted = false;
-        int i = 0; // Attempt counter
+    size_t getNumFsyncs() {
+        std::lock_guard<std::mutex> lock(mutex);
+        return num_fsyncs;
+    }
 
-        do {
-            if (!hashTable[index].exists) {
-                hashTable[index] = HashEntry(key, value, true);
-                hashTable[index].position = index;
-                inserted = true;
-                break;
-            } else if (hashTable[index].key == key) {
-                hashTable[index].value += value;
-                hashTable[index].position = index;
-                inserted = true;
+    // Read all complete records from the log file, stopping at the first
+    // torn or corrupt record.
+    std::vector<LogRecord> readLog() {
+        std::vector<LogRecord> records;
+        off_t position = LOG_HEADER_SIZE;
+        LogRecord record;
+        while (readFully(fd, reinterpret_cast<char*>(&record.header), sizeof(LogRecordHeader), position)) {
+            record.payload.resize(record.header.length);
+            if (!readFully(fd, record.payload.data(), record.header.length, position + sizeof(LogRecordHeader)) ||
+                record.header.checksum != checksum(record.header, record.payload.data())) {
                 break;
             }
-            i++;
-            index = (originalIndex + i*i) % capacity; // Quadratic probing
-        } while (index != originalIndex && !inserted);
-
-        if (!inserted) {
-            std::cerr << "HashTable is full or cannot insert key: " << key << std::endl;
+            position += sizeof(LogRecordHeader) + record.header.length;
+            records.push_back(record);
         }
+        return records;
     }
 
-   int getValue(int key) const {
-        size_t index = hashFunction(key);
-        size_t originalIndex = index;
-
-        do {
-            if (hashTable[index].exists && hashTable[index].key == key) {
-                return hashTable[index].value;
-            }
-            if (!hashTable[index].exists) {
-                break; // Stop if we find a slot that has never been used
-            }
-            index = (index + 1) % capacity;
-        } while (index != originalIndex);
-
-        return -1; // Key not found
-    }
-
-    // This method is not efficient for range queries 
-    // as this is an unordered index
-    // but is included for comparison
-    std::vector<int> rangeQuery(int lowerBound, int upperBound) const {
-        std::vector<int> values;
-        for (size_t i = 0; i < capacity; ++i) {
-            if (hashTable[i].exists && hashTable[i].key >= lowerBound && hashTable[i].key <= upperBound) {
-                std::cout << "Key: " << hashTable[i].key << 
-                ", Value: " << hashTable[i].value << std::endl;
-                values.push_back(hashTable[i].value);
-            }
-        }
-        return values;
-    }
-
-    void print() const {
-        for (size_t i = 0; i < capacity; ++i) {
-            if (hashTable[i].exists) {
-                std::cout << "Position: " << hashTable[i].position << 
-                ", Key: " << hashTable[i].key << 
-                ", Value: " << hashTable[i].value << std::endl;
-            }
+    // Drop all records once the pages they describe are on disk.
+    // The caller must have flushed the log and the data file before.
+    void truncate() {
+        std::lock_guard<std::mutex> lock(mutex);
+        assert(log_buffer.empty());
+        LSN base_lsn = next_lsn;
+        if (::ftruncate(fd, 0) != 0 ||
+            !writeFully(fd, reinterpret_cast<const char*>(&base_lsn), LOG_HEADER_SIZE, 0) ||
+            ::fsync(fd) != 0) {
+            std::cerr << "Error: Unable to truncate log\n";
+            exit(-1);
         }
+        file_size = LOG_HEADER_SIZE;
     }
 };
 
+// Commit timestamps of BuzzDB writes; a snapshot sees the writes up to
+// its timestamp
+using Timestamp = uint64_t;
+constexpr Timestamp LATEST_TIMESTAMP = std::numeric_limits<Timestamp>::max();
+
+// Hands out commit timestamps to writers and snapshot timestamps to
+// readers, and keeps the snapshots in use so versions nobody can see
+// any more are dropped. Writers are serialized by the caller, so every
+// write commits in timestamp order.
+class TransactionManager {
+private:
+    std::mutex latch;
+    Timestamp committed = 0;
+    std::multiset<Timestamp> snapshots;
 
-class CostModel {
 public:
-    double estimateScanCost(size_t numPages) {
-        // Assume each page access costs 1 unit
-        return static_cast<double>(numPages);
+    Timestamp beginWrite() {
+        std::lock_guard<std::mutex> guard(latch);
+        return committed + 1;
     }
 
-    double estimateSelectCost(size_t numTuples, double selectivity) {
-        // Cost of scanning all tuples plus cost of applying predicate
-        return static_cast<double>(numTuples) * (1.0 + selectivity);
+    void commit(Timestamp timestamp) {
+        std::lock_guard<std::mutex> guard(latch);
+        committed = timestamp;
     }
 
-    double estimateHashAggregateCost(size_t numTuples, size_t numGroups) {
-        // Cost of hashing all tuples plus cost of aggregation
-        return static_cast<double>(numTuples) * 2.0 + static_cast<double>(numGroups);
+    Timestamp acquireSnapshot() {
+        std::lock_guard<std::mutex> guard(latch);
+        snapshots.insert(committed);
+        return committed;
     }
-};
 
+    void releaseSnapshot(Timestamp timestamp) {
+        std::lock_guard<std::mutex> guard(latch);
+        snapshots.erase(snapshots.find(timestamp));
+    }
 
-class Operator {
-    public:
-    virtual ~Operator() = default;
+    // Changes committed at or before this are seen the same way by
+    // every snapshot
+    Timestamp oldestSnapshot() {
+        std::lock_guard<std::mutex> guard(latch);
+        return snapshots.empty() ? committed : *snapshots.begin();
+    }
+};
 
-    /// Initializes the operator.
-    virtual void open() = 0;
+// A snapshot timestamp registered for as long as the object lives
+class Snapshot {
+private:
+    TransactionManager& transactions;
 
-    /// Tries to generate the next tuple. Return true when a new tuple is
-    /// available.
-    virtual bool next() = 0;
+public:
+    const Timestamp timestamp;
 
-    /// Destroys the operator.
-    virtual void close() = 0;
+    explicit Snapshot(TransactionManager& transactions)
+        : transactions(transactions), timestamp(transactions.acquireSnapshot()) {}
 
-    /// This returns the pointers to the Fields of the generated tuple. When
-    /// `next()` returns true, the Fields will contain the values for the
-    /// next tuple. Each `Field` pointer in the vector stands for one attribute of the tuple.
-    virtual std::vector<std::unique_ptr<Field>> getOutput() = 0;
+    Snapshot(const Snapshot&) = delete;
+    Snapshot& operator=(const Snapshot&) = delete;
 
-    // New method for cost estimation
-    virtual double estimateCost(CostModel& costModel) = 0;
+    ~Snapshot() {
+        transactions.releaseSnapshot(timestamp);
+    }
 };
 
-class UnaryOperator : public Operator {
-    protected:
-    Operator* input;
-
-    public:
-    explicit UnaryOperator(Operator& input) : input(&input) {}
-
-    ~UnaryOperator() override = default;
+// What a snapshot sees of a page besides its current contents: the
+// slots (PAX rows) written after the snapshot, and the tuples deleted
+// after it. Also whether the page had a current PageSummary when it was
+// copied, and how often it had changed.
+struct PageVersions {
+    std::vector<size_t> hidden;                             // Ascending
+    std::vector<std::pair<size_t, std::string>> deleted;    // Slot, serialized tuple
+    bool summarized = false;
+    uint64_t changes = 0;
+
+    bool isHidden(size_t slot) const {
+        return !hidden.empty() && std::binary_search(hidden.begin(), hidden.end(), slot);
+    }
 };
 
-class BinaryOperator : public Operator {
-    protected:
-    Operator* input_left;
-    Operator* input_right;
+struct ValueRange {
+    double low = -std::numeric_limits<double>::infinity();
+    double high = std::numeric_limits<double>::infinity();
+};
 
-    public:
-    explicit BinaryOperator(Operator& input_left, Operator& input_right)
-        : input_left(&input_left), input_right(&input_right) {}
+// Min and max of every INT and FLOAT attribute over the tuples stored in
+// a page, which lets scans skip pages outside a WHERE range. Attributes
+// without numbers have min > max.
+struct PageSummary {
+    size_t tuples = 0;
+    std::vector<double> min;
+    std::vector<double> max;
+
+    void add(size_t attr, double value) {
+        if (attr >= min.size()) {
+            min.resize(attr + 1, std::numeric_limits<double>::infinity());
+            max.resize(attr + 1, -std::numeric_limits<double>::infinity());
+        }
+        min[attr] = std::min(min[attr], value);
+        max[attr] = std::max(max[attr], value);
+    }
 
-    ~BinaryOperator() override = default;
+    // Whether no tuple lies within bounds, closed ranges of attributes
+    bool excludes(const std::vector<std::pair<size_t, ValueRange>>& bounds) const {
+        if (tuples == 0) {
+            return true;
+        }
+        for (const auto& [attr, range] : bounds) {
+            if (attr < min.size() && min[attr] <= max[attr] && (max[attr] < range.low || min[attr] > range.high)) {
+                return true;
+            }
+        }
+        return false;
+    }
 };
 
-class ScanOperator : public Operator {
+constexpr size_t MAX_PAGES_IN_MEMORY = 10;
+
+class BufferManager {
 private:
-    BufferManager& bufferManager;
-    size_t currentPageIndex = 0;
-    size_t currentSlotIndex = 0;
-    std::unique_ptr<Tuple> currentTuple;
-    size_t tuple_count = 0;
+    using PageMap = std::unordered_map<PageID, std::unique_ptr<SlottedPage>>;
 
-public:
-    ScanOperator(BufferManager& manager) : bufferManager(manager) {}
+    StorageManager storage_manager;
+    PageMap pageMap;
+    std::unique_ptr<Policy> policy;
+    std::unordered_set<PageID> dirty_pages;
+    std::unordered_map<PageID, size_t> pin_counts;
+    LogManager* log_manager = nullptr;
+    uint32_t segment_id = 0;    // Tags this file's records in the shared log
+    const PaxLayout* pax_layout = nullptr;  // Page format, SlottedPage if null
+    // Free space map: SlottedPage::getFreeSpace() of every page, or
+    // UNKNOWN_FREE_SPACE if the page was not looked at since startup
+    std::vector<uint16_t> free_space;
+    // Pages with deleted tuples not compacted yet, for the vacuum
+    std::set<PageID> dead_space_pages;
+    // Summaries scans took of the pages, valid until a tuple of the page
+    // is inserted or deleted, and the number of such changes per page
+    struct SummaryEntry {
+        uint64_t changes = 0;
+        bool valid = false;
+        PageSummary summary;
+    };
+    std::vector<SummaryEntry> page_summaries;
 
-    void open() override {
-        currentPageIndex = 0;
-        currentSlotIndex = 0;
-        currentTuple.reset(); // Ensure currentTuple is reset
-        loadNextTuple();
+    static constexpr uint16_t UNKNOWN_FREE_SPACE = std::numeric_limits<uint16_t>::max();
+
+    // Versions of the tuples changed since the oldest snapshot: when the
+    // recent tuples were inserted, and the bytes of the recently deleted
+    // ones. version_order lists both in timestamp order for pruning.
+    struct DeletedVersion {
+        Timestamp begin;
+        Timestamp end;
+        std::string tuple;
+    };
+    std::map<TupleID, Timestamp> inserted_versions;
+    std::multimap<TupleID, DeletedVersion> deleted_versions;
+    std::deque<std::pair<Timestamp, TupleID>> version_order;
+    Timestamp write_timestamp = 0;      // Of the running write, none if 0
+
+    // Guards the pool and the versions. Readers hold it while they copy a
+    // page (readPage()), writers for a whole change (lock()).
+    std::recursive_mutex pool_latch;
+
+    void pageChanged(PageID page_id) {
+        if (page_id >= page_summaries.size()) {
+            page_summaries.resize(page_id + 1);
+        }
+        page_summaries[page_id].changes++;
+        page_summaries[page_id].valid = false;
     }
 
-    bool next() override {
-        if (!currentTuple) return false; // No more tuples available
+public:
+    const size_t capacity;
 
-        loadNextTuple();
-        return currentTuple != nullptr;
-    }
+    // Pages of a compressed file are decompressed when they are loaded
+    BufferManager(const std::string& filename = database_filename,
+                  size_t capacity = MAX_PAGES_IN_MEMORY, bool compressed = false):
+    storage_manager(filename, compressed),
+    policy(std::make_unique<LruPolicy>(capacity)),
+    capacity(capacity) {}
 
-    void close() override {
-        std::cout << "Scan Operator tuple_count: " << tuple_count << "\n";
-        currentPageIndex = 0;
-        currentSlotIndex = 0;
-        currentTuple.reset();
-    }
+    // The page stays in the pool while the caller holds lock()
+    std::unique_ptr<SlottedPage>& getPage(int page_id) {
+        std::lock_guard<std::recursive_mutex> guard(pool_latch);
+        auto it = pageMap.find(page_id);
+        if (it != pageMap.end()) {
+            policy->touch(page_id);
+            return pageMap.find(page_id)->second;
+        }
 
-    std::vector<std::unique_ptr<Field>> getOutput() override {
-        if (currentTuple) {
-            return std::move(currentTuple->fields);
+        if (pageMap.size() >= capacity) {
+            auto evictedPageId = policy->evict();
+            // Pinned pages are in use, give them another round. Once every
+            // page has been offered there is nothing left that may go.
+            for (size_t tries = 1; evictedPageId != INVALID_PAGE_ID && pin_counts.count(evictedPageId); ++tries) {
+                policy->touch(evictedPageId);
+                if (tries >= pageMap.size()) {
+                    throw std::runtime_error("Buffer pool is full of pinned pages.");
+                }
+                evictedPageId = policy->evict();
+            }
+            if(evictedPageId != INVALID_PAGE_ID){
+                //std::cout << "Evicting page " << evictedPageId << "\n";
+                if (dirty_pages.count(evictedPageId)) {
+                    flushPage(evictedPageId);
+                }
+                pageMap.erase(evictedPageId);
+            }
         }
-        return {}; // Return an empty vector if no tuple is available
+
+        auto page = storage_manager.load(page_id);
+        policy->touch(page_id);
+        //std::cout << "Loading page: " << page_id << "\n";
+        pageMap[page_id] = std::move(page);
+        return pageMap[page_id];
     }
 
-    double estimateCost(CostModel& costModel) override {
-        return costModel.estimateScanCost(bufferManager.getNumPages());
+    void flushPage(int page_id) {
+        //std::cout << "Flush page " << page_id << "\n";
+        std::lock_guard<std::recursive_mutex> guard(pool_latch);
+        auto it = pageMap.find(page_id);
+        if (it == pageMap.end()) {
+            return;
+        }
+        // Write-ahead rule: the log must be durable up to the page LSN
+        if (log_manager) {
+            log_manager->flush(it->second->getPageLSN());
+        }
+        storage_manager.flush(page_id, it->second);
+        dirty_pages.erase(page_id);
     }
 
-private:
-    void loadNextTuple() {
-        while (currentPageIndex < bufferManager.getNumPages()) {
-            auto& currentPage = bufferManager.getPage(currentPageIndex);
-            if (!currentPage || currentSlotIndex >= MAX_SLOTS) {
-                currentSlotIndex = 0; // Reset slot index when moving to a new page
-            }
+    void flushAll() {
+        std::lock_guard<std::recursive_mutex> guard(pool_latch);
+        std::vector<PageID> pages(dirty_pages.begin(), dirty_pages.end());
+        for (auto page_id : pages) {
+            flushPage(page_id);
+        }
+    }
 
-            char* page_buffer = currentPage->page_data.get();
-            Slot* slot_array = reinterpret_cast<Slot*>(page_buffer);
+    void markDirty(int page_id) {
+        dirty_pages.insert(page_id);
+    }
 
-            while (currentSlotIndex < MAX_SLOTS) {
-                if (!slot_array[currentSlotIndex].empty) {
-                    assert(slot_array[currentSlotIndex].offset != INVALID_VALUE);
-                    const char* tuple_data = page_buffer + slot_array[currentSlotIndex].offset;
-                    std::istringstream iss(std::string(tuple_data, slot_array[currentSlotIndex].length));
-                    currentTuple = Tuple::deserialize(iss);
-                    currentSlotIndex++; // Move to the next slot for the next call
-                    tuple_count++;
-                    return; // Tuple loaded successfully
-                }
-                currentSlotIndex++;
-            }
+    // A pinned page is never evicted, so pointers into it stay valid
+    // while other pages are loaded
+    void pinPage(PageID page_id) {
+        std::lock_guard<std::recursive_mutex> guard(pool_latch);
+        pin_counts[page_id]++;
+    }
 
-            // Increment page index after exhausting current page
-            currentPageIndex++;
+    void unpinPage(PageID page_id) {
+        std::lock_guard<std::recursive_mutex> guard(pool_latch);
+        auto it = pin_counts.find(page_id);
+        if (it != pin_counts.end() && --it->second == 0) {
+            pin_counts.erase(it);
         }
-
-        // No more tuples are available
-        currentTuple.reset();
     }
-};
 
-class IPredicate {
-public:
-    virtual ~IPredicate() = default;
-    virtual bool check(const std::vector<std::unique_ptr<Field>>& tupleFields) const = 0;
-};
+    void setLogManager(LogManager* manager, uint32_t segment = 0) {
+        log_manager = manager;
+        segment_id = segment;
+    }
 
-void printTuple(const std::vector<std::unique_ptr<Field>>& tupleFields) {
-    std::cout << "Tuple: [";
-    for (const auto& field : tupleFields) {
-        field->print(); // Assuming `print()` is a method that prints field content
-        std::cout << " ";
+    void setPaxLayout(const PaxLayout* layout) {
+        pax_layout = layout;
     }
-    std::cout << "]";
-}
 
-class SimplePredicate: public IPredicate {
-public:
-    enum OperandType { DIRECT, INDIRECT };
-    enum ComparisonOperator { EQ, NE, GT, GE, LT, LE }; // Renamed from PredicateType
+    const PaxLayout* getPaxLayout() const {
+        return pax_layout;
+    }
 
-    struct Operand {
-        std::unique_ptr<Field> directValue;
-        size_t index;
-        OperandType type;
+    // Exclusive access to the pool for a change that spans several calls
+    std::unique_lock<std::recursive_mutex> lock() {
+        return std::unique_lock<std::recursive_mutex>(pool_latch);
+    }
 
-        Operand(std::unique_ptr<Field> value) : directValue(std::move(value)), type(DIRECT) {}
-        Operand(size_t idx) : index(idx), type(INDIRECT) {}
-    };
+    // Changes until the next call keep versions stamped with timestamp
+    // for the snapshots older than it, or none if it is 0
+    void setWriteTimestamp(Timestamp timestamp) {
+        std::lock_guard<std::recursive_mutex> guard(pool_latch);
+        write_timestamp = timestamp;
+    }
 
-    Operand left_operand;
-    Operand right_operand;
-    ComparisonOperator comparison_operator;
+    // Drop the versions every snapshot from oldest on sees the same way
+    // as the page
+    void pruneVersions(Timestamp oldest) {
+        std::lock_guard<std::recursive_mutex> guard(pool_latch);
+        while (!version_order.empty() && version_order.front().first <= oldest) {
+            auto [timestamp, tuple_id] = version_order.front();
+            version_order.pop_front();
+            auto inserted = inserted_versions.find(tuple_id);
+            if (inserted != inserted_versions.end() && inserted->second == timestamp) {
+                inserted_versions.erase(inserted);
+            }
+            auto range = deleted_versions.equal_range(tuple_id);
+            for (auto it = range.first; it != range.second; ++it) {
+                if (it->second.end == timestamp) {
+                    deleted_versions.erase(it);
+                    break;
+                }
+            }
+        }
+    }
 
-    SimplePredicate(Operand left, Operand right, ComparisonOperator op)
-        : left_operand(std::move(left)), right_operand(std::move(right)), comparison_operator(op) {}
+    size_t getNumVersions() {
+        std::lock_guard<std::recursive_mutex> guard(pool_latch);
+        return inserted_versions.size() + deleted_versions.size();
+    }
 
-    bool check(const std::vector<std::unique_ptr<Field>>& tupleFields) const {
-        const Field* leftField = nullptr;
-        const Field* rightField = nullptr;
+    // Copy count consecutive pages for a reader that runs next to
+    // writers, with what a snapshot at timestamp sees differently on each
+    // (see PageVersions). Pages that are not in the pool are read from
+    // the file without loading them, so scans do not evict the pages
+    // writers work on.
+    void readPages(PageID first_page, size_t count, char* pages, Timestamp snapshot,
+                   std::vector<PageVersions>& versions) {
+        std::lock_guard<std::recursive_mutex> guard(pool_latch);
+        storage_manager.readPages(first_page, count, pages);
+        versions.resize(count);
+        for (size_t i = 0; i < count; ++i) {
+            auto it = pageMap.find(first_page + i);
+            if (it != pageMap.end()) {
+                std::memcpy(pages + i * PAGE_SIZE, it->second->page_data.get(), PAGE_SIZE);
+            }
+            versions[i].hidden.clear();
+            versions[i].deleted.clear();
+            PageID page_id = first_page + i;
+            versions[i].summarized = page_id < page_summaries.size() && page_summaries[page_id].valid;
+            versions[i].changes = (page_id < page_summaries.size()) ? page_summaries[page_id].changes : 0;
+        }
 
-        if (left_operand.type == DIRECT) {
-            leftField = left_operand.directValue.get();
-        } else if (left_operand.type == INDIRECT) {
-            leftField = tupleFields[left_operand.index].get();
+        TupleID first = makeTupleID(first_page, 0);
+        TupleID last = makeTupleID(first_page + count - 1, std::numeric_limits<uint16_t>::max());
+        for (auto it = inserted_versions.lower_bound(first); it != inserted_versions.end() && it->first <= last; ++it) {
+            if (it->second > snapshot) {
+                versions[tupleIDPage(it->first) - first_page].hidden.push_back(tupleIDSlot(it->first));
+            }
+        }
+        for (auto it = deleted_versions.lower_bound(first); it != deleted_versions.end() && it->first <= last; ++it) {
+            if (it->second.begin <= snapshot && snapshot < it->second.end) {
+                versions[tupleIDPage(it->first) - first_page].deleted.emplace_back(tupleIDSlot(it->first),
+                                                                                   it->second.tuple);
+            }
         }
+    }
 
-        if (right_operand.type == DIRECT) {
-            rightField = right_operand.directValue.get();
-        } else if (right_operand.type == INDIRECT) {
-            rightField = tupleFields[right_operand.index].get();
+    // Keep the summary a scan took of a copy of the page, unless the page
+    // changed after the copy (changes as in its PageVersions)
+    void setPageSummary(PageID page_id, PageSummary summary, uint64_t changes) {
+        std::lock_guard<std::recursive_mutex> guard(pool_latch);
+        if (page_id >= page_summaries.size()) {
+            page_summaries.resize(page_id + 1);
+        }
+        SummaryEntry& entry = page_summaries[page_id];
+        if (entry.changes == changes) {
+            entry.summary = std::move(summary);
+            entry.valid = true;
         }
+    }
 
-        if (leftField == nullptr || rightField == nullptr) {
-            std::cerr << "Error: Invalid field reference.\n";
+    // Whether a scan of a snapshot at timestamp may skip the page as none
+    // of its tuples lies within bounds: the summary of the page is
+    // current and excludes them, and no tuple deleted after the snapshot
+    // is kept for it
+    bool skipPage(PageID page_id, const std::vector<std::pair<size_t, ValueRange>>& bounds, Timestamp snapshot) {
+        std::lock_guard<std::recursive_mutex> guard(pool_latch);
+        if (page_id >= page_summaries.size() || !page_summaries[page_id].valid ||
+            !page_summaries[page_id].summary.excludes(bounds)) {
             return false;
         }
+        TupleID last = makeTupleID(page_id, std::numeric_limits<uint16_t>::max());
+        for (auto it = deleted_versions.lower_bound(makeTupleID(page_id, 0));
+             it != deleted_versions.end() && it->first <= last; ++it) {
+            if (it->second.begin <= snapshot && snapshot < it->second.end) {
+                return false;
+            }
+        }
+        return true;
+    }
 
-        if (leftField->getType() != rightField->getType()) {
-            std::cerr << "Error: Comparing fields of different types.\n";
-            return false;
+    // Record an insert into a resident page. With a log attached the page
+    // is only marked dirty; without one it is written through right away.
+    void logInsert(int page_id, size_t slot) {
+        std::lock_guard<std::recursive_mutex> guard(pool_latch);
+        auto& page = pageMap.at(page_id);
+        pageChanged(page_id);
+        if (write_timestamp) {
+            inserted_versions[makeTupleID(page_id, slot)] = write_timestamp;
+            version_order.emplace_back(write_timestamp, makeTupleID(page_id, slot));
+        }
+        if (!pax_layout) {
+            updateFreeSpace(page_id);
+        }
+        if (!log_manager) {
+            flushPage(page_id);
+            return;
+        }
+        if (pax_layout) {
+            // PAX rows are logged in the slotted page format
+            std::string row = pax_layout->serializeRow(page->page_data.get(), slot);
+            page->setPageLSN(log_manager->appendInsert(segment_id, page_id, slot, 0, row.data(), row.size()));
+            markDirty(page_id);
+            return;
         }
+        const Slot& slot_info = page->getSlot(slot);
+        LSN lsn = log_manager->appendInsert(segment_id, page_id, slot, slot_info.offset,
+                                            page->page_data.get() + slot_info.offset,
+                                            slot_info.length);
+        page->setPageLSN(lsn);
+        markDirty(page_id);
+    }
 
-        // Perform comparison based on field type
-        switch (leftField->getType()) {
-            case FieldType::INT: {
-                int left_val = leftField->asInt();
-                int right_val = rightField->asInt();
-                return compare(left_val, right_val);
-            }
-            case FieldType::FLOAT: {
-                float left_val = leftField->asFloat();
-                float right_val = rightField->asFloat();
-                return compare(left_val, right_val);
+    // The deleted tuple's bytes must still be in its slot
+    void logDelete(int page_id, size_t slot) {
+        std::lock_guard<std::recursive_mutex> guard(pool_latch);
+        auto& page = pageMap.at(page_id);
+        pageChanged(page_id);
+        if (write_timestamp) {
+            // Snapshots that saw the tuple keep reading it from here
+            TupleID tuple_id = makeTupleID(page_id, slot);
+            Timestamp begin = 0;
+            auto inserted = inserted_versions.find(tuple_id);
+            if (inserted != inserted_versions.end()) {
+                begin = inserted->second;
+                inserted_versions.erase(inserted);
             }
-            case FieldType::STRING: {
-                std::string left_val = leftField->asString();
-                std::string right_val = rightField->asString();
-                return compare(left_val, right_val);
-            }
-            default:
-                std::cerr << "Invalid field type\n";
-                return false;
+            const Slot& slot_info = page->getSlot(slot);
+            deleted_versions.emplace(tuple_id, DeletedVersion{begin, write_timestamp,
+                std::string(page->page_data.get() + slot_info.offset, slot_info.length)});
+            version_order.emplace_back(write_timestamp, tuple_id);
         }
+        dead_space_pages.insert(page_id);
+        updateFreeSpace(page_id);
+        if (!log_manager) {
+            flushPage(page_id);
+            return;
+        }
+        page->setPageLSN(log_manager->appendDelete(segment_id, page_id, slot));
+        markDirty(page_id);
     }
 
+    // Compact a page (SlottedPage::compact()) and log it if it has at
+    // least min_dead_space bytes of deleted tuples. Returns the number of
+    // bytes reclaimed.
+    size_t compactPage(PageID page_id, size_t min_dead_space = 0) {
+        std::lock_guard<std::recursive_mutex> guard(pool_latch);
+        auto& page = getPage(page_id);
+        dead_space_pages.erase(page_id);
+        if (page->getDeadSpace() < min_dead_space) {
+            return 0;
+        }
+        size_t reclaimed = page->compact();
+        updateFreeSpace(page_id);
+        if (!log_manager) {
+            flushPage(page_id);
+        } else {
+            page->setPageLSN(log_manager->appendCompact(segment_id, page_id));
+            markDirty(page_id);
+        }
+        return reclaimed;
+    }
 
-private:
+    // A page with deleted tuples, INVALID_PAGE_ID if there is none
+    PageID getDeadSpacePage() {
+        std::lock_guard<std::recursive_mutex> guard(pool_latch);
+        return dead_space_pages.empty() ? INVALID_PAGE_ID : *dead_space_pages.begin();
+    }
 
-    // Compares two values of the same type
-    template<typename T>
-    bool compare(const T& left_val, const T& right_val) const {
-        switch (comparison_operator) {
-            case ComparisonOperator::EQ: return left_val == right_val;
-            case ComparisonOperator::NE: return left_val != right_val;
-            case ComparisonOperator::GT: return left_val > right_val;
-            case ComparisonOperator::GE: return left_val >= right_val;
-            case ComparisonOperator::LT: return left_val < right_val;
-            case ComparisonOperator::LE: return left_val <= right_val;
-            default: std::cerr << "Invalid predicate type\n"; return false;
+    // First page from start on that may have room for a tuple of size
+    // bytes, getNumPages() if there is none
+    PageID findPageWithSpace(size_t size, PageID start = 0) {
+        std::lock_guard<std::recursive_mutex> guard(pool_latch);
+        free_space.resize(getNumPages(), UNKNOWN_FREE_SPACE);
+        for (PageID page_id = start; page_id < free_space.size(); ++page_id) {
+            if (free_space[page_id] >= size) {
+                return page_id;
+            }
         }
+        return getNumPages();
     }
-};
 
-class ComplexPredicate : public IPredicate {
-public:
-    enum LogicOperator { AND, OR };
+    // Record the free space of a resident page after a change
+    void updateFreeSpace(PageID page_id) {
+        std::lock_guard<std::recursive_mutex> guard(pool_latch);
+        free_space.resize(getNumPages(), UNKNOWN_FREE_SPACE);
+        free_space[page_id] = static_cast<uint16_t>(pageMap.at(page_id)->getFreeSpace());
+    }
 
-private:
-    std::vector<std::unique_ptr<IPredicate>> predicates;
-    LogicOperator logic_operator;
+    // Redo the changes to this segment among the log records that did
+    // not reach the data file before the last shutdown or crash. Returns
+    // the number of records of this segment.
+    size_t recover(const std::vector<LogRecord>& records) {
+        std::lock_guard<std::recursive_mutex> guard(pool_latch);
+        size_t redone = 0;
+        for (const auto& record : records) {
+            const auto& header = record.header;
+            if (header.segment_id != segment_id) {
+                continue;
+            }
+            redone++;
+            while (header.page_id >= getNumPages()) {
+                extend();
+            }
+            auto& page = getPage(header.page_id);
+            if (page->getPageLSN() >= header.lsn) {
+                continue; // Change already reached the disk
+            }
+            if (pax_layout) {
+                pax_layout->restoreRow(page->page_data.get(), header.slot, record.payload.data(), header.length);
+            } else if (header.type == static_cast<uint16_t>(LogRecordType::INSERT)) {
+                page->restoreTuple(header.slot, header.offset, record.payload.data(), header.length);
+            } else if (header.type == static_cast<uint16_t>(LogRecordType::COMPACT)) {
+                page->compact();
+            } else {
+                page->deleteTuple(header.slot);
+                dead_space_pages.insert(header.page_id);
+            }
+            page->setPageLSN(header.lsn);
+            markDirty(header.page_id);
+            pageChanged(header.page_id);
+        }
+        return redone;
+    }
 
-public:
-    ComplexPredicate(LogicOperator op) : logic_operator(op) {}
+    // Write all dirty pages and sync the file. The log is shared by all
+    // segments, so truncating it is up to the caller.
+    void checkpoint() {
+        std::lock_guard<std::recursive_mutex> guard(pool_latch);
+        if (log_manager) {
+            log_manager->flushAll();
+        }
+        flushAll();
+        storage_manager.sync();
+    }
 
-    void addPredicate(std::unique_ptr<IPredicate> predicate) {
-        predicates.push_back(std::move(predicate));
+    void extend(){
+        std::lock_guard<std::recursive_mutex> guard(pool_latch);
+        storage_manager.extend();
     }
 
-    bool check(const std::vector<std::unique_ptr<Field>>& tupleFields) const {
-        
-        if (logic_operator == AND) {
-            for (const auto& pred : predicates) {
-                if (!pred->check(tupleFields)) {
-                    return false; // If any predicate fails, the AND condition fails
-                }
-            }
-            return true; // All predicates passed
-        } else if (logic_operator == OR) {
-            for (const auto& pred : predicates) {
-                if (pred->check(tupleFields)) {
-                    return true; // If any predicate passes, the OR condition passes
-                }
-            }
-            return false; // No predicates passed
-        }
-        return false;
+    // Sequential I/O for bulk operations, bypassing the pool. Appended
+    // pages are not logged, so they are forced to disk by the caller.
+    PageID appendPages(const char* pages, size_t count) {
+        std::lock_guard<std::recursive_mutex> guard(pool_latch);
+        return storage_manager.appendPages(pages, count);
+    }
+
+    void readPages(PageID first_page, size_t count, char* pages) {
+        std::lock_guard<std::recursive_mutex> guard(pool_latch);
+        storage_manager.readPages(first_page, count, pages);
+    }
+
+    void sync() {
+        storage_manager.sync();
+    }
+    
+    uint64_t getFileSize() {
+        std::lock_guard<std::recursive_mutex> guard(pool_latch);
+        return storage_manager.getFileSize();
     }
 
+    // Write the dirty pages and evict the file from the OS page cache
+    void dropCache() {
+        std::lock_guard<std::recursive_mutex> guard(pool_latch);
+        flushAll();
+        storage_manager.dropCache();
+    }
+
+    size_t getNumPages(){
+        std::lock_guard<std::recursive_mutex> guard(pool_latch);
+        return storage_manager.num_pages;
+    }
 
 };
 
+const std::string hash_index_filename = "buzzdb_hash.idx";
 
-class SelectOperator : public UnaryOperator {
+// Frames for index buckets; an index over millions of keys needs more
+// than the MAX_PAGES_IN_MEMORY frames of the table pool.
+constexpr size_t HASH_INDEX_PAGES_IN_MEMORY = 4096;
+
+// Disk-backed extendible hash index from int keys to tuple ids. Buckets
+// are pages in their own file, managed by a BufferManager. The directory
+// lives in memory and is written to a sidecar file on persist(); a missing
+// sidecar means the index was not closed cleanly and starts out empty so
+// the owner can rebuild it. Duplicate keys are allowed: a bucket whose
+// entries all share one key cannot be split and grows an overflow chain
+// behind its first page.
+class HashIndex {
 private:
-    std::unique_ptr<IPredicate> predicate;
-    bool has_next;
-    std::vector<std::unique_ptr<Field>> currentOutput; // Store the current output here
+    struct BucketHeader {
+        uint32_t local_depth;
+        uint32_t num_entries;
+        PageID overflow_page;   // Next page of the chain or INVALID_PAGE_ID
+        uint32_t mixed_keys;    // Chain holds more than one key, kept on the first page
+    };
 
-public:
-    SelectOperator(Operator& input, std::unique_ptr<IPredicate> predicate)
-        : UnaryOperator(input), predicate(std::move(predicate)), has_next(false) {}
+    struct BucketEntry {
+        int32_t key;
+        uint32_t unused;
+        TupleID value;
+    };
 
-    void open() override {
-        input->open();
-        has_next = false;
-        currentOutput.clear(); // Ensure currentOutput is cleared at the beginning
+    static constexpr size_t BUCKET_CAPACITY = (PAGE_SIZE - sizeof(BucketHeader)) / sizeof(BucketEntry);
+    static constexpr uint32_t MAX_GLOBAL_DEPTH = 24;
+
+    std::string filename;
+    std::unique_ptr<BufferManager> bucket_pages;
+    uint32_t global_depth = 0;
+    std::vector<PageID> directory;
+    std::vector<PageID> free_pages;    // Overflow pages released by splits
+    size_t num_entries = 0;
+
+    static uint64_t hashFunction(int key) {
+        return hashInt(key);
     }
 
-    bool next() override {
-        while (input->next()) {
-            const auto& output = input->getOutput(); // Temporarily hold the output
-            if (predicate->check(output)) {
-                // If the predicate is satisfied, store the output in the member variable
-                currentOutput.clear(); // Clear previous output
-                for (const auto& field : output) {
-                    // Assuming Field class has a clone method or copy constructor to duplicate fields
-                    currentOutput.push_back(field->clone());
-                }
-                has_next = true;
-                return true;
-            }
+    size_t directoryIndex(int key) const {
+        return hashFunction(key) & ((size_t(1) << global_depth) - 1);
+    }
+
+    // A bucket page viewed as header plus entry array. The pointers stay
+    // valid until another page is fetched.
+    struct Bucket {
+        BucketHeader* header;
+        BucketEntry* entries;
+    };
+
+    Bucket bucket(PageID page_id) {
+        char* data = bucket_pages->getPage(page_id)->page_data.get();
+        return {reinterpret_cast<BucketHeader*>(data),
+                reinterpret_cast<BucketEntry*>(data + sizeof(BucketHeader))};
+    }
+
+    PageID allocatePage(uint32_t local_depth) {
+        PageID page_id;
+        if (!free_pages.empty()) {
+            page_id = free_pages.back();
+            free_pages.pop_back();
+        } else {
+            bucket_pages->extend();
+            page_id = bucket_pages->getNumPages() - 1;
         }
-        has_next = false;
-        currentOutput.clear(); // Clear output if no more tuples satisfy the predicate
-        return false;
+        initPage(page_id, local_depth);
+        return page_id;
     }
 
-    void close() override {
-        input->close();
-        currentOutput.clear(); // Ensure currentOutput is cleared at the end
+    void initPage(PageID page_id, uint32_t local_depth) {
+        auto page = bucket(page_id);
+        page.header->local_depth = local_depth;
+        page.header->num_entries = 0;
+        page.header->overflow_page = INVALID_PAGE_ID;
+        page.header->mixed_keys = 0;
+        bucket_pages->markDirty(page_id);
     }
 
-    std::vector<std::unique_ptr<Field>> getOutput() override {
-        if (has_next) {
-            // Since currentOutput already holds the desired output, simply return it
-            // Need to create a deep copy to return since we're returning by value
-            std::vector<std::unique_ptr<Field>> outputCopy;
-            for (const auto& field : currentOutput) {
-                outputCopy.push_back(field->clone()); // Clone each field
+    // Append to the first page of the chain. When it is full its entries
+    // move to a new overflow page linked right behind it, so an insert
+    // never walks a long chain of duplicates.
+    void appendToChain(PageID page_id, const BucketEntry& entry) {
+        auto page = bucket(page_id);
+        std::optional<int> chain_key;
+        if (page.header->num_entries == BUCKET_CAPACITY) {
+            std::vector<BucketEntry> entries(page.entries, page.entries + BUCKET_CAPACITY);
+            PageID next = page.header->overflow_page;
+            PageID overflow_page = allocatePage(page.header->local_depth);
+            auto overflow = bucket(overflow_page);
+            std::copy(entries.begin(), entries.end(), overflow.entries);
+            overflow.header->num_entries = BUCKET_CAPACITY;
+            overflow.header->overflow_page = next;
+            bucket_pages->markDirty(overflow_page);
+
+            page = bucket(page_id);
+            page.header->num_entries = 0;
+            page.header->overflow_page = overflow_page;
+            chain_key = entries[0].key;
+        } else if (page.header->num_entries > 0) {
+            chain_key = page.entries[0].key;
+        } else if (page.header->overflow_page != INVALID_PAGE_ID) {
+            // First page emptied by deletes
+            auto overflow = bucket(page.header->overflow_page);
+            if (overflow.header->num_entries > 0) {
+                chain_key = overflow.entries[0].key;
             }
-            return outputCopy;
-        } else {
-            return {}; // Return an empty vector if no matching tuple is found
+            page = bucket(page_id);
+        }
+        if (chain_key && *chain_key != entry.key) {
+            page.header->mixed_keys = 1;
         }
+        page.entries[page.header->num_entries++] = entry;
+        bucket_pages->markDirty(page_id);
     }
 
-    double estimateCost(CostModel& costModel) override {
-        // Assume 10% selectivity for now. In a real system, this would be based on statistics.
-        return costModel.estimateSelectCost(input->estimateCost(costModel), 0.1);
+    bool chainIsFull(PageID page_id) {
+        return bucket(page_id).header->num_entries == BUCKET_CAPACITY;
     }
-};
 
-enum class AggrFuncType { COUNT, MAX, MIN, SUM };
+    // Splitting only helps if the bucket holds more than one distinct key
+    bool canSplit(PageID page_id) {
+        auto first = bucket(page_id);
+        return first.header->local_depth < MAX_GLOBAL_DEPTH && first.header->mixed_keys;
+    }
 
-struct AggrFunc {
-    AggrFuncType func;
-    size_t attr_index; // Index of the attribute to aggregate
-};
+    void split(size_t dir_index) {
+        PageID old_page = directory[dir_index];
+        uint32_t local_depth = bucket(old_page).header->local_depth;
 
-class HashAggregationOperator : public UnaryOperator {
-private:
-    std::vector<size_t> group_by_attrs;
-    std::vector<AggrFunc> aggr_funcs;
-    std::vector<Tuple> output_tuples; // Use your Tuple class for output
-    size_t output_tuples_index = 0;
+        if (local_depth == global_depth) {
+            // Double the directory, the new half mirrors the old one
+            directory.insert(directory.end(), directory.begin(), directory.end());
+            global_depth++;
+        }
 
-    struct FieldVectorHasher {
-        std::size_t operator()(const std::vector<Field>& fields) const {
-            std::size_t hash = 0;
-            for (const auto& field : fields) {
-                std::hash<std::string> hasher;
-                std::size_t fieldHash = 0;
-
-                // Depending on the type, hash the corresponding data
-                switch (field.type) {
-                    case INT: {
-                        // Convert integer data to string and hash
-                        int value = *reinterpret_cast<const int*>(field.data.get());
-                        fieldHash = hasher(std::to_string(value));
-                        break;
-                    }
-                    case FLOAT: {
-                        // Convert float data to string and hash
-                        float value = *reinterpret_cast<const float*>(field.data.get());
-                        fieldHash = hasher(std::to_string(value));
-                        break;
-                    }
-                    case STRING: {
-                        // Directly hash the string data
-                        std::string value(field.data.get(), field.data_length - 1); // Exclude null-terminator
-                        fieldHash = hasher(value);
-                        break;
-                    }
-                    default:
-                        throw std::runtime_error("Unsupported field type for hashing.");
-                }
+        PageID new_page = allocatePage(local_depth + 1);
+        for (size_t i = 0; i < directory.size(); ++i) {
+            if (directory[i] == old_page && ((i >> local_depth) & 1)) {
+                directory[i] = new_page;
+            }
+        }
 
-                // Combine the hash of the current field with the hash so far
-                hash ^= fieldHash + 0x9e3779b9 + (hash << 6) + (hash >> 2);
+        // Collect the chain, reset it and redistribute on the next hash bit
+        std::vector<BucketEntry> chain_entries;
+        for (PageID page_id = old_page; page_id != INVALID_PAGE_ID;) {
+            auto page = bucket(page_id);
+            chain_entries.insert(chain_entries.end(), page.entries, page.entries + page.header->num_entries);
+            if (page_id != old_page) {
+                free_pages.push_back(page_id);
             }
-            return hash;
+            page_id = page.header->overflow_page;
         }
-    };
+        initPage(old_page, local_depth + 1);
 
+        for (const auto& entry : chain_entries) {
+            bool high = (hashFunction(entry.key) >> local_depth) & 1;
+            appendToChain(high ? new_page : old_page, entry);
+        }
+    }
 
 public:
-    HashAggregationOperator(Operator& input, std::vector<size_t> group_by_attrs, std::vector<AggrFunc> aggr_funcs)
-        : UnaryOperator(input), group_by_attrs(group_by_attrs), aggr_funcs(aggr_funcs) {}
-
-    void open() override {
-        input->open(); // Ensure the input operator is opened
-        output_tuples_index = 0;
-        output_tuples.clear();
-
-        // Assume a hash map to aggregate tuples based on group_by_attrs
-        std::unordered_map<std::vector<Field>, std::vector<Field>, FieldVectorHasher> hash_table;
+    HashIndex(const std::string& filename = hash_index_filename) : filename(filename) {
+        bool clean = loadDirectory();
+        if (!clean) {
+            std::remove(filename.c_str());
+        }
+        bucket_pages = std::make_unique<BufferManager>(filename, HASH_INDEX_PAGES_IN_MEMORY);
+        if (!clean) {
+            // Page 0 is created by the storage manager and becomes the first bucket
+            global_depth = 0;
+            directory.assign(1, 0);
+            free_pages.clear();
+            num_entries = 0;
+            initPage(0, 0);
+        }
+    }
 
-        while (input->next()) {
-            const auto& tuple = input->getOutput(); // Assume getOutput returns a reference to the current tuple
+    ~HashIndex() {
+        persist();
+    }
 
-            // Extract group keys and initialize aggregation values
-            std::vector<Field> group_keys;
-            for (auto& index : group_by_attrs) {
-                group_keys.push_back(*tuple[index]); // Deep copy the Field object for group key
+    void insert(int key, TupleID value) {
+        while (true) {
+            size_t dir_index = directoryIndex(key);
+            PageID page_id = directory[dir_index];
+            if (!chainIsFull(page_id) || !canSplit(page_id)) {
+                appendToChain(page_id, BucketEntry{key, 0, value});
+                num_entries++;
+                return;
             }
+            split(dir_index);
+        }
+    }
 
-            // Process aggregation functions
-            if (!hash_table.count(group_keys)) {
-                // Initialize aggregate values for a new group
-                std::vector<Field> aggr_values(aggr_funcs.size(), Field(0)); // Assuming Field(int) initializes an integer Field
-                hash_table[group_keys] = aggr_values;
+    // Remove one (key, value) entry, returns false if it was not found.
+    // Buckets are never merged.
+    bool remove(int key, TupleID value) {
+        for (PageID page_id = directory[directoryIndex(key)]; page_id != INVALID_PAGE_ID;) {
+            auto page = bucket(page_id);
+            for (uint32_t i = 0; i < page.header->num_entries; ++i) {
+                if (page.entries[i].key == key && page.entries[i].value == value) {
+                    page.entries[i] = page.entries[--page.header->num_entries];
+                    bucket_pages->markDirty(page_id);
+                    num_entries--;
+                    return true;
+                }
             }
+            page_id = page.header->overflow_page;
+        }
+        return false;
+    }
 
-            // Update aggregate values
-            auto& aggr_values = hash_table[group_keys];
-            for (size_t i = 0; i < aggr_funcs.size(); ++i) {
-                // Simplified update logic for demonstration
-                // You'll need to implement actual aggregation logic here
-                aggr_values[i] = updateAggregate(aggr_funcs[i], aggr_values[i], *tuple[aggr_funcs[i].attr_index]);
+    // All values stored under key
+    std::vector<TupleID> getValues(int key) {
+        std::vector<TupleID> values;
+        for (PageID page_id = directory[directoryIndex(key)]; page_id != INVALID_PAGE_ID;) {
+            auto page = bucket(page_id);
+            for (uint32_t i = 0; i < page.header->num_entries; ++i) {
+                if (page.entries[i].key == key) {
+                    values.push_back(page.entries[i].value);
+                }
             }
+            page_id = page.header->overflow_page;
         }
+        return values;
+    }
 
-        // Prepare output tuples from the hash table
-        for (const auto& entry : hash_table) {
-            const auto& group_keys = entry.first;
-            const auto& aggr_values = entry.second;
-            Tuple output_tuple;
-            // Assuming Tuple has a method to add Fields
-            for (const auto& key : group_keys) {
-                output_tuple.addField(std::make_unique<Field>(key)); // Add group keys to the tuple
-            }
-            for (const auto& value : aggr_values) {
-                output_tuple.addField(std::make_unique<Field>(value)); // Add aggregated values to the tuple
+    // This method is not efficient for range queries 
+    // as this is an unordered index
+    // but is included for comparison
+    std::vector<TupleID> rangeQuery(int lowerBound, int upperBound) {
+        std::vector<TupleID> values;
+        std::vector<PageID> buckets(directory.begin(), directory.end());
+        std::sort(buckets.begin(), buckets.end());
+        buckets.erase(std::unique(buckets.begin(), buckets.end()), buckets.end());
+        for (PageID page_id : buckets) {
+            while (page_id != INVALID_PAGE_ID) {
+                auto page = bucket(page_id);
+                for (uint32_t i = 0; i < page.header->num_entries; ++i) {
+                    if (page.entries[i].key >= lowerBound && page.entries[i].key <= upperBound) {
+                        values.push_back(page.entries[i].value);
+                    }
+                }
+                page_id = page.header->overflow_page;
             }
-            output_tuples.push_back(std::move(output_tuple));
         }
+        return values;
     }
 
-    bool next() override {
-        if (output_tuples_index < output_tuples.size()) {
-            output_tuples_index++;
-            return true;
-        }
-        return false;
+    size_t size() const {
+        return num_entries;
     }
 
-    void close() override {
-        input->close();
+    // Drop every entry, e.g. before a rebuild
+    void clear() {
+        bucket_pages.reset();
+        std::remove(filename.c_str());
+        bucket_pages = std::make_unique<BufferManager>(filename, HASH_INDEX_PAGES_IN_MEMORY);
+        global_depth = 0;
+        directory.assign(1, 0);
+        free_pages.clear();
+        num_entries = 0;
+        initPage(0, 0);
+    }
+
+    // Write all bucket pages and the directory
+    void persist() {
+        bucket_pages->flushAll();
+        bucket_pages->sync();
+        std::ofstream out(filename + ".dir", std::ios::binary | std::ios::trunc);
+        uint64_t sizes[4] = {global_depth, num_entries, directory.size(), free_pages.size()};
+        out.write(reinterpret_cast<const char*>(sizes), sizeof(sizes));
+        out.write(reinterpret_cast<const char*>(directory.data()), directory.size() * sizeof(PageID));
+        out.write(reinterpret_cast<const char*>(free_pages.data()), free_pages.size() * sizeof(PageID));
+    }
+
+    void print() {
+        std::cout << "Hash index :: global depth " << global_depth << ", "
+                  << bucket_pages->getNumPages() << " pages, " << num_entries << " entries\n";
+    }
+
+private:
+    // Read the directory and remove the sidecar until the next persist()
+    bool loadDirectory() {
+        std::string dir_filename = filename + ".dir";
+        std::ifstream in(dir_filename, std::ios::binary);
+        uint64_t sizes[4];
+        if (!in || !in.read(reinterpret_cast<char*>(sizes), sizeof(sizes))) {
+            return false;
+        }
+        global_depth = sizes[0];
+        num_entries = sizes[1];
+        directory.resize(sizes[2]);
+        free_pages.resize(sizes[3]);
+        in.read(reinterpret_cast<char*>(directory.data()), directory.size() * sizeof(PageID));
+        in.read(reinterpret_cast<char*>(free_pages.data()), free_pages.size() * sizeof(PageID));
+        bool complete = static_cast<bool>(in);
+        in.close();
+        std::remove(dir_filename.c_str());
+        return complete;
     }
+};
+
 
-    std::vector<std::unique_ptr<Field>> getOutput() override {
-        std::vector<std::unique_ptr<Field>> outputCopy;
+const std::string btree_index_filename = "buzzdb_btree.idx";
 
-        if (output_tuples_index == 0 || output_tuples_index > output_tuples.size()) {
-            // If there is no current tuple because next() hasn't been called yet or we're past the last tuple,
-            // return an empty vector.
-            return outputCopy; // This will be an empty vector
+constexpr size_t BTREE_PAGES_IN_MEMORY = 4096;
+
+// Disk-backed B+-tree from int keys to tuple ids. Nodes are pages in their
+// own file behind a BufferManager, page 0 holds the tree metadata. Entries
+// are ordered by (key, tuple id), so duplicate keys are adjacent entries
+// and every entry can be found exactly for removal. Leaves are chained
+// left to right for range scans. Removal does not rebalance.
+//
+// Readers (lookups, range iterators, estimates) run concurrently under a
+// shared tree latch and pin the node they are reading; writers take the
+// latch exclusively. An index that was not persisted on shutdown comes
+// back empty so the owner can rebuild it.
+class BTreeIndex {
+private:
+    struct Entry {
+        int32_t key;
+        uint32_t unused;
+        TupleID value;
+
+        bool operator<(const Entry& other) const {
+            return key < other.key || (key == other.key && value < other.value);
         }
+    };
+
+    struct NodeHeader {
+        uint16_t is_leaf;
+        uint16_t num_keys;
+        PageID next_leaf;   // Right sibling of a leaf or INVALID_PAGE_ID
+    };
+
+    struct Meta {
+        uint64_t magic;
+        uint64_t num_entries;
+        PageID root;
+        uint32_t height;    // Number of levels, 1 for a single leaf
+        uint32_t clean;     // Set by persist(), cleared while the index is open
+        uint32_t unused;
+    };
+
+    // Inner nodes: num_keys separators followed by num_keys + 1 children,
+    // separator i is the smallest entry below child i + 1
+    static constexpr size_t LEAF_CAPACITY = (PAGE_SIZE - sizeof(NodeHeader)) / sizeof(Entry);
+    static constexpr size_t INNER_CAPACITY =
+        (PAGE_SIZE - sizeof(NodeHeader) - sizeof(PageID)) / (sizeof(Entry) + sizeof(PageID));
+    static constexpr size_t CHILDREN_OFFSET = sizeof(NodeHeader) + INNER_CAPACITY * sizeof(Entry);
+    // Bulk loading leaves 10% free space for later inserts
+    static constexpr size_t LEAF_FILL = LEAF_CAPACITY * 9 / 10;
+    static constexpr size_t INNER_FILL = INNER_CAPACITY * 9 / 10;
+    static constexpr size_t PAGES_PER_IO = 256;
+    static constexpr uint64_t BTREE_MAGIC = 0x31305f4545525442ULL; // "BTREE_01"
+
+    struct Node {
+        NodeHeader* header;
+        Entry* entries;     // Leaf entries or inner separators
+        PageID* children;   // Inner nodes only
+    };
+
+    static Node nodeAt(char* data) {
+        return {reinterpret_cast<NodeHeader*>(data),
+                reinterpret_cast<Entry*>(data + sizeof(NodeHeader)),
+                reinterpret_cast<PageID*>(data + CHILDREN_OFFSET)};
+    }
 
-        // Assuming that output_tuples stores Tuple objects and each Tuple has a vector of Field objects or similar
-        const auto& currentTuple = output_tuples[output_tuples_index - 1]; // Adjust for 0-based indexing after increment in next()
+    // Keeps a node resident while a reader looks at it
+    class PinnedNode {
+        BTreeIndex& index;
+        PageID page_id;
 
-        // Assuming the Tuple class provides a way to access its fields, e.g., a method or a public member
-        for (const auto& field : currentTuple.fields) {
-            outputCopy.push_back(field->clone()); // Use the clone method to create a deep copy of each field
+    public:
+        Node node;
+
+        PinnedNode(BTreeIndex& index, PageID page_id) : index(index), page_id(page_id) {
+            std::lock_guard<std::mutex> guard(index.pool_latch);
+            node = nodeAt(index.node_pages->getPage(page_id)->page_data.get());
+            index.node_pages->pinPage(page_id);
+        }
+
+        ~PinnedNode() {
+            std::lock_guard<std::mutex> guard(index.pool_latch);
+            index.node_pages->unpinPage(page_id);
         }
+    };
 
-        return outputCopy;
+    std::string filename;
+    std::unique_ptr<BufferManager> node_pages;
+    std::shared_mutex tree_latch;
+    std::mutex pool_latch;      // The buffer manager is shared by all readers
+    PageID root = INVALID_PAGE_ID;
+    uint32_t height = 0;
+    size_t num_entries = 0;
+
+    // Writer access, the tree latch is held exclusively
+    Node node(PageID page_id) {
+        return nodeAt(node_pages->getPage(page_id)->page_data.get());
     }
 
-     double estimateCost(CostModel& costModel) override {
-        // Assume 10% of tuples form distinct groups. Again, this should be based on statistics in a real system.
-        size_t estimatedNumTuples = static_cast<size_t>(input->estimateCost(costModel));
-        return costModel.estimateHashAggregateCost(estimatedNumTuples, estimatedNumTuples / 10);
+    PageID allocateNode(bool leaf) {
+        node_pages->extend();
+        PageID page_id = node_pages->getNumPages() - 1;
+        Node n = node(page_id);
+        n.header->is_leaf = leaf;
+        n.header->num_keys = 0;
+        n.header->next_leaf = INVALID_PAGE_ID;
+        node_pages->markDirty(page_id);
+        return page_id;
     }
 
+    // Start over with an empty file: the metadata page and one empty leaf
+    void reset() {
+        node_pages.reset();
+        std::remove(filename.c_str());
+        node_pages = std::make_unique<BufferManager>(filename, BTREE_PAGES_IN_MEMORY);
+        root = allocateNode(true);
+        height = 1;
+        num_entries = 0;
+    }
 
-private:
+    void writeMeta(bool clean) {
+        Meta meta{BTREE_MAGIC, num_entries, root, height, clean, 0};
+        std::memcpy(node_pages->getPage(0)->page_data.get(), &meta, sizeof(meta));
+        node_pages->markDirty(0);
+        node_pages->flushPage(0);
+        node_pages->sync();
+    }
 
-    Field updateAggregate(const AggrFunc& aggrFunc, const Field& currentAggr, const Field& newValue) {
-        if (currentAggr.getType() != newValue.getType()) {
-            throw std::runtime_error("Mismatched Field types in aggregation.");
+    // Leaf that holds target, or would hold it. Caller holds the tree latch.
+    PageID findLeaf(const Entry& target) {
+        PageID page_id = root;
+        for (uint32_t level = height; level > 1; --level) {
+            PinnedNode pinned(*this, page_id);
+            const Node& n = pinned.node;
+            size_t child = std::upper_bound(n.entries, n.entries + n.header->num_keys, target) - n.entries;
+            page_id = n.children[child];
         }
+        return page_id;
+    }
 
-        switch (aggrFunc.func) {
-            case AggrFuncType::COUNT: {
-                if (currentAggr.getType() == FieldType::INT) {
-                    // For COUNT, simply increment the integer value
-                    int count = currentAggr.asInt() + 1;
-                    return Field(count);
-                }
-                break;
-            }
-            case AggrFuncType::SUM: {
-                if (currentAggr.getType() == FieldType::INT) {
-                    int sum = currentAggr.asInt() + newValue.asInt();
-                    return Field(sum);
-                } else if (currentAggr.getType() == FieldType::FLOAT) {
-                    float sum = currentAggr.asFloat() + newValue.asFloat();
-                    return Field(sum);
-                }
-                break;
-            }
-            case AggrFuncType::MAX: {
-                if (currentAggr.getType() == FieldType::INT) {
-                    int max = std::max(currentAggr.asInt(), newValue.asInt());
-                    return Field(max);
-                } else if (currentAggr.getType() == FieldType::FLOAT) {
-                    float max = std::max(currentAggr.asFloat(), newValue.asFloat());
-                    return Field(max);
-                }
-                break;
-            }
-            case AggrFuncType::MIN: {
-                if (currentAggr.getType() == FieldType::INT) {
-                    int min = std::min(currentAggr.asInt(), newValue.asInt());
-                    return Field(min);
-                } else if (currentAggr.getType() == FieldType::FLOAT) {
-                    float min = std::min(currentAggr.asFloat(), newValue.asFloat());
-                    return Field(min);
-                }
-                break;
+    // Fraction of all entries that sort before target, interpolated from
+    // the child positions along the search path
+    double rank(const Entry& target) {
+        double position = 0.0;
+        double width = 1.0;
+        PageID page_id = root;
+        for (uint32_t level = height; ; --level) {
+            PinnedNode pinned(*this, page_id);
+            const Node& n = pinned.node;
+            size_t count = n.header->num_keys;
+            if (level == 1) {
+                size_t index = std::lower_bound(n.entries, n.entries + count, target) - n.entries;
+                return count ? position + width * index / count : position;
             }
-            default:
-                throw std::runtime_error("Unsupported aggregation function.");
+            size_t child = std::upper_bound(n.entries, n.entries + count, target) - n.entries;
+            position += width * child / (count + 1);
+            width /= (count + 1);
+            page_id = n.children[child];
         }
+    }
 
-        // Default case for unsupported operations or types
-        throw std::runtime_error(
-            "Invalid operation or unsupported Field type.");
+    using Split = std::optional<std::pair<Entry, PageID>>;
+
+    // Insert below page_id, level 1 being the leaves. Returns the separator
+    // and page of the new right sibling if the node was split.
+    Split insertInto(PageID page_id, uint32_t level, const Entry& entry) {
+        if (level == 1) {
+            return insertIntoLeaf(page_id, entry);
+        }
+        Node n = node(page_id);
+        size_t child = std::upper_bound(n.entries, n.entries + n.header->num_keys, entry) - n.entries;
+        auto split = insertInto(n.children[child], level - 1, entry);
+        if (!split) {
+            return std::nullopt;
+        }
+        return insertIntoInner(page_id, child, split->first, split->second);
     }
 
-};
+    Split insertIntoLeaf(PageID page_id, const Entry& entry) {
+        Node n = node(page_id);
+        size_t count = n.header->num_keys;
+        size_t pos = std::lower_bound(n.entries, n.entries + count, entry) - n.entries;
+        if (count < LEAF_CAPACITY) {
+            std::copy_backward(n.entries + pos, n.entries + count, n.entries + count + 1);
+            n.entries[pos] = entry;
+            n.header->num_keys++;
+            node_pages->markDirty(page_id);
+            return std::nullopt;
+        }
 
-class JoinOrderOptimizer {
-public:
-    std::vector<size_t> optimizeJoinOrder(const std::vector<std::pair<size_t, size_t>>& joins, 
-                                          const std::vector<size_t>& tableSizes) {
-        std::vector<size_t> joinOrder;
-        std::vector<bool> joined(tableSizes.size(), false);
+        // The upper half moves to a new right sibling
+        std::vector<Entry> all(n.entries, n.entries + count);
+        all.insert(all.begin() + pos, entry);
+        size_t left_count = all.size() / 2;
+
+        PageID right_id = allocateNode(true);
+        Node right = node(right_id);
+        Node left = node(page_id);
+        right.header->num_keys = all.size() - left_count;
+        right.header->next_leaf = left.header->next_leaf;
+        std::copy(all.begin() + left_count, all.end(), right.entries);
+        left.header->num_keys = left_count;
+        left.header->next_leaf = right_id;
+        std::copy(all.begin(), all.begin() + left_count, left.entries);
+        node_pages->markDirty(page_id);
+        node_pages->markDirty(right_id);
+        return std::make_pair(all[left_count], right_id);
+    }
 
-        // Start with the smallest table
-        size_t smallestTable = std::min_element(tableSizes.begin(), tableSizes.end()) - tableSizes.begin();
-        joinOrder.push_back(smallestTable);
-        joined[smallestTable] = true;
+    Split insertIntoInner(PageID page_id, size_t child, const Entry& separator, PageID new_child) {
+        Node n = node(page_id);
+        size_t count = n.header->num_keys;
+        if (count < INNER_CAPACITY) {
+            std::copy_backward(n.entries + child, n.entries + count, n.entries + count + 1);
+            std::copy_backward(n.children + child + 1, n.children + count + 1, n.children + count + 2);
+            n.entries[child] = separator;
+            n.children[child + 1] = new_child;
+            n.header->num_keys++;
+            node_pages->markDirty(page_id);
+            return std::nullopt;
+        }
 
-        while (joinOrder.size() < tableSizes.size()) {
-            double bestCost = std::numeric_limits<double>::max();
-            size_t bestTable = -1;
+        std::vector<Entry> keys(n.entries, n.entries + count);
+        std::vector<PageID> children(n.children, n.children + count + 1);
+        keys.insert(keys.begin() + child, separator);
+        children.insert(children.begin() + child + 1, new_child);
+
+        // The middle separator moves up to the parent
+        size_t middle = keys.size() / 2;
+        PageID right_id = allocateNode(false);
+        Node right = node(right_id);
+        Node left = node(page_id);
+        right.header->num_keys = keys.size() - middle - 1;
+        std::copy(keys.begin() + middle + 1, keys.end(), right.entries);
+        std::copy(children.begin() + middle + 1, children.end(), right.children);
+        left.header->num_keys = middle;
+        std::copy(keys.begin(), keys.begin() + middle, left.entries);
+        std::copy(children.begin(), children.begin() + middle + 1, left.children);
+        node_pages->markDirty(page_id);
+        node_pages->markDirty(right_id);
+        return std::make_pair(keys[middle], right_id);
+    }
 
-            for (const auto& join : joins) {
-                size_t table1 = join.first;
-                size_t table2 = join.second;
-
-                if (joined[table1] && !joined[table2]) {
-                    double cost = estimateJoinCost(tableSizes[table1], tableSizes[table2]);
-                    if (cost < bestCost) {
-                        bestCost = cost;
-                        bestTable = table2;
-                    }
-                } else if (joined[table2] && !joined[table1]) {
-                    double cost = estimateJoinCost(tableSizes[table2], tableSizes[table1]);
-                    if (cost < bestCost) {
-                        bestCost = cost;
-                        bestTable = table1;
-                    }
+public:
+    // Iterates the entries with lowerBound <= key <= upperBound in order.
+    // Each leaf is copied under the shared latch, so writers may run
+    // between two leaves; entries inserted meanwhile may or may not show up.
+    class RangeIterator {
+    private:
+        BTreeIndex* index;
+        Entry lower;
+        int upper;
+        std::vector<Entry> buffered;
+        size_t position = 0;
+        PageID next_leaf = INVALID_PAGE_ID;
+        bool started = false;
+
+        // Copy the matching entries of a leaf, stop at the first key past upper
+        void loadLeaf(PageID page_id) {
+            PinnedNode pinned(*index, page_id);
+            const Node& n = pinned.node;
+            size_t count = n.header->num_keys;
+            buffered.clear();
+            position = 0;
+            next_leaf = n.header->next_leaf;
+            for (size_t i = std::lower_bound(n.entries, n.entries + count, lower) - n.entries; i < count; ++i) {
+                if (n.entries[i].key > upper) {
+                    next_leaf = INVALID_PAGE_ID;
+                    break;
                 }
+                buffered.push_back(n.entries[i]);
             }
+        }
 
-            if (bestTable != size_t(-1)) {
-                joinOrder.push_back(bestTable);
-                joined[bestTable] = true;
-            } else {
-                // If no join found, add the smallest unjoinedtable
-                auto it = std::find(joined.begin(), joined.end(), false);
-                if (it != joined.end()) {
-                    size_t index = std::distance(joined.begin(), it);
-                    joinOrder.push_back(index);
-                    joined[index] = true;
+    public:
+        RangeIterator(BTreeIndex& index, int lowerBound, int upperBound)
+            : index(&index), lower{lowerBound, 0, 0}, upper(upperBound) {}
+
+        bool next(int& key, TupleID& value) {
+            while (position == buffered.size()) {
+                if (started && next_leaf == INVALID_PAGE_ID) {
+                    return false;
                 }
+                std::shared_lock<std::shared_mutex> guard(index->tree_latch);
+                loadLeaf(started ? next_leaf : index->findLeaf(lower));
+                started = true;
             }
+            key = buffered[position].key;
+            value = buffered[position].value;
+            position++;
+            return true;
         }
+    };
 
-        return joinOrder;
+    BTreeIndex(const std::string& filename = btree_index_filename) : filename(filename) {
+        node_pages = std::make_unique<BufferManager>(filename, BTREE_PAGES_IN_MEMORY);
+        Meta meta;
+        std::memcpy(&meta, node_pages->getPage(0)->page_data.get(), sizeof(meta));
+        if (meta.magic == BTREE_MAGIC && meta.clean) {
+            root = meta.root;
+            height = meta.height;
+            num_entries = meta.num_entries;
+        } else {
+            reset();
+        }
+        // Until the next persist() the file does not describe a valid tree
+        writeMeta(false);
     }
 
-private:
-    double estimateJoinCost(size_t size1, size_t size2) {
-        // Simple cost model: larger tables are more expensive to join
-        return static_cast<double>(size1 * size2);
+    ~BTreeIndex() {
+        persist();
     }
-};
-
-struct QueryComponents {
-    std::vector<int> selectAttributes;
-    bool sumOperation = false;
-    int sumAttributeIndex = -1;
-    bool groupBy = false;
-    int groupByAttributeIndex = -1;
-    bool whereCondition = false;
-    int whereAttributeIndex = -1;
-    int lowerBound = std::numeric_limits<int>::min();
-    int upperBound = std::numeric_limits<int>::max();
-};
 
-QueryComponents parseQuery(const std::string& query) {
-    QueryComponents components;
+    void insert(int key, TupleID value) {
+        std::unique_lock<std::shared_mutex> guard(tree_latch);
+        auto split = insertInto(root, height, Entry{key, 0, value});
+        if (split) {
+            // Grow a new root above the old one
+            PageID new_root = allocateNode(false);
+            Node n = node(new_root);
+            n.header->num_keys = 1;
+            n.entries[0] = split->first;
+            n.children[0] = root;
+            n.children[1] = split->second;
+            root = new_root;
+            height++;
+        }
+        num_entries++;
+    }
 
-    // Parse selected attributes
-    std::regex selectRegex("\\{(\\d+)\\}(, \\{(\\d+)\\})?");
-    std::smatch selectMatches;
-    std::string::const_iterator queryStart(query.cbegin());
-    while (std::regex_search(queryStart, query.cend(), selectMatches, selectRegex)) {
-        for (size_t i = 1; i < selectMatches.size(); i += 2) {
-            if (!selectMatches[i].str().empty()) {
-                components.selectAttributes.push_back(std::stoi(selectMatches[i]) - 1);
-            }
-        }
-        queryStart = selectMatches.suffix().first;
-    }
-
-    // Check for SUM operation
-    std::regex sumRegex("SUM\\{(\\d+)\\}");
-    std::smatch sumMatches;
-    if (std::regex_search(query, sumMatches, sumRegex)) {
-        components.sumOperation = true;
-        components.sumAttributeIndex = std::stoi(sumMatches[1]) - 1;
-    }
-
-    // Check for GROUP BY clause
-    std::regex groupByRegex("GROUP BY \\{(\\d+)\\}");
-    std::smatch groupByMatches;
-    if (std::regex_search(query, groupByMatches, groupByRegex)) {
-        components.groupBy = true;
-        components.groupByAttributeIndex = std::stoi(groupByMatches[1]) - 1;
-    }
-
-    // Extract WHERE conditions more accurately
-    std::regex whereRegex("\\{(\\d+)\\} > (\\d+) and \\{(\\d+)\\} < (\\d+)");
-    std::smatch whereMatches;
-    if (std::regex_search(query, whereMatches, whereRegex)) {
-        components.whereCondition = true;
-        // Correctly identify the attribute index for the WHERE condition
-        components.whereAttributeIndex = std::stoi(whereMatches[1]) - 1;
-        components.lowerBound = std::stoi(whereMatches[2]);
-        // Ensure the same attribute is used for both conditions
-        if (std::stoi(whereMatches[3]) - 1 == components.whereAttributeIndex) {
-            components.upperBound = std::stoi(whereMatches[4]);
-        } else {
-            std::cerr << "Error: WHERE clause conditions apply to different attributes." << std::endl;
-            // Handle error or set components.whereCondition = false;
+    // Remove one (key, value) entry, returns false if it was not found
+    bool remove(int key, TupleID value) {
+        std::unique_lock<std::shared_mutex> guard(tree_latch);
+        Entry target{key, 0, value};
+        PageID page_id = root;
+        for (uint32_t level = height; level > 1; --level) {
+            Node n = node(page_id);
+            page_id = n.children[std::upper_bound(n.entries, n.entries + n.header->num_keys, target) - n.entries];
+        }
+        Node leaf = node(page_id);
+        size_t count = leaf.header->num_keys;
+        size_t pos = std::lower_bound(leaf.entries, leaf.entries + count, target) - leaf.entries;
+        if (pos == count || leaf.entries[pos].key != key || leaf.entries[pos].value != value) {
+            return false;
         }
+        std::copy(leaf.entries + pos + 1, leaf.entries + count, leaf.entries + pos);
+        leaf.header->num_keys--;
+        node_pages->markDirty(page_id);
+        num_entries--;
+        return true;
     }
 
-    return components;
-}
+    // Build the tree bottom-up from entries sorted by (key, value). Nodes
+    // are written level by level with large sequential writes. A non-empty
+    // tree falls back to single inserts.
+    void bulkLoad(const std::vector<std::pair<int, TupleID>>& sorted) {
+        if (size() > 0) {
+            for (const auto& [key, value] : sorted) {
+                insert(key, value);
+            }
+            return;
+        }
 
-class MaterializedView {
-private:
-    std::string viewName;
-    std::string viewDefinition;
-    std::vector<std::unique_ptr<Tuple>> viewData;
+        std::unique_lock<std::shared_mutex> guard(tree_latch);
+        node_pages.reset();
+        std::remove(filename.c_str());
+        node_pages = std::make_unique<BufferManager>(filename, BTREE_PAGES_IN_MEMORY);
+
+        std::vector<char> pages(PAGES_PER_IO * PAGE_SIZE);
+        size_t num_buffered = 0;
+        auto newPage = [&]() {
+            if (num_buffered == PAGES_PER_IO) {
+                node_pages->appendPages(pages.data(), num_buffered);
+                num_buffered = 0;
+            }
+            char* data = pages.data() + num_buffered++ * PAGE_SIZE;
+            std::memset(data, 0, PAGE_SIZE);
+            return nodeAt(data);
+        };
 
-public:
-    MaterializedView(const std::string& name, const std::string& definition)
-        : viewName(name), viewDefinition(definition) {}
+        // Leaves, remembering the first entry and page of each
+        std::vector<Entry> first_entries;
+        std::vector<PageID> level_pages;
+        size_t num_leaves = std::max<size_t>(1, (sorted.size() + LEAF_FILL - 1) / LEAF_FILL);
+        PageID first_page = node_pages->getNumPages();
+        for (size_t leaf = 0; leaf < num_leaves; ++leaf) {
+            Node n = newPage();
+            size_t begin = leaf * LEAF_FILL;
+            size_t end = std::min(sorted.size(), begin + LEAF_FILL);
+            n.header->is_leaf = 1;
+            n.header->num_keys = end - begin;
+            n.header->next_leaf = (leaf + 1 < num_leaves) ? first_page + leaf + 1 : INVALID_PAGE_ID;
+            for (size_t i = begin; i < end; ++i) {
+                n.entries[i - begin] = Entry{sorted[i].first, 0, sorted[i].second};
+            }
+            first_entries.push_back(n.entries[0]);
+            level_pages.push_back(first_page + leaf);
+        }
+        node_pages->appendPages(pages.data(), num_buffered);
+        num_buffered = 0;
+        height = 1;
+
+        // Inner levels until a single root is left
+        while (level_pages.size() > 1) {
+            size_t num_nodes = (level_pages.size() + INNER_FILL) / (INNER_FILL + 1);
+            size_t per_node = (level_pages.size() + num_nodes - 1) / num_nodes;
+            std::vector<Entry> parent_entries;
+            std::vector<PageID> parent_pages;
+            first_page = node_pages->getNumPages();
+            for (size_t begin = 0; begin < level_pages.size(); begin += per_node) {
+                size_t end = std::min(level_pages.size(), begin + per_node);
+                Node n = newPage();
+                n.header->num_keys = end - begin - 1;
+                n.header->next_leaf = INVALID_PAGE_ID;
+                for (size_t i = begin; i < end; ++i) {
+                    n.children[i - begin] = level_pages[i];
+                    if (i > begin) {
+                        n.entries[i - begin - 1] = first_entries[i];
+                    }
+                }
+                parent_entries.push_back(first_entries[begin]);
+                parent_pages.push_back(first_page + parent_pages.size());
+            }
+            node_pages->appendPages(pages.data(), num_buffered);
+            num_buffered = 0;
+            first_entries = std::move(parent_entries);
+            level_pages = std::move(parent_pages);
+            height++;
+        }
 
-    void refresh(BufferManager& bufferManager) {
-        // Parse the view definition and execute the query
-        auto components = parseQuery(viewDefinition);
-        
-        // Clear existing data
-        viewData.clear();
+        root = level_pages[0];
+        num_entries = sorted.size();
+        writeMeta(false);
+    }
 
-        // Execute the query and store results
-        ScanOperator scanOp(bufferManager);
-        Operator* rootOp = &scanOp;
+    RangeIterator scan(int lowerBound, int upperBound) {
+        return RangeIterator(*this, lowerBound, upperBound);
+    }
 
-        // Apply operations based on query components
-        // ... (similar to executeQuery function)
+    // All values stored under key
+    std::vector<TupleID> getValues(int key) {
+        return rangeQuery(key, key);
+    }
 
-        rootOp->open();
-        while (rootOp->next()) {
-            auto output = rootOp->getOutput();
-            auto tuple = std::make_unique<Tuple>();
-            for (auto& field : output) {
-                tuple->addField(std::move(field));
-            }
-            viewData.push_back(std::move(tuple));
+    // Values of all keys in [lowerBound, upperBound], in key order
+    std::vector<TupleID> rangeQuery(int lowerBound, int upperBound) {
+        std::vector<TupleID> values;
+        auto iterator = scan(lowerBound, upperBound);
+        int key;
+        TupleID value;
+        while (iterator.next(key, value)) {
+            values.push_back(value);
         }
-        rootOp->close();
+        return values;
     }
 
-    const std::vector<std::unique_ptr<Tuple>>& getData() const {
-        return viewData;
+    // Estimated number of entries in [lowerBound, upperBound], from two
+    // root-to-leaf descents
+    size_t estimateRangeCount(int lowerBound, int upperBound) {
+        if (lowerBound > upperBound) {
+            return 0;
+        }
+        std::shared_lock<std::shared_mutex> guard(tree_latch);
+        double start = rank(Entry{lowerBound, 0, 0});
+        double end = (upperBound == std::numeric_limits<int>::max()) ? 1.0 : rank(Entry{upperBound + 1, 0, 0});
+        return static_cast<size_t>((end - start) * num_entries + 0.5);
     }
 
-    const std::string& getName() const {
-        return viewName;
+    size_t size() const {
+        return num_entries;
     }
-};
 
-class MaterializedViewManager {
-private:
-    std::unordered_map<std::string, std::unique_ptr<MaterializedView>> views;
-    BufferManager& bufferManager;
+    uint32_t getHeight() const {
+        return height;
+    }
 
-public:
-    MaterializedViewManager(BufferManager& bm) : bufferManager(bm) {}
+    // Pages a range scan over numEntries entries reads: one descent and
+    // the leaves, assuming bulk loaded leaves
+    size_t estimateIndexPages(size_t numEntries) const {
+        return height + numEntries / LEAF_FILL;
+    }
 
-    void createView(const std::string& name, const std::string& definition) {
-        auto view = std::make_unique<MaterializedView>(name, definition);
-        view->refresh(bufferManager);
-        views[name] = std::move(view);
+    // Drop every entry, e.g. before a rebuild
+    void clear() {
+        std::unique_lock<std::shared_mutex> guard(tree_latch);
+        reset();
+        writeMeta(false);
     }
 
-    void refreshView(const std::string& name) {
-        auto it = views.find(name);
-        if (it != views.end()) {
-            it->second->refresh(bufferManager);
-        }
+    // Write all nodes, then mark the metadata clean
+    void persist() {
+        std::unique_lock<std::shared_mutex> guard(tree_latch);
+        node_pages->flushAll();
+        node_pages->sync();
+        writeMeta(true);
     }
 
-    const MaterializedView* getView(const std::string& name) const {
-        auto it = views.find(name);
-        return (it != views.end()) ? it->second.get() : nullptr;
+    void print() {
+        std::cout << "B+-tree index :: height " << height << ", "
+                  << node_pages->getNumPages() << " pages, " << num_entries << " entries\n";
     }
 };
 
+// Read-optimized secondary index on an int column. The (key, tuple id)
+// entries are kept in sorted arrays and a linear model fitted at build
+// time predicts the position of a key. The build also records the largest
+// prediction error over all possible keys, which bounds the last-mile
+// binary search. Inserts and deletes go to a delta that is merged in once
+// it outgrows 1/16 of the index. The index lives in memory and is built
+// from the B+-tree on startup.
+class LearnedIndex {
+private:
+    static constexpr size_t MIN_MERGE_THRESHOLD = 1024;
 
-void prettyPrint(const QueryComponents& components) {
-    std::cout << "Query Components:\n";
-    std::cout << "  Selected Attributes: ";
-    for (auto attr : components.selectAttributes) {
-        std::cout << "{" << attr + 1 << "} "; // Convert back to 1-based indexing for display
+    using Entry = std::pair<int, TupleID>;
+
+    std::vector<int> keys;
+    std::vector<TupleID> values;        // Sorted within each key
+    double slope = 0.0;
+    double intercept = 0.0;
+    double max_error = 0.0;
+    std::set<Entry> inserted;           // Not merged yet
+    std::set<Entry> deleted;            // Tombstones for merged entries
+
+    double predict(int key) const {
+        return slope * key + intercept;
     }
-    std::cout << "\n  SUM Operation: " << (components.sumOperation ? "Yes" : "No");
-    if (components.sumOperation) {
-        std::cout << " on {" << components.sumAttributeIndex + 1 << "}";
+
+    // Least squares fit of position over key, then the error bound: any
+    // key in a gap between stored keys errs at most as much as its ends
+    void fit() {
+        size_t n = keys.size();
+        slope = 0.0;
+        intercept = 0.0;
+        max_error = 0.0;
+        if (n == 0) {
+            return;
+        }
+
+        double mean_key = 0.0;
+        for (int key : keys) {
+            mean_key += key;
+        }
+        mean_key /= n;
+        double mean_position = (n - 1) / 2.0;
+        double covariance = 0.0, variance = 0.0;
+        for (size_t i = 0; i < n; ++i) {
+            double delta = keys[i] - mean_key;
+            covariance += delta * (i - mean_position);
+            variance += delta * delta;
+        }
+        if (variance > 0) {
+            slope = covariance / variance;
+        }
+        intercept = mean_position - slope * mean_key;
+
+        for (size_t i = 0; i < n; ++i) {
+            if (i > 0 && keys[i] == keys[i - 1]) {
+                continue;
+            }
+            max_error = std::max(max_error, std::abs(predict(keys[i]) - i));
+            if (i > 0) {
+                max_error = std::max(max_error, std::abs(predict(keys[i - 1] + 1) - i));
+            }
+        }
     }
-    std::cout << "\n  GROUP BY: " << (components.groupBy ? "Yes" : "No");
-    if (components.groupBy) {
-        std::cout << " on {" << components.groupByAttributeIndex + 1 << "}";
+
+    // Position of the first key > upperBound, galloping forward from a
+    // position at or before it as most ranges are short
+    size_t endPosition(size_t first, int upperBound) const {
+        size_t low = first, high = first, step = 1;
+        while (high < keys.size() && keys[high] <= upperBound) {
+            low = high + 1;
+            high = first + step;
+            step *= 2;
+        }
+        high = std::min(high, keys.size());
+        return std::upper_bound(keys.begin() + low, keys.begin() + high, upperBound) - keys.begin();
     }
-    std::cout << "\n  WHERE Condition: " << (components.whereCondition ? "Yes" : "No");
-    if (components.whereCondition) {
-        std::cout << " on {" << components.whereAttributeIndex + 1 << "} > " << components.lowerBound << " and < " << components.upperBound;
+
+    void maybeMerge() {
+        if (inserted.size() + deleted.size() > std::max(MIN_MERGE_THRESHOLD, keys.size() / 16)) {
+            merge();
+        }
     }
-    std::cout << std::endl;
-}
 
-void executeQuery(const QueryComponents& components, 
-                  BufferManager& buffer_manager) {
-    // Stack allocation of ScanOperator
-    ScanOperator scanOp(buffer_manager);
+    void merge() {
+        std::vector<int> merged_keys;
+        std::vector<TupleID> merged_values;
+        merged_keys.reserve(keys.size() + inserted.size());
+        merged_values.reserve(keys.size() + inserted.size());
+        auto delta = inserted.begin();
+        for (size_t i = 0; i <= keys.size(); ++i) {
+            while (delta != inserted.end() && (i == keys.size() || *delta < Entry(keys[i], values[i]))) {
+                merged_keys.push_back(delta->first);
+                merged_values.push_back(delta->second);
+                ++delta;
+            }
+            if (i < keys.size() && !deleted.count(Entry(keys[i], values[i]))) {
+                merged_keys.push_back(keys[i]);
+                merged_values.push_back(values[i]);
+            }
+        }
+        keys = std::move(merged_keys);
+        values = std::move(merged_values);
+        inserted.clear();
+        deleted.clear();
+        fit();
+    }
 
-    // Using a pointer to Operator to handle polymorphism
-    Operator* rootOp = &scanOp;
+public:
+    // Iterates the entries with lowerBound <= key <= upperBound in order,
+    // merging the sorted arrays with the delta
+    class RangeIterator {
+    private:
+        const LearnedIndex* index;
+        size_t position;
+        size_t end;
+        std::set<Entry>::const_iterator delta;
+        std::set<Entry>::const_iterator delta_end;
 
-    // Buffer for optional operators to ensure lifetime
-    std::optional<SelectOperator> selectOpBuffer;
-    std::optional<HashAggregationOperator> hashAggOpBuffer;
+    public:
+        RangeIterator(const LearnedIndex& index, int lowerBound, int upperBound)
+            : index(&index),
+              position(index.lowerBound(lowerBound)),
+              end(index.endPosition(position, upperBound)),
+              delta(index.inserted.lower_bound(Entry(lowerBound, 0))),
+              delta_end(upperBound == std::numeric_limits<int>::max()
+                            ? index.inserted.end()
+                            : index.inserted.lower_bound(Entry(upperBound + 1, 0))) {
+            if (lowerBound > upperBound) {
+                end = position;
+                delta_end = delta;
+            }
+        }
 
-    // Apply WHERE conditions
-    if (components.whereAttributeIndex != -1) {
-        // Create simple predicates with comparison operators
-        auto predicate1 = std::make_unique<SimplePredicate>(
-            SimplePredicate::Operand(components.whereAttributeIndex),
-            SimplePredicate::Operand(std::make_unique<Field>(components.lowerBound)),
-            SimplePredicate::ComparisonOperator::GT
-        );
-
-        auto predicate2 = std::make_unique<SimplePredicate>(
-            SimplePredicate::Operand(components.whereAttributeIndex),
-            SimplePredicate::Operand(std::make_unique<Field>(components.upperBound)),
-            SimplePredicate::ComparisonOperator::LT
-        );
-
-        // Combine simple predicates into a complex predicate with logical AND operator
-        auto complexPredicate = std::make_unique<ComplexPredicate>(ComplexPredicate::LogicOperator::AND);
-        complexPredicate->addPredicate(std::move(predicate1));
-        complexPredicate->addPredicate(std::move(predicate2));
+        bool next(int& key, TupleID& value) {
+            while (position < end || delta != delta_end) {
+                if (delta != delta_end &&
+                    (position == end || *delta < Entry(index->keys[position], index->values[position]))) {
+                    key = delta->first;
+                    value = delta->second;
+                    ++delta;
+                    return true;
+                }
+                key = index->keys[position];
+                value = index->values[position];
+                position++;
+                if (index->deleted.empty() || !index->deleted.count(Entry(key, value))) {
+                    return true;
+                }
+            }
+            return false;
+        }
+    };
 
-        // Using std::optional to manage the lifetime of SelectOperator
-        selectOpBuffer.emplace(*rootOp, std::move(complexPredicate));
-        rootOp = &*selectOpBuffer;
+    // Build from entries sorted by (key, value), e.g. a B+-tree scan
+    void build(const std::vector<Entry>& sorted) {
+        keys.resize(sorted.size());
+        values.resize(sorted.size());
+        for (size_t i = 0; i < sorted.size(); ++i) {
+            keys[i] = sorted[i].first;
+            values[i] = sorted[i].second;
+        }
+        inserted.clear();
+        deleted.clear();
+        fit();
     }
 
-    // Apply SUM or GROUP BY operation
-    if (components.sumOperation || components.groupBy) {
-        std::vector<size_t> groupByAttrs;
-        if (components.groupBy) {
-            groupByAttrs.push_back(static_cast<size_t>(components.groupByAttributeIndex));
+    void insert(int key, TupleID value) {
+        if (!deleted.erase(Entry(key, value))) {
+            inserted.insert(Entry(key, value));
         }
-        std::vector<AggrFunc> aggrFuncs{
-            {AggrFuncType::SUM, static_cast<size_t>(components.sumAttributeIndex)}
-        };
-
-        // Using std::optional to manage the lifetime of HashAggregationOperator
-        hashAggOpBuffer.emplace(*rootOp, groupByAttrs, aggrFuncs);
-        rootOp = &*hashAggOpBuffer;
+        maybeMerge();
     }
 
-    // Execute the Root Operator
-    rootOp->open();
-    while (rootOp->next()) {
-        // Retrieve and print the current tuple
-        const auto& output = rootOp->getOutput();
-        for (const auto& field : output) {
-            field->print();
-            std::cout << " ";
+    // Remove one (key, value) entry, returns false if it was not found
+    bool remove(int key, TupleID value) {
+        if (inserted.erase(Entry(key, value))) {
+            return true;
         }
-        std::cout << std::endl;
+        size_t first = lowerBound(key);
+        size_t last = endPosition(first, key);
+        auto it = std::lower_bound(values.begin() + first, values.begin() + last, value);
+        if (it == values.begin() + last || *it != value || !deleted.insert(Entry(key, value)).second) {
+            return false;
+        }
+        maybeMerge();
+        return true;
     }
-    rootOp->close();
-}
-
-class InsertOperator : public Operator {
-private:
-    BufferManager& bufferManager;
-    std::unique_ptr<Tuple> tupleToInsert;
-
-public:
-    InsertOperator(BufferManager& manager) : bufferManager(manager) {}
 
-    // Set the tuple to be inserted by this operator.
-    void setTupleToInsert(std::unique_ptr<Tuple> tuple) {
-        tupleToInsert = std::move(tuple);
+    // Position in the sorted arrays of the first entry with a key >= key
+    size_t lowerBound(int key) const {
+        if (keys.empty() || key <= keys.front()) {
+            return 0;
+        }
+        if (key > keys.back()) {
+            return keys.size();
+        }
+        // One position of slack on each side for rounding
+        double predicted = predict(key);
+        double first = std::max(0.0, std::floor(predicted - max_error) - 1);
+        double last = std::max(0.0, std::ceil(predicted + max_error) + 2);
+        auto begin = keys.begin() + std::min(static_cast<size_t>(first), keys.size());
+        auto end = keys.begin() + std::min(static_cast<size_t>(last), keys.size());
+        return std::lower_bound(begin, end, key) - keys.begin();
     }
 
-    void open() override {
-        // Not used in this context
+    RangeIterator scan(int lowerBound, int upperBound) const {
+        return RangeIterator(*this, lowerBound, upperBound);
     }
 
-    bool next() override {
-        if (!tupleToInsert) return false; // No tuple to insert
+    // All values stored under key
+    std::vector<TupleID> getValues(int key) const {
+        return rangeQuery(key, key);
+    }
 
-        for (size_t pageId = 0; pageId < bufferManager.getNumPages(); ++pageId) {
-            auto& page = bufferManager.getPage(pageId);
-            // Attempt to insert the tuple
-            if (page->addTuple(tupleToInsert->clone())) { 
-                // Flush the page to disk after insertion
-                bufferManager.flushPage(pageId); 
-                return true; // Insertion successful
+    // Values of all keys in [lowerBound, upperBound], in key order
+    std::vector<TupleID> rangeQuery(int lowerBound, int upperBound) const {
+        if (inserted.empty() && deleted.empty()) {
+            // No delta, the answer is a slice of the sorted arrays
+            if (lowerBound > upperBound) {
+                return {};
             }
+            size_t first = this->lowerBound(lowerBound);
+            size_t last = endPosition(first, upperBound);
+            return std::vector<TupleID>(values.begin() + first, values.begin() + last);
+        }
+        std::vector<TupleID> result;
+        auto iterator = scan(lowerBound, upperBound);
+        int key;
+        TupleID value;
+        while (iterator.next(key, value)) {
+            result.push_back(value);
         }
+        return result;
+    }
 
-        // If insertion failed in all existing pages, extend the database and try again
-        bufferManager.extend();
-        auto& newPage = bufferManager.getPage(bufferManager.getNumPages() - 1);
-        if (newPage->addTuple(tupleToInsert->clone())) {
-            bufferManager.flushPage(bufferManager.getNumPages() - 1);
-            return true; // Insertion successful after extending the database
+    // Exact up to pending deletes: two searches plus the delta range
+    size_t estimateRangeCount(int lowerBound, int upperBound) const {
+        if (lowerBound > upperBound) {
+            return 0;
         }
+        size_t first = this->lowerBound(lowerBound);
+        size_t count = endPosition(first, upperBound) - first;
+        auto delta_end = (upperBound == std::numeric_limits<int>::max())
+                             ? inserted.end()
+                             : inserted.lower_bound(Entry(upperBound + 1, 0));
+        return count + std::distance(inserted.lower_bound(Entry(lowerBound, 0)), delta_end);
+    }
 
-        return false; // Insertion failed even after extending the database
+    // The index is memory resident, a lookup reads no pages
+    size_t estimateIndexPages(size_t numEntries) const {
+        (void)numEntries;
+        return 0;
     }
 
-    void close() override {
-        // Not used in this context
+    size_t size() const {
+        return keys.size() + inserted.size() - deleted.size();
     }
 
-    std::vector<std::unique_ptr<Field>> getOutput() override {
-        return {}; // Return empty vector
+    double getMaxError() const {
+        return max_error;
     }
 
-    double estimateCost(CostModel& costModel) override {
-        // Placeholder logic
-        return 1.0;
+    void print() const {
+        std::cout << "Learned index :: " << size() << " entries, position = " << slope << " * key + "
+                  << intercept << ", max error " << max_error << "\n";
     }
 };
 
-class DeleteOperator : public Operator {
+// Values low <= v < high of an attribute. An INT value v counts as the
+// interval [v, v + 1), so ranges over integers come out exact.
+constexpr size_t HISTOGRAM_BUCKETS = 64;
+constexpr size_t DISTINCT_SKETCH_BITS = 10;     // 1024 HyperLogLog registers
+
+// Statistics of one attribute: min/max, an equi-width histogram of the
+// values (INT and FLOAT) and a HyperLogLog sketch of the distinct values.
+// The histogram covers [min, max] as of layoutHistogram(); values added
+// later outside that range are counted in the first or last bucket.
+class ColumnStatistics {
 private:
-    BufferManager& bufferManager;
-    size_t pageId;
-    size_t tupleId;
+    std::vector<double> buckets;
+    double histogram_low = 0.0;
+    double bucket_width = 1.0;
+    double histogram_rows = 0.0;
+    std::vector<uint8_t> registers = std::vector<uint8_t>(size_t(1) << DISTINCT_SKETCH_BITS);
+
+    size_t bucketOf(double value) const {
+        double position = std::floor((value - histogram_low) / bucket_width);
+        return static_cast<size_t>(std::clamp(position, 0.0, static_cast<double>(buckets.size() - 1)));
+    }
+
+    // Fraction of the histogrammed values below x, uniform within a bucket
+    double fractionBelow(double x) const {
+        double position = (x - histogram_low) / bucket_width;
+        if (position <= 0) {
+            return 0.0;
+        }
+        if (position >= buckets.size()) {
+            return 1.0;
+        }
+        size_t bucket = static_cast<size_t>(position);
+        double below = buckets[bucket] * (position - bucket);
+        for (size_t i = 0; i < bucket; ++i) {
+            below += buckets[i];
+        }
+        return below / histogram_rows;
+    }
 
 public:
-    DeleteOperator(BufferManager& manager, size_t pageId, size_t tupleId) 
-        : bufferManager(manager), pageId(pageId), tupleId(tupleId) {}
+    FieldType type = INT;
+    double min = std::numeric_limits<double>::infinity();
+    double max = -std::numeric_limits<double>::infinity();
+
+    static double numericValue(const Field& field) {
+        switch (field.getType()) {
+            case FLOAT: return field.asFloat();
+            case BIGINT: return static_cast<double>(field.asBigInt());
+            default: return field.asInt();
+        }
+    }
 
-    void open() override {
-        // Not used in this context
+    static uint64_t hashValue(int value) {
+        return hashInt(value);
+    }
+    static uint64_t hashValue(float value) {
+        uint32_t bits;
+        std::memcpy(&bits, &value, sizeof(bits));
+        return hashInt(static_cast<int>(bits));
+    }
+    static uint64_t hashValue(std::string_view value) {
+        uint64_t hash = std::hash<std::string_view>()(value);
+        return hashInt(static_cast<int>(hash)) ^ (hash >> 32);
+    }
+    static uint64_t hashValue(int64_t value) {
+        return hashValue(std::string_view(reinterpret_cast<const char*>(&value), sizeof(value)));
+    }
+    static uint64_t hashValue(const Field& field) {
+        switch (field.getType()) {
+            case INT: return hashValue(field.asInt());
+            case FLOAT: return hashValue(field.asFloat());
+            case STRING: return hashValue(std::string_view(field.data.get(), field.data_length - 1));
+            case BIGINT: return hashValue(field.asBigInt());
+        }
+        return 0;
     }
 
-    bool next() override {
-        auto& page = bufferManager.getPage(pageId);
-        if (!page) {
-            std::cerr << "Page not found." << std::endl;
-            return false;
+    // Widen min/max and add the value to the distinct sketch
+    void observe(double value, uint64_t hash) {
+        if (type != STRING) {
+            min = std::min(min, value);
+            max = std::max(max, value);
         }
+        size_t index = hash >> (64 - DISTINCT_SKETCH_BITS);
+        uint64_t rest = hash << DISTINCT_SKETCH_BITS;
+        uint8_t rank = rest ? __builtin_clzll(rest) + 1 : 64 - DISTINCT_SKETCH_BITS + 1;
+        registers[index] = std::max(registers[index], rank);
+    }
 
-        page->deleteTuple(tupleId); // Perform deletion
-        bufferManager.flushPage(pageId); // Flush the page to disk after deletion
-        return true;
+    // Size the histogram buckets to [min, max]; integer buckets for INT
+    void layoutHistogram() {
+        buckets.clear();
+        histogram_rows = 0.0;
+        if (type == STRING || min > max) {
+            return;
+        }
+        histogram_low = min;
+        if (type == INT) {
+            double span = max + 1 - min;
+            bucket_width = std::max(1.0, std::ceil(span / HISTOGRAM_BUCKETS));
+            buckets.resize(static_cast<size_t>(std::ceil(span / bucket_width)));
+        } else {
+            bucket_width = (max > min) ? (max - min) / HISTOGRAM_BUCKETS : 1.0;
+            buckets.resize(HISTOGRAM_BUCKETS);
+        }
     }
 
-    void close() override {
-        // Not used in this context
+    // Count a value in (sign 1) or out of (sign -1) the histogram
+    void count(double value, int sign) {
+        if (buckets.empty()) {
+            return;
+        }
+        buckets[bucketOf(value)] += sign;
+        histogram_rows += sign;
     }
 
-    std::vector<std::unique_ptr<Field>> getOutput() override {
-        return {}; // Return empty vector
+    double estimateDistinct() const {
+        const double m = static_cast<double>(registers.size());
+        double sum = 0.0;
+        size_t zeros = 0;
+        for (uint8_t rank : registers) {
+            sum += std::ldexp(1.0, -rank);
+            zeros += (rank == 0);
+        }
+        double estimate = 0.7213 / (1 + 1.079 / m) * m * m / sum;
+        if (estimate <= 2.5 * m && zeros > 0) {
+            estimate = m * std::log(m / zeros);    // Linear counting for small sets
+        }
+        return estimate;
     }
 
-    double estimateCost(CostModel& costModel) override {
-        // Placeholder logic
-        return 1.0;
+    // Fraction of the values in range, or -1 without a histogram
+    double estimateFraction(const ValueRange& range) const {
+        if (buckets.empty() || histogram_rows <= 0) {
+            return -1.0;
+        }
+        return std::max(0.0, fractionBelow(range.high) - fractionBelow(range.low));
     }
 };
 
-class BuzzDB {
-public:
-    HashIndex hash_index;
-    BufferManager buffer_manager;
-    CostModel cost_model;
-    JoinOrderOptimizer join_optimizer;
-    MaterializedViewManager view_manager;
+// A uniform sample without replacement of a changing set of rows. Inserts
+// go through reservoir sampling; after deletes, random pairing (Gemulla
+// et al.) lets each insert take the place of a deleted row, in the sample
+// if the deleted row was, so the sample stays uniform. Rows are stored
+// serialized in the page format.
+class Reservoir {
+private:
+    size_t capacity;
+    size_t population = 0;
+    std::vector<std::string> rows;
+    std::vector<uint64_t> hashes;       // Of rows, to find deleted ones
+    // Deletes not paired with an insert yet, of sampled and other rows
+    size_t deleted_in = 0;
+    size_t deleted_out = 0;
 
 public:
-    size_t max_number_of_tuples = 5000;
-    size_t tuple_insertion_attempt_counter = 0;
-
-    BuzzDB() : view_manager(buffer_manager) {
-        // Initialize materialized views
-        view_manager.createView("sum_by_key", "SUM{2} GROUP BY {1}");
+    explicit Reservoir(size_t capacity) : capacity(capacity) {}
+
+    // Count a new row; serialize() gives it if the sample takes it
+    template <typename Serialize>
+    void insert(std::mt19937_64& random, Serialize&& serialize) {
+        population++;
+        size_t slot = rows.size();
+        if (deleted_in + deleted_out > 0) {
+            if (random() % (deleted_in + deleted_out) >= deleted_in) {
+                deleted_out--;
+                return;
+            }
+            deleted_in--;
+        } else if (rows.size() == capacity) {
+            slot = random() % population;
+            if (slot >= capacity) {
+                return;
+            }
+        }
+        std::string row = serialize();
+        uint64_t hash = std::hash<std::string>()(row);
+        if (slot == rows.size()) {
+            rows.push_back(std::move(row));
+            hashes.push_back(hash);
+        } else {
+            rows[slot] = std::move(row);
+            hashes[slot] = hash;
+        }
     }
 
-    // insert function
-    void insert(int key, int value) {
-        tuple_insertion_attempt_counter += 1;
-
-        // Create a new tuple with the given key and value
-        auto newTuple = std::make_unique<Tuple>();
-
-        auto key_field = std::make_unique<Field>(key);
-        auto value_field = std::make_unique<Field>(value);
-        float float_val = 132.04;
-        auto float_field = std::make_unique<Field>(float_val);
-        auto string_field = std::make_unique<Field>("buzzdb");
-
-        newTuple->addField(std::move(key_field));
-        newTuple->addField(std::move(value_field));
-        newTuple->addField(std::move(float_field));
-        newTuple->addField(std::move(string_field));
-
-        InsertOperator insertOp(buffer_manager);
-        insertOp.setTupleToInsert(std::move(newTuple));
-        bool status = insertOp.next();
-
-        assert(status == true);
-
-        if (tuple_insertion_attempt_counter % 10 != 0) {
-            // Assuming you want to delete the first tuple from the first page
-            DeleteOperator delOp(buffer_manager, 0, 0); 
-            if (!delOp.next()) {
-                std::cerr << "Failed to delete tuple." << std::endl;
+    void remove(const std::string& row) {
+        population = std::max<size_t>(population, 1) - 1;
+        uint64_t hash = std::hash<std::string>()(row);
+        for (size_t i = 0; i < rows.size(); ++i) {
+            if (hashes[i] == hash && rows[i] == row) {
+                rows[i] = std::move(rows.back());
+                hashes[i] = hashes.back();
+                rows.pop_back();
+                hashes.pop_back();
+                deleted_in++;
+                return;
             }
         }
+        deleted_out++;
+    }
 
-
+    // Rows of the set
+    size_t getPopulation() const {
+        return population;
     }
 
-    void executeQueries() {
-        std::vector<std::string> test_queries = {
-            "SUM{1} GROUP BY {1} WHERE {1} > 2 and {1} < 6"
-        };
+    const std::vector<std::string>& getRows() const {
+        return rows;
+    }
+};
 
-        for (const auto& query : test_queries) {
-            auto components = parseQuery(query);
-            
-            // Check if we can use a materialized view
-            const MaterializedView* view = view_manager.getView("sum_by_key");
-            if (view && canUseView(components, view)) {
-                std::cout << "Using materialized view for query." << std::endl;
-                // Use the view data instead of executing the query
-                for (const auto& tuple : view->getData()) {
-                    for (const auto& field : tuple->fields) {
-                        field->print();
-                        std::cout << " ";
-                    }
-                    std::cout << std::endl;
-                }
-            } else {
-                // Execute the query as before, but now with cost estimation
-                executeOptimizedQuery(components);
-            }
+// Rows of the uniform sample of a table, and of each stratum of the
+// stratified sample; at most MAX_STRATA strata
+constexpr size_t SAMPLE_ROWS = 10000;
+constexpr size_t STRATUM_ROWS = 100;
+constexpr size_t MAX_STRATA = 4096;
+
+// Samples of a table for approximate answers: a uniform sample of
+// SAMPLE_ROWS rows, and a sample stratified by the first attribute, with
+// STRATUM_ROWS rows of every value, if it is INT and has at most
+// MAX_STRATA values. Small groups, which the uniform sample misses, are
+// all in the stratified one.
+class TableSample {
+private:
+    std::mt19937_64 random{42};
+    Reservoir uniform{SAMPLE_ROWS};
+    std::map<int, Reservoir> strata;
+    bool stratified = true;
+
+    template <typename Serialize>
+    void insert(std::optional<int> stratum, Serialize&& serialize) {
+        uniform.insert(random, serialize);
+        if (stratified && (!stratum || (strata.size() == MAX_STRATA && !strata.count(*stratum)))) {
+            stratified = false;
+            strata.clear();
+        }
+        if (stratified) {
+            strata.try_emplace(*stratum, STRATUM_ROWS).first->second.insert(random, serialize);
         }
     }
 
-private:
-    void executeOptimizedQuery(const QueryComponents& components) {
-        ScanOperator scanOp(buffer_manager);
-        Operator* rootOp = &scanOp;
+    // As Tuple::serialize()
+    static std::string serialize(const std::vector<std::unique_ptr<Field>>& fields) {
+        std::string row;
+        Field::appendNumber(row, fields.size());
+        for (const auto& field : fields) {
+            field->appendSerialized(row);
+        }
+        return row;
+    }
 
-        std::vector<std::unique_ptr<Operator>> operators;
+    static std::optional<int> stratumOf(const Field& field) {
+        return (field.getType() == INT) ? std::optional<int>(field.asInt()) : std::nullopt;
+    }
 
-        if (components.whereCondition) {
-            auto selectOp = std::make_unique<SelectOperator>(*rootOp, createPredicate(components));
-            rootOp = selectOp.get();
-            operators.push_back(std::move(selectOp));
-        }
+public:
+    void clear() {
+        uniform = Reservoir(SAMPLE_ROWS);
+        strata.clear();
+        stratified = true;
+    }
 
-        if (components.sumOperation || components.groupBy) {
-            auto aggOp = std::make_unique<HashAggregationOperator>(*rootOp, 
-                components.groupBy ? std::vector<size_t>{static_cast<size_t>(components.groupByAttributeIndex)} : std::vector<size_t>{},
-                std::vector<AggrFunc>{{AggrFuncType::SUM, static_cast<size_t>(components.sumAttributeIndex)}});
-            rootOp = aggOp.get();
-            operators.push_back(std::move(aggOp));
-        }
+    void insert(const std::vector<std::unique_ptr<Field>>& fields) {
+        insert(fields.empty() ? std::nullopt : stratumOf(*fields[0]), [&fields]() {
+            return serialize(fields);
+        });
+    }
 
-        // Estimate cost of the plan
-        double planCost = rootOp->estimateCost(cost_model);
-        std::cout << "Estimated query cost: " << planCost << std::endl;
+    // A row of a table scan
+    void insert(const Batch& batch, size_t row) {
+        const ColumnVector& first = batch.columns[0];
+        insert((first.type == INT) ? std::optional<int>(first.ints[row]) : std::nullopt, [&batch, row]() {
+            Tuple tuple;
+            tuple.fields = batch.getTuple(row);
+            return tuple.serialize();
+        });
+    }
 
-        // Execute the plan
-        rootOp->open();
-        while (rootOp->next()) {
-            const auto& output = rootOp->getOutput();
-            for (const auto& field : output) {
-                field->print();
-                std::cout << " ";
+    void remove(const std::vector<std::unique_ptr<Field>>& fields) {
+        std::string row = serialize(fields);
+        uniform.remove(row);
+        if (stratified && !fields.empty() && stratumOf(*fields[0])) {
+            auto stratum = strata.find(*stratumOf(*fields[0]));
+            if (stratum != strata.end()) {
+                stratum->second.remove(row);
             }
-            std::cout << std::endl;
         }
-        rootOp->close();
     }
 
-    std::unique_ptr<IPredicate> createPredicate(const QueryComponents& components) {
-        // ... create predicate based on components ...
+    const Reservoir& getUniform() const {
+        return uniform;
     }
 
-    bool canUseView(const QueryComponents& components, const MaterializedView* view) {
-        // Check if the view can answer the query
-        // This is a simplified check and should be more comprehensive in a real system
-        return components.sumOperation && components.groupBy && 
-               components.groupByAttributeIndex == 0 && components.sumAttributeIndex == 1;
+    // The stratified sample by value of the first attribute, nullptr if
+    // there is none
+    const std::map<int, Reservoir>* getStrata() const {
+        return stratified ? &strata : nullptr;
     }
-    
 };
 
-int main() {
+// Number of changes from which TableStatistics call for a new ANALYZE, at
+// least 10% of the table
+constexpr size_t AUTO_ANALYZE_MIN_CHANGES = 1000;
+
+// Row count and attribute statistics of the table. analyze() rebuilds
+// them from the table; insert() and remove() keep them roughly current in
+// between (the distinct counts only grow and the histogram keeps its
+// buckets), and isStale() tells when another analyze() is due.
+class TableStatistics {
+private:
+    std::vector<ColumnStatistics> columns;
+    TableSample sample;
+    double rows = 0;
+    size_t changes = 0;
+    bool analyzed = false;
+
+    // The statistics describe tuples of this layout
+    bool matches(const std::vector<std::unique_ptr<Field>>& fields) const {
+        if (fields.size() != columns.size()) {
+            return false;
+        }
+        for (size_t i = 0; i < fields.size(); ++i) {
+            if (fields[i]->getType() != columns[i].type) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    template <typename Visit>
+    static void forEachValue(const ColumnVector& column, Visit visit) {
+        switch (column.type) {
+            case INT:
+                for (int value : column.ints) visit(value, ColumnStatistics::hashValue(value));
+                break;
+            case FLOAT:
+                for (float value : column.floats) visit(value, ColumnStatistics::hashValue(value));
+                break;
+            case STRING:
+                for (const auto& value : column.strings) visit(0.0, ColumnStatistics::hashValue(std::string_view(value)));
+                break;
+            case BIGINT:
+                for (int64_t value : column.bigints) visit(static_cast<double>(value), ColumnStatistics::hashValue(value));
+                break;
+        }
+    }
+
+public:
+    // Rebuild from two passes over the table; scan(consume) calls
+    // consume(batch) for every batch of the table
+    void analyze(const std::function<void(const std::function<void(const Batch&)>&)>& scan) {
+        columns.clear();
+        rows = 0;
+        sample.clear();
+        scan([this](const Batch& batch) {
+            for (size_t row = 0; row < batch.size(); ++row) {
+                sample.insert(batch, row);
+            }
+            if (columns.empty()) {
+                columns.resize(batch.columns.size());
+                for (size_t i = 0; i < columns.size(); ++i) {
+                    columns[i].type = batch.columns[i].type;
+                }
+            }
+            for (size_t i = 0; i < columns.size(); ++i) {
+                forEachValue(batch.columns[i], [&column = columns[i]](double value, uint64_t hash) {
+                    column.observe(value, hash);
+                });
+            }
+            rows += batch.size();
+        });
+        for (auto& column : columns) {
+            column.layoutHistogram();
+        }
+        scan([this](const Batch& batch) {
+            for (size_t i = 0; i < columns.size(); ++i) {
+                forEachValue(batch.columns[i], [&column = columns[i]](double value, uint64_t) {
+                    column.count(value, 1);
+                });
+            }
+        });
+        changes = 0;
+        analyzed = true;
+    }
+
+    void insert(const std::vector<std::unique_ptr<Field>>& fields) {
+        rows++;
+        changes++;
+        sample.insert(fields);
+        if (!matches(fields)) {
+            return;
+        }
+        for (size_t i = 0; i < fields.size(); ++i) {
+            double value = (fields[i]->getType() == STRING) ? 0.0 : ColumnStatistics::numericValue(*fields[i]);
+            columns[i].observe(value, ColumnStatistics::hashValue(*fields[i]));
+            columns[i].count(value, 1);
+        }
+    }
+
+    void remove(const std::vector<std::unique_ptr<Field>>& fields) {
+        rows = std::max(0.0, rows - 1);
+        changes++;
+        sample.remove(fields);
+        if (!matches(fields)) {
+            return;
+        }
+        for (size_t i = 0; i < fields.size(); ++i) {
+            if (fields[i]->getType() != STRING) {
+                columns[i].count(ColumnStatistics::numericValue(*fields[i]), -1);
+            }
+        }
+    }
+
+    bool isAnalyzed() const {
+        return analyzed;
+    }
+
+    bool isStale() const {
+        return !analyzed || changes > std::max<double>(AUTO_ANALYZE_MIN_CHANGES, rows / 10);
+    }
+
+    double getRows() const {
+        return rows;
+    }
+
+    // Samples of the table, kept current between analyze() runs
+    const TableSample& getSample() const {
+        return sample;
+    }
+
+    size_t getNumColumns() const {
+        return columns.size();
+    }
+
+    // Statistics of an attribute, nullptr if not analyzed
+    const ColumnStatistics* getColumn(size_t attr) const {
+        return (analyzed && attr < columns.size()) ? &columns[attr] : nullptr;
+    }
+
+    void print() const {
+        std::cout << "Statistics :: " << static_cast<size_t>(rows) << " rows\n";
+        for (size_t i = 0; i < columns.size(); ++i) {
+            const auto& column = columns[i];
+            std::cout << "  {" << i + 1 << "} " << static_cast<size_t>(column.estimateDistinct()) << " distinct";
+            if (column.type != STRING && column.min <= column.max) {
+                std::cout << ", " << column.min << " to " << column.max;
+            }
+            std::cout << "\n";
+        }
+    }
+};
+
+// Plan costs in page accesses. Cardinalities come from TableStatistics
+// when set, otherwise from fixed guesses.
+class CostModel {
+private:
+    const TableStatistics* statistics = nullptr;
+    // Table attribute of each column of plans that scan a projection
+    std::vector<size_t> projection;
+
+    const ColumnStatistics* column(size_t attr) const {
+        if (!projection.empty()) {
+            attr = (attr < projection.size()) ? projection[attr] : std::numeric_limits<size_t>::max();
+        }
+        return statistics ? statistics->getColumn(attr) : nullptr;
+    }
+
+public:
+    // Processing one tuple in memory, relative to a page access
+    static constexpr double CPU_TUPLE_COST = 0.01;
+    // Guesses without statistics
+    static constexpr double DEFAULT_SELECTIVITY = 0.1;
+    static constexpr double DEFAULT_GROUP_FRACTION = 0.1;
+    static constexpr double DEFAULT_TUPLES_PER_PAGE = 26;  // 38 byte sales tuples
+
+    void setStatistics(const TableStatistics* table_statistics) {
+        statistics = table_statistics;
+    }
+
+    // Estimate plans whose column i is attribute attributes[i] of the
+    // table, all attributes if empty
+    void setProjection(std::vector<size_t> attributes) {
+        projection = std::move(attributes);
+    }
+
+    double estimateTableRows(size_t numPages) const {
+        if (statistics && statistics->isAnalyzed()) {
+            return statistics->getRows();
+        }
+        return numPages * DEFAULT_TUPLES_PER_PAGE;
+    }
+
+    // Fraction of the table with range.low <= attr < range.high
+    double estimateRangeSelectivity(size_t attr, const ValueRange& range) const {
+        const ColumnStatistics* stats = column(attr);
+        double fraction = stats ? stats->estimateFraction(range) : -1.0;
+        return (fraction < 0) ? DEFAULT_SELECTIVITY : fraction;
+    }
+
+    // Fraction of the table with attr == value
+    double estimateEqualitySelectivity(size_t attr, const Field& value) const {
+        const ColumnStatistics* stats = column(attr);
+        if (!stats || stats->type != value.getType()) {
+            return DEFAULT_SELECTIVITY;
+        }
+        if (value.getType() != STRING) {
+            double number = ColumnStatistics::numericValue(value);
+            if (number < stats->min || number > stats->max) {
+                return 0.0;
+            }
+        }
+        return 1.0 / std::max(1.0, stats->estimateDistinct());
+    }
+
+    // Groups of numTuples tuples grouped by attrs
+    double estimateGroups(const std::vector<size_t>& attrs, double numTuples) const {
+        if (attrs.empty()) {
+            return 1.0;
+        }
+        double groups = 1.0;
+        for (size_t attr : attrs) {
+            const ColumnStatistics* stats = column(attr);
+            groups *= stats ? std::max(1.0, stats->estimateDistinct()) : numTuples * DEFAULT_GROUP_FRACTION;
+        }
+        return std::min(groups, numTuples);
+    }
+
+    double estimateScanCost(size_t numPages, double numTuples) const {
+        return numPages + numTuples * CPU_TUPLE_COST;
+    }
+
+    // Evaluating the predicate on every input tuple
+    double estimateSelectCost(double numTuples) const {
+        return numTuples * CPU_TUPLE_COST;
+    }
+
+    // Hashing every input tuple and folding it into its group, then
+    // emitting the groups; groups that do not fit in memory are also
+    // written to spillPages and read back
+    double estimateHashAggregateCost(double numTuples, double numGroups, double spillPages = 0.0) const {
+        return (2.0 * numTuples + numGroups) * CPU_TUPLE_COST + 2.0 * spillPages;
+    }
+
+    double estimateIndexScanCost(size_t indexPages, size_t numMatches) const {
+        // The index pages, then one page access per matching tuple as
+        // matches are scattered over the table
+        return indexPages + numMatches * (1.0 + CPU_TUPLE_COST);
+    }
+
+    // Building a hash table on one input, probing it with the other and
+    // emitting the matches
+    double estimateHashJoinCost(double buildRows, double probeRows, double outputRows) const {
+        return (2.0 * buildRows + probeRows + outputRows) * CPU_TUPLE_COST;
+    }
+
+    // Comparison sort of numTuples in memory; a sort that spills also
+    // writes and reads its runPages once per merge pass
+    double estimateSortCost(double numTuples, double runPages, size_t mergePasses) const {
+        return numTuples * std::log2(std::max(2.0, numTuples)) * CPU_TUPLE_COST + 2.0 * runPages * mergePasses;
+    }
+
+    // Views are in memory
+    double estimateViewScanCost(size_t numRows) const {
+        return numRows * CPU_TUPLE_COST;
+    }
+};
+
+
+class Operator {
+    public:
+    virtual ~Operator() = default;
+
+    /// Initializes the operator.
+    virtual void open() = 0;
+
+    /// Tries to generate the next tuple. Return true when a new tuple is
+    /// available.
+    virtual bool next() = 0;
+
+    /// Destroys the operator.
+    virtual void close() = 0;
+
+    /// This returns the pointers to the Fields of the generated tuple. When
+    /// `next()` returns true, the Fields will contain the values for the
+    /// next tuple. Each `Field` pointer in the vector stands for one attribute of the tuple.
+    /// The Fields are owned by the operator (or its input) and stay valid,
+    /// unchanged, until the next call to `next()` or `close()`; callers
+    /// that keep a tuple longer copy it.
+    virtual const std::vector<std::unique_ptr<Field>>& getOutput() = 0;
+
+    /// Replaces the contents of `batch` with up to BATCH_SIZE next tuples,
+    /// one ColumnVector per attribute. Returns false once the input is
+    /// exhausted, the batch is then empty. Operators that produce batches
+    /// natively override this; the default collects tuples from `next()`.
+    virtual bool nextBatch(Batch& batch) {
+        batch.clear();
+        while (batch.size() < BATCH_SIZE && next()) {
+            batch.appendTuple(getOutput());
+        }
+        return batch.size() > 0;
+    }
+
+    // New method for cost estimation
+    virtual double estimateCost(CostModel& costModel) = 0;
+
+    /// Estimated number of tuples the operator produces
+    virtual double estimateRows(CostModel&) {
+        return 0;
+    }
+
+protected:
+    // getOutput() of an operator without a current tuple
+    static const std::vector<std::unique_ptr<Field>>& noOutput() {
+        static const std::vector<std::unique_ptr<Field>> empty;
+        return empty;
+    }
+};
+
+class UnaryOperator : public Operator {
+    protected:
+    Operator* input;
+
+    public:
+    explicit UnaryOperator(Operator& input) : input(&input) {}
+
+    ~UnaryOperator() override = default;
+};
+
+class BinaryOperator : public Operator {
+    protected:
+    Operator* input_left;
+    Operator* input_right;
+
+    public:
+    explicit BinaryOperator(Operator& input_left, Operator& input_right)
+        : input_left(&input_left), input_right(&input_right) {}
+
+    ~BinaryOperator() override = default;
+};
+
+class IPredicate {
+public:
+    virtual ~IPredicate() = default;
+    virtual bool check(const std::vector<std::unique_ptr<Field>>& tupleFields) const = 0;
+
+    // Keep the rows of `selection` (ascending row numbers of batch) for
+    // which the predicate holds. The default checks row by row.
+    virtual void filter(const Batch& batch, std::vector<uint32_t>& selection) const {
+        size_t kept = 0;
+        for (uint32_t row : selection) {
+            if (check(batch.getTuple(row))) {
+                selection[kept++] = row;
+            }
+        }
+        selection.resize(kept);
+    }
+
+    // Fraction of tuples expected to pass
+    virtual double estimateSelectivity(const CostModel&) const {
+        return CostModel::DEFAULT_SELECTIVITY;
+    }
+
+    // The attribute and the values of it the predicate keeps, if it
+    // compares an attribute with a numeric constant
+    virtual std::optional<std::pair<size_t, ValueRange>> getRange() const {
+        return std::nullopt;
+    }
+
+    // Closed ranges [low, high] of attributes that every tuple the
+    // predicate keeps lies within, possibly wider; for skipping pages
+    virtual std::vector<std::pair<size_t, ValueRange>> getBounds() const {
+        return {};
+    }
+};
+
+enum class AggrFuncType { COUNT, MAX, MIN, SUM };
+
+struct AggrFunc {
+    AggrFuncType func;
+    size_t attr_index; // Index of the attribute to aggregate
+};
+
+// Running value of one aggregate: an int64_t, or a float for SUM, MIN and
+// MAX over a FLOAT attribute
+union AggregateValue {
+    int64_t i;
+    float f;
+};
+
+// The identity of an aggregate over values of type
+inline AggregateValue aggregateIdentity(AggrFuncType func, FieldType type) {
+    AggregateValue value;
+    if (type == FLOAT) {
+        value.f = (func == AggrFuncType::MIN) ? std::numeric_limits<float>::max()
+                : (func == AggrFuncType::MAX) ? std::numeric_limits<float>::lowest() : 0.0f;
+    } else {
+        value.i = (func == AggrFuncType::MIN) ? std::numeric_limits<int64_t>::max()
+                : (func == AggrFuncType::MAX) ? std::numeric_limits<int64_t>::min() : 0;
+    }
+    return value;
+}
+
+// Output type of an aggregate over values of type: SUM and COUNT of
+// integers are BIGINT so they cannot overflow
+inline FieldType aggregateResultType(AggrFuncType func, FieldType type) {
+    if (func == AggrFuncType::COUNT || (func == AggrFuncType::SUM && type != FLOAT)) {
+        return BIGINT;
+    }
+    return type;
+}
+
+template <typename T, typename V>
+inline void foldAggregate(AggrFuncType func, T& current, V value) {
+    switch (func) {
+        case AggrFuncType::SUM: current += value; break;
+        case AggrFuncType::MIN: current = std::min<T>(current, value); break;
+        case AggrFuncType::MAX: current = std::max<T>(current, value); break;
+        case AggrFuncType::COUNT: current += 1; break;
+    }
+}
+
+// How AggregationHashTable hashes and compares a key type. A single INT
+// group-by attribute is the int itself; anything else is the group-by
+// values encoded back to back in a std::string.
+template <typename Key>
+struct GroupKeyTraits;
+
+template <>
+struct GroupKeyTraits<int> {
+    using View = int;
+    static uint64_t hash(int key) { return hashInt(key); }
+    static View view(int key) { return key; }
+    static size_t heapBytes(int) { return 0; }
+};
+
+template <>
+struct GroupKeyTraits<std::string> {
+    using View = std::string_view;
+    static uint64_t hash(std::string_view key) { return std::hash<std::string_view>()(key); }
+    static View view(const std::string& key) { return key; }
+    static size_t heapBytes(const std::string& key) { return key.size(); }
+};
+
+// Open addressing hash table from group keys to a fixed number of
+// AggregateValues per group, stored inline next to the keys. Linear
+// probing over a power of two number of slots, grown at 3/4 load.
+template <typename Key>
+class AggregationHashTable {
+public:
+    using Traits = GroupKeyTraits<Key>;
+    using View = typename Traits::View;
+
+private:
+    static constexpr size_t INITIAL_CAPACITY = 64;
+
+    size_t num_values;
+    size_t num_groups = 0;
+    size_t key_bytes = 0;                // Held by the keys outside the slots
+    size_t mask = INITIAL_CAPACITY - 1;
+    std::vector<uint64_t> hashes;        // 0 marks an empty slot
+    std::vector<Key> keys;
+    std::vector<AggregateValue> values;  // num_values per slot
+
+public:
+    explicit AggregationHashTable(size_t num_values)
+        : num_values(num_values), hashes(INITIAL_CAPACITY, 0), keys(INITIAL_CAPACITY),
+          values(INITIAL_CAPACITY * num_values) {}
+
+    // Hash as stored in the table, never 0
+    static uint64_t hash(View key) {
+        uint64_t hash = Traits::hash(key);
+        return hash ? hash : 1;
+    }
+
+    // The values of key's group, a copy of initial_values if it is new
+    AggregateValue* findOrInsert(View key, uint64_t hash, const AggregateValue* initial_values) {
+        size_t slot = hash & mask;
+        while (hashes[slot] != 0) {
+            if (hashes[slot] == hash && keys[slot] == key) {
+                return &values[slot * num_values];
+            }
+            slot = (slot + 1) & mask;
+        }
+
+        if ((num_groups + 1) * 4 > hashes.size() * 3) {
+            grow();
+            return findOrInsert(key, hash, initial_values);
+        }
+        hashes[slot] = hash;
+        keys[slot] = Key(key);
+        std::copy(initial_values, initial_values + num_values, &values[slot * num_values]);
+        num_groups++;
+        key_bytes += Traits::heapBytes(keys[slot]);
+        return &values[slot * num_values];
+    }
+
+    // The values of key's group, nullptr if there is none
+    const AggregateValue* find(View key, uint64_t hash) const {
+        for (size_t slot = hash & mask; hashes[slot] != 0; slot = (slot + 1) & mask) {
+            if (hashes[slot] == hash && keys[slot] == key) {
+                return &values[slot * num_values];
+            }
+        }
+        return nullptr;
+    }
+
+    size_t size() const {
+        return num_groups;
+    }
+
+    // Bytes of the slot arrays and of the keys' own allocations
+    size_t memoryBytes() const {
+        return hashes.size() * slotBytes() + key_bytes;
+    }
+
+    // Whether a new group keeps the table within budget bytes, counting
+    // the old and the new arrays while a grow copies between them
+    bool canInsert(size_t budget) const {
+        size_t bytes = memoryBytes();
+        if ((num_groups + 1) * 4 > hashes.size() * 3) {
+            bytes += 2 * hashes.size() * slotBytes();
+        }
+        return bytes <= budget;
+    }
+
+    // Calls f(key, hash, values) for every group
+    template <typename Function>
+    void forEach(Function&& f) const {
+        forEach(0, num_groups, f);
+    }
+
+    // Calls f(key, hash, values) for the groups from slot on, up to
+    // max_groups of them; returns the slot to continue from, which is
+    // past the end once all were visited
+    template <typename Function>
+    size_t forEach(size_t slot, size_t max_groups, Function&& f) const {
+        for (; slot < hashes.size() && max_groups > 0; ++slot) {
+            if (hashes[slot] != 0) {
+                f(keys[slot], hashes[slot], &values[slot * num_values]);
+                max_groups--;
+            }
+        }
+        return slot;
+    }
+
+    bool done(size_t slot) const {
+        return slot >= hashes.size();
+    }
+
+private:
+    size_t slotBytes() const {
+        return sizeof(uint64_t) + sizeof(Key) + num_values * sizeof(AggregateValue);
+    }
+
+    void grow() {
+        std::vector<uint64_t> old_hashes(hashes.size() * 2, 0);
+        std::vector<Key> old_keys(hashes.size() * 2);
+        std::vector<AggregateValue> old_values(hashes.size() * 2 * num_values);
+        old_hashes.swap(hashes);
+        old_keys.swap(keys);
+        old_values.swap(values);
+        mask = hashes.size() - 1;
+
+        for (size_t old_slot = 0; old_slot < old_hashes.size(); ++old_slot) {
+            if (old_hashes[old_slot] == 0) {
+                continue;
+            }
+            size_t slot = old_hashes[old_slot] & mask;
+            while (hashes[slot] != 0) {
+                slot = (slot + 1) & mask;
+            }
+            hashes[slot] = old_hashes[old_slot];
+            keys[slot] = std::move(old_keys[old_slot]);
+            std::copy(&old_values[old_slot * num_values], &old_values[(old_slot + 1) * num_values],
+                      &values[slot * num_values]);
+        }
+    }
+};
+
+// Pages a scan copies at a time
+constexpr size_t SCAN_CHUNK_PAGES = 32;
+
+// Produces the tuples of the table page by page in batches; the tuple
+// interface is served from the current batch
+class ScanOperator : public Operator {
+private:
+    BufferManager& bufferManager;
+    size_t currentPageIndex = 0;
+    size_t currentSlotIndex = 0;
+    size_t tuple_count = 0;
+    // Tuple ids of the last batch produced
+    std::vector<TupleID> batch_tuple_ids;
+    // Batch behind next() / getOutput(), the position in it and the
+    // Fields the current row is read into
+    Batch currentBatch;
+    size_t currentRow = 0;
+    bool has_current = false;
+    std::vector<std::unique_ptr<Field>> currentFields;
+    // Of this table, for estimates when the cost model's are of another
+    const TableStatistics* statistics;
+    // The attributes read, in output order, all if empty; and the output
+    // column of each attribute, -1 if it is not read
+    std::vector<size_t> attributes;
+    std::vector<int> output_columns;
+    // The snapshot read and the pages of the table at its time
+    Timestamp snapshot = LATEST_TIMESTAMP;
+    PageID snapshot_pages = INVALID_PAGE_ID;
+    // Copies of the pages from copied_page on, so writers may change the
+    // pages in the pool while the scan is on them, and their versions.
+    // versions is those of the current page.
+    std::unique_ptr<char[]> page_copies = std::make_unique<char[]>(SCAN_CHUNK_PAGES * PAGE_SIZE);
+    PageID copied_page = INVALID_PAGE_ID;
+    size_t copied_count = 0;
+    std::vector<PageVersions> copied_versions;
+    const PageVersions* versions = nullptr;
+    // Closed ranges of table attributes that all tuples wanted lie in;
+    // pages whose summary excludes them are not read
+    std::vector<std::pair<size_t, ValueRange>> bounds;
+    size_t pages_skipped = 0;
+
+    // An aggregation pushed into the scan, see pushAggregation()
+    struct PushedAggregation {
+        size_t key_attr = std::numeric_limits<size_t>::max();  // Table attribute, none if max
+        std::vector<AggrFunc> aggr_funcs;
+        std::vector<FieldType> value_types;
+        std::vector<AggregateValue> identities;
+        std::vector<size_t> value_attrs;                // Table attribute of each aggregate
+        std::vector<std::vector<size_t>> attr_aggregates;  // Aggregates over each table attribute
+        std::unique_ptr<IPredicate> predicate;          // On the scan's output columns
+    };
+    std::unique_ptr<PushedAggregation> pushed;
+    AggregationHashTable<int> partials{0};
+    size_t partial_slot = 0;
+    bool emitting = false;
+    Batch page_rows;                    // A page's tuples, when a predicate needs them
+    std::vector<uint32_t> selection;
+    std::vector<AggregateValue> row_values;
+
+    size_t lastPage() {
+        return std::min<size_t>(bufferManager.getNumPages(), snapshot_pages);
+    }
+
+    const char* copyPage(PageID page_id) {
+        if (copied_page == INVALID_PAGE_ID || page_id < copied_page || page_id >= copied_page + copied_count) {
+            copied_count = std::min<size_t>(SCAN_CHUNK_PAGES, lastPage() - page_id);
+            bufferManager.readPages(page_id, copied_count, page_copies.get(), snapshot, copied_versions);
+            copied_page = page_id;
+        }
+        versions = &copied_versions[page_id - copied_page];
+        return page_copies.get() + (page_id - copied_page) * PAGE_SIZE;
+    }
+
+    // copyPage() of a page the scan starts on, or nullptr if its summary
+    // shows that no tuple of it lies within the bounds. A page without a
+    // summary gets one from the copy, for the scans after this one.
+    const char* readPage(PageID page_id) {
+        if (bounds.empty()) {
+            return copyPage(page_id);
+        }
+        if (bufferManager.skipPage(page_id, bounds, snapshot)) {
+            pages_skipped++;
+            return nullptr;
+        }
+        const char* page = copyPage(page_id);
+        if (!versions->summarized) {
+            PageSummary summary = summarize(page);
+            // Tuples deleted since the snapshot are not on the page
+            bool skip = versions->deleted.empty() && summary.excludes(bounds);
+            bufferManager.setPageSummary(page_id, std::move(summary), versions->changes);
+            if (skip) {
+                pages_skipped++;
+                return nullptr;
+            }
+        }
+        return page;
+    }
+
+    // Summary of all tuples stored in a page copy, also those the
+    // snapshot does not see, so it holds for any snapshot
+    PageSummary summarize(const char* page) const {
+        PageSummary summary;
+        if (const PaxLayout* layout = bufferManager.getPaxLayout()) {
+            summary.tuples = layout->numRows(page);
+            for (size_t attr = 0; attr < layout->getNumColumns(); ++attr) {
+                FieldType type = layout->getType(attr);
+                if (type == STRING) {
+                    continue;
+                }
+                const char* values = layout->fixedValues(page, attr);
+                for (size_t row = 0; row < summary.tuples; ++row) {
+                    if (type == INT) {
+                        int value;
+                        std::memcpy(&value, values + row * sizeof(int), sizeof(int));
+                        summary.add(attr, value);
+                    } else {
+                        float value;
+                        std::memcpy(&value, values + row * sizeof(float), sizeof(float));
+                        summary.add(attr, value);
+                    }
+                }
+            }
+            return summary;
+        }
+        const Slot* slot_array = reinterpret_cast<const Slot*>(page);
+        for (size_t slot = 0; slot < MAX_SLOTS; ++slot) {
+            if (slot_array[slot].empty) {
+                continue;
+            }
+            summary.tuples++;
+            Tuple::parseSerialized(page + slot_array[slot].offset, slot_array[slot].length,
+                                   [&summary](size_t attr, auto value) {
+                if constexpr (!std::is_same_v<decltype(value), std::string_view>) {
+                    summary.add(attr, value);
+                }
+            });
+        }
+        return summary;
+    }
+
+    // Calls f(tuple, length) for every tuple of a slotted page copy the
+    // snapshot sees
+    template <typename Function>
+    void forEachTuple(const char* page, Function&& f) const {
+        const Slot* slot_array = reinterpret_cast<const Slot*>(page);
+        for (size_t slot = 0; slot < MAX_SLOTS; ++slot) {
+            if (!slot_array[slot].empty && !versions->isHidden(slot)) {
+                f(page + slot_array[slot].offset, slot_array[slot].length);
+            }
+        }
+        for (const auto& deleted : versions->deleted) {
+            f(deleted.second.data(), deleted.second.size());
+        }
+    }
+
+    // Rows of a PAX page copy the snapshot sees; rows are appended, so
+    // those after the snapshot are the last
+    size_t visibleRows(const char* page, const PaxLayout& layout) const {
+        return versions->hidden.empty() ? layout.numRows(page)
+            : std::min(layout.numRows(page), versions->hidden.front());
+    }
+
+    template <typename T>
+    static void foldValue(AggrFuncType func, AggregateValue& current, T value) {
+        if constexpr (std::is_integral_v<T>) {
+            foldAggregate(func, current.i, value);
+        } else {
+            foldAggregate(func, current.f, value);
+        }
+    }
+
+    // Fold the rows of a page copy into the partial aggregates
+    void aggregatePage(const char* page) {
+        PushedAggregation& aggr = *pushed;
+        const PaxLayout* layout = bufferManager.getPaxLayout();
+        if (aggr.predicate) {
+            // Filter the page's tuples as a batch, then fold the rows kept
+            page_rows.clear();
+            if (layout) {
+                size_t rows = visibleRows(page, *layout);
+                size_t width = attributes.empty() ? layout->getNumColumns() : attributes.size();
+                page_rows.appendColumns(width, rows, [&](size_t i, ColumnVector& column) {
+                    layout->readColumn(page, attributes.empty() ? i : attributes[i], 0, rows, column);
+                });
+            } else {
+                forEachTuple(page, [this](const char* tuple, size_t length) {
+                    if (attributes.empty()) {
+                        page_rows.appendSerialized(tuple, length);
+                    } else {
+                        page_rows.appendSerialized(tuple, length, output_columns);
+                    }
+                });
+            }
+            tuple_count += page_rows.size();
+            selection.resize(page_rows.size());
+            std::iota(selection.begin(), selection.end(), 0);
+            aggr.predicate->filter(page_rows, selection);
+            size_t key_column = (aggr.key_attr == std::numeric_limits<size_t>::max()) ? 0
+                : attributes.empty() ? aggr.key_attr : output_columns[aggr.key_attr];
+            for (uint32_t row : selection) {
+                int key = (aggr.key_attr == std::numeric_limits<size_t>::max()) ? 0
+                    : page_rows.columns[key_column].values<int>()[row];
+                AggregateValue* values = partials.findOrInsert(key, partials.hash(key), aggr.identities.data());
+                for (size_t i = 0; i < aggr.aggr_funcs.size(); ++i) {
+                    size_t attr = aggr.value_attrs[i];
+                    const ColumnVector& column = page_rows.columns[attributes.empty() ? attr : output_columns[attr]];
+                    if (aggr.aggr_funcs[i].func == AggrFuncType::COUNT) {
+                        values[i].i++;
+                    } else if (aggr.value_types[i] == INT) {
+                        foldValue(aggr.aggr_funcs[i].func, values[i], column.values<int>()[row]);
+                    } else {
+                        foldValue(aggr.aggr_funcs[i].func, values[i], column.values<float>()[row]);
+                    }
+                }
+            }
+            return;
+        }
+
+        if (layout) {
+            // Straight from the minipages; a single group per page when
+            // there is no key
+            size_t rows = visibleRows(page, *layout);
+            tuple_count += rows;
+            const char* keys = (aggr.key_attr == std::numeric_limits<size_t>::max()) ? nullptr
+                : layout->fixedValues(page, aggr.key_attr);
+            auto fold = [&](AggregateValue* target, size_t i, size_t row) {
+                AggrFuncType func = aggr.aggr_funcs[i].func;
+                if (func == AggrFuncType::COUNT) {
+                    target[i].i++;
+                    return;
+                }
+                const char* value = layout->fixedValues(page, aggr.value_attrs[i]) + row * sizeof(int);
+                if (aggr.value_types[i] == INT) {
+                    int number;
+                    std::memcpy(&number, value, sizeof(int));
+                    foldValue(func, target[i], number);
+                } else {
+                    float number;
+                    std::memcpy(&number, value, sizeof(float));
+                    foldValue(func, target[i], number);
+                }
+            };
+            if (keys) {
+                for (size_t row = 0; row < rows; ++row) {
+                    int key;
+                    std::memcpy(&key, keys + row * sizeof(int), sizeof(int));
+                    AggregateValue* target = partials.findOrInsert(key, partials.hash(key), aggr.identities.data());
+                    for (size_t i = 0; i < aggr.aggr_funcs.size(); ++i) {
+                        fold(target, i, row);
+                    }
+                }
+            } else if (rows > 0) {
+                AggregateValue* group = partials.findOrInsert(0, partials.hash(0), aggr.identities.data());
+                for (size_t i = 0; i < aggr.aggr_funcs.size(); ++i) {
+                    for (size_t row = 0; row < rows; ++row) {
+                        fold(group, i, row);
+                    }
+                }
+            }
+            return;
+        }
+
+        // Parse the tuples of a slotted page without building a batch
+        forEachTuple(page, [this, &aggr](const char* tuple, size_t length) {
+            int key = 0;
+            Tuple::parseSerialized(tuple, length, [this, &aggr, &key](size_t attr, auto value) {
+                if constexpr (!std::is_same_v<decltype(value), std::string_view>) {
+                    if (attr == aggr.key_attr) {
+                        key = static_cast<int>(value);
+                    }
+                    if (attr < aggr.attr_aggregates.size()) {
+                        for (size_t i : aggr.attr_aggregates[attr]) {
+                            if (aggr.value_types[i] == INT) {
+                                row_values[i].i = static_cast<int>(value);
+                            } else {
+                                row_values[i].f = static_cast<float>(value);
+                            }
+                        }
+                    }
+                }
+            });
+            AggregateValue* values = partials.findOrInsert(key, partials.hash(key), aggr.identities.data());
+            for (size_t i = 0; i < aggr.aggr_funcs.size(); ++i) {
+                AggrFuncType func = aggr.aggr_funcs[i].func;
+                if (func == AggrFuncType::COUNT) {
+                    values[i].i++;
+                } else if (aggr.value_types[i] == INT) {
+                    foldValue(func, values[i], row_values[i].i);
+                } else {
+                    foldValue(func, values[i], row_values[i].f);
+                }
+            }
+            tuple_count++;
+        });
+    }
+
+    // Partial aggregate rows (key, value...) of the pages from the
+    // current one on. The groups gathered are emitted once there are
+    // BATCH_SIZE of them and at the end of the table.
+    bool nextPartials(Batch& batch) {
+        PushedAggregation& aggr = *pushed;
+        bool keyed = aggr.key_attr != std::numeric_limits<size_t>::max();
+        size_t width = (keyed ? 1 : 0) + aggr.aggr_funcs.size();
+        while (true) {
+            if (emitting) {
+                partial_slot = partials.forEach(partial_slot, BATCH_SIZE - batch.size(),
+                                                [&](int key, uint64_t, const AggregateValue* values) {
+                    batch.appendColumns(width, 1, [&](size_t i, ColumnVector& column) {
+                        if (keyed && i == 0) {
+                            column.append(key);
+                            return;
+                        }
+                        size_t value = i - (keyed ? 1 : 0);
+                        switch (aggregateResultType(aggr.aggr_funcs[value].func, aggr.value_types[value])) {
+                            case INT: column.append(static_cast<int>(values[value].i)); break;
+                            case BIGINT: column.append(values[value].i); break;
+                            default: column.append(values[value].f); break;
+                        }
+                    });
+                });
+                if (partials.done(partial_slot)) {
+                    partials = AggregationHashTable<int>(aggr.aggr_funcs.size());
+                    partial_slot = 0;
+                    emitting = false;
+                }
+                if (batch.size() == BATCH_SIZE) {
+                    return true;
+                }
+                continue;
+            }
+            if (currentPageIndex >= lastPage()) {
+                if (partials.size() == 0) {
+                    return batch.size() > 0;
+                }
+                emitting = true;
+                continue;
+            }
+            if (const char* page = readPage(currentPageIndex)) {
+                aggregatePage(page);
+            }
+            currentPageIndex++;
+            if (partials.size() >= BATCH_SIZE) {
+                emitting = true;
+            }
+        }
+    }
+
+    // Pages in the PAX layout: copy whole minipage ranges of the
+    // attributes read into the batch
+    bool nextPaxBatch(Batch& batch, const PaxLayout& layout) {
+        size_t width = attributes.empty() ? layout.getNumColumns() : attributes.size();
+        while (currentPageIndex < lastPage()) {
+            const char* page = (currentSlotIndex == 0) ? readPage(currentPageIndex) : copyPage(currentPageIndex);
+            size_t rows = page ? visibleRows(page, layout) : 0;
+            if (currentSlotIndex < rows) {
+                size_t begin = currentSlotIndex;
+                size_t end = std::min(rows, begin + BATCH_SIZE - batch.size());
+                batch.appendColumns(width, end - begin, [&](size_t i, ColumnVector& column) {
+                    layout.readColumn(page, attributes.empty() ? i : attributes[i], begin, end, column);
+                });
+                for (size_t row = begin; row < end; ++row) {
+                    batch_tuple_ids.push_back(makeTupleID(currentPageIndex, row));
+                }
+                tuple_count += end - begin;
+                currentSlotIndex = end;
+                if (batch.size() == BATCH_SIZE) {
+                    return true; // Resume at this row
+                }
+            }
+            currentPageIndex++;
+            currentSlotIndex = 0;
+        }
+        return batch.size() > 0;
+    }
+
+public:
+    ScanOperator(BufferManager& manager, const TableStatistics* statistics = nullptr,
+                 std::vector<size_t> attributes = {})
+        : bufferManager(manager), statistics(statistics), attributes(std::move(attributes)) {
+        for (size_t i = 0; i < this->attributes.size(); ++i) {
+            size_t attr = this->attributes[i];
+            output_columns.resize(std::max(output_columns.size(), attr + 1), -1);
+            output_columns[attr] = static_cast<int>(i);
+        }
+    }
+
+    // Read the table as of a snapshot timestamp, which had num_pages
+    // pages; the latest version of every page by default
+    void setSnapshot(Timestamp timestamp = LATEST_TIMESTAMP, PageID num_pages = INVALID_PAGE_ID) {
+        snapshot = timestamp;
+        snapshot_pages = num_pages;
+        copied_page = INVALID_PAGE_ID;
+    }
+
+    // Skip the pages whose summary shows that none of their tuples lie
+    // within bounds, closed ranges of table attributes such as
+    // IPredicate::getBounds() gives. The tuples of the pages read are
+    // not filtered.
+    void setBounds(std::vector<std::pair<size_t, ValueRange>> attribute_bounds) {
+        bounds = std::move(attribute_bounds);
+    }
+
+    // Produce partial aggregates instead of tuples: (key, value...) rows,
+    // one per group of a range of pages, computed from the page bytes.
+    // group_by (at most one INT column) and aggr_funcs refer to the
+    // columns the scan outputs, value_types are those of the aggregated
+    // columns, and only tuples the predicate keeps are aggregated.
+    // A HashAggregationOperator with mergeFunctions() combines the rows.
+    void pushAggregation(const std::vector<size_t>& group_by, const std::vector<AggrFunc>& aggr_funcs,
+                         const std::vector<FieldType>& value_types,
+                         std::unique_ptr<IPredicate> predicate = nullptr) {
+        if (group_by.size() > 1) {
+            throw std::runtime_error("Only a single INT group-by attribute can be pushed into a scan.");
+        }
+        auto tableAttribute = [this](size_t column) {
+            return attributes.empty() ? column : attributes.at(column);
+        };
+        auto aggr = std::make_unique<PushedAggregation>();
+        if (!group_by.empty()) {
+            aggr->key_attr = tableAttribute(group_by[0]);
+        }
+        aggr->aggr_funcs = aggr_funcs;
+        for (size_t i = 0; i < aggr_funcs.size(); ++i) {
+            FieldType type = (aggr_funcs[i].func == AggrFuncType::COUNT) ? INT : value_types.at(i);
+            if (type == STRING) {
+                throw std::runtime_error("Only INT and FLOAT aggregates can be pushed into a scan.");
+            }
+            size_t attr = tableAttribute(aggr_funcs[i].attr_index);
+            aggr->value_types.push_back(type);
+            aggr->identities.push_back(aggregateIdentity(aggr_funcs[i].func, type));
+            aggr->value_attrs.push_back(attr);
+            if (aggr->attr_aggregates.size() <= attr) {
+                aggr->attr_aggregates.resize(attr + 1);
+            }
+            aggr->attr_aggregates[attr].push_back(i);
+        }
+        aggr->predicate = std::move(predicate);
+        partials = AggregationHashTable<int>(aggr_funcs.size());
+        row_values.resize(aggr_funcs.size());
+        pushed = std::move(aggr);
+    }
+
+    // The aggregates that combine the partial rows of aggr_funcs pushed
+    // with num_keys group-by columns: counts and sums add up
+    static std::vector<AggrFunc> mergeFunctions(const std::vector<AggrFunc>& aggr_funcs, size_t num_keys) {
+        std::vector<AggrFunc> merge;
+        for (size_t i = 0; i < aggr_funcs.size(); ++i) {
+            AggrFuncType func = aggr_funcs[i].func;
+            merge.push_back({(func == AggrFuncType::COUNT) ? AggrFuncType::SUM : func, num_keys + i});
+        }
+        return merge;
+    }
+
+    // Pages the bounds let the scan skip since it was opened
+    size_t getSkippedPages() const {
+        return pages_skipped;
+    }
+
+    void open() override {
+        currentPageIndex = 0;
+        currentSlotIndex = 0;
+        copied_page = INVALID_PAGE_ID;
+        pages_skipped = 0;
+        if (pushed) {
+            partials = AggregationHashTable<int>(pushed->aggr_funcs.size());
+            partial_slot = 0;
+            emitting = false;
+        }
+        currentBatch.clear();
+        batch_tuple_ids.clear();
+        currentRow = 0;
+        has_current = false;
+    }
+
+    bool next() override {
+        if (has_current && currentRow + 1 < currentBatch.size()) {
+            currentRow++;
+        } else {
+            currentRow = 0;
+            has_current = nextBatch(currentBatch);
+            if (!has_current) {
+                return false;
+            }
+        }
+        currentBatch.readTuple(currentRow, currentFields);
+        return true;
+    }
+
+    void close() override {
+        std::cout << "Scan Operator tuple_count: " << tuple_count << "\n";
+        currentPageIndex = 0;
+        currentSlotIndex = 0;
+        currentBatch.clear();
+        has_current = false;
+    }
+
+    const std::vector<std::unique_ptr<Field>>& getOutput() override {
+        if (has_current) {
+            return currentFields;
+        }
+        return noOutput(); // No tuple is available
+    }
+
+    bool nextBatch(Batch& batch) override {
+        batch.clear();
+        batch_tuple_ids.clear();
+        if (pushed) {
+            return nextPartials(batch);
+        }
+        if (const PaxLayout* layout = bufferManager.getPaxLayout()) {
+            return nextPaxBatch(batch, *layout);
+        }
+        while (currentPageIndex < lastPage()) {
+            const char* page_buffer = (currentSlotIndex == 0) ? readPage(currentPageIndex) : copyPage(currentPageIndex);
+            if (!page_buffer) {
+                currentPageIndex++;
+                continue;
+            }
+            const Slot* slot_array = reinterpret_cast<const Slot*>(page_buffer);
+
+            // Tuples deleted after the snapshot follow the slots
+            for (; currentSlotIndex < MAX_SLOTS + versions->deleted.size(); ++currentSlotIndex) {
+                const char* tuple;
+                size_t length;
+                size_t slot_itr = currentSlotIndex;
+                if (currentSlotIndex < MAX_SLOTS) {
+                    const Slot& slot = slot_array[currentSlotIndex];
+                    if (slot.empty || versions->isHidden(currentSlotIndex)) {
+                        continue;
+                    }
+                    assert(slot.offset != INVALID_VALUE);
+                    tuple = page_buffer + slot.offset;
+                    length = slot.length;
+                } else {
+                    const auto& deleted = versions->deleted[currentSlotIndex - MAX_SLOTS];
+                    slot_itr = deleted.first;
+                    tuple = deleted.second.data();
+                    length = deleted.second.size();
+                }
+                if (batch.size() == BATCH_SIZE) {
+                    return true; // Resume at this slot
+                }
+                if (attributes.empty()) {
+                    batch.appendSerialized(tuple, length);
+                } else {
+                    batch.appendSerialized(tuple, length, output_columns);
+                }
+                batch_tuple_ids.push_back(makeTupleID(currentPageIndex, slot_itr));
+                tuple_count++;
+            }
+
+            // Move to the next page after exhausting the current one
+            currentPageIndex++;
+            currentSlotIndex = 0;
+        }
+        return batch.size() > 0;
+    }
+
+    // Location of the current tuple, valid after next() returned true
+    TupleID getCurrentTupleID() const {
+        return batch_tuple_ids[currentRow];
+    }
+
+    // Locations of the tuples of the last batch returned by nextBatch()
+    const std::vector<TupleID>& getBatchTupleIDs() const {
+        return batch_tuple_ids;
+    }
+
+    double estimateCost(CostModel& costModel) override {
+        return costModel.estimateScanCost(bufferManager.getNumPages(), estimateRows(costModel));
+    }
+
+    double estimateRows(CostModel& costModel) override {
+        if (statistics && statistics->isAnalyzed()) {
+            return statistics->getRows();
+        }
+        return costModel.estimateTableRows(bufferManager.getNumPages());
+    }
+};
+
+// Fetches the tuples with lowerBound <= key <= upperBound through an
+// index on the key attribute (BTreeIndex or LearnedIndex), in key order
+template <typename Index>
+class IndexScanOperator : public Operator {
+private:
+    BufferManager& bufferManager;
+    Index& index;
+    int lowerBound;
+    int upperBound;
+    std::optional<typename Index::RangeIterator> iterator;
+    std::vector<std::unique_ptr<Field>> currentFields;
+    bool has_current = false;
+    size_t tuple_count = 0;
+
+public:
+    IndexScanOperator(BufferManager& manager, Index& index, int lowerBound, int upperBound)
+        : bufferManager(manager), index(index), lowerBound(lowerBound), upperBound(upperBound) {}
+
+    void open() override {
+        iterator.emplace(index.scan(lowerBound, upperBound));
+        has_current = false;
+    }
+
+    bool next() override {
+        int key;
+        TupleID tuple_id;
+        while (iterator && iterator->next(key, tuple_id)) {
+            auto guard = bufferManager.lock();
+            auto& page = bufferManager.getPage(tupleIDPage(tuple_id));
+            const Slot& slot = page->getSlot(tupleIDSlot(tuple_id));
+            if (slot.empty) {
+                continue; // Stale entry
+            }
+            Tuple::deserializeInto(currentFields, page->page_data.get() + slot.offset, slot.length);
+            tuple_count++;
+            has_current = true;
+            return true;
+        }
+        has_current = false;
+        return false;
+    }
+
+    void close() override {
+        std::cout << "Index Scan Operator tuple_count: " << tuple_count << "\n";
+        iterator.reset();
+        has_current = false;
+    }
+
+    const std::vector<std::unique_ptr<Field>>& getOutput() override {
+        if (has_current) {
+            return currentFields;
+        }
+        return noOutput();
+    }
+
+    double estimateCost(CostModel& costModel) override {
+        size_t matches = index.estimateRangeCount(lowerBound, upperBound);
+        return costModel.estimateIndexScanCost(index.estimateIndexPages(matches), matches);
+    }
+
+    double estimateRows(CostModel&) override {
+        return index.estimateRangeCount(lowerBound, upperBound);
+    }
+};
+
+void printTuple(const std::vector<std::unique_ptr<Field>>& tupleFields) {
+    std::cout << "Tuple: [";
+    for (const auto& field : tupleFields) {
+        field->print(); // Assuming `print()` is a method that prints field content
+        std::cout << " ";
+    }
+    std::cout << "]";
+}
+
+class SimplePredicate: public IPredicate {
+public:
+    enum OperandType { DIRECT, INDIRECT };
+    enum ComparisonOperator { EQ, NE, GT, GE, LT, LE }; // Renamed from PredicateType
+
+    struct Operand {
+        std::unique_ptr<Field> directValue;
+        size_t index = 0;
+        OperandType type;
+
+        Operand(std::unique_ptr<Field> value) : directValue(std::move(value)), type(DIRECT) {}
+        Operand(size_t idx) : index(idx), type(INDIRECT) {}
+    };
+
+    Operand left_operand;
+    Operand right_operand;
+    ComparisonOperator comparison_operator;
+
+    SimplePredicate(Operand left, Operand right, ComparisonOperator op)
+        : left_operand(std::move(left)), right_operand(std::move(right)), comparison_operator(op) {}
+
+    bool check(const std::vector<std::unique_ptr<Field>>& tupleFields) const {
+        const Field* leftField = nullptr;
+        const Field* rightField = nullptr;
+
+        if (left_operand.type == DIRECT) {
+            leftField = left_operand.directValue.get();
+        } else if (left_operand.type == INDIRECT && left_operand.index < tupleFields.size()) {
+            leftField = tupleFields[left_operand.index].get();
+        }
+
+        if (right_operand.type == DIRECT) {
+            rightField = right_operand.directValue.get();
+        } else if (right_operand.type == INDIRECT && right_operand.index < tupleFields.size()) {
+            rightField = tupleFields[right_operand.index].get();
+        }
+
+        if (leftField == nullptr || rightField == nullptr) {
+            std::cerr << "Error: Invalid field reference.\n";
+            return false;
+        }
+
+        if (leftField->getType() != rightField->getType()) {
+            std::cerr << "Error: Comparing fields of different types.\n";
+            return false;
+        }
+
+        // Perform comparison based on field type
+        switch (leftField->getType()) {
+            case FieldType::INT: {
+                int left_val = leftField->asInt();
+                int right_val = rightField->asInt();
+                return compare(left_val, right_val);
+            }
+            case FieldType::FLOAT: {
+                float left_val = leftField->asFloat();
+                float right_val = rightField->asFloat();
+                return compare(left_val, right_val);
+            }
+            case FieldType::STRING: {
+                std::string_view left_val(leftField->data.get(), leftField->data_length - 1);
+                std::string_view right_val(rightField->data.get(), rightField->data_length - 1);
+                return compare(left_val, right_val);
+            }
+            case FieldType::BIGINT:
+                return compare(leftField->asBigInt(), rightField->asBigInt());
+            default:
+                std::cerr << "Invalid field type\n";
+                return false;
+        }
+    }
+
+    // Compares whole columns at a time, resolving operand types once
+    void filter(const Batch& batch, std::vector<uint32_t>& selection) const override {
+        FieldType left_type = operandType(left_operand, batch);
+        FieldType right_type = operandType(right_operand, batch);
+        if (left_type != right_type) {
+            std::cerr << "Error: Comparing fields of different types.\n";
+            selection.clear();
+            return;
+        }
+
+        switch (left_type) {
+            case FieldType::INT: filterValues<int>(batch, selection); break;
+            case FieldType::FLOAT: filterValues<float>(batch, selection); break;
+            case FieldType::STRING: filterValues<std::string>(batch, selection); break;
+            case FieldType::BIGINT: filterValues<int64_t>(batch, selection); break;
+        }
+    }
+
+    std::optional<std::pair<size_t, ValueRange>> getRange() const override {
+        size_t attr;
+        const Field* constant;
+        ComparisonOperator op;
+        if (!attributeAndConstant(attr, constant, op) || constant->getType() == STRING) {
+            return std::nullopt;
+        }
+        // Integers are intervals [v, v + 1), floats points
+        double value = ColumnStatistics::numericValue(*constant);
+        double next = (constant->getType() == INT) ? value + 1 : value;
+        ValueRange range;
+        switch (op) {
+            case ComparisonOperator::GT: range.low = next; break;
+            case ComparisonOperator::GE: range.low = value; break;
+            case ComparisonOperator::LT: range.high = value; break;
+            case ComparisonOperator::LE: range.high = next; break;
+            default: return std::nullopt;
+        }
+        return std::make_pair(attr, range);
+    }
+
+    std::vector<std::pair<size_t, ValueRange>> getBounds() const override {
+        size_t attr;
+        const Field* constant;
+        ComparisonOperator op;
+        if (!attributeAndConstant(attr, constant, op) || constant->getType() == STRING) {
+            return {};
+        }
+        // Integers are the next integer past the constant for < and >
+        double value = ColumnStatistics::numericValue(*constant);
+        double step = (constant->getType() == INT) ? 1.0 : 0.0;
+        ValueRange range;
+        switch (op) {
+            case ComparisonOperator::EQ: range.low = range.high = value; break;
+            case ComparisonOperator::GT: range.low = value + step; break;
+            case ComparisonOperator::GE: range.low = value; break;
+            case ComparisonOperator::LT: range.high = value - step; break;
+            case ComparisonOperator::LE: range.high = value; break;
+            default: return {};
+        }
+        return {{attr, range}};
+    }
+
+    double estimateSelectivity(const CostModel& costModel) const override {
+        if (auto range = getRange()) {
+            return costModel.estimateRangeSelectivity(range->first, range->second);
+        }
+        size_t attr;
+        const Field* constant;
+        ComparisonOperator op;
+        if (attributeAndConstant(attr, constant, op)) {
+            if (op == ComparisonOperator::EQ) {
+                return costModel.estimateEqualitySelectivity(attr, *constant);
+            }
+            if (op == ComparisonOperator::NE) {
+                return 1.0 - costModel.estimateEqualitySelectivity(attr, *constant);
+            }
+        }
+        return CostModel::DEFAULT_SELECTIVITY;
+    }
+
+private:
+    // The predicate as "attribute op constant", flipping a constant on the left
+    bool attributeAndConstant(size_t& attr, const Field*& constant, ComparisonOperator& op) const {
+        op = comparison_operator;
+        if (left_operand.type == INDIRECT && right_operand.type == DIRECT) {
+            attr = left_operand.index;
+            constant = right_operand.directValue.get();
+            return true;
+        }
+        if (left_operand.type == DIRECT && right_operand.type == INDIRECT) {
+            attr = right_operand.index;
+            constant = left_operand.directValue.get();
+            switch (op) {
+                case ComparisonOperator::GT: op = ComparisonOperator::LT; break;
+                case ComparisonOperator::GE: op = ComparisonOperator::LE; break;
+                case ComparisonOperator::LT: op = ComparisonOperator::GT; break;
+                case ComparisonOperator::LE: op = ComparisonOperator::GE; break;
+                default: break;
+            }
+            return true;
+        }
+        return false;
+    }
+
+    static FieldType operandType(const Operand& operand, const Batch& batch) {
+        if (operand.type == DIRECT) {
+            return operand.directValue->getType();
+        }
+        if (operand.index >= batch.columns.size()) {
+            throw std::runtime_error("Predicate attribute {" + std::to_string(operand.index + 1) + "} is out of range.");
+        }
+        return batch.columns[operand.index].type;
+    }
+
+    template <typename T>
+    static T fieldValue(const Field& field) {
+        if constexpr (std::is_same_v<T, int>) {
+            return field.asInt();
+        } else if constexpr (std::is_same_v<T, float>) {
+            return field.asFloat();
+        } else if constexpr (std::is_same_v<T, int64_t>) {
+            return field.asBigInt();
+        } else {
+            return field.asString();
+        }
+    }
+
+    template <typename T>
+    void filterValues(const Batch& batch, std::vector<uint32_t>& selection) const {
+        // A column operand reads values[row], a constant has stride 0
+        const T* left_values = nullptr;
+        const T* right_values = nullptr;
+        T left_constant{}, right_constant{};
+        size_t left_stride = 0, right_stride = 0;
+        if (left_operand.type == DIRECT) {
+            left_constant = fieldValue<T>(*left_operand.directValue);
+            left_values = &left_constant;
+        } else {
+            left_values = batch.columns[left_operand.index].template values<T>().data();
+            left_stride = 1;
+        }
+        if (right_operand.type == DIRECT) {
+            right_constant = fieldValue<T>(*right_operand.directValue);
+            right_values = &right_constant;
+        } else {
+            right_values = batch.columns[right_operand.index].template values<T>().data();
+            right_stride = 1;
+        }
+
+        auto keep = [&](auto comparison) {
+            size_t kept = 0;
+            for (uint32_t row : selection) {
+                if (comparison(left_values[row * left_stride], right_values[row * right_stride])) {
+                    selection[kept++] = row;
+                }
+            }
+            selection.resize(kept);
+        };
+        switch (comparison_operator) {
+            case ComparisonOperator::EQ: keep(std::equal_to<T>()); break;
+            case ComparisonOperator::NE: keep(std::not_equal_to<T>()); break;
+            case ComparisonOperator::GT: keep(std::greater<T>()); break;
+            case ComparisonOperator::GE: keep(std::greater_equal<T>()); break;
+            case ComparisonOperator::LT: keep(std::less<T>()); break;
+            case ComparisonOperator::LE: keep(std::less_equal<T>()); break;
+        }
+    }
+
+    // Compares two values of the same type
+    template<typename T>
+    bool compare(const T& left_val, const T& right_val) const {
+        switch (comparison_operator) {
+            case ComparisonOperator::EQ: return left_val == right_val;
+            case ComparisonOperator::NE: return left_val != right_val;
+            case ComparisonOperator::GT: return left_val > right_val;
+            case ComparisonOperator::GE: return left_val >= right_val;
+            case ComparisonOperator::LT: return left_val < right_val;
+            case ComparisonOperator::LE: return left_val <= right_val;
+            default: std::cerr << "Invalid predicate type\n"; return false;
+        }
+    }
+};
+
+class ComplexPredicate : public IPredicate {
+public:
+    enum LogicOperator { AND, OR };
+
+private:
+    std::vector<std::unique_ptr<IPredicate>> predicates;
+    LogicOperator logic_operator;
+
+public:
+    ComplexPredicate(LogicOperator op) : logic_operator(op) {}
+
+    void addPredicate(std::unique_ptr<IPredicate> predicate) {
+        predicates.push_back(std::move(predicate));
+    }
+
+    bool check(const std::vector<std::unique_ptr<Field>>& tupleFields) const {
+        
+        if (logic_operator == AND) {
+            for (const auto& pred : predicates) {
+                if (!pred->check(tupleFields)) {
+                    return false; // If any predicate fails, the AND condition fails
+                }
+            }
+            return true; // All predicates passed
+        } else if (logic_operator == OR) {
+            for (const auto& pred : predicates) {
+                if (pred->check(tupleFields)) {
+                    return true; // If any predicate passes, the OR condition passes
+                }
+            }
+            return false; // No predicates passed
+        }
+        return false;
+    }
+
+    // AND narrows the selection predicate by predicate, OR unions the
+    // rows each predicate keeps from the original selection
+    void filter(const Batch& batch, std::vector<uint32_t>& selection) const override {
+        if (logic_operator == AND) {
+            for (const auto& pred : predicates) {
+                if (selection.empty()) {
+                    return;
+                }
+                pred->filter(batch, selection);
+            }
+            return;
+        }
+
+        std::vector<uint32_t> result, matches, merged;
+        for (const auto& pred : predicates) {
+            matches = selection;
+            pred->filter(batch, matches);
+            merged.clear();
+            std::set_union(result.begin(), result.end(), matches.begin(), matches.end(), std::back_inserter(merged));
+            result.swap(merged);
+        }
+        selection.swap(result);
+    }
+
+    // AND intersects the bounds of its predicates, OR takes the hull of
+    // the bounds of attributes that all of them bound
+    std::vector<std::pair<size_t, ValueRange>> getBounds() const override {
+        std::map<size_t, ValueRange> bounds;
+        for (size_t i = 0; i < predicates.size(); ++i) {
+            std::map<size_t, ValueRange> next;
+            for (const auto& [attr, range] : predicates[i]->getBounds()) {
+                auto it = bounds.find(attr);
+                if (logic_operator == AND) {
+                    auto& bound = bounds.try_emplace(attr, range).first->second;
+                    bound.low = std::max(bound.low, range.low);
+                    bound.high = std::min(bound.high, range.high);
+                } else if (i == 0) {
+                    next.emplace(attr, range);
+                } else if (it != bounds.end()) {
+                    next.emplace(attr, ValueRange{std::min(it->second.low, range.low),
+                                                  std::max(it->second.high, range.high)});
+                }
+            }
+            if (logic_operator == OR) {
+                bounds.swap(next);
+            }
+        }
+        return std::vector<std::pair<size_t, ValueRange>>(bounds.begin(), bounds.end());
+    }
+
+    // Predicates are taken as independent, except that AND combines
+    // range comparisons of one attribute into a single range
+    double estimateSelectivity(const CostModel& costModel) const override {
+        if (logic_operator == OR) {
+            double miss = 1.0;
+            for (const auto& pred : predicates) {
+                miss *= 1.0 - pred->estimateSelectivity(costModel);
+            }
+            return 1.0 - miss;
+        }
+
+        double selectivity = 1.0;
+        std::map<size_t, ValueRange> ranges;
+        for (const auto& pred : predicates) {
+            if (auto range = pred->getRange()) {
+                auto [it, inserted] = ranges.try_emplace(range->first, range->second);
+                if (!inserted) {
+                    it->second.low = std::max(it->second.low, range->second.low);
+                    it->second.high = std::min(it->second.high, range->second.high);
+                }
+            } else {
+                selectivity *= pred->estimateSelectivity(costModel);
+            }
+        }
+        for (const auto& [attr, range] : ranges) {
+            selectivity *= (range.low < range.high) ? costModel.estimateRangeSelectivity(attr, range) : 0.0;
+        }
+        return selectivity;
+    }
+};
+
+
+// Passes on the input tuples that satisfy the predicate. getOutput()
+// hands out the input's Fields, nothing is copied.
+class SelectOperator : public UnaryOperator {
+private:
+    std::unique_ptr<IPredicate> predicate;
+    bool has_next;
+    Batch inputBatch;
+    std::vector<uint32_t> selection;
+
+public:
+    SelectOperator(Operator& input, std::unique_ptr<IPredicate> predicate)
+        : UnaryOperator(input), predicate(std::move(predicate)), has_next(false) {}
+
+    void open() override {
+        input->open();
+        has_next = false;
+    }
+
+    bool next() override {
+        while (input->next()) {
+            if (predicate->check(input->getOutput())) {
+                has_next = true;
+                return true;
+            }
+        }
+        has_next = false;
+        return false;
+    }
+
+    void close() override {
+        input->close();
+        has_next = false;
+    }
+
+    const std::vector<std::unique_ptr<Field>>& getOutput() override {
+        if (has_next) {
+            // The input still holds the tuple that passed the predicate
+            return input->getOutput();
+        }
+        return noOutput(); // No matching tuple
+    }
+
+    bool nextBatch(Batch& batch) override {
+        batch.clear();
+        while (input->nextBatch(inputBatch)) {
+            selection.resize(inputBatch.size());
+            std::iota(selection.begin(), selection.end(), 0);
+            predicate->filter(inputBatch, selection);
+            if (selection.size() == inputBatch.size()) {
+                std::swap(batch, inputBatch);
+                return true;
+            }
+            if (!selection.empty()) {
+                batch.appendRows(inputBatch, selection);
+                return true;
+            }
+        }
+        return false;
+    }
+
+    double estimateCost(CostModel& costModel) override {
+        return input->estimateCost(costModel) + costModel.estimateSelectCost(input->estimateRows(costModel));
+    }
+
+    double estimateRows(CostModel& costModel) override {
+        return input->estimateRows(costModel) * predicate->estimateSelectivity(costModel);
+    }
+};
+
+// Outputs the given attributes of every input tuple, in the given order
+class ProjectionOperator : public UnaryOperator {
+private:
+    std::vector<size_t> attributes;
+    std::vector<std::unique_ptr<Field>> output;
+    Batch inputBatch;
+    bool has_next;
+
+public:
+    ProjectionOperator(Operator& input, std::vector<size_t> attributes)
+        : UnaryOperator(input), attributes(std::move(attributes)), has_next(false) {}
+
+    void open() override {
+        input->open();
+        has_next = false;
+    }
+
+    bool next() override {
+        has_next = input->next();
+        if (has_next) {
+            const auto& fields = input->getOutput();
+            for (size_t i = 0; i < attributes.size(); ++i) {
+                Tuple::reuseField(output, i) = *fields[attributes[i]];
+            }
+        }
+        return has_next;
+    }
+
+    void close() override {
+        input->close();
+        has_next = false;
+    }
+
+    const std::vector<std::unique_ptr<Field>>& getOutput() override {
+        return has_next ? output : noOutput();
+    }
+
+    bool nextBatch(Batch& batch) override {
+        batch.clear();
+        if (!input->nextBatch(inputBatch)) {
+            return false;
+        }
+        batch.appendColumns(attributes.size(), inputBatch.size(), [this](size_t i, ColumnVector& column) {
+            column = inputBatch.columns[attributes[i]];
+        });
+        return true;
+    }
+
+    double estimateCost(CostModel& costModel) override {
+        return input->estimateCost(costModel);
+    }
+
+    double estimateRows(CostModel& costModel) override {
+        return input->estimateRows(costModel);
+    }
+};
+
+// Runs are written and read in chunks of this many consecutive pages
+static constexpr size_t SORT_CHUNK_PAGES = 16;
+
+// Runs of rows in a temporary file: the sorted runs of
+// ExternalSortOperator and the spilled partitions of
+// HashAggregationOperator. The file is unlinked as soon as it is created
+// so it disappears with its descriptor. Each writer takes chunks of
+// SORT_CHUNK_PAGES pages for itself, so runs can be written
+// concurrently. A page holds a 2 byte row count followed by the rows,
+// encoded attribute by attribute (ColumnVector::encode).
+class SortRunFile {
+public:
+    struct Run {
+        std::vector<PageID> chunks;     // First page of every chunk
+        size_t num_pages = 0;           // All chunks but the last are full
+        size_t num_rows = 0;
+    };
+
+    // Types of the attributes of every row
+    std::vector<FieldType> types;
+
+private:
+    int fd = -1;
+    std::atomic<PageID> num_pages{0};
+    std::atomic<size_t> pages_written{0};
+
+public:
+    explicit SortRunFile(const std::string& prefix) {
+        std::string filename = prefix + "_XXXXXX";
+        fd = ::mkstemp(filename.data());
+        if (fd < 0) {
+            throw std::runtime_error("Unable to create sort run file " + filename);
+        }
+        ::unlink(filename.c_str());
+    }
+
+    ~SortRunFile() {
+        if (fd >= 0) {
+            ::close(fd);
+        }
+    }
+
+    SortRunFile(const SortRunFile&) = delete;
+    SortRunFile& operator=(const SortRunFile&) = delete;
+
+    // Append count pages as the next chunk of run
+    void writeChunk(const char* pages, size_t count, Run& run) {
+        PageID first_page = num_pages.fetch_add(SORT_CHUNK_PAGES);
+        if (!writeFully(fd, pages, count * PAGE_SIZE, static_cast<off_t>(first_page) * PAGE_SIZE)) {
+            throw std::runtime_error("Unable to write sort run.");
+        }
+        run.chunks.push_back(first_page);
+        run.num_pages += count;
+        pages_written += count;
+    }
+
+    void readPages(PageID first_page, size_t count, char* pages) const {
+        if (!readFully(fd, pages, count * PAGE_SIZE, static_cast<off_t>(first_page) * PAGE_SIZE)) {
+            throw std::runtime_error("Unable to read sort run.");
+        }
+    }
+
+    size_t getPagesWritten() const {
+        return pages_written;
+    }
+};
+
+// Writes rows to a new run, buffering one chunk
+class SortRunWriter {
+private:
+    SortRunFile& file;
+    SortRunFile::Run run;
+    std::unique_ptr<char[]> chunk = std::make_unique<char[]>(SORT_CHUNK_PAGES * PAGE_SIZE);
+    size_t page = 0;                    // Page of the chunk being filled
+    size_t offset = sizeof(uint16_t);   // End of the rows in it
+    uint16_t page_rows = 0;
+
+public:
+    explicit SortRunWriter(SortRunFile& file) : file(file) {}
+
+    void append(const Batch& batch, size_t row) {
+        size_t size = 0;
+        for (const auto& column : batch.columns) {
+            size += column.encodedSize(row);
+        }
+        if (offset + size > PAGE_SIZE) {
+            if (page_rows == 0) {
+                throw std::runtime_error("Tuple too large for a sort run page.");
+            }
+            finishPage();
+        }
+        char* out = chunk.get() + page * PAGE_SIZE + offset;
+        for (const auto& column : batch.columns) {
+            out = column.encode(row, out);
+        }
+        offset += size;
+        page_rows++;
+        run.num_rows++;
+    }
+
+    // Write what is buffered and return the run
+    SortRunFile::Run finish() {
+        if (page_rows > 0) {
+            finishPage();
+        }
+        if (page > 0) {
+            flush();
+        }
+        return std::move(run);
+    }
+
+private:
+    void finishPage() {
+        std::memcpy(chunk.get() + page * PAGE_SIZE, &page_rows, sizeof(page_rows));
+        page++;
+        offset = sizeof(uint16_t);
+        page_rows = 0;
+        if (page == SORT_CHUNK_PAGES) {
+            flush();
+        }
+    }
+
+    void flush() {
+        file.writeChunk(chunk.get(), page, run);
+        page = 0;
+    }
+};
+
+// Reads a run back a chunk at a time; rows holds the decoded current
+// page and row the current row of it
+class SortRunReader {
+private:
+    const SortRunFile* file;
+    SortRunFile::Run run;
+    std::unique_ptr<char[]> chunk = std::make_unique<char[]>(SORT_CHUNK_PAGES * PAGE_SIZE);
+    size_t next_chunk = 0;
+    size_t chunk_pages = 0;
+    size_t page = 0;                    // Next page of the chunk to decode
+    size_t pages_left;                  // Not yet read from the file
+
+public:
+    Batch rows;
+    size_t row = 0;
+
+    SortRunReader(const SortRunFile& file, SortRunFile::Run run)
+        : file(&file), run(std::move(run)), pages_left(this->run.num_pages) {
+        loadPage();
+    }
+
+    bool exhausted() const {
+        return row >= rows.size();
+    }
+
+    void advance() {
+        if (++row >= rows.size()) {
+            loadPage();
+        }
+    }
+
+private:
+    void loadPage() {
+        rows.clear();
+        row = 0;
+        if (page == chunk_pages) {
+            if (next_chunk == run.chunks.size()) {
+                return;
+            }
+            chunk_pages = std::min(SORT_CHUNK_PAGES, pages_left);
+            file->readPages(run.chunks[next_chunk++], chunk_pages, chunk.get());
+            pages_left -= chunk_pages;
+            page = 0;
+        }
+        const char* data = chunk.get() + page++ * PAGE_SIZE;
+        uint16_t count;
+        std::memcpy(&count, data, sizeof(count));
+        data += sizeof(count);
+        for (uint16_t i = 0; i < count; ++i) {
+            data = rows.appendEncoded(data, file->types);
+        }
+    }
+};
+
+
+// Default memory budget of HashAggregationOperator
+constexpr size_t AGGREGATION_MEMORY_BUDGET = 64 << 20;
+// A spilling aggregation splits its groups into 2^AGGREGATION_SPILL_BITS
+// partitions on the next bits of their hashes, from the top
+constexpr size_t AGGREGATION_SPILL_BITS = 4;
+constexpr size_t AGGREGATION_SPILL_PARTITIONS = size_t{1} << AGGREGATION_SPILL_BITS;
+// Partitions this many times split are aggregated in memory whatever
+// their size (all 32 high hash bits are used up)
+constexpr size_t AGGREGATION_MAX_SPILL_LEVEL = 32 / AGGREGATION_SPILL_BITS;
+
+// Groups on group_by_attrs and computes aggr_funcs per group. A single INT
+// group-by attribute uses an int keyed AggregationHashTable, other
+// groupings an encoded std::string key. With num_threads > 1 the input is
+// aggregated in two phases: worker threads take batches from the input in
+// turn and pre-aggregate them into thread-local tables, then worker t
+// merges the groups of hash partition t from all local tables.
+//
+// The tables stay within memory_budget bytes (shared by the workers).
+// When a new group would take a table past it, its groups are written to
+// a SortRunFile as partial aggregates, split into hash partitions, and
+// the table starts over empty. The partitions are then aggregated one at
+// a time, partitioned again on the next hash bits if one does not fit.
+// Groups are output a batch at a time straight from the tables.
+class HashAggregationOperator : public UnaryOperator {
+private:
+    // Partial aggregates of one hash partition, as (group key...,
+    // value...) rows in the spill file
+    struct SpilledPartition {
+        std::vector<SortRunFile::Run> runs;
+        size_t level = 0;               // Spill level that wrote it
+    };
+
+    // Where a table spills: one run writer per partition, opened on the
+    // first spill. level selects the hash bits, budget is the memory the
+    // table may take.
+    class PartitionWriters {
+    private:
+        std::vector<SortRunWriter> writers;
+
+    public:
+        const size_t level;
+        const size_t budget;
+
+        PartitionWriters(size_t level, size_t budget) : level(level), budget(budget) {}
+
+        bool isOpen() const {
+            return !writers.empty();
+        }
+
+        void open(SortRunFile& file) {
+            writers.reserve(AGGREGATION_SPILL_PARTITIONS);
+            for (size_t i = 0; i < AGGREGATION_SPILL_PARTITIONS; ++i) {
+                writers.emplace_back(file);
+            }
+        }
+
+        SortRunWriter& of(uint64_t hash) {
+            size_t shift = 64 - AGGREGATION_SPILL_BITS * (level + 1);
+            return writers[(hash >> shift) % AGGREGATION_SPILL_PARTITIONS];
+        }
+
+        // Finish the runs, adding the run of partition i to spilled[i]
+        void finish(std::vector<SpilledPartition>& spilled) {
+            for (size_t i = 0; i < writers.size(); ++i) {
+                SortRunFile::Run run = writers[i].finish();
+                if (run.num_rows > 0) {
+                    spilled[i].runs.push_back(std::move(run));
+                }
+            }
+            writers.clear();
+        }
+    };
+
+    // Chunk buffers of one PartitionWriters, taken from the budget
+    static constexpr size_t WRITER_BYTES = AGGREGATION_SPILL_PARTITIONS * SORT_CHUNK_PAGES * PAGE_SIZE;
+
+    std::vector<size_t> group_by_attrs;
+    std::vector<AggrFunc> aggr_funcs;
+    size_t num_threads;
+    size_t memory_budget;
+    std::string temp_prefix;
+
+    // Types of the group-by attributes, of the aggregated values and of
+    // the aggregates output, taken from the first input tuple
+    std::vector<FieldType> key_types;
+    std::vector<FieldType> value_types;
+    std::vector<FieldType> result_types;
+    std::vector<AggregateValue> initial_values;
+
+    // The input is aggregated by the first next() or nextBatch() call,
+    // through the same interface
+    bool aggregated = false;
+
+    // Aggregated tables not output yet (of the key type in use), output
+    // from slot output_slot of table output_table on
+    std::vector<AggregationHashTable<int>> int_tables;
+    std::vector<AggregationHashTable<std::string>> string_tables;
+    size_t output_table = 0;
+    size_t output_slot = 0;
+
+    // Spilled groups: the file and the partitions not aggregated yet
+    std::unique_ptr<SortRunFile> spill_file;
+    std::mutex spill_latch;
+    std::vector<SpilledPartition> partitions;
+    size_t num_partitions = 0;
+    size_t pages_written = 0;
+
+    // Batch behind next() / getOutput()
+    Batch currentBatch;
+    size_t currentRow = 0;
+    bool has_current = false;
+    std::vector<std::unique_ptr<Field>> currentFields;
+
+public:
+    HashAggregationOperator(Operator& input, std::vector<size_t> group_by_attrs, std::vector<AggrFunc> aggr_funcs,
+                            size_t num_threads = 1, size_t memory_budget = AGGREGATION_MEMORY_BUDGET,
+                            std::string temp_prefix = "buzzdb_aggregation")
+        : UnaryOperator(input), group_by_attrs(group_by_attrs), aggr_funcs(aggr_funcs),
+          num_threads(std::max<size_t>(1, num_threads)), memory_budget(memory_budget),
+          temp_prefix(std::move(temp_prefix)) {}
+
+    void open() override {
+        input->open(); // Ensure the input operator is opened
+        release();
+        aggregated = false;
+        key_types.clear();
+        value_types.clear();
+        result_types.clear();
+        num_partitions = 0;
+        pages_written = 0;
+        currentBatch.clear();
+        has_current = false;
+    }
+
+    bool next() override {
+        if (!aggregated) {
+            if (num_threads > 1) {
+                aggregateBatches();
+            } else {
+                aggregateTuples();
+            }
+        }
+        if (has_current && currentRow + 1 < currentBatch.size()) {
+            currentRow++;
+        } else {
+            currentRow = 0;
+            has_current = produce(currentBatch);
+            if (!has_current) {
+                return false;
+            }
+        }
+        currentBatch.readTuple(currentRow, currentFields);
+        return true;
+    }
+
+    void close() override {
+        input->close();
+        release();
+        has_current = false;
+    }
+
+    const std::vector<std::unique_ptr<Field>>& getOutput() override {
+        if (has_current) {
+            return currentFields;
+        }
+        return noOutput(); // next() hasn't been called yet or we're past the last group
+    }
+
+    bool nextBatch(Batch& batch) override {
+        if (!aggregated) {
+            aggregateBatches();
+        }
+        return produce(batch);
+    }
+
+    double estimateCost(CostModel& costModel) override {
+        double inputRows = input->estimateRows(costModel);
+        double groups = costModel.estimateGroups(group_by_attrs, inputRows);
+        // Groups that do not fit are written and read back once, as rows
+        // of 4 bytes per attribute
+        double group_bytes = 4.0 * (group_by_attrs.size() + aggr_funcs.size());
+        double spill_pages = (groups * (sizeof(uint64_t) + group_bytes) * 2 > memory_budget)
+            ? groups * group_bytes / PAGE_SIZE : 0.0;
+        return input->estimateCost(costModel) + costModel.estimateHashAggregateCost(inputRows, groups, spill_pages);
+    }
+
+    double estimateRows(CostModel& costModel) override {
+        return costModel.estimateGroups(group_by_attrs, input->estimateRows(costModel));
+    }
+
+    // Hash partitions written by the last run, counting repartitioned ones
+    size_t getSpilledPartitions() const {
+        return num_partitions;
+    }
+
+    size_t getPagesWritten() const {
+        return spill_file ? spill_file->getPagesWritten() : pages_written;
+    }
+
+private:
+    // Drop the tables and the spilled partitions
+    void release() {
+        int_tables.clear();
+        string_tables.clear();
+        output_table = 0;
+        output_slot = 0;
+        partitions.clear();
+        if (spill_file) {
+            pages_written = spill_file->getPagesWritten();
+            spill_file.reset();
+        }
+    }
+
+    bool useIntKey() const {
+        return group_by_attrs.size() == 1 && key_types[0] == INT;
+    }
+
+    // Fix the key and value types from the attribute types of the first
+    // tuple, getType(attr) returning the type of attribute attr
+    template <typename TypeOf>
+    void resolveTypes(TypeOf getType) {
+        key_types.clear();
+        for (auto attr : group_by_attrs) {
+            key_types.push_back(getType(attr));
+        }
+        value_types.clear();
+        result_types.clear();
+        initial_values.clear();
+        for (const auto& aggr : aggr_funcs) {
+            FieldType type = (aggr.func == AggrFuncType::COUNT) ? INT : getType(aggr.attr_index);
+            if (type == STRING) {
+                throw std::runtime_error("Unsupported Field type for aggregation.");
+            }
+            value_types.push_back(type);
+            result_types.push_back(aggregateResultType(aggr.func, type));
+            initial_values.push_back(aggregateIdentity(aggr.func, type));
+        }
+    }
+
+    void update(AggregateValue* values, const std::vector<std::unique_ptr<Field>>& tuple) const {
+        for (size_t i = 0; i < aggr_funcs.size(); ++i) {
+            if (aggr_funcs[i].func == AggrFuncType::COUNT) {
+                values[i].i++;
+            } else if (value_types[i] == INT) {
+                foldAggregate(aggr_funcs[i].func, values[i].i, tuple[aggr_funcs[i].attr_index]->asInt());
+            } else if (value_types[i] == BIGINT) {
+                foldAggregate(aggr_funcs[i].func, values[i].i, tuple[aggr_funcs[i].attr_index]->asBigInt());
+            } else {
+                foldAggregate(aggr_funcs[i].func, values[i].f, tuple[aggr_funcs[i].attr_index]->asFloat());
+            }
+        }
+    }
+
+    void update(AggregateValue* values, const Batch& batch, size_t row) const {
+        for (size_t i = 0; i < aggr_funcs.size(); ++i) {
+            const ColumnVector& column = batch.columns[aggr_funcs[i].attr_index];
+            if (aggr_funcs[i].func == AggrFuncType::COUNT) {
+                values[i].i++;
+            } else if (value_types[i] == INT) {
+                foldAggregate(aggr_funcs[i].func, values[i].i, column.ints[row]);
+            } else if (value_types[i] == BIGINT) {
+                foldAggregate(aggr_funcs[i].func, values[i].i, column.bigints[row]);
+            } else {
+                foldAggregate(aggr_funcs[i].func, values[i].f, column.floats[row]);
+            }
+        }
+    }
+
+    // Combine the values of the same group from two partial aggregations
+    void merge(AggregateValue* values, const AggregateValue* other) const {
+        for (size_t i = 0; i < aggr_funcs.size(); ++i) {
+            AggrFuncType func = (aggr_funcs[i].func == AggrFuncType::COUNT) ? AggrFuncType::SUM : aggr_funcs[i].func;
+            if (value_types[i] != FLOAT) {
+                foldAggregate(func, values[i].i, other[i].i);
+            } else {
+                foldAggregate(func, values[i].f, other[i].f);
+            }
+        }
+    }
+
+    // merge() with the values of a spilled (group key..., value...) row
+    void merge(AggregateValue* values, const Batch& rows, size_t row) const {
+        for (size_t i = 0; i < aggr_funcs.size(); ++i) {
+            AggrFuncType func = (aggr_funcs[i].func == AggrFuncType::COUNT) ? AggrFuncType::SUM : aggr_funcs[i].func;
+            const ColumnVector& column = rows.columns[key_types.size() + i];
+            if (result_types[i] == INT) {
+                foldAggregate(func, values[i].i, column.ints[row]);
+            } else if (result_types[i] == BIGINT) {
+                foldAggregate(func, values[i].i, column.bigints[row]);
+            } else {
+                foldAggregate(func, values[i].f, column.floats[row]);
+            }
+        }
+    }
+
+    // Group-by values encoded back to back into key: 4 bytes for INT and
+    // FLOAT, 8 for BIGINT, a 4 byte length and the bytes for STRING
+    static void appendKey(std::string& key, const Field& field) {
+        if (field.getType() == STRING) {
+            uint32_t length = field.data_length - 1;
+            key.append(reinterpret_cast<const char*>(&length), sizeof(length));
+            key.append(field.data.get(), length);
+        } else {
+            key.append(field.data.get(), field.data_length);
+        }
+    }
+
+    static void appendKey(std::string& key, const ColumnVector& column, size_t row) {
+        switch (column.type) {
+            case INT: key.append(reinterpret_cast<const char*>(&column.ints[row]), 4); break;
+            case FLOAT: key.append(reinterpret_cast<const char*>(&column.floats[row]), 4); break;
+            case STRING: {
+                uint32_t length = column.strings[row].size();
+                key.append(reinterpret_cast<const char*>(&length), sizeof(length));
+                key.append(column.strings[row]);
+                break;
+            }
+            case BIGINT: key.append(reinterpret_cast<const char*>(&column.bigints[row]), 8); break;
+        }
+    }
+
+    // The group key of a tuple or of a batch row grouped on attrs as
+    // looked up in the table, scratch holding the encoded key of
+    // std::string tables
+    int groupKey(int*, const std::vector<std::unique_ptr<Field>>& tuple, std::string&) const {
+        return tuple[group_by_attrs[0]]->asInt();
+    }
+    int groupKey(int*, const Batch& batch, size_t row, const std::vector<size_t>& attrs, std::string&) const {
+        return batch.columns[attrs[0]].ints[row];
+    }
+    std::string_view groupKey(std::string*, const std::vector<std::unique_ptr<Field>>& tuple, std::string& scratch) const {
+        scratch.clear();
+        for (auto attr : group_by_attrs) {
+            appendKey(scratch, *tuple[attr]);
+        }
+        return scratch;
+    }
+    std::string_view groupKey(std::string*, const Batch& batch, size_t row, const std::vector<size_t>& attrs,
+                              std::string& scratch) const {
+        scratch.clear();
+        for (auto attr : attrs) {
+            appendKey(scratch, batch.columns[attr], row);
+        }
+        return scratch;
+    }
+
+    std::vector<AggregationHashTable<int>>& tables(int*) {
+        return int_tables;
+    }
+    std::vector<AggregationHashTable<std::string>>& tables(std::string*) {
+        return string_tables;
+    }
+
+    // Memory one of num_workers tables may take next to its writers
+    size_t tableBudget(size_t num_workers) const {
+        return std::max(memory_budget / num_workers, 2 * WRITER_BYTES) - WRITER_BYTES;
+    }
+
+    SortRunFile& spillFile() {
+        std::lock_guard<std::mutex> lock(spill_latch);
+        if (!spill_file) {
+            spill_file = std::make_unique<SortRunFile>(temp_prefix);
+            spill_file->types = key_types;
+            spill_file->types.insert(spill_file->types.end(), result_types.begin(), result_types.end());
+        }
+        return *spill_file;
+    }
+
+    // Write the groups of table to its partitions and empty it
+    template <typename Key>
+    void spill(AggregationHashTable<Key>& table, PartitionWriters& writers) {
+        if (!writers.isOpen()) {
+            writers.open(spillFile());
+        }
+        Batch row;
+        table.forEach([&](const Key& key, uint64_t hash, const AggregateValue* values) {
+            row.clear();
+            appendGroup(row, key, values);
+            writers.of(hash).append(row, 0);
+        });
+        table = AggregationHashTable<Key>(aggr_funcs.size());
+    }
+
+    // Spill table if a new group could take it past its budget
+    template <typename Key>
+    void makeRoom(AggregationHashTable<Key>& table, PartitionWriters& writers) {
+        if (writers.level < AGGREGATION_MAX_SPILL_LEVEL && !table.canInsert(writers.budget)) {
+            spill(table, writers);
+        }
+    }
+
+    // Queue the partitions written at level, spilled[i] holding the
+    // runs of partition i
+    void queue(std::vector<SpilledPartition>& spilled, size_t level) {
+        for (auto& partition : spilled) {
+            if (!partition.runs.empty()) {
+                partition.level = level;
+                partitions.push_back(std::move(partition));
+                num_partitions++;
+            }
+        }
+    }
+
+    // Make the groups of table the next output if it never spilled, and
+    // otherwise spill the rest of it and queue its partitions
+    template <typename Key>
+    void finish(AggregationHashTable<Key>& table, PartitionWriters& writers) {
+        if (!writers.isOpen()) {
+            tables(static_cast<Key*>(nullptr)).push_back(std::move(table));
+            return;
+        }
+        std::vector<SpilledPartition> spilled(AGGREGATION_SPILL_PARTITIONS);
+        spill(table, writers);
+        writers.finish(spilled);
+        queue(spilled, writers.level);
+    }
+
+    void aggregateTuples() {
+        aggregated = true;
+        if (!input->next()) {
+            return;
+        }
+        const auto& first = input->getOutput();
+        resolveTypes([&first](size_t attr) { return first[attr]->getType(); });
+        if (useIntKey()) {
+            aggregateTuples<int>();
+        } else {
+            aggregateTuples<std::string>();
+        }
+    }
+
+    // Aggregate the input from its current tuple on
+    template <typename Key>
+    void aggregateTuples() {
+        AggregationHashTable<Key> table(aggr_funcs.size());
+        PartitionWriters writers(0, tableBudget(1));
+        std::string scratch;
+        do {
+            const auto& tuple = input->getOutput();
+            auto key = groupKey(static_cast<Key*>(nullptr), tuple, scratch);
+            makeRoom(table, writers);
+            update(table.findOrInsert(key, table.hash(key), initial_values.data()), tuple);
+        } while (input->next());
+        finish(table, writers);
+    }
+
+    void aggregateBatches() {
+        aggregated = true;
+        Batch batch;
+        if (!input->nextBatch(batch)) {
+            return;
+        }
+        resolveTypes([&batch](size_t attr) { return batch.columns[attr].type; });
+        if (useIntKey()) {
+            aggregateBatches<int>(batch);
+        } else {
+            aggregateBatches<std::string>(batch);
+        }
+    }
+
+    template <typename Key>
+    void aggregateBatch(AggregationHashTable<Key>& table, PartitionWriters& writers, const Batch& batch,
+                        std::string& scratch) {
+        for (size_t row = 0; row < batch.size(); ++row) {
+            auto key = groupKey(static_cast<Key*>(nullptr), batch, row, group_by_attrs, scratch);
+            makeRoom(table, writers);
+            update(table.findOrInsert(key, table.hash(key), initial_values.data()), batch, row);
+        }
+    }
+
+    // Aggregate first and the rest of the input batch by batch
+    template <typename Key>
+    void aggregateBatches(Batch& first) {
+        if (num_threads == 1) {
+            AggregationHashTable<Key> table(aggr_funcs.size());
+            PartitionWriters writers(0, tableBudget(1));
+            std::string scratch;
+            do {
+                aggregateBatch(table, writers, first, scratch);
+            } while (input->nextBatch(first));
+            finish(table, writers);
+            return;
+        }
+
+        // Phase 1: thread-local pre-aggregation. The input is not thread
+        // safe, so workers take batches from it in turn.
+        std::vector<AggregationHashTable<Key>> local_tables(num_threads, AggregationHashTable<Key>(aggr_funcs.size()));
+        std::vector<PartitionWriters> local_writers;
+        local_writers.reserve(num_threads);
+        for (size_t worker = 0; worker < num_threads; ++worker) {
+            local_writers.emplace_back(0, tableBudget(num_threads));
+        }
+        std::mutex input_latch;
+        bool first_taken = false;
+        runWorkers([&](size_t worker) {
+            Batch batch;
+            std::string scratch;
+            while (true) {
+                {
+                    std::lock_guard<std::mutex> lock(input_latch);
+                    if (!first_taken) {
+                        std::swap(batch, first);
+                        first_taken = true;
+                    } else if (!input->nextBatch(batch)) {
+                        break;
+                    }
+                }
+                aggregateBatch(local_tables[worker], local_writers[worker], batch, scratch);
+            }
+        });
+
+        // If a worker spilled, all groups go to the partitions: the same
+        // group may be in any local table
+        if (std::any_of(local_writers.begin(), local_writers.end(), [](const auto& w) { return w.isOpen(); })) {
+            std::vector<SpilledPartition> spilled(AGGREGATION_SPILL_PARTITIONS);
+            for (size_t worker = 0; worker < num_threads; ++worker) {
+                spill(local_tables[worker], local_writers[worker]);
+                local_writers[worker].finish(spilled);
+            }
+            queue(spilled, 0);
+            return;
+        }
+
+        // Phase 2: worker t merges the groups of partition t
+        std::vector<AggregationHashTable<Key>> merged(num_threads, AggregationHashTable<Key>(aggr_funcs.size()));
+        runWorkers([&](size_t worker) {
+            for (const auto& local_table : local_tables) {
+                local_table.forEach([&](const Key& key, uint64_t hash, const AggregateValue* values) {
+                    if ((hash >> 32) % num_threads == worker) {
+                        merge(merged[worker].findOrInsert(GroupKeyTraits<Key>::view(key), hash,
+                                                          initial_values.data()), values);
+                    }
+                });
+            }
+        });
+        for (auto& table : merged) {
+            tables(static_cast<Key*>(nullptr)).push_back(std::move(table));
+        }
+    }
+
+    // Aggregate spilled partitions until one fits its budget and make it
+    // the next output; false once no partition is left
+    template <typename Key>
+    bool loadPartition() {
+        std::vector<size_t> key_columns(key_types.size());
+        std::iota(key_columns.begin(), key_columns.end(), 0);
+        std::string scratch;
+        while (!partitions.empty()) {
+            SpilledPartition partition = std::move(partitions.back());
+            partitions.pop_back();
+            AggregationHashTable<Key> table(aggr_funcs.size());
+            PartitionWriters writers(partition.level + 1, tableBudget(1));
+            for (auto& run : partition.runs) {
+                for (SortRunReader reader(*spill_file, std::move(run)); !reader.exhausted(); reader.advance()) {
+                    auto key = groupKey(static_cast<Key*>(nullptr), reader.rows, reader.row, key_columns, scratch);
+                    makeRoom(table, writers);
+                    merge(table.findOrInsert(key, table.hash(key), initial_values.data()), reader.rows, reader.row);
+                }
+            }
+            finish(table, writers);
+            if (!tables(static_cast<Key*>(nullptr)).empty()) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    bool produce(Batch& batch) {
+        batch.clear();
+        if (key_types.size() != group_by_attrs.size() || value_types.size() != aggr_funcs.size()) {
+            return false; // Empty input
+        }
+        return useIntKey() ? produce<int>(batch) : produce<std::string>(batch);
+    }
+
+    // Fill batch with the next groups of the output tables, aggregating
+    // the next spilled partition when they run out
+    template <typename Key>
+    bool produce(Batch& batch) {
+        auto& output = tables(static_cast<Key*>(nullptr));
+        while (batch.size() < BATCH_SIZE) {
+            if (output_table == output.size()) {
+                output.clear();
+                output_table = 0;
+                if (!loadPartition<Key>()) {
+                    break;
+                }
+            }
+            auto& table = output[output_table];
+            output_slot = table.forEach(output_slot, BATCH_SIZE - batch.size(),
+                                        [&](const Key& key, uint64_t, const AggregateValue* values) {
+                                            appendGroup(batch, key, values);
+                                        });
+            if (table.done(output_slot)) {
+                table = AggregationHashTable<Key>(aggr_funcs.size());
+                output_table++;
+                output_slot = 0;
+            }
+        }
+        return batch.size() > 0;
+    }
+
+    template <typename Function>
+    void runWorkers(Function&& work) {
+        std::vector<std::thread> workers;
+        for (size_t worker = 0; worker < num_threads; ++worker) {
+            workers.emplace_back(work, worker);
+        }
+        for (auto& thread : workers) {
+            thread.join();
+        }
+    }
+
+    void appendValue(ColumnVector& column, size_t i, const AggregateValue* values) const {
+        switch (result_types[i]) {
+            case INT: column.append(static_cast<int>(values[i].i)); break;
+            case BIGINT: column.append(values[i].i); break;
+            default: column.append(values[i].f); break;
+        }
+    }
+
+    // Append a (group key..., aggregate...) row
+    void appendGroup(Batch& batch, int key, const AggregateValue* values) const {
+        batch.appendColumns(1 + aggr_funcs.size(), 1, [&](size_t i, ColumnVector& column) {
+            if (i == 0) {
+                column.append(key);
+            } else {
+                appendValue(column, i - 1, values);
+            }
+        });
+    }
+
+    // Decodes an encoded key, see appendKey()
+    void appendGroup(Batch& batch, const std::string& key, const AggregateValue* values) const {
+        const char* data = key.data();
+        size_t num_keys = key_types.size();
+        batch.appendColumns(num_keys + aggr_funcs.size(), 1, [&](size_t i, ColumnVector& column) {
+            if (i >= num_keys) {
+                appendValue(column, i - num_keys, values);
+            } else if (key_types[i] == INT) {
+                int value;
+                std::memcpy(&value, data, sizeof(value));
+                column.append(value);
+                data += sizeof(value);
+            } else if (key_types[i] == FLOAT) {
+                float value;
+                std::memcpy(&value, data, sizeof(value));
+                column.append(value);
+                data += sizeof(value);
+            } else if (key_types[i] == BIGINT) {
+                int64_t value;
+                std::memcpy(&value, data, sizeof(value));
+                column.append(value);
+                data += sizeof(value);
+            } else {
+                uint32_t length;
+                std::memcpy(&length, data, sizeof(length));
+                data += sizeof(length);
+                column.append(std::string_view(data, length));
+                data += length;
+            }
+        });
+    }
+};
+
+// Sort order on one attribute
+struct SortKey {
+    size_t attr;
+    bool ascending = true;
+};
+
+// <0, 0 or >0 as row a of x sorts before, with or after row b of y
+inline int compareRows(const Batch& x, size_t a, const Batch& y, size_t b, const std::vector<SortKey>& keys) {
+    for (const auto& key : keys) {
+        int order = x.columns[key.attr].compare(a, y.columns[key.attr], b);
+        if (order != 0) {
+            return key.ascending ? order : -order;
+        }
+    }
+    return 0;
+}
+
+
+// Tournament tree that picks the smallest of k inputs in log2(k)
+// comparisons: inner node i (1 <= i < k) keeps the loser of the match
+// between its children, node 0 the overall winner. Input j is leaf k + j.
+// less(a, b) orders the current rows of inputs a and b.
+class LoserTree {
+private:
+    std::vector<size_t> nodes;
+    size_t num_inputs = 0;
+
+public:
+    template <typename Less>
+    void build(size_t inputs, Less&& less) {
+        num_inputs = inputs;
+        nodes.assign(std::max<size_t>(1, inputs), 0);
+        if (inputs > 0) {
+            nodes[0] = play(1, less);
+        }
+    }
+
+    size_t winner() const {
+        return nodes[0];
+    }
+
+    // Restore the tree after the winner's input advanced
+    template <typename Less>
+    void replay(Less&& less) {
+        size_t winner = nodes[0];
+        for (size_t node = (winner + num_inputs) / 2; node > 0; node /= 2) {
+            if (less(nodes[node], winner)) {
+                std::swap(nodes[node], winner);
+            }
+        }
+        nodes[0] = winner;
+    }
+
+private:
+    // The winner of the subtree at node
+    template <typename Less>
+    size_t play(size_t node, Less& less) {
+        if (node >= num_inputs) {
+            return node - num_inputs;
+        }
+        size_t left = play(2 * node, less);
+        size_t right = play(2 * node + 1, less);
+        if (less(right, left)) {
+            std::swap(left, right);
+        }
+        nodes[node] = right;
+        return left;
+    }
+};
+
+// Standard normal quantile of two-sided 95% confidence intervals
+constexpr double CONFIDENCE_Z = 1.96;
+
+// Estimates COUNT, SUM or AVG of an attribute over the rows of a table
+// the predicate keeps, per group of the group-by attribute or overall,
+// from the table's samples: (group key, estimate, error) rows, error
+// being the half-width of a 95% confidence interval. Queries grouped by
+// the first attribute read the stratified sample if there is one, others
+// the uniform sample as a single stratum. A stratum h of N rows sampled
+// by n contributes N/n times the sum of the z_i over its sampled rows to
+// a total (z is 1 for a kept row's COUNT and its value for SUM, 0 if not
+// kept), and N^2 (1 - n/N) s^2(z) / n to its variance; AVG is the ratio
+// SUM / COUNT, its variance linearized. Estimates from all rows of a
+// stratum are exact.
+class ApproximateAggregationOperator : public Operator {
+private:
+    const TableSample& sample;
+    std::optional<size_t> group_by;
+    AggrFuncType func;
+    bool average;
+    size_t attr;
+    std::unique_ptr<IPredicate> predicate;
+
+    // Sums over the kept rows of a group in one stratum
+    struct StratumSums {
+        size_t stratum;
+        double count = 0;
+        double sum = 0;
+        double squares = 0;
+    };
+    struct Group {
+        Field key{0};
+        std::vector<StratumSums> strata;
+    };
+    // Size of each stratum and of its sample
+    std::vector<std::pair<double, double>> strata_sizes;
+
+    Batch results;
+    size_t result_row = 0;
+    Batch currentBatch;
+    size_t currentRow = 0;
+    bool has_current = false;
+    std::vector<std::unique_ptr<Field>> currentFields;
+
+    void addStratum(const Reservoir& reservoir, std::unordered_map<std::string, size_t>& index,
+                    std::vector<Group>& groups) {
+        size_t stratum = strata_sizes.size();
+        strata_sizes.push_back({static_cast<double>(reservoir.getPopulation()),
+                                static_cast<double>(reservoir.getRows().size())});
+        Batch rows;
+        for (const auto& row : reservoir.getRows()) {
+            rows.appendSerialized(row.data(), row.size());
+        }
+        std::vector<uint32_t> selection(rows.size());
+        std::iota(selection.begin(), selection.end(), 0);
+        if (predicate && rows.size() > 0) {
+            predicate->filter(rows, selection);
+        }
+        std::string key;
+        for (uint32_t row : selection) {
+            key.clear();
+            if (group_by) {
+                const ColumnVector& column = rows.columns.at(*group_by);
+                key.resize(column.encodedSize(row));
+                column.encode(row, key.data());
+            }
+            auto [it, inserted] = index.try_emplace(key, groups.size());
+            if (inserted) {
+                groups.emplace_back();
+                if (group_by) {
+                    groups.back().key = rows.columns[*group_by].getField(row);
+                }
+            }
+            Group& group = groups[it->second];
+            if (group.strata.empty() || group.strata.back().stratum != stratum) {
+                group.strata.push_back({stratum});
+            }
+            StratumSums& sums = group.strata.back();
+            double value = 1;
+            if (func != AggrFuncType::COUNT || average) {
+                const ColumnVector& column = rows.columns.at(attr);
+                if (column.type == STRING) {
+                    throw std::runtime_error("Unsupported Field type for aggregation.");
+                }
+                value = (column.type == INT) ? column.ints[row] : column.floats[row];
+            }
+            sums.count++;
+            sums.sum += value;
+            sums.squares += value * value;
+        }
+    }
+
+    // Estimate and variance of the total of z over the group, with z_i
+    // of the kept rows given by their sums of z and z^2
+    template <typename Z>
+    std::pair<double, double> total(const Group& group, Z z) const {
+        double estimate = 0;
+        double variance = 0;
+        for (const auto& sums : group.strata) {
+            auto [population, sampled] = strata_sizes[sums.stratum];
+            auto [z_sum, z_squares] = z(sums);
+            estimate += population / sampled * z_sum;
+            if (sampled > 1 && sampled < population) {
+                double s2 = std::max(0.0, (z_squares - z_sum * z_sum / sampled) / (sampled - 1));
+                variance += population * population * (1 - sampled / population) * s2 / sampled;
+            }
+        }
+        return {estimate, variance};
+    }
+
+    std::pair<double, double> estimate(const Group& group) const {
+        auto count = total(group, [](const StratumSums& sums) { return std::make_pair(sums.count, sums.count); });
+        auto sum = total(group, [](const StratumSums& sums) { return std::make_pair(sums.sum, sums.squares); });
+        if (!average) {
+            auto [value, variance] = (func == AggrFuncType::COUNT) ? count : sum;
+            return {value, CONFIDENCE_Z * std::sqrt(variance)};
+        }
+        // d_i = z_i - ratio for kept rows
+        double ratio = sum.first / count.first;
+        auto residual = total(group, [ratio](const StratumSums& sums) {
+            return std::make_pair(sums.sum - ratio * sums.count,
+                                  sums.squares - 2 * ratio * sums.sum + ratio * ratio * sums.count);
+        });
+        return {ratio, CONFIDENCE_Z * std::sqrt(residual.second) / count.first};
+    }
+
+public:
+    ApproximateAggregationOperator(const TableSample& sample, std::optional<size_t> group_by, AggrFuncType func,
+                                   bool average, size_t attr, std::unique_ptr<IPredicate> predicate)
+        : sample(sample), group_by(group_by), func(func), average(average), attr(attr),
+          predicate(std::move(predicate)) {}
+
+    void open() override {
+        strata_sizes.clear();
+        std::unordered_map<std::string, size_t> index;
+        std::vector<Group> groups;
+        const auto* strata = sample.getStrata();
+        if (group_by == 0u && strata) {
+            for (const auto& [value, reservoir] : *strata) {
+                addStratum(reservoir, index, groups);
+            }
+        } else {
+            addStratum(sample.getUniform(), index, groups);
+        }
+
+        results.clear();
+        for (const auto& group : groups) {
+            auto [value, error] = estimate(group);
+            std::vector<std::unique_ptr<Field>> row;
+            if (group_by) {
+                row.push_back(std::make_unique<Field>(group.key));
+            }
+            row.push_back(std::make_unique<Field>(static_cast<float>(value)));
+            row.push_back(std::make_unique<Field>(static_cast<float>(error)));
+            results.appendTuple(row);
+        }
+        result_row = 0;
+        currentRow = 0;
+        has_current = false;
+    }
+
+    bool next() override {
+        if (has_current && currentRow + 1 < currentBatch.size()) {
+            currentRow++;
+        } else {
+            currentRow = 0;
+            has_current = nextBatch(currentBatch);
+            if (!has_current) {
+                return false;
+            }
+        }
+        currentBatch.readTuple(currentRow, currentFields);
+        return true;
+    }
+
+    bool nextBatch(Batch& batch) override {
+        batch.clear();
+        for (; result_row < results.size() && batch.size() < BATCH_SIZE; ++result_row) {
+            batch.appendRow(results, result_row);
+        }
+        return batch.size() > 0;
+    }
+
+    void close() override {
+        results.clear();
+        has_current = false;
+    }
+
+    const std::vector<std::unique_ptr<Field>>& getOutput() override {
+        if (has_current) {
+            return currentFields;
+        }
+        return noOutput();
+    }
+
+    double estimateCost(CostModel&) override {
+        return (sample.getUniform().getRows().size() +
+                (sample.getStrata() ? sample.getStrata()->size() * STRATUM_ROWS : 0)) * CostModel::CPU_TUPLE_COST;
+    }
+
+    double estimateRows(CostModel&) override {
+        return results.size();
+    }
+};
+
+// Default memory budget of ExternalSortOperator
+constexpr size_t SORT_MEMORY_BUDGET = 64 << 20;
+
+// Sorts its input on the sort keys within memory_budget bytes. Input
+// rows are collected until they fill the budget, sorted and written to a
+// SortRunFile as a run; the runs are then merged through a LoserTree,
+// in several passes while there are more runs than chunk buffers fit in
+// the budget. Input that fits is sorted in memory without writing runs.
+// With num_threads > 1, workers take batches from the input in turn and
+// each sorts and writes its own runs within memory_budget / num_threads.
+class ExternalSortOperator : public UnaryOperator {
+private:
+    std::vector<SortKey> keys;
+    size_t memory_budget;
+    size_t num_threads;
+    std::string temp_prefix;
+    bool sorted = false;
+
+    // Input that fit in memory and the order of its rows
+    Batch buffer;
+    std::vector<uint32_t> order;
+    size_t order_index = 0;
+
+    // Spilled input: the runs and the readers of the final merge
+    std::unique_ptr<SortRunFile> run_file;
+    std::vector<SortRunFile::Run> runs;
+    std::vector<SortRunReader> readers;
+    LoserTree tree;
+    size_t num_runs = 0;
+    size_t merge_passes = 0;
+
+    // Batch behind next() / getOutput()
+    Batch currentBatch;
+    size_t currentRow = 0;
+    bool has_current = false;
+    std::vector<std::unique_ptr<Field>> currentFields;
+    size_t tuple_count = 0;
+
+    // Orders the inputs of the merge by their current rows, ties by run
+    // so the tree sees a strict order; exhausted runs lose to all others
+    auto readerLess() {
+        return [this](size_t a, size_t b) {
+            if (readers[a].exhausted()) {
+                return false;
+            }
+            if (readers[b].exhausted()) {
+                return true;
+            }
+            int order = compareRows(readers[a].rows, readers[a].row, readers[b].rows, readers[b].row, keys);
+            return order < 0 || (order == 0 && a < b);
+        };
+    }
+
+public:
+    ExternalSortOperator(Operator& input, std::vector<SortKey> keys, size_t memory_budget = SORT_MEMORY_BUDGET,
+                         size_t num_threads = 1, std::string temp_prefix = "buzzdb_sort")
+        : UnaryOperator(input), keys(std::move(keys)),
+          memory_budget(std::max(memory_budget, SORT_CHUNK_PAGES * PAGE_SIZE)),
+          num_threads(std::max<size_t>(1, num_threads)), temp_prefix(std::move(temp_prefix)) {}
+
+    void open() override {
+        input->open();
+        reset();
+        currentBatch.clear();
+        has_current = false;
+    }
+
+    bool next() override {
+        if (has_current && currentRow + 1 < currentBatch.size()) {
+            currentRow++;
+        } else {
+            currentRow = 0;
+            has_current = nextBatch(currentBatch);
+            if (!has_current) {
+                return false;
+            }
+        }
+        currentBatch.readTuple(currentRow, currentFields);
+        return true;
+    }
+
+    void close() override {
+        std::cout << "External Sort Operator tuple_count: " << tuple_count << ", runs: " << num_runs
+                  << ", merge passes: " << merge_passes << "\n";
+        input->close();
+        reset();
+        has_current = false;
+    }
+
+    const std::vector<std::unique_ptr<Field>>& getOutput() override {
+        if (has_current) {
+            return currentFields;
+        }
+        return noOutput();
+    }
+
+    bool nextBatch(Batch& batch) override {
+        if (!sorted) {
+            sort();
+        }
+        batch.clear();
+        if (!run_file) {
+            while (batch.size() < BATCH_SIZE && order_index < order.size()) {
+                batch.appendRow(buffer, order[order_index++]);
+            }
+        } else {
+            auto less = readerLess();
+            while (batch.size() < BATCH_SIZE && !readers[tree.winner()].exhausted()) {
+                SortRunReader& reader = readers[tree.winner()];
+                batch.appendRow(reader.rows, reader.row);
+                reader.advance();
+                tree.replay(less);
+            }
+        }
+        tuple_count += batch.size();
+        return batch.size() > 0;
+    }
+
+    double estimateCost(CostModel& costModel) override {
+        double rows = input->estimateRows(costModel);
+        double pages = rows / CostModel::DEFAULT_TUPLES_PER_PAGE;
+        size_t passes = 0;
+        if (pages * PAGE_SIZE > memory_budget) {
+            double initial_runs = std::ceil(pages * PAGE_SIZE / memory_budget);
+            passes = static_cast<size_t>(std::max(1.0, std::ceil(std::log(initial_runs) / std::log(fanIn()))));
+        }
+        return input->estimateCost(costModel) + costModel.estimateSortCost(rows, passes ? pages : 0, passes);
+    }
+
+    double estimateRows(CostModel& costModel) override {
+        return input->estimateRows(costModel);
+    }
+
+    // Bytes the rows of batch take up in the sort buffer
+    static size_t memoryBytes(const Batch& batch) {
+        size_t bytes = batch.size() * sizeof(uint32_t);
+        for (const auto& column : batch.columns) {
+            if (column.type == STRING) {
+                for (const auto& value : column.strings) {
+                    bytes += sizeof(std::string) + value.size();
+                }
+            } else {
+                bytes += batch.size() * 4;
+            }
+        }
+        return bytes;
+    }
+
+    size_t getPagesWritten() const {
+        return run_file ? run_file->getPagesWritten() : 0;
+    }
+
+private:
+    void reset() {
+        sorted = false;
+        buffer.clear();
+        order.clear();
+        order_index = 0;
+        readers.clear();
+        runs.clear();
+        run_file.reset();
+        num_runs = 0;
+        merge_passes = 0;
+    }
+
+    // Runs merged at once: one chunk buffer per run and one for the output
+    size_t fanIn() const {
+        size_t buffers = memory_budget / (SORT_CHUNK_PAGES * PAGE_SIZE);
+        return (buffers > 3) ? buffers - 1 : 2;
+    }
+
+    void sort() {
+        sorted = true;
+        generateRuns();
+        if (run_file) {
+            mergeRuns();
+        }
+    }
+
+    // The first sort key that is not a column of batch, if any
+    std::optional<size_t> keyOutOfRange(const Batch& batch) const {
+        for (const auto& key : keys) {
+            if (key.attr >= batch.columns.size()) {
+                return key.attr;
+            }
+        }
+        return std::nullopt;
+    }
+
+    static std::runtime_error keyError(size_t attr) {
+        return std::runtime_error("Sort attribute {" + std::to_string(attr + 1) + "} is out of range.");
+    }
+
+    // The rows of batch in sort order
+    std::vector<uint32_t> sortRows(const Batch& rows) const {
+        if (rows.size() > 0) {
+            if (auto attr = keyOutOfRange(rows)) {
+                throw keyError(*attr);
+            }
+        }
+        std::vector<uint32_t> row_order(rows.size());
+        if (keys.size() == 1 && rows.size() > 0 && rows.columns[keys[0].attr].type == INT) {
+            // (key, row) pairs move and compare faster than rows
+            const auto& values = rows.columns[keys[0].attr].ints;
+            std::vector<std::pair<int, uint32_t>> pairs(rows.size());
+            for (uint32_t row = 0; row < rows.size(); ++row) {
+                pairs[row] = {values[row], row};
+            }
+            if (keys[0].ascending) {
+                std::sort(pairs.begin(), pairs.end());
+            } else {
+                std::sort(pairs.begin(), pairs.end(), [](const auto& a, const auto& b) {
+                    return a.first > b.first || (a.first == b.first && a.second < b.second);
+                });
+            }
+            for (size_t i = 0; i < pairs.size(); ++i) {
+                row_order[i] = pairs[i].second;
+            }
+            return row_order;
+        }
+        std::iota(row_order.begin(), row_order.end(), 0);
+        std::stable_sort(row_order.begin(), row_order.end(), [&rows, this](uint32_t a, uint32_t b) {
+            return compareRows(rows, a, rows, b, keys) < 0;
+        });
+        return row_order;
+    }
+
+    void writeRun(const Batch& rows, std::mutex& runs_latch) {
+        SortRunWriter writer(*run_file);
+        for (uint32_t row : sortRows(rows)) {
+            writer.append(rows, row);
+        }
+        SortRunFile::Run run = writer.finish();
+        std::lock_guard<std::mutex> lock(runs_latch);
+        runs.push_back(std::move(run));
+    }
+
+    // Phase 1: fill a buffer of the budget (per worker) from the input,
+    // sort it and write it as a run. If the whole input fits, it stays in
+    // memory instead.
+    void generateRuns() {
+        size_t worker_budget = memory_budget / num_threads;
+        std::vector<Batch> leftovers(num_threads);
+        std::mutex input_latch;
+        std::mutex runs_latch;
+        std::atomic<bool> spilled{false};
+        // Checked on the first batch; workers cannot throw, so they stop
+        std::optional<size_t> bad_key;
+        run_file = std::make_unique<SortRunFile>(temp_prefix);
+
+        runWorkers([&](size_t worker) {
+            Batch batch;
+            Batch& rows = leftovers[worker];
+            size_t bytes = 0;
+            std::vector<uint32_t> all_rows;
+            while (true) {
+                {
+                    // The input is not thread safe, workers take batches in turn
+                    std::lock_guard<std::mutex> lock(input_latch);
+                    if (bad_key || !input->nextBatch(batch)) {
+                        break;
+                    }
+                    if (run_file->types.empty()) {
+                        if ((bad_key = keyOutOfRange(batch))) {
+                            break;
+                        }
+                        for (const auto& column : batch.columns) {
+                            run_file->types.push_back(column.type);
+                        }
+                    }
+                }
+                all_rows.resize(batch.size());
+                std::iota(all_rows.begin(), all_rows.end(), 0);
+                rows.appendRows(batch, all_rows);
+                bytes += memoryBytes(batch);
+                if (bytes >= worker_budget) {
+                    writeRun(rows, runs_latch);
+                    rows.clear();
+                    bytes = 0;
+                    spilled = true;
+                }
+            }
+        });
+
+        if (bad_key) {
+            throw keyError(*bad_key);
+        }
+        if (!spilled) {
+            run_file.reset();
+            std::vector<uint32_t> all_rows;
+            for (auto& rows : leftovers) {
+                all_rows.resize(rows.size());
+                std::iota(all_rows.begin(), all_rows.end(), 0);
+                buffer.appendRows(rows, all_rows);
+            }
+            order = sortRows(buffer);
+            return;
+        }
+        runWorkers([&](size_t worker) {
+            if (leftovers[worker].size() > 0) {
+                writeRun(leftovers[worker], runs_latch);
+            }
+        });
+        num_runs = runs.size();
+    }
+
+    void openReaders(size_t first, size_t last) {
+        readers.clear();
+        for (size_t run = first; run < last; ++run) {
+            readers.emplace_back(*run_file, std::move(runs[run]));
+        }
+        tree.build(readers.size(), readerLess());
+    }
+
+    // Phase 2: merge groups of fanIn() runs into longer runs until one
+    // merge of all of them remains, which nextBatch() performs
+    void mergeRuns() {
+        size_t fan_in = fanIn();
+        auto less = readerLess();
+        while (runs.size() > fan_in) {
+            std::vector<SortRunFile::Run> merged;
+            for (size_t first = 0; first < runs.size(); first += fan_in) {
+                size_t last = std::min(runs.size(), first + fan_in);
+                if (last - first == 1) {
+                    merged.push_back(std::move(runs[first]));
+                    continue;
+                }
+                openReaders(first, last);
+                SortRunWriter writer(*run_file);
+                while (!readers[tree.winner()].exhausted()) {
+                    SortRunReader& reader = readers[tree.winner()];
+                    writer.append(reader.rows, reader.row);
+                    reader.advance();
+                    tree.replay(less);
+                }
+                merged.push_back(writer.finish());
+            }
+            runs = std::move(merged);
+            merge_passes++;
+        }
+        openReaders(0, runs.size());
+        runs.clear();
+        merge_passes++;
+    }
+
+    template <typename Function>
+    void runWorkers(Function&& work) {
+        if (num_threads == 1) {
+            work(0);
+            return;
+        }
+        std::vector<std::thread> workers;
+        for (size_t worker = 0; worker < num_threads; ++worker) {
+            workers.emplace_back(work, worker);
+        }
+        for (auto& thread : workers) {
+            thread.join();
+        }
+    }
+};
+
+// An equi-join condition: attribute left_attr of relation left equals
+// attribute right_attr of relation right. Relations are numbered by
+// their position in the join.
+struct JoinPredicate {
+    size_t left;
+    size_t left_attr;
+    size_t right;
+    size_t right_attr;
+    double selectivity;     // Fraction of the cross product that matches
+};
+
+// Joins its inputs on build_attr == probe_attr by hashing the build
+// input and probing it with the probe input a batch at a time. Output
+// tuples are the build tuple followed by the probe tuple. Join keys are
+// INT attributes.
+class HashJoinOperator : public BinaryOperator {
+private:
+    size_t build_attr;
+    size_t probe_attr;
+    double selectivity;
+
+    // The build input, the first of its rows with each key and, for
+    // every row, the next row with the same key (-1 ends a chain)
+    Batch build_rows;
+    AggregationHashTable<int> heads{1};
+    std::vector<int> chain_next;
+    bool built = false;
+
+    // Probe batch in progress, the next row of it to probe and the
+    // build row that row continues at
+    Batch probe_batch;
+    size_t probe_row = 0;
+    int chain = -1;
+    std::vector<uint32_t> build_selection;
+    std::vector<uint32_t> probe_selection;
+
+    // Batch behind next() / getOutput()
+    Batch currentBatch;
+    size_t currentRow = 0;
+    bool has_current = false;
+    std::vector<std::unique_ptr<Field>> currentFields;
+    size_t tuple_count = 0;
+
+public:
+    HashJoinOperator(Operator& build, Operator& probe, size_t build_attr, size_t probe_attr,
+                     double selectivity = CostModel::DEFAULT_SELECTIVITY)
+        : BinaryOperator(build, probe), build_attr(build_attr), probe_attr(probe_attr),
+          selectivity(selectivity) {}
+
+    void open() override {
+        input_left->open();
+        input_right->open();
+        build_rows.clear();
+        heads = AggregationHashTable<int>(1);
+        chain_next.clear();
+        built = false;
+        probe_batch.clear();
+        probe_row = 0;
+        chain = -1;
+        currentBatch.clear();
+        has_current = false;
+    }
+
+    bool next() override {
+        if (has_current && currentRow + 1 < currentBatch.size()) {
+            currentRow++;
+        } else {
+            currentRow = 0;
+            has_current = nextBatch(currentBatch);
+            if (!has_current) {
+                return false;
+            }
+        }
+        currentBatch.readTuple(currentRow, currentFields);
+        return true;
+    }
+
+    void close() override {
+        std::cout << "Hash Join Operator tuple_count: " << tuple_count << "\n";
+        input_left->close();
+        input_right->close();
+        build_rows.clear();
+        heads = AggregationHashTable<int>(1);
+        chain_next.clear();
+        has_current = false;
+    }
+
+    const std::vector<std::unique_ptr<Field>>& getOutput() override {
+        if (has_current) {
+            return currentFields;
+        }
+        return noOutput();
+    }
+
+    bool nextBatch(Batch& batch) override {
+        if (!built) {
+            build();
+        }
+        batch.clear();
+        build_selection.clear();
+        probe_selection.clear();
+        // Matches refer to rows of the current probe batch, so one call
+        // emits matches of one probe batch only
+        while (build_selection.empty()) {
+            if (probe_row >= probe_batch.size()) {
+                if (!input_right->nextBatch(probe_batch)) {
+                    return false;
+                }
+                checkKeyType(probe_batch, probe_attr);
+                probe_row = 0;
+                chain = -1;
+            }
+            probe();
+        }
+        batch.appendRowPairs(build_rows, build_selection, probe_batch, probe_selection);
+        tuple_count += batch.size();
+        return true;
+    }
+
+    double estimateCost(CostModel& costModel) override {
+        double buildRows = input_left->estimateRows(costModel);
+        double probeRows = input_right->estimateRows(costModel);
+        return input_left->estimateCost(costModel) + input_right->estimateCost(costModel) +
+               costModel.estimateHashJoinCost(buildRows, probeRows, estimateRows(costModel));
+    }
+
+    double estimateRows(CostModel& costModel) override {
+        return input_left->estimateRows(costModel) * input_right->estimateRows(costModel) * selectivity;
+    }
+
+private:
+    static void checkKeyType(const Batch& batch, size_t attr) {
+        if (batch.size() > 0 && batch.columns[attr].type != INT) {
+            throw std::runtime_error("Unsupported Field type for join.");
+        }
+    }
+
+    void build() {
+        Batch batch;
+        std::vector<uint32_t> rows;
+        while (input_left->nextBatch(batch)) {
+            checkKeyType(batch, build_attr);
+            rows.resize(batch.size());
+            std::iota(rows.begin(), rows.end(), 0);
+            size_t first = build_rows.size();
+            build_rows.appendRows(batch, rows);
+
+            const auto& keys = batch.columns[build_attr].ints;
+            AggregateValue none;
+            none.i = -1;
+            for (size_t row = 0; row < batch.size(); ++row) {
+                AggregateValue* head = heads.findOrInsert(keys[row], AggregationHashTable<int>::hash(keys[row]), &none);
+                chain_next.push_back(head->i);
+                head->i = static_cast<int>(first + row);
+            }
+        }
+        built = true;
+    }
+
+    // Collect matches of the probe batch from probe_row on, up to
+    // BATCH_SIZE of them
+    void probe() {
+        const auto& keys = probe_batch.columns[probe_attr].ints;
+        while (probe_row < probe_batch.size()) {
+            if (chain < 0) {
+                int key = keys[probe_row];
+                const AggregateValue* head = heads.find(key, AggregationHashTable<int>::hash(key));
+                chain = head ? head->i : -1;
+            }
+            for (; chain >= 0; chain = chain_next[chain]) {
+                if (build_selection.size() == BATCH_SIZE) {
+                    return; // Resume at this build row
+                }
+                build_selection.push_back(static_cast<uint32_t>(chain));
+                probe_selection.push_back(static_cast<uint32_t>(probe_row));
+            }
+            probe_row++;
+        }
+    }
+};
+
+// Joins the outer input on outer_attr with the tuples of the inner table
+// whose key (attribute 0) is equal, looking each one up in an index on
+// the key (BTreeIndex or LearnedIndex). Output tuples are the outer
+// tuple followed by the inner tuple.
+template <typename Index>
+class IndexNestedLoopJoinOperator : public UnaryOperator {
+private:
+    size_t outer_attr;
+    BufferManager& bufferManager;
+    Index& index;
+    double selectivity;
+
+    // Outer batch in progress, the next row of it to look up and the
+    // lookup of the current row if it is unfinished
+    Batch outer_batch;
+    size_t outer_row = 0;
+    std::optional<typename Index::RangeIterator> iterator;
+    std::vector<uint32_t> outer_selection;
+    std::vector<uint32_t> inner_selection;
+    Batch inner_rows;
+
+    // Batch behind next() / getOutput()
+    Batch currentBatch;
+    size_t currentRow = 0;
+    bool has_current = false;
+    std::vector<std::unique_ptr<Field>> currentFields;
+    size_t tuple_count = 0;
+
+public:
+    IndexNestedLoopJoinOperator(Operator& outer, size_t outer_attr, BufferManager& inner, Index& index,
+                                double selectivity = CostModel::DEFAULT_SELECTIVITY)
+        : UnaryOperator(outer), outer_attr(outer_attr), bufferManager(inner), index(index),
+          selectivity(selectivity) {}
+
+    void open() override {
+        input->open();
+        outer_batch.clear();
+        outer_row = 0;
+        iterator.reset();
+        currentBatch.clear();
+        has_current = false;
+    }
+
+    bool next() override {
+        if (has_current && currentRow + 1 < currentBatch.size()) {
+            currentRow++;
+        } else {
+            currentRow = 0;
+            has_current = nextBatch(currentBatch);
+            if (!has_current) {
+                return false;
+            }
+        }
+        currentBatch.readTuple(currentRow, currentFields);
+        return true;
+    }
+
+    void close() override {
+        std::cout << "Index Nested Loop Join Operator tuple_count: " << tuple_count << "\n";
+        input->close();
+        iterator.reset();
+        has_current = false;
+    }
+
+    const std::vector<std::unique_ptr<Field>>& getOutput() override {
+        if (has_current) {
+            return currentFields;
+        }
+        return noOutput();
+    }
+
+    bool nextBatch(Batch& batch) override {
+        batch.clear();
+        outer_selection.clear();
+        inner_rows.clear();
+        // Matches refer to rows of the current outer batch, so one call
+        // emits matches of one outer batch only
+        while (outer_selection.empty()) {
+            if (outer_row >= outer_batch.size()) {
+                if (!input->nextBatch(outer_batch)) {
+                    return false;
+                }
+                if (outer_batch.columns[outer_attr].type != INT) {
+                    throw std::runtime_error("Unsupported Field type for join.");
+                }
+                outer_row = 0;
+                iterator.reset();
+            }
+            lookup();
+        }
+        inner_selection.resize(inner_rows.size());
+        std::iota(inner_selection.begin(), inner_selection.end(), 0);
+        batch.appendRowPairs(outer_batch, outer_selection, inner_rows, inner_selection);
+        tuple_count += batch.size();
+        return true;
+    }
+
+    double estimateCost(CostModel& costModel) override {
+        double outerRows = input->estimateRows(costModel);
+        double matches = index.size() * selectivity;
+        return input->estimateCost(costModel) +
+               outerRows * costModel.estimateIndexScanCost(index.estimateIndexPages(matches), matches);
+    }
+
+    double estimateRows(CostModel& costModel) override {
+        return input->estimateRows(costModel) * index.size() * selectivity;
+    }
+
+private:
+    // Fetch the inner tuples matching the outer batch from outer_row on,
+    // up to BATCH_SIZE of them
+    void lookup() {
+        const auto& keys = outer_batch.columns[outer_attr].ints;
+        int key;
+        TupleID tuple_id;
+        while (outer_row < outer_batch.size()) {
+            if (!iterator) {
+                iterator.emplace(index.scan(keys[outer_row], keys[outer_row]));
+            }
+            while (outer_selection.size() < BATCH_SIZE && iterator->next(key, tuple_id)) {
+                auto guard = bufferManager.lock();
+                auto& page = bufferManager.getPage(tupleIDPage(tuple_id));
+                const Slot& slot = page->getSlot(tupleIDSlot(tuple_id));
+                if (slot.empty) {
+                    continue; // Stale entry
+                }
+                inner_rows.appendSerialized(page->page_data.get() + slot.offset, slot.length);
+                outer_selection.push_back(static_cast<uint32_t>(outer_row));
+            }
+            if (outer_selection.size() == BATCH_SIZE) {
+                return; // The lookup may have more matches
+            }
+            iterator.reset();
+            outer_row++;
+        }
+    }
+};
+
+// Orders the relations of a join greedily: starting from the smallest
+// relation, it adds the relation joined with those so far that yields
+// the smallest intermediate result
+class JoinOrderOptimizer {
+public:
+    std::vector<size_t> optimizeJoinOrder(const std::vector<JoinPredicate>& joins,
+                                          const std::vector<double>& cardinalities) {
+        std::vector<size_t> joinOrder;
+        if (cardinalities.empty()) {
+            return joinOrder;
+        }
+        std::vector<bool> joined(cardinalities.size(), false);
+
+        // Start with the smallest table
+        size_t smallestTable = std::min_element(cardinalities.begin(), cardinalities.end()) - cardinalities.begin();
+        joinOrder.push_back(smallestTable);
+        joined[smallestTable] = true;
+        double resultRows = cardinalities[smallestTable];
+
+        while (joinOrder.size() < cardinalities.size()) {
+            double bestCost = std::numeric_limits<double>::max();
+            size_t bestTable = -1;
+
+            for (size_t table = 0; table < cardinalities.size(); ++table) {
+                if (joined[table]) {
+                    continue;
+                }
+                // Every predicate with the joined relations applies
+                double selectivity = 1.0;
+                bool connected = false;
+                for (const auto& join : joins) {
+                    if ((join.left == table && joined[join.right]) || (join.right == table && joined[join.left])) {
+                        selectivity *= join.selectivity;
+                        connected = true;
+                    }
+                }
+                if (!connected) {
+                    continue;
+                }
+                double cost = estimateJoinCost(resultRows, cardinalities[table], selectivity);
+                if (cost < bestCost) {
+                    bestCost = cost;
+                    bestTable = table;
+                }
+            }
+
+            if (bestTable != size_t(-1)) {
+                resultRows = bestCost;
+            } else {
+                // If no join found, cross the smallest unjoined table
+                for (size_t table = 0; table < cardinalities.size(); ++table) {
+                    if (!joined[table] && (bestTable == size_t(-1) || cardinalities[table] < cardinalities[bestTable])) {
+                        bestTable = table;
+                    }
+                }
+                resultRows *= cardinalities[bestTable];
+            }
+            joinOrder.push_back(bestTable);
+            joined[bestTable] = true;
+        }
+
+        return joinOrder;
+    }
+
+private:
+    // Simple cost model: the size of the intermediate result
+    double estimateJoinCost(double leftRows, double rightRows, double selectivity) {
+        return leftRows * rightRows * selectivity;
+    }
+};
+
+// A parsed WHERE condition: a comparison of two operands, each an
+// attribute or a constant, or an AND / OR of conditions
+struct Condition {
+    enum Kind { COMPARISON, AND, OR };
+
+    struct Operand {
+        int attr = -1;                  // Attribute index, -1 for a constant
+        std::optional<Field> constant;
+    };
+
+    Kind kind = COMPARISON;
+    Operand left;
+    Operand right;
+    SimplePredicate::ComparisonOperator op = SimplePredicate::EQ;
+    std::vector<Condition> children;   // Of AND and OR
+};
+
+// The table BuzzDB has always stored, which queries without FROM read
+const std::string sales_table = "sales";
+
+struct QueryComponents {
+    std::string table = sales_table;
+    std::vector<int> selectAttributes;
+    bool sumOperation = false;   // Any aggregate, not only SUM
+    AggrFuncType aggregateType = AggrFuncType::SUM;
+    int sumAttributeIndex = -1;
+    // APPROX: estimate COUNT, SUM or AVG from the table's samples, with
+    // the half-width of a 95% confidence interval
+    bool approximate = false;
+    bool average = false;        // AVG, only answered approximately
+    bool groupBy = false;
+    int groupByAttributeIndex = -1;
+    // Any WHERE clause sets whereCondition and where. A clause that is a
+    // range of INT constants on one attribute also sets the attribute and
+    // the exclusive bounds, which view matching and index scans use.
+    bool whereCondition = false;
+    int whereAttributeIndex = -1;
+    int lowerBound = std::numeric_limits<int>::min();
+    int upperBound = std::numeric_limits<int>::max();
+    std::optional<Condition> where;
+    // ORDER BY on the attributes of the query result
+    std::vector<SortKey> orderBy;
+};
+
+// Splits a query into tokens: {n} attributes, numbers, 'quoted' strings,
+// words and the symbols ( ) , = == != <> < <= > >=
+class QueryLexer {
+public:
+    enum TokenType { ATTRIBUTE, NUMBER, STRING, WORD, SYMBOL, END };
+
+    struct Token {
+        TokenType type;
+        std::string_view text;          // Without the braces or quotes
+        size_t position;
+    };
+
+    static std::vector<Token> tokenize(std::string_view query) {
+        std::vector<Token> tokens;
+        size_t i = 0;
+        while (true) {
+            while (i < query.size() && std::isspace(static_cast<unsigned char>(query[i]))) {
+                i++;
+            }
+            if (i == query.size()) {
+                break;
+            }
+            size_t start = i;
+            char c = query[i];
+            if (c == '{') {
+                size_t close = query.find('}', i);
+                if (close == std::string_view::npos) {
+                    throw syntaxError(query, start, "unterminated attribute");
+                }
+                tokens.push_back({ATTRIBUTE, query.substr(i + 1, close - i - 1), start});
+                i = close + 1;
+            } else if (c == '\'') {
+                size_t close = query.find('\'', i + 1);
+                if (close == std::string_view::npos) {
+                    throw syntaxError(query, start, "unterminated string");
+                }
+                tokens.push_back({STRING, query.substr(i + 1, close - i - 1), start});
+                i = close + 1;
+            } else if (std::isdigit(static_cast<unsigned char>(c)) || c == '-' || c == '.') {
+                i++;
+                while (i < query.size() && (std::isdigit(static_cast<unsigned char>(query[i])) || query[i] == '.')) {
+                    i++;
+                }
+                tokens.push_back({NUMBER, query.substr(start, i - start), start});
+            } else if (std::isalpha(static_cast<unsigned char>(c)) || c == '_') {
+                while (i < query.size() && (std::isalnum(static_cast<unsigned char>(query[i])) || query[i] == '_')) {
+                    i++;
+                }
+                tokens.push_back({WORD, query.substr(start, i - start), start});
+            } else {
+                i++;
+                // Two character comparisons
+                if (i < query.size() && ((c == '<' && (query[i] == '=' || query[i] == '>')) ||
+                                         ((c == '>' || c == '!' || c == '=') && query[i] == '='))) {
+                    i++;
+                }
+                tokens.push_back({SYMBOL, query.substr(start, i - start), start});
+            }
+        }
+        tokens.push_back({END, std::string_view(), query.size()});
+        return tokens;
+    }
+
+    static std::runtime_error syntaxError(std::string_view query, size_t position, const std::string& message) {
+        return std::runtime_error("Query syntax error at position " + std::to_string(position) + " (" + message +
+                                  "): " + std::string(query));
+    }
+};
+
+// Recursive descent parser of
+//   query      := [SELECT] [APPROX] item {',' item} {clause}
+//   item       := attribute | (SUM|COUNT|MIN|MAX|AVG) attribute
+//   clause     := FROM table | WHERE or | GROUP BY attribute
+//               | ORDER BY order {',' order}
+//   order      := item [ASC|DESC]
+//   or         := and {OR and}
+//   and        := comparison {AND comparison}
+//   comparison := '(' or ')' | operand (=|==|!=|<>|<|<=|>|>=) operand
+//   operand    := attribute | number | string
+// Keywords are case-insensitive, attributes are 1-based.
+class QueryParser {
+private:
+    using Token = QueryLexer::Token;
+
+    std::string_view query;
+    std::vector<Token> tokens;
+    size_t pos = 0;
+
+    // ORDER BY items, resolved once the whole query is known
+    struct OrderItem {
+        int attr;
+        std::optional<AggrFuncType> aggregate;  // AVG is SUM with average set
+        bool average;
+        bool ascending;
+        size_t position;
+    };
+    std::vector<OrderItem> order_items;
+
+public:
+    explicit QueryParser(std::string_view query) : query(query), tokens(QueryLexer::tokenize(query)) {}
+
+    QueryComponents parse() {
+        QueryComponents components;
+        acceptWord("SELECT");
+        components.approximate = acceptWord("APPROX");
+        do {
+            parseSelectItem(components);
+        } while (acceptSymbol(","));
+
+        bool from = false;
+        while (peek().type != QueryLexer::END) {
+            if (acceptWord("FROM")) {
+                if (from || peek().type != QueryLexer::WORD) {
+                    throw error(from ? "duplicate FROM" : "expected a table name");
+                }
+                components.table = std::string(peek().text);
+                from = true;
+                pos++;
+            } else if (acceptWord("WHERE")) {
+                if (components.where) {
+                    throw error("duplicate WHERE");
+                }
+                components.where = parseOr();
+                components.whereCondition = true;
+            } else if (acceptWord("GROUP")) {
+                expectWord("BY");
+                if (components.groupBy) {
+                    throw error("duplicate GROUP BY");
+                }
+                components.groupBy = true;
+                components.groupByAttributeIndex = parseAttribute();
+            } else if (acceptWord("ORDER")) {
+                expectWord("BY");
+                do {
+                    parseOrderItem();
+                } while (acceptSymbol(","));
+            } else {
+                throw error("expected FROM, WHERE, GROUP BY or ORDER BY");
+            }
+        }
+        if (components.approximate && (!components.sumOperation || components.aggregateType == AggrFuncType::MIN ||
+                                       components.aggregateType == AggrFuncType::MAX)) {
+            throw QueryLexer::syntaxError(query, 0, "APPROX answers a single COUNT, SUM or AVG");
+        }
+        if (components.average && !components.approximate) {
+            throw QueryLexer::syntaxError(query, 0, "AVG is only answered with APPROX");
+        }
+
+        if (components.where) {
+            int attr = -1;
+            int lower = std::numeric_limits<int>::min();
+            int upper = std::numeric_limits<int>::max();
+            if (rangeOf(*components.where, attr, lower, upper)) {
+                components.whereAttributeIndex = attr;
+                components.lowerBound = lower;
+                components.upperBound = upper;
+            }
+        }
+        resolveOrder(components);
+        return components;
+    }
+
+private:
+    const Token& peek() const {
+        return tokens[pos];
+    }
+
+    std::runtime_error error(const std::string& message) const {
+        return QueryLexer::syntaxError(query, peek().position, message);
+    }
+
+    static bool equalsIgnoreCase(std::string_view text, std::string_view word) {
+        return text.size() == word.size() &&
+               std::equal(text.begin(), text.end(), word.begin(), [](char a, char b) {
+                   return std::toupper(static_cast<unsigned char>(a)) == b;
+               });
+    }
+
+    bool acceptWord(std::string_view word) {
+        if (peek().type == QueryLexer::WORD && equalsIgnoreCase(peek().text, word)) {
+            pos++;
+            return true;
+        }
+        return false;
+    }
+
+    void expectWord(std::string_view word) {
+        if (!acceptWord(word)) {
+            throw error("expected " + std::string(word));
+        }
+    }
+
+    bool acceptSymbol(std::string_view symbol) {
+        if (peek().type == QueryLexer::SYMBOL && peek().text == symbol) {
+            pos++;
+            return true;
+        }
+        return false;
+    }
+
+    int parseAttribute() {
+        if (peek().type != QueryLexer::ATTRIBUTE) {
+            throw error("expected an attribute {n}");
+        }
+        std::string_view text = peek().text;
+        int attr = 0;
+        auto result = std::from_chars(text.data(), text.data() + text.size(), attr);
+        if (result.ec != std::errc() || result.ptr != text.data() + text.size() || attr < 1) {
+            throw error("invalid attribute");
+        }
+        pos++;
+        return attr - 1;
+    }
+
+    // An aggregate function name, consumed if there is one
+    std::optional<AggrFuncType> acceptAggregate() {
+        if (acceptWord("SUM")) return AggrFuncType::SUM;
+        if (acceptWord("COUNT")) return AggrFuncType::COUNT;
+        if (acceptWord("MIN")) return AggrFuncType::MIN;
+        if (acceptWord("MAX")) return AggrFuncType::MAX;
+        return std::nullopt;
+    }
+
+    void parseSelectItem(QueryComponents& components) {
+        bool average = acceptWord("AVG");
+        std::optional<AggrFuncType> function = average ? AggrFuncType::SUM : acceptAggregate();
+        if (function) {
+            if (components.sumOperation) {
+                throw error("only one aggregate is supported");
+            }
+            components.sumOperation = true;
+            components.aggregateType = *function;
+            components.average = average;
+            components.sumAttributeIndex = parseAttribute();
+        } else {
+            components.selectAttributes.push_back(parseAttribute());
+        }
+    }
+
+    void parseOrderItem() {
+        OrderItem item;
+        item.position = peek().position;
+        item.average = acceptWord("AVG");
+        item.aggregate = item.average ? AggrFuncType::SUM : acceptAggregate();
+        item.attr = parseAttribute();
+        item.ascending = !acceptWord("DESC");
+        if (item.ascending) {
+            acceptWord("ASC");
+        }
+        order_items.push_back(item);
+    }
+
+    // Aggregate results are (group key, aggregate) or the aggregate
+    // alone; other results are the input tuples
+    void resolveOrder(QueryComponents& components) const {
+        bool aggregated = components.sumOperation || components.groupBy;
+        for (const auto& item : order_items) {
+            if (!aggregated && !item.aggregate) {
+                components.orderBy.push_back({static_cast<size_t>(item.attr), item.ascending});
+            } else if (aggregated && item.aggregate && components.sumOperation &&
+                       *item.aggregate == components.aggregateType && item.average == components.average &&
+                       item.attr == components.sumAttributeIndex) {
+                components.orderBy.push_back({components.groupBy ? 1u : 0u, item.ascending});
+            } else if (aggregated && !item.aggregate && components.groupBy &&
+                       item.attr == components.groupByAttributeIndex) {
+                components.orderBy.push_back({0, item.ascending});
+            } else {
+                throw QueryLexer::syntaxError(query, item.position, "ORDER BY must name a column of the result");
+            }
+        }
+    }
+
+    Condition parseOr() {
+        Condition first = parseAnd();
+        if (!(peek().type == QueryLexer::WORD && equalsIgnoreCase(peek().text, "OR"))) {
+            return first;
+        }
+        Condition condition;
+        condition.kind = Condition::OR;
+        condition.children.push_back(std::move(first));
+        while (acceptWord("OR")) {
+            condition.children.push_back(parseAnd());
+        }
+        return condition;
+    }
+
+    Condition parseAnd() {
+        Condition first = parseComparison();
+        if (!(peek().type == QueryLexer::WORD && equalsIgnoreCase(peek().text, "AND"))) {
+            return first;
+        }
+        Condition condition;
+        condition.kind = Condition::AND;
+        condition.children.push_back(std::move(first));
+        while (acceptWord("AND")) {
+            condition.children.push_back(parseComparison());
+        }
+        return condition;
+    }
+
+    Condition parseComparison() {
+        if (acceptSymbol("(")) {
+            Condition condition = parseOr();
+            if (!acceptSymbol(")")) {
+                throw error("expected )");
+            }
+            return condition;
+        }
+        Condition condition;
+        condition.left = parseOperand();
+        condition.op = parseComparisonOperator();
+        condition.right = parseOperand();
+        if (condition.left.constant && condition.right.constant) {
+            throw error("comparison of two constants");
+        }
+        return condition;
+    }
+
+    Condition::Operand parseOperand() {
+        Condition::Operand operand;
+        const Token& token = peek();
+        switch (token.type) {
+            case QueryLexer::ATTRIBUTE:
+                operand.attr = parseAttribute();
+                return operand;
+            case QueryLexer::STRING:
+                operand.constant.emplace(std::string(token.text));
+                break;
+            case QueryLexer::NUMBER: {
+                const char* end = token.text.data() + token.text.size();
+                int integer = 0;
+                auto result = std::from_chars(token.text.data(), end, integer);
+                if (result.ec == std::errc() && result.ptr == end) {
+                    operand.constant.emplace(integer);
+                } else if (result.ec == std::errc::result_out_of_range) {
+                    throw error("integer out of range");
+                } else {
+                    float number = 0;
+                    result = std::from_chars(token.text.data(), end, number);
+                    if (result.ec != std::errc() || result.ptr != end) {
+                        throw error("invalid number");
+                    }
+                    operand.constant.emplace(number);
+                }
+                break;
+            }
+            default:
+                throw error("expected an attribute or a constant");
+        }
+        pos++;
+        return operand;
+    }
+
+    SimplePredicate::ComparisonOperator parseComparisonOperator() {
+        static const std::pair<std::string_view, SimplePredicate::ComparisonOperator> operators[] = {
+            {"=", SimplePredicate::EQ}, {"==", SimplePredicate::EQ}, {"!=", SimplePredicate::NE},
+            {"<>", SimplePredicate::NE}, {"<", SimplePredicate::LT}, {"<=", SimplePredicate::LE},
+            {">", SimplePredicate::GT}, {">=", SimplePredicate::GE}};
+        for (const auto& [symbol, op] : operators) {
+            if (acceptSymbol(symbol)) {
+                return op;
+            }
+        }
+        throw error("expected a comparison");
+    }
+
+    // Narrow (lower, upper) to the values of attr the condition keeps if
+    // it is a comparison, or an AND of comparisons, of one attribute with
+    // INT constants
+    static bool rangeOf(const Condition& condition, int& attr, int& lower, int& upper) {
+        if (condition.kind == Condition::OR) {
+            return false;
+        }
+        if (condition.kind == Condition::AND) {
+            for (const auto& child : condition.children) {
+                if (!rangeOf(child, attr, lower, upper)) {
+                    return false;
+                }
+            }
+            return true;
+        }
+
+        // Attribute on the left, constant on the right
+        const Condition::Operand* attribute = &condition.left;
+        const Condition::Operand* constant = &condition.right;
+        SimplePredicate::ComparisonOperator op = condition.op;
+        if (attribute->constant) {
+            std::swap(attribute, constant);
+            op = (op == SimplePredicate::LT) ? SimplePredicate::GT : (op == SimplePredicate::GT) ? SimplePredicate::LT
+               : (op == SimplePredicate::LE) ? SimplePredicate::GE : (op == SimplePredicate::GE) ? SimplePredicate::LE : op;
+        }
+        if (!constant->constant || constant->constant->getType() != INT || op == SimplePredicate::NE) {
+            return false;
+        }
+        if (attr != -1 && attr != attribute->attr) {
+            return false;
+        }
+        attr = attribute->attr;
+
+        // Bounds are exclusive
+        int64_t value = constant->constant->asInt();
+        int64_t low = std::numeric_limits<int>::min();
+        int64_t high = std::numeric_limits<int>::max();
+        switch (op) {
+            case SimplePredicate::GT: low = value; break;
+            case SimplePredicate::GE: low = value - 1; break;
+            case SimplePredicate::LT: high = value; break;
+            case SimplePredicate::LE: high = value + 1; break;
+            default: low = value - 1; high = value + 1; break;    // EQ
+        }
+        if (low < std::numeric_limits<int>::min() || high > std::numeric_limits<int>::max()) {
+            return false;
+        }
+        lower = std::max<int64_t>(lower, low);
+        upper = std::min<int64_t>(upper, high);
+        return true;
+    }
+};
+
+QueryComponents parseQuery(const std::string& query) {
+    return QueryParser(query).parse();
+}
+
+// The operator form of a WHERE condition
+std::unique_ptr<IPredicate> createPredicate(const Condition& condition) {
+    if (condition.kind != Condition::COMPARISON) {
+        auto predicate = std::make_unique<ComplexPredicate>(
+            (condition.kind == Condition::AND) ? ComplexPredicate::AND : ComplexPredicate::OR);
+        for (const auto& child : condition.children) {
+            predicate->addPredicate(createPredicate(child));
+        }
+        return predicate;
+    }
+    auto operand = [](const Condition::Operand& side) {
+        return side.constant ? SimplePredicate::Operand(std::make_unique<Field>(*side.constant))
+                             : SimplePredicate::Operand(static_cast<size_t>(side.attr));
+    };
+    return std::make_unique<SimplePredicate>(operand(condition.left), operand(condition.right), condition.op);
+}
+
+// The attributes an aggregate query reads, in increasing order. Empty for
+// other queries, which output whole tuples.
+std::vector<size_t> referencedAttributes(const QueryComponents& components) {
+    if (!components.sumOperation && !components.groupBy) {
+        return {};
+    }
+    std::vector<size_t> attributes(components.selectAttributes.begin(), components.selectAttributes.end());
+    if (components.sumOperation) {
+        attributes.push_back(components.sumAttributeIndex);
+    }
+    if (components.groupBy) {
+        attributes.push_back(components.groupByAttributeIndex);
+    }
+    std::function<void(const Condition&)> visit = [&](const Condition& condition) {
+        for (const auto* operand : {&condition.left, &condition.right}) {
+            if (condition.kind == Condition::COMPARISON && operand->attr >= 0) {
+                attributes.push_back(operand->attr);
+            }
+        }
+        for (const auto& child : condition.children) {
+            visit(child);
+        }
+    };
+    if (components.where) {
+        visit(*components.where);
+    }
+    std::sort(attributes.begin(), attributes.end());
+    attributes.erase(std::unique(attributes.begin(), attributes.end()), attributes.end());
+    return attributes;
+}
+
+// Column of attr in a projection to the sorted attributes
+size_t projectedColumn(const std::vector<size_t>& attributes, size_t attr) {
+    return std::lower_bound(attributes.begin(), attributes.end(), attr) - attributes.begin();
+}
+
+// The condition over the columns of a projection to the sorted attributes
+Condition projectCondition(Condition condition, const std::vector<size_t>& attributes) {
+    for (auto* operand : {&condition.left, &condition.right}) {
+        if (condition.kind == Condition::COMPARISON && operand->attr >= 0) {
+            operand->attr = projectedColumn(attributes, operand->attr);
+        }
+    }
+    for (auto& child : condition.children) {
+        child = projectCondition(std::move(child), attributes);
+    }
+    return condition;
+}
+
+// A query result kept current as the table changes. Aggregate views
+// (SUM, COUNT, MIN or MAX of one attribute, optionally grouped by another)
+// hold one output tuple per group and update it in place, together with
+// the number of base tuples in the group so a group disappears with its
+// last tuple. Deleting the current MIN or MAX of a group cannot be undone
+// in place; it marks the view stale until refresh() recomputes it.
+class MaterializedView {
+private:
+    std::string viewName;
+    std::string viewDefinition;
+    QueryComponents components;
+    std::vector<std::unique_ptr<Tuple>> viewData;
+    std::vector<size_t> groupCounts;                    // Base table tuples per row of viewData
+    std::unordered_map<Field, size_t, FieldHasher> groups;  // Group key -> row of viewData
+    std::unique_ptr<IPredicate> predicate;              // The WHERE clause, if any
+    bool stale = false;
+
+    bool matches(const std::vector<std::unique_ptr<Field>>& fields) const {
+        return !predicate || predicate->check(fields);
+    }
+
+    Field groupKey(const std::vector<std::unique_ptr<Field>>& fields) const {
+        return components.groupBy ? *fields[components.groupByAttributeIndex] : Field(0);
+    }
+
+    // The aggregate is the last field of a group's output tuple
+    Field& aggregateOf(size_t row) {
+        return *viewData[row]->fields.back();
+    }
+
+    static bool lessThan(const Field& lhs, const Field& rhs) {
+        switch (lhs.getType()) {
+            case INT: return lhs.asInt() < rhs.asInt();
+            case FLOAT: return lhs.asFloat() < rhs.asFloat();
+            case STRING: return lhs.asString() < rhs.asString();
+            case BIGINT: return lhs.asBigInt() < rhs.asBigInt();
+        }
+        return false;
+    }
+
+    static void addTo(Field& aggregate, const Field& value, int sign) {
+        if (aggregate.getType() == FLOAT) {
+            aggregate.setFloat(aggregate.asFloat() + sign * value.asFloat());
+        } else {
+            aggregate.setBigInt(aggregate.asBigInt() + sign * value.asInt());
+        }
+    }
+
+    // The aggregate of a new group's first tuple, typed as the query's
+    // (aggregateResultType)
+    std::unique_ptr<Field> firstAggregate(const Field& value) const {
+        if (components.aggregateType == AggrFuncType::COUNT) {
+            return std::make_unique<Field>(int64_t{1});
+        }
+        if (components.aggregateType == AggrFuncType::SUM && value.getType() == INT) {
+            return std::make_unique<Field>(static_cast<int64_t>(value.asInt()));
+        }
+        return value.clone();
+    }
+
+    // Drop the output tuple of a group by moving the last one into its row
+    void removeGroup(std::unordered_map<Field, size_t, FieldHasher>::iterator it) {
+        size_t row = it->second;
+        groups.erase(it);
+        if (row + 1 != viewData.size()) {
+            viewData[row] = std::move(viewData.back());
+            groupCounts[row] = groupCounts.back();
+            groups.find(components.groupBy ? *viewData[row]->fields[0] : Field(0))->second = row;
+        }
+        viewData.pop_back();
+        groupCounts.pop_back();
+    }
+
+public:
+    MaterializedView(const std::string& name, const std::string& definition)
+        : viewName(name), viewDefinition(definition), components(parseQuery(definition)) {
+        if (components.where) {
+            predicate = createPredicate(*components.where);
+        }
+    }
+
+    // Recompute the view from the table
+    void refresh(BufferManager& bufferManager) {
+        clear();
+
+        ScanOperator scanOp(bufferManager);
+        scanOp.open();
+        while (scanOp.next()) {
+            applyInsert(scanOp.getOutput());
+        }
+        scanOp.close();
+    }
+
+    void clear() {
+        viewData.clear();
+        groupCounts.clear();
+        groups.clear();
+        stale = false;
+    }
+
+    // Fold a tuple inserted into the base table into the view
+    void applyInsert(const std::vector<std::unique_ptr<Field>>& fields) {
+        if (stale || !matches(fields)) {
+            return;
+        }
+
+        if (!isAggregate()) {
+            auto tuple = std::make_unique<Tuple>();
+            for (const auto& field : fields) {
+                tuple->addField(field->clone());
+            }
+            viewData.push_back(std::move(tuple));
+            return;
+        }
+
+        auto [it, inserted] = groups.try_emplace(groupKey(fields), viewData.size());
+        if (inserted) {
+            groupCounts.push_back(1);
+            auto tuple = std::make_unique<Tuple>();
+            if (components.groupBy) {
+                tuple->addField(it->first.clone());
+            }
+            if (components.sumOperation) {
+                tuple->addField(firstAggregate(*fields[components.sumAttributeIndex]));
+            }
+            viewData.push_back(std::move(tuple));
+            return;
+        }
+        ++groupCounts[it->second];
+        if (!components.sumOperation) {
+            return;
+        }
+
+        Field& aggregate = aggregateOf(it->second);
+        const Field& value = *fields[components.sumAttributeIndex];
+        switch (components.aggregateType) {
+            case AggrFuncType::COUNT:
+                aggregate.setBigInt(aggregate.asBigInt() + 1);
+                break;
+            case AggrFuncType::SUM:
+                addTo(aggregate, value, 1);
+                break;
+            case AggrFuncType::MIN:
+                if (lessThan(value, aggregate)) {
+                    aggregate = value;
+                }
+                break;
+            case AggrFuncType::MAX:
+                if (lessThan(aggregate, value)) {
+                    aggregate = value;
+                }
+                break;
+        }
+    }
+
+    // Take a tuple deleted from the base table out of the view
+    void applyDelete(const std::vector<std::unique_ptr<Field>>& fields) {
+        if (stale || !matches(fields)) {
+            return;
+        }
+
+        if (!isAggregate()) {
+            auto it = std::find_if(viewData.begin(), viewData.end(), [&fields](const auto& tuple) {
+                return std::equal(fields.begin(), fields.end(), tuple->fields.begin(), tuple->fields.end(),
+                                  [](const auto& lhs, const auto& rhs) { return *lhs == *rhs; });
+            });
+            if (it != viewData.end()) {
+                *it = std::move(viewData.back());
+                viewData.pop_back();
+            }
+            return;
+        }
+
+        auto it = groups.find(groupKey(fields));
+        if (it == groups.end()) {
+            return;
+        }
+        if (--groupCounts[it->second] == 0) {
+            removeGroup(it);
+            return;
+        }
+        if (!components.sumOperation) {
+            return;
+        }
+
+        Field& aggregate = aggregateOf(it->second);
+        const Field& value = *fields[components.sumAttributeIndex];
+        switch (components.aggregateType) {
+            case AggrFuncType::COUNT:
+                aggregate.setBigInt(aggregate.asBigInt() - 1);
+                break;
+            case AggrFuncType::SUM:
+                addTo(aggregate, value, -1);
+                break;
+            case AggrFuncType::MIN:
+            case AggrFuncType::MAX:
+                // The next smallest (largest) value is not known here
+                if (value == aggregate) {
+                    stale = true;
+                }
+                break;
+        }
+    }
+
+    bool isAggregate() const {
+        return components.sumOperation || components.groupBy;
+    }
+
+    bool isStale() const {
+        return stale;
+    }
+
+    const QueryComponents& getComponents() const {
+        return components;
+    }
+
+    // Rows are (group key, aggregate) for aggregate views, either field
+    // missing without GROUP BY or aggregate, and base tuples otherwise
+    const std::vector<std::unique_ptr<Tuple>>& getData() const {
+        return viewData;
+    }
+
+    // Base table tuples behind each row of an aggregate view
+    const std::vector<size_t>& getGroupCounts() const {
+        return groupCounts;
+    }
+
+    const std::string& getName() const {
+        return viewName;
+    }
+};
+
+constexpr size_t DEFAULT_VIEW_BATCH_SIZE = 4096;
+
+// Keeps all views current. By default every insert and delete is applied
+// to the views right away. With setDeferred(true) changes are queued and a
+// background thread applies them in batches of batch_size; getView() first
+// applies whatever is still queued. Stale views are recomputed by getView()
+// on the calling thread, as their scan goes through the buffer manager,
+// which is not thread-safe.
+class MaterializedViewManager {
+private:
+    std::unordered_map<std::string, std::unique_ptr<MaterializedView>> views;
+    BufferManager& bufferManager;
+
+    // apply_mutex is held while views change and taken before queue_mutex,
+    // so queued changes reach the views in order
+    std::mutex apply_mutex;
+    std::mutex queue_mutex;
+    std::condition_variable queue_cv;
+    Batch queue;                    // Changed tuples in order
+    std::vector<bool> queue_inserts;  // Whether each was inserted or deleted
+    bool deferred = false;
+    bool stopping = false;
+    size_t batch_size = DEFAULT_VIEW_BATCH_SIZE;
+    size_t num_batches = 0;
+    std::thread maintainer;
+    size_t version = 0;             // Changes when views are created
+
+    void apply(const std::vector<std::unique_ptr<Field>>& fields, bool insert) {
+        for (auto& view : views) {
+            if (insert) {
+                view.second->applyInsert(fields);
+            } else {
+                view.second->applyDelete(fields);
+            }
+        }
+    }
+
+    void enqueue(const std::vector<std::unique_ptr<Field>>& fields, bool insert) {
+        if (!deferred) {
+            apply(fields, insert);
+            return;
+        }
+        bool full;
+        {
+            std::lock_guard<std::mutex> lock(queue_mutex);
+            queue.appendTuple(fields);
+            queue_inserts.push_back(insert);
+            full = queue.size() >= batch_size;
+        }
+        if (full) {
+            queue_cv.notify_one();
+        }
+    }
+
+    // Caller holds apply_mutex
+    void applyQueued() {
+        Batch deltas;
+        std::vector<bool> inserts;
+        {
+            std::lock_guard<std::mutex> lock(queue_mutex);
+            std::swap(deltas, queue);
+            inserts.swap(queue_inserts);
+        }
+        std::vector<std::unique_ptr<Field>> fields;
+        for (size_t row = 0; row < deltas.size(); ++row) {
+            deltas.readTuple(row, fields);
+            apply(fields, inserts[row]);
+        }
+        if (deltas.size() > 0) {
+            ++num_batches;
+        }
+    }
+
+    void maintain() {
+        std::unique_lock<std::mutex> lock(queue_mutex);
+        while (true) {
+            queue_cv.wait(lock, [this] { return stopping || queue.size() >= batch_size; });
+            if (stopping) {
+                return;
+            }
+            lock.unlock();
+            {
+                std::lock_guard<std::mutex> apply_lock(apply_mutex);
+                applyQueued();
+            }
+            lock.lock();
+        }
+    }
+
+    void stopMaintainer() {
+        if (!maintainer.joinable()) {
+            return;
+        }
+        {
+            std::lock_guard<std::mutex> lock(queue_mutex);
+            stopping = true;
+        }
+        queue_cv.notify_one();
+        maintainer.join();
+        stopping = false;
+    }
+
+public:
+    MaterializedViewManager(BufferManager& bm) : bufferManager(bm) {}
+
+    ~MaterializedViewManager() {
+        stopMaintainer();
+    }
+
+    // Queue changes for a background thread instead of applying them
+    // inline. Turning it off applies everything still queued.
+    void setDeferred(bool enable, size_t batch_size = DEFAULT_VIEW_BATCH_SIZE) {
+        stopMaintainer();
+        sync();
+        deferred = enable;
+        this->batch_size = batch_size;
+        if (enable) {
+            maintainer = std::thread(&MaterializedViewManager::maintain, this);
+        }
+    }
+
+    void createView(const std::string& name, const std::string& definition) {
+        auto view = std::make_unique<MaterializedView>(name, definition);
+        std::lock_guard<std::mutex> apply_lock(apply_mutex);
+        applyQueued();
+        view->refresh(bufferManager);
+        views[name] = std::move(view);
+        version++;
+    }
+
+    // Plans over the views are valid while this stays the same
+    size_t getVersion() const {
+        return version;
+    }
+
+    void refreshView(const std::string& name) {
+        std::lock_guard<std::mutex> apply_lock(apply_mutex);
+        applyQueued();
+        auto it = views.find(name);
+        if (it != views.end()) {
+            it->second->refresh(bufferManager);
+        }
+    }
+
+    // Apply all queued changes and recompute stale views
+    void sync() {
+        std::lock_guard<std::mutex> apply_lock(apply_mutex);
+        applyQueued();
+        for (auto& view : views) {
+            if (view.second->isStale()) {
+                view.second->refresh(bufferManager);
+            }
+        }
+    }
+
+    // The up to date view, valid until the next insert or delete
+    const MaterializedView* getView(const std::string& name) {
+        auto it = views.find(name);
+        if (it == views.end()) {
+            return nullptr;
+        }
+        sync();
+        return it->second.get();
+    }
+
+    // All views, up to date as for getView()
+    std::vector<const MaterializedView*> getViews() {
+        sync();
+        std::vector<const MaterializedView*> result;
+        for (const auto& view : views) {
+            result.push_back(view.second.get());
+        }
+        return result;
+    }
+
+    void applyInsert(const std::vector<std::unique_ptr<Field>>& fields) {
+        enqueue(fields, true);
+    }
+
+    void applyDelete(const std::vector<std::unique_ptr<Field>>& fields) {
+        enqueue(fields, false);
+    }
+
+    // Batches of queued changes applied so far
+    size_t getNumBatches() const {
+        return num_batches;
+    }
+};
+
+
+// The value ViewScanOperator derives from each row of an aggregate view
+enum class ViewValue {
+    NONE,               // Group key only
+    AGGREGATE,          // The view's aggregate
+    COUNT,              // Base tuples in the group
+    KEY,                // The group key, as MIN/MAX of the key attribute
+    KEY_TIMES_COUNT,    // SUM of the key attribute over the group
+    TUPLE               // Base tuples of a non-aggregate view
+};
+
+// Reads the rows of a materialized view as (group key, value), dropping
+// the key for views without GROUP BY, or as stored for ViewValue::TUPLE
+class ViewScanOperator : public Operator {
+private:
+    const MaterializedView& view;
+    ViewValue value;
+    size_t row = 0;
+    std::vector<std::unique_ptr<Field>> currentFields;
+
+    Field& output(size_t index) {
+        return Tuple::reuseField(currentFields, index);
+    }
+
+public:
+    ViewScanOperator(const MaterializedView& view, ViewValue value) : view(view), value(value) {}
+
+    void open() override {
+        row = 0;
+    }
+
+    bool next() override {
+        const auto& data = view.getData();
+        if (row >= data.size()) {
+            return false;
+        }
+        const auto& fields = data[row]->fields;
+        size_t count = view.getGroupCounts().empty() ? 0 : view.getGroupCounts()[row];
+        row++;
+
+        if (value == ViewValue::TUPLE) {
+            for (size_t i = 0; i < fields.size(); ++i) {
+                output(i) = *fields[i];
+            }
+            currentFields.resize(fields.size());
+            return true;
+        }
+
+        size_t width = 0;
+        if (view.getComponents().groupBy) {
+            output(width++) = *fields[0];
+        }
+        switch (value) {
+            case ViewValue::NONE:
+            case ViewValue::TUPLE:
+                break;
+            case ViewValue::AGGREGATE:
+                output(width++) = *fields.back();
+                break;
+            case ViewValue::COUNT:
+                output(width++).assign(static_cast<int64_t>(count));
+                break;
+            case ViewValue::KEY:
+                output(width++) = *fields[0];
+                break;
+            case ViewValue::KEY_TIMES_COUNT:
+                if (fields[0]->getType() == STRING) {
+                    throw std::runtime_error("Unsupported Field type for aggregation.");
+                }
+                if (fields[0]->getType() == FLOAT) {
+                    output(width++).assign(fields[0]->asFloat() * count);
+                } else {
+                    output(width++).assign(static_cast<int64_t>(fields[0]->asInt()) * static_cast<int64_t>(count));
+                }
+                break;
+        }
+        currentFields.resize(width);
+        return true;
+    }
+
+    void close() override {}
+
+    const std::vector<std::unique_ptr<Field>>& getOutput() override {
+        return currentFields;
+    }
+
+    double estimateCost(CostModel& costModel) override {
+        return costModel.estimateViewScanCost(view.getData().size());
+    }
+
+    double estimateRows(CostModel&) override {
+        return view.getData().size();
+    }
+};
+
+// A query answered from a view: scan the view deriving `value`, keep the
+// rows in the residual range and, if needed, aggregate them again.
+// Attribute indexes refer to the columns of the view scan.
+struct ViewRewrite {
+    const MaterializedView* view = nullptr;
+    ViewValue value = ViewValue::NONE;
+    bool residual = false;
+    int residualAttributeIndex = -1;
+    int lowerBound = std::numeric_limits<int>::min();
+    int upperBound = std::numeric_limits<int>::max();
+    bool reaggregate = false;
+    bool groupBy = false;
+    int groupByAttributeIndex = -1;
+    bool aggregate = false;
+    AggrFuncType aggregateType = AggrFuncType::SUM;
+    int valueAttributeIndex = -1;
+};
+
+// How to answer query from view, if the view holds every row the query
+// reads (its WHERE range contains the query's), keeps the query's groups
+// apart and stores or implies the aggregate the query asks for.
+std::optional<ViewRewrite> matchView(const QueryComponents& query, const MaterializedView& view) {
+    const QueryComponents& definition = view.getComponents();
+    // Only ranges on one attribute are compared
+    if ((query.whereCondition && query.whereAttributeIndex == -1) ||
+        (definition.whereCondition && definition.whereAttributeIndex == -1)) {
+        return std::nullopt;
+    }
+    if (definition.whereCondition &&
+        !(query.whereCondition && query.whereAttributeIndex == definition.whereAttributeIndex &&
+          query.lowerBound >= definition.lowerBound && query.upperBound <= definition.upperBound)) {
+        return std::nullopt;
+    }
+    bool sameRange = query.whereCondition == definition.whereCondition &&
+        (!query.whereCondition || (query.whereAttributeIndex == definition.whereAttributeIndex &&
+                                   query.lowerBound == definition.lowerBound &&
+                                   query.upperBound == definition.upperBound));
+
+    ViewRewrite rewrite;
+    rewrite.view = &view;
+    rewrite.lowerBound = query.lowerBound;
+    rewrite.upperBound = query.upperBound;
+
+    // Base tuples: run the whole query over the view
+    if (!view.isAggregate()) {
+        rewrite.value = ViewValue::TUPLE;
+        rewrite.residual = !sameRange;
+        rewrite.residualAttributeIndex = query.whereAttributeIndex;
+        rewrite.reaggregate = query.sumOperation || query.groupBy;
+        rewrite.groupBy = query.groupBy;
+        rewrite.groupByAttributeIndex = query.groupByAttributeIndex;
+        rewrite.aggregate = query.sumOperation;
+        rewrite.aggregateType = query.aggregateType;
+        rewrite.valueAttributeIndex = query.sumAttributeIndex;
+        return rewrite;
+    }
+
+    // Groups can be merged but not split, and only the group key can be
+    // filtered on
+    bool keyed = definition.groupBy;
+    int key = definition.groupByAttributeIndex;
+    if (!query.sumOperation && !query.groupBy) {
+        return std::nullopt;
+    }
+    if (query.groupBy && !(keyed && query.groupByAttributeIndex == key)) {
+        return std::nullopt;
+    }
+    if (!sameRange) {
+        if (!keyed || query.whereAttributeIndex != key) {
+            return std::nullopt;
+        }
+        rewrite.residual = true;
+        rewrite.residualAttributeIndex = 0;
+    }
+
+    if (query.sumOperation) {
+        if (query.aggregateType == AggrFuncType::COUNT) {
+            rewrite.value = ViewValue::COUNT;
+        } else if (keyed && query.sumAttributeIndex == key) {
+            rewrite.value = (query.aggregateType == AggrFuncType::SUM) ? ViewValue::KEY_TIMES_COUNT : ViewValue::KEY;
+        } else if (definition.sumOperation && definition.aggregateType == query.aggregateType &&
+                   definition.sumAttributeIndex == query.sumAttributeIndex) {
+            rewrite.value = ViewValue::AGGREGATE;
+        } else {
+            return std::nullopt;
+        }
+        // COUNTs add up, the other aggregates combine with themselves
+        rewrite.aggregate = true;
+        rewrite.aggregateType = (query.aggregateType == AggrFuncType::COUNT) ? AggrFuncType::SUM : query.aggregateType;
+        rewrite.valueAttributeIndex = keyed ? 1 : 0;
+    }
+    // One view row per group already; otherwise merge all rows into one
+    rewrite.reaggregate = !query.groupBy;
+    return rewrite;
+}
+
+
+void prettyPrint(const QueryComponents& components) {
+    std::cout << "Query Components:\n";
+    std::cout << "  Selected Attributes: ";
+    for (auto attr : components.selectAttributes) {
+        std::cout << "{" << attr + 1 << "} "; // Convert back to 1-based indexing for display
+    }
+    std::cout << "\n  SUM Operation: " << (components.sumOperation ? "Yes" : "No");
+    if (components.sumOperation) {
+        std::cout << " on {" << components.sumAttributeIndex + 1 << "}";
+    }
+    std::cout << "\n  GROUP BY: " << (components.groupBy ? "Yes" : "No");
+    if (components.groupBy) {
+        std::cout << " on {" << components.groupByAttributeIndex + 1 << "}";
+    }
+    std::cout << "\n  WHERE Condition: " << (components.whereCondition ? "Yes" : "No");
+    if (components.whereAttributeIndex != -1) {
+        std::cout << " on {" << components.whereAttributeIndex + 1 << "} > " << components.lowerBound << " and < " << components.upperBound;
+    }
+    std::cout << std::endl;
+}
+
+// lowerBound < {attr} < upperBound
+std::unique_ptr<IPredicate> makeRangePredicate(size_t attr, int lowerBound, int upperBound) {
+    auto complexPredicate = std::make_unique<ComplexPredicate>(ComplexPredicate::LogicOperator::AND);
+    complexPredicate->addPredicate(std::make_unique<SimplePredicate>(
+        SimplePredicate::Operand(attr),
+        SimplePredicate::Operand(std::make_unique<Field>(lowerBound)),
+        SimplePredicate::ComparisonOperator::GT));
+    complexPredicate->addPredicate(std::make_unique<SimplePredicate>(
+        SimplePredicate::Operand(attr),
+        SimplePredicate::Operand(std::make_unique<Field>(upperBound)),
+        SimplePredicate::ComparisonOperator::LT));
+    return complexPredicate;
+}
+
+void executeQuery(const QueryComponents& components, 
+                  BufferManager& buffer_manager) {
+    // Stack allocation of ScanOperator
+    ScanOperator scanOp(buffer_manager);
+
+    // Using a pointer to Operator to handle polymorphism
+    Operator* rootOp = &scanOp;
+
+    // Buffer for optional operators to ensure lifetime
+    std::optional<SelectOperator> selectOpBuffer;
+    std::optional<HashAggregationOperator> hashAggOpBuffer;
+
+    // Apply WHERE conditions
+    if (components.where) {
+        // Using std::optional to manage the lifetime of SelectOperator
+        selectOpBuffer.emplace(*rootOp, createPredicate(*components.where));
+        rootOp = &*selectOpBuffer;
+    }
+
+    // Apply SUM or GROUP BY operation
+    if (components.sumOperation || components.groupBy) {
+        std::vector<size_t> groupByAttrs;
+        if (components.groupBy) {
+            groupByAttrs.push_back(static_cast<size_t>(components.groupByAttributeIndex));
+        }
+        std::vector<AggrFunc> aggrFuncs{
+            {components.aggregateType, static_cast<size_t>(components.sumAttributeIndex)}
+        };
+
+        // Using std::optional to manage the lifetime of HashAggregationOperator
+        hashAggOpBuffer.emplace(*rootOp, groupByAttrs, aggrFuncs);
+        rootOp = &*hashAggOpBuffer;
+    }
+
+    // Execute the Root Operator
+    rootOp->open();
+    while (rootOp->next()) {
+        // Retrieve and print the current tuple
+        const auto& output = rootOp->getOutput();
+        for (const auto& field : output) {
+            field->print();
+            std::cout << " ";
+        }
+        std::cout << std::endl;
+    }
+    rootOp->close();
+}
+
+class InsertOperator : public Operator {
+private:
+    BufferManager& bufferManager;
+    std::unique_ptr<Tuple> tupleToInsert;
+    TupleID inserted_tuple_id = 0;
+    Batch batchToInsert;
+    std::vector<TupleID> inserted_tuple_ids;
+    // First page nextBatch() tries, the page of its last insert
+    PageID insert_page_id = 0;
+
+public:
+    InsertOperator(BufferManager& manager) : bufferManager(manager) {}
+
+    // Set the tuple to be inserted by this operator.
+    void setTupleToInsert(std::unique_ptr<Tuple> tuple) {
+        tupleToInsert = std::move(tuple);
+    }
+
+    // Set the tuples to be inserted by nextBatch()
+    void setBatchToInsert(Batch batch) {
+        batchToInsert = std::move(batch);
+    }
+
+    void open() override {
+        // Not used in this context
+    }
+
+    // Writers hold the pool latch, so snapshot scans never copy a page
+    // whose change has no version yet
+    bool next() override {
+        if (!tupleToInsert) return false; // No tuple to insert
+        auto guard = bufferManager.lock();
+        if (bufferManager.getPaxLayout()) {
+            return appendPax(tupleToInsert->fields, inserted_tuple_id);
+        }
+
+        // Only pages the free space map does not rule out are read
+        size_t size = tupleToInsert->serialize().size();
+        for (PageID pageId = bufferManager.findPageWithSpace(size); pageId < bufferManager.getNumPages();
+             pageId = bufferManager.findPageWithSpace(size, pageId + 1)) {
+            auto& page = bufferManager.getPage(pageId);
+            // Attempt to insert the tuple
+            if (auto slot = page->addTuple(tupleToInsert->clone())) { 
+                // Log the insert, the page itself is written lazily
+                bufferManager.logInsert(pageId, *slot); 
+                inserted_tuple_id = makeTupleID(pageId, *slot);
+                return true; // Insertion successful
+            }
+            bufferManager.updateFreeSpace(pageId);
+        }
+
+        // If insertion failed in all existing pages, extend the database and try again
+        bufferManager.extend();
+        auto& newPage = bufferManager.getPage(bufferManager.getNumPages() - 1);
+        if (auto slot = newPage->addTuple(tupleToInsert->clone())) {
+            bufferManager.logInsert(bufferManager.getNumPages() - 1, *slot);
+            inserted_tuple_id = makeTupleID(bufferManager.getNumPages() - 1, *slot);
+            return true; // Insertion successful after extending the database
+        }
+
+        return false; // Insertion failed even after extending the database
+    }
+
+    // PAX pages are only appended to, so rows go to the last page or a
+    // new one
+    bool appendPax(const std::vector<std::unique_ptr<Field>>& fields, TupleID& tuple_id) {
+        const PaxLayout& layout = *bufferManager.getPaxLayout();
+        auto guard = bufferManager.lock();
+        PageID page_id = bufferManager.getNumPages() - 1;
+        auto row = layout.append(bufferManager.getPage(page_id)->page_data.get(), fields);
+        if (!row) {
+            bufferManager.extend();
+            page_id++;
+            row = layout.append(bufferManager.getPage(page_id)->page_data.get(), fields);
+            if (!row) {
+                return false; // Does not fit into an empty page
+            }
+        }
+        bufferManager.logInsert(page_id, *row);
+        tuple_id = makeTupleID(page_id, *row);
+        return true;
+    }
+
+    // Where the last successful next() placed the tuple
+    TupleID getInsertedTupleID() const {
+        return inserted_tuple_id;
+    }
+
+    // Inserts the batch set by setBatchToInsert() and produces no tuples.
+    // Returns true if every tuple was inserted. Pages are filled in order
+    // like next() does per tuple, but the search for a page with room
+    // resumes where the previous tuple went instead of at page 0, so space
+    // freed behind that page is not reused by this operator.
+    bool nextBatch(Batch& batch) override {
+        batch.clear();
+        inserted_tuple_ids.clear();
+        auto guard = bufferManager.lock();
+        PageID& page_id = insert_page_id;
+        for (size_t row = 0; row < batchToInsert.size(); ++row) {
+            auto tuple = std::make_unique<Tuple>();
+            tuple->fields = batchToInsert.getTuple(row);
+            if (bufferManager.getPaxLayout()) {
+                TupleID tuple_id;
+                if (!appendPax(tuple->fields, tuple_id)) {
+                    return false;
+                }
+                inserted_tuple_ids.push_back(tuple_id);
+                continue;
+            }
+            std::optional<size_t> slot;
+            while (!slot) {
+                bool new_page = (page_id == bufferManager.getNumPages());
+                if (new_page) {
+                    bufferManager.extend();
+                }
+                slot = bufferManager.getPage(page_id)->addTuple(tuple->clone());
+                if (!slot) {
+                    if (new_page) {
+                        return false; // Does not fit into an empty page
+                    }
+                    page_id++;
+                }
+            }
+            bufferManager.logInsert(page_id, *slot);
+            inserted_tuple_ids.push_back(makeTupleID(page_id, *slot));
+        }
+        batchToInsert.clear();
+        return true;
+    }
+
+    // Where the last nextBatch() placed its tuples, in batch order
+    const std::vector<TupleID>& getInsertedTupleIDs() const {
+        return inserted_tuple_ids;
+    }
+
+    void close() override {
+        // Not used in this context
+    }
+
+    const std::vector<std::unique_ptr<Field>>& getOutput() override {
+        return noOutput(); // Produces no tuples
+    }
+
+    double estimateCost(CostModel& costModel) override {
+        // Placeholder logic
+        return 1.0;
+    }
+};
+
+class DeleteOperator : public Operator {
+private:
+    BufferManager& bufferManager;
+    size_t pageId;
+    size_t tupleId;
+    std::unique_ptr<Tuple> deletedTuple;
+
+public:
+    DeleteOperator(BufferManager& manager, size_t pageId, size_t tupleId) 
+        : bufferManager(manager), pageId(pageId), tupleId(tupleId) {}
+
+    void open() override {
+        // Not used in this context
+    }
+
+    bool next() override {
+        auto guard = bufferManager.lock();
+        auto& page = bufferManager.getPage(pageId);
+        if (!page) {
+            std::cerr << "Page not found." << std::endl;
+            return false;
+        }
+
+        // Keep the old tuple around so indexes can drop their entries
+        const Slot& slot = page->getSlot(tupleId);
+        if (!slot.empty) {
+            deletedTuple = Tuple::deserialize(page->page_data.get() + slot.offset, slot.length);
+        }
+
+        if (page->deleteTuple(tupleId)) { // Perform deletion
+            bufferManager.logDelete(pageId, tupleId);
+        }
+        return true;
+    }
+
+    // The tuple removed by next(), nullptr if the slot was empty
+    const Tuple* getDeletedTuple() const {
+        return deletedTuple.get();
+    }
+
+    void close() override {
+        // Not used in this context
+    }
+
+    const std::vector<std::unique_ptr<Field>>& getOutput() override {
+        return noOutput(); // Produces no tuples
+    }
+
+    double estimateCost(CostModel& costModel) override {
+        // Placeholder logic
+        return 1.0;
+    }
+};
+
+// The 4-field tuple layout BuzzDB stores for a (key, value) sale
+std::unique_ptr<Tuple> makeSalesTuple(int key, int value) {
+    auto newTuple = std::make_unique<Tuple>();
+
+    auto key_field = std::make_unique<Field>(key);
+    auto value_field = std::make_unique<Field>(value);
+    float float_val = 132.04;
+    auto float_field = std::make_unique<Field>(float_val);
+    auto string_field = std::make_unique<Field>("buzzdb");
+
+    newTuple->addField(std::move(key_field));
+    newTuple->addField(std::move(value_field));
+    newTuple->addField(std::move(float_field));
+    newTuple->addField(std::move(string_field));
+    return newTuple;
+}
+
+// Packs tuples into fresh pages in memory, for appending them to a file
+// in one write: slotted pages by the placement rule SlottedPage::addTuple
+// follows on an empty page, or PAX pages. The last page stays open for
+// more tuples.
+class PagePacker {
+private:
+    const PaxLayout* layout;
+    SlottedPage empty_page;
+    std::vector<char> pages;        // num_full_pages full pages, then the open one
+    size_t num_full_pages = 0;
+    size_t current_slot = 0;
+    size_t current_offset = 0;
+
+    char* openPage() {
+        return pages.data() + num_full_pages * PAGE_SIZE;
+    }
+
+    void startPage() {
+        pages.resize((num_full_pages + 1) * PAGE_SIZE);
+        std::memcpy(openPage(), empty_page.page_data.get(), PAGE_SIZE);
+        current_slot = 0;
+        current_offset = empty_page.metadata_size;
+    }
+
+    void finishPage() {
+        num_full_pages++;
+        startPage();
+    }
+
+public:
+    explicit PagePacker(const PaxLayout* layout = nullptr) : layout(layout) {
+        startPage();
+    }
+
+    // Add a serialized tuple to slotted pages, returns its page (counted
+    // from the first page of the packer) and slot
+    std::pair<size_t, size_t> append(const std::string& serialized) {
+        if (current_slot == MAX_SLOTS || current_offset + serialized.size() >= PAGE_LSN_OFFSET) {
+            finishPage();
+        }
+        Slot* slot_array = reinterpret_cast<Slot*>(openPage());
+        slot_array[current_slot].empty = false;
+        slot_array[current_slot].offset = current_offset;
+        slot_array[current_slot].length = serialized.size();
+        std::memcpy(openPage() + current_offset, serialized.data(), serialized.size());
+        current_offset += serialized.size();
+        return {num_full_pages, current_slot++};
+    }
+
+    // Add a row of the layout to PAX pages, returns its page and row
+    std::pair<size_t, size_t> append(const std::vector<std::unique_ptr<Field>>& fields) {
+        auto row = layout->append(openPage(), fields);
+        if (!row) {
+            finishPage();
+            row = layout->append(openPage(), fields);
+        }
+        current_slot++;
+        return {num_full_pages, *row};
+    }
+
+    const char* data() const {
+        return pages.data();
+    }
+
+    size_t getNumFullPages() const {
+        return num_full_pages;
+    }
+
+    // The full pages and the open one if it has tuples
+    size_t getNumPages() const {
+        return num_full_pages + (current_slot > 0);
+    }
+
+    // Forget the full pages once they are written, keep filling the open one
+    void dropFullPages() {
+        std::memmove(pages.data(), openPage(), PAGE_SIZE);
+        num_full_pages = 0;
+        pages.resize(PAGE_SIZE);
+    }
+
+    void clear() {
+        num_full_pages = 0;
+        startPage();
+    }
+};
+
+// Loads a "key value" file as written by generate-data into tuples shaped
+// like the prototype (a sale by default): the two INT values replace its
+// first two fields. Tuples are packed into fresh pages of the segment's
+// page layout that are appended to the database file with large
+// sequential writes, bypassing the buffer pool and the log; the file is
+// synced before load() returns.
+class BulkLoader {
+private:
+    static constexpr size_t PAGES_PER_IO = 256; // 1 MB writes and reads
+    static constexpr size_t READ_BUFFER_SIZE = 1 << 20;
+
+    BufferManager& bufferManager;
+    std::unique_ptr<Tuple> prototype;
+    PagePacker packer;
+    PageID first_page = INVALID_PAGE_ID;
+    size_t num_pages = 0;
+    size_t num_tuples = 0;
+
+    void writePages(size_t count) {
+        PageID page_id = bufferManager.appendPages(packer.data(), count);
+        if (first_page == INVALID_PAGE_ID) {
+            first_page = page_id;
+        }
+        num_pages += count;
+    }
+
+    void tupleAdded() {
+        num_tuples++;
+        if (packer.getNumFullPages() == PAGES_PER_IO) {
+            writePages(PAGES_PER_IO);
+            packer.dropFullPages();
+        }
+    }
+
+public:
+    BulkLoader(BufferManager& manager, std::unique_ptr<Tuple> prototype = makeSalesTuple(0, 0))
+        : bufferManager(manager), prototype(std::move(prototype)), packer(manager.getPaxLayout()) {
+        if (this->prototype->fields.size() < 2 || this->prototype->fields[0]->getType() != INT ||
+            this->prototype->fields[1]->getType() != INT) {
+            throw std::runtime_error("Bulk load needs tuples starting with two INT fields.");
+        }
+    }
+
+    // Returns the number of tuples loaded
+    size_t load(const std::string& filename) {
+        std::ifstream input(filename, std::ios::binary);
+        if (!input) {
+            std::cerr << "Unable to open file " << filename << std::endl;
+            return 0;
+        }
+
+        // Only the key and value differ between tuples, serialize the rest once
+        std::string suffix;
+        for (size_t i = 2; i < prototype->fields.size(); ++i) {
+            prototype->fields[i]->appendSerialized(suffix);
+        }
+
+        std::vector<char> buffer(READ_BUFFER_SIZE);
+        std::string serialized;
+        size_t filled = 0;
+        while (true) {
+            input.read(buffer.data() + filled, buffer.size() - filled);
+            size_t bytes = filled + input.gcount();
+            bool at_end = !input;
+
+            // Parse whole lines only, carry a partial last line over
+            size_t parse_end = bytes;
+            if (!at_end) {
+                while (parse_end > 0 && buffer[parse_end - 1] != '\n') {
+                    parse_end--;
+                }
+            }
+
+            const char* cursor = buffer.data();
+            const char* end = buffer.data() + parse_end;
+            auto skipSpace = [&cursor, end]() {
+                while (cursor < end && std::isspace(static_cast<unsigned char>(*cursor))) ++cursor;
+            };
+            while (true) {
+                int key = 0, value = 0;
+                skipSpace();
+                auto key_result = std::from_chars(cursor, end, key);
+                cursor = key_result.ptr;
+                skipSpace();
+                auto value_result = std::from_chars(cursor, end, value);
+                cursor = value_result.ptr;
+                if (key_result.ec != std::errc() || value_result.ec != std::errc()) {
+                    break;
+                }
+
+                if (bufferManager.getPaxLayout()) {
+                    prototype->fields[0]->setInt(key);
+                    prototype->fields[1]->setInt(value);
+                    packer.append(prototype->fields);
+                } else {
+                    serialized.clear();
+                    Field::appendNumber(serialized, prototype->fields.size());
+                    Field::appendSerializedInt(serialized, key);
+                    Field::appendSerializedInt(serialized, value);
+                    serialized += suffix;
+                    packer.append(serialized);
+                }
+                tupleAdded();
+            }
+
+            filled = bytes - parse_end;
+            std::memmove(buffer.data(), buffer.data() + parse_end, filled);
+            if (at_end) {
+                break;
+            }
+        }
+
+        if (packer.getNumPages() > 0) {
+            writePages(packer.getNumPages());
+        }
+        packer.clear();
+        bufferManager.sync();
+        return num_tuples;
+    }
+
+    // Read the loaded pages back sequentially and call fn for every tuple
+    template <typename Fn>
+    void forEachLoadedTuple(Fn fn) {
+        std::vector<char> pages(PAGES_PER_IO * PAGE_SIZE);
+        for (size_t done = 0; done < num_pages; done += PAGES_PER_IO) {
+            size_t count = std::min(PAGES_PER_IO, num_pages - done);
+            bufferManager.readPages(first_page + done, count, pages.data());
+            for (size_t page = 0; page < count; ++page) {
+                const char* page_buffer = pages.data() + page * PAGE_SIZE;
+                if (const PaxLayout* layout = bufferManager.getPaxLayout()) {
+                    for (size_t row = 0; row < layout->numRows(page_buffer); ++row) {
+                        fn(makeTupleID(first_page + done + page, row), *layout->readTuple(page_buffer, row));
+                    }
+                    continue;
+                }
+                const Slot* slot_array = reinterpret_cast<const Slot*>(page_buffer);
+                for (size_t slot = 0; slot < MAX_SLOTS && !slot_array[slot].empty; ++slot) {
+                    auto tuple = Tuple::deserialize(page_buffer + slot_array[slot].offset,
+                                                    slot_array[slot].length);
+                    fn(makeTupleID(first_page + done + page, slot), *tuple);
+                }
+            }
+        }
+    }
+
+    size_t getNumPages() const {
+        return num_pages;
+    }
+};
+
+// Number of inserts grouped into one log fsync
+constexpr size_t DEFAULT_COMMIT_INTERVAL = 64;
+
+// Rows a worker of BuzzDB::insertParallel packs into pages of its own
+// before publishing them
+constexpr size_t PARALLEL_INSERT_BATCH = 4096;
+
+// Deleted bytes that make the background vacuum compact a page, an
+// eighth of the tuple space of a slotted page
+constexpr size_t VACUUM_MIN_DEAD_SPACE = 128;
+
+// Index files live next to the data file: buzzdb.dat -> buzzdb_hash.idx
+std::string indexFilename(const std::string& db_filename, const std::string& suffix) {
+    return db_filename.substr(0, db_filename.rfind('.')) + suffix;
+}
+
+// The layout makeSalesTuple() writes
+const Schema sales_schema = Schema::parse("key:INT,value:INT,price:FLOAT,name:STRING");
+
+// Page format of a table: SlottedPages of serialized tuples or PaxLayout
+enum class PageLayout { ROW, PAX };
+
+// A relation of the catalog. Each table is a segment: a data file of its
+// own with its own buffer pool, so scans read only the table's pages.
+// All segments share the database's log, whose records carry the id.
+struct Table {
+    std::string name;
+    Schema schema;
+    uint32_t segment_id;
+    std::string filename;
+    PageLayout layout = PageLayout::ROW;
+    bool compressed = false;            // Pages stored with PageCodec
+    BufferManager* buffer_manager;
+    TableStatistics* statistics;
+    // Set unless the table lives in the database's main file
+    std::unique_ptr<BufferManager> owned_buffer_manager;
+    std::unique_ptr<TableStatistics> owned_statistics;
+    std::unique_ptr<PaxLayout> pax_layout;
+};
+
+// Named tables, persisted to a text file with one "name segment file
+// schema [ROW|PAX] [LZ]" line per table, LZ for compressed pages. Segment
+// 0 is the sales table in the main data file, which the catalog
+// references rather than owns.
+class Catalog {
+private:
+    std::string filename;
+    std::vector<std::unique_ptr<Table>> tables;     // By segment id
+    LogManager* log_manager = nullptr;
+
+    Table& open(const std::string& name, const Schema& schema, const std::string& data_filename,
+                PageLayout layout, bool compressed) {
+        auto table = std::make_unique<Table>();
+        table->name = name;
+        table->schema = schema;
+        table->segment_id = static_cast<uint32_t>(tables.size());
+        table->filename = data_filename;
+        table->layout = layout;
+        table->compressed = compressed;
+        table->owned_buffer_manager = std::make_unique<BufferManager>(data_filename, MAX_PAGES_IN_MEMORY, compressed);
+        table->owned_statistics = std::make_unique<TableStatistics>();
+        table->buffer_manager = table->owned_buffer_manager.get();
+        table->statistics = table->owned_statistics.get();
+        table->buffer_manager->setLogManager(log_manager, table->segment_id);
+        if (layout == PageLayout::PAX) {
+            table->pax_layout = std::make_unique<PaxLayout>(schema);
+            table->buffer_manager->setPaxLayout(table->pax_layout.get());
+        }
+        tables.push_back(std::move(table));
+        return *tables.back();
+    }
+
+public:
+    // Opens the main table and every table in the catalog file
+    Catalog(const std::string& filename, const std::string& main_filename, BufferManager& main_buffer_manager,
+            TableStatistics& main_statistics, LogManager* log_manager)
+        : filename(filename), log_manager(log_manager) {
+        auto table = std::make_unique<Table>();
+        table->name = sales_table;
+        table->schema = sales_schema;
+        table->segment_id = 0;
+        table->filename = main_filename;
+        table->buffer_manager = &main_buffer_manager;
+        table->statistics = &main_statistics;
+        main_buffer_manager.setLogManager(log_manager, 0);
+        tables.push_back(std::move(table));
+
+        std::ifstream input(filename);
+        std::string line;
+        while (std::getline(input, line)) {
+            std::stringstream fields(line);
+            std::string name, data_filename, schema, layout, compression;
+            uint32_t segment_id;
+            if (!(fields >> name >> segment_id >> data_filename >> schema) || segment_id != tables.size()) {
+                throw std::runtime_error("Corrupt catalog " + filename);
+            }
+            fields >> layout >> compression;
+            open(name, Schema::parse(schema), data_filename, (layout == "PAX") ? PageLayout::PAX : PageLayout::ROW,
+                 compression == "LZ");
+        }
+    }
+
+    // Add an empty table and persist the catalog. Its data file sits next
+    // to the main one: buzzdb.dat -> buzzdb_name.dat (and
+    // buzzdb_name.dat.map if compressed)
+    Table& createTable(const std::string& name, const Schema& schema, PageLayout layout = PageLayout::ROW,
+                       bool compressed = false) {
+        if (find(name)) {
+            throw std::runtime_error("Table " + name + " already exists.");
+        }
+        if (name.empty() || !std::all_of(name.begin(), name.end(), [](char c) {
+                return std::isalnum(static_cast<unsigned char>(c)) || c == '_';
+            })) {
+            throw std::runtime_error("Invalid table name " + name + ".");
+        }
+        std::string data_filename = indexFilename(tables[0]->filename, "_" + name + ".dat");
+        std::remove(data_filename.c_str());
+        std::remove((data_filename + ".map").c_str());
+        Table& table = open(name, schema, data_filename, layout, compressed);
+        std::ofstream output(filename, std::ios::app);
+        output << name << " " << table.segment_id << " " << data_filename << " " << schema.toString() << " "
+               << ((layout == PageLayout::PAX) ? "PAX" : "ROW") << (compressed ? " LZ" : "") << "\n";
+        output.flush();
+        if (!output) {
+            throw std::runtime_error("Unable to write catalog " + filename);
+        }
+        return table;
+    }
+
+    Table* find(const std::string& name) {
+        for (auto& table : tables) {
+            if (table->name == name) {
+                return table.get();
+            }
+        }
+        return nullptr;
+    }
+
+    Table& get(const std::string& name) {
+        Table* table = find(name);
+        if (!table) {
+            throw std::runtime_error("Unknown table " + name + ".");
+        }
+        return *table;
+    }
+
+    const std::vector<std::unique_ptr<Table>>& getTables() const {
+        return tables;
+    }
+};
+
+// Estimated input rows from which planned aggregations run on all cores
+constexpr double PARALLEL_AGGREGATION_MIN_ROWS = 32768;
+
+// Queries answered by BuzzDB::executeQuery and how many came from views
+struct ViewUsage {
+    size_t queries = 0;
+    size_t answered = 0;
+    std::map<std::string, size_t> hits;     // Per view
+};
+
+// Operators of a plan, inputs before the operators reading them
+struct QueryPlan {
+    std::vector<std::unique_ptr<Operator>> operators;
+    Operator* root = nullptr;
+    std::string access_path;    // Unless a full table scan
+    // The scan of a plan that reads nothing but the table, which can run
+    // on a snapshot
+    ScanOperator* snapshot_scan = nullptr;
+
+    Operator& add(std::unique_ptr<Operator> op) {
+        root = op.get();
+        operators.push_back(std::move(op));
+        return *root;
+    }
+};
+
+// Statements whose plans BuzzDB keeps; the cache is emptied when full
+constexpr size_t QUERY_CACHE_CAPACITY = 1024;
+
+// A parsed query and the plan last chosen for it, with the versions of
+// the statistics and views it was planned with
+struct PreparedQuery {
+    QueryComponents components;
+    QueryPlan plan;
+    double cost = 0;
+    const MaterializedView* view = nullptr;     // Answering the query, if any
+    size_t statistics_version = 0;
+    size_t view_version = 0;
+    bool running = false;       // On a snapshot, the plan is in use
+};
+
+// A table taking part in a join: its pages, an index on its key
+// (attribute 0) if it has one, and its statistics
+struct Relation {
+    std::string name;
+    BufferManager& buffer_manager;
+    BTreeIndex* key_index;
+    const TableStatistics& statistics;
+};
+
+// One BuzzDB write to a table: its changes keep versions stamped with
+// its commit timestamp, and snapshots taken after it is destroyed see
+// them. Writers are serialized by the database latch.
+class WriteTransaction {
+private:
+    TransactionManager& transactions;
+    BufferManager& pages;
+    Timestamp timestamp;
+
+public:
+    WriteTransaction(TransactionManager& transactions, BufferManager& pages)
+        : transactions(transactions), pages(pages), timestamp(transactions.beginWrite()) {
+        pages.setWriteTimestamp(timestamp);
+    }
+
+    WriteTransaction(const WriteTransaction&) = delete;
+    WriteTransaction& operator=(const WriteTransaction&) = delete;
+
+    ~WriteTransaction() {
+        pages.setWriteTimestamp(0);
+        transactions.commit(timestamp);
+        pages.pruneVersions(transactions.oldestSnapshot());
+    }
+};
+
+// Checks every attribute a query uses against the table's schema and the
+// WHERE constants against the type of the attribute they are compared
+// with. An INT constant compared with a FLOAT attribute becomes a FLOAT,
+// other mismatches are errors, so nothing is left to fail per row.
+void checkQuery(QueryComponents& components, const std::string& table_name, const Schema& schema) {
+    const auto& columns = schema.columns;
+    auto check = [&](int attr) {
+        if (attr < 0 || static_cast<size_t>(attr) >= columns.size()) {
+            throw std::runtime_error("Table " + table_name + " has no attribute {" + std::to_string(attr + 1) + "}.");
+        }
+    };
+    for (int attr : components.selectAttributes) {
+        check(attr);
+    }
+    if (components.sumOperation) {
+        check(components.sumAttributeIndex);
+    }
+    if (components.groupBy) {
+        check(components.groupByAttributeIndex);
+    }
+    // Aggregate results are ordered by their own columns, checked by the parser
+    if (!components.sumOperation && !components.groupBy) {
+        for (const auto& key : components.orderBy) {
+            check(static_cast<int>(key.attr));
+        }
+    }
+
+    std::function<void(Condition&)> visit = [&](Condition& condition) {
+        for (auto& child : condition.children) {
+            visit(child);
+        }
+        if (condition.kind != Condition::COMPARISON) {
+            return;
+        }
+        for (const auto* operand : {&condition.left, &condition.right}) {
+            if (!operand->constant) {
+                check(operand->attr);
+            }
+        }
+        Condition::Operand* attribute = &condition.left;
+        Condition::Operand* other = &condition.right;
+        if (attribute->constant) {
+            std::swap(attribute, other);
+        }
+        FieldType type = columns[attribute->attr].type;
+        FieldType other_type = other->constant ? other->constant->getType() : columns[other->attr].type;
+        if (type == FLOAT && other->constant && other_type == INT) {
+            other->constant.emplace(static_cast<float>(other->constant->asInt()));
+        } else if (type != other_type) {
+            throw std::runtime_error("Cannot compare attribute {" + std::to_string(attribute->attr + 1) + "} (" +
+                                     Schema::typeName(type) + ") of table " + table_name + " with " +
+                                     (other->constant ? std::string("a constant") :
+                                                        "attribute {" + std::to_string(other->attr + 1) + "}") +
+                                     " (" + Schema::typeName(other_type) + ").");
+        }
+    };
+    if (components.where) {
+        visit(*components.where);
+    }
+    // The parser only takes ranges of INT constants, which a FLOAT
+    // attribute no longer compares with
+    if (components.whereAttributeIndex >= 0 && columns[components.whereAttributeIndex].type != INT) {
+        components.whereAttributeIndex = -1;
+        components.lowerBound = std::numeric_limits<int>::min();
+        components.upperBound = std::numeric_limits<int>::max();
+    }
+}
+
+class BuzzDB {
+public:
+    HashIndex hash_index;
+    BTreeIndex btree_index;
+    LearnedIndex learned_index;
+    LogManager log_manager;
+    BufferManager buffer_manager;
+    CostModel cost_model;
+    JoinOrderOptimizer join_optimizer;
+    MaterializedViewManager view_manager;
+    ViewUsage view_usage;
+    TableStatistics statistics;
+    Catalog catalog;
+    TransactionManager transactions;
+    size_t statistics_version = 0;      // Number of analyze() calls
+    std::unordered_map<std::string, PreparedQuery> query_cache;
+
+    // Held by the operations that touch pages (inserts, deletes, bulk
+    // loads, checkpoints, planning and queries that use indexes or
+    // views) and by every vacuum step, which is what lets the vacuum
+    // thread run next to them. Full scan queries release it once they
+    // have a snapshot.
+    std::recursive_mutex latch;
+    std::thread vacuum_thread;
+    std::mutex vacuum_mutex;
+    std::condition_variable vacuum_cv;
+    bool vacuum_running = false;
+    std::atomic<size_t> vacuumed_pages{0};
+    std::atomic<size_t> vacuumed_bytes{0};
+
+public:
+    size_t max_number_of_tuples = 5000;
+    size_t tuple_insertion_attempt_counter = 0;
+    size_t commit_interval;
+    size_t uncommitted_inserts = 0;
+
+    BuzzDB(const std::string& db_filename = database_filename,
+           const std::string& wal_filename = log_filename,
+           size_t commit_interval = DEFAULT_COMMIT_INTERVAL)
+        : hash_index(indexFilename(db_filename, "_hash.idx")),
+          btree_index(indexFilename(db_filename, "_btree.idx")),
+          log_manager(wal_filename), buffer_manager(db_filename),
+          view_manager(buffer_manager),
+          catalog(indexFilename(db_filename, ".catalog"), db_filename, buffer_manager, statistics, &log_manager),
+          commit_interval(commit_interval) {
+        recover();
+        cost_model.setStatistics(&statistics);
+
+        // The indexes come back empty unless they were closed cleanly
+        if (hash_index.size() == 0 || btree_index.size() == 0) {
+            rebuildIndexes();
+        }
+        buildLearnedIndex();
+
+        // Initialize materialized views
+        view_manager.createView("sum_by_key", "SUM{2} GROUP BY {1}");
+    }
+
+    ~BuzzDB() {
+        stopVacuum();
+        commit();
+        checkpoint();
+    }
+
+    // Redo the changes every segment lost in the last shutdown or crash
+    // from the shared log, then checkpoint
+    void recover() {
+        auto records = log_manager.readLog();
+        size_t redone = 0;
+        for (const auto& table : catalog.getTables()) {
+            redone += table->buffer_manager->recover(records);
+        }
+        if (!records.empty()) {
+            std::cout << "Recovery :: Redo of " << records.size() << " log records\n";
+        }
+        if (redone != records.size()) {
+            std::cerr << "Recovery :: " << records.size() - redone << " log records of unknown segments\n";
+        }
+        checkpoint();
+    }
+
+    // Write the dirty pages of every segment and start a fresh log
+    void checkpoint() {
+        std::lock_guard<std::recursive_mutex> guard(latch);
+        for (const auto& table : catalog.getTables()) {
+            table->buffer_manager->checkpoint();
+        }
+        log_manager.truncate();
+    }
+
+    Table& createTable(const std::string& name, const Schema& schema, PageLayout layout = PageLayout::ROW,
+                       bool compressed = false) {
+        std::lock_guard<std::recursive_mutex> guard(latch);
+        return catalog.createTable(name, schema, layout, compressed);
+    }
+
+    // Look at up to max_pages pages with deleted tuples in slotted page
+    // tables and compact those with at least min_dead_space bytes of them.
+    // Returns the number of pages looked at.
+    size_t vacuum(size_t max_pages = std::numeric_limits<size_t>::max(), size_t min_dead_space = 0) {
+        size_t pages = 0;
+        for (size_t segment = 0; pages < max_pages; ++segment) {
+            std::lock_guard<std::recursive_mutex> guard(latch);
+            if (segment == catalog.getTables().size()) {
+                break;
+            }
+            BufferManager& manager = *catalog.getTables()[segment]->buffer_manager;
+            for (PageID page_id; pages < max_pages && (page_id = manager.getDeadSpacePage()) != INVALID_PAGE_ID;
+                 ++pages) {
+                size_t reclaimed = manager.compactPage(page_id, min_dead_space);
+                vacuumed_bytes += reclaimed;
+                vacuumed_pages += (reclaimed > 0);
+            }
+        }
+        return pages;
+    }
+
+    // Vacuum pages_per_step pages every interval on a background thread
+    // until stopVacuum(). Pages with fewer than VACUUM_MIN_DEAD_SPACE
+    // bytes of deleted tuples are left to be reused by inserts.
+    void startVacuum(std::chrono::milliseconds interval = std::chrono::milliseconds(1),
+                     size_t pages_per_step = 64) {
+        stopVacuum();
+        vacuum_running = true;
+        vacuum_thread = std::thread([this, interval, pages_per_step]() {
+            std::unique_lock<std::mutex> lock(vacuum_mutex);
+            while (vacuum_running) {
+                lock.unlock();
+                vacuum(pages_per_step, VACUUM_MIN_DEAD_SPACE);
+                lock.lock();
+                vacuum_cv.wait_for(lock, interval, [this]() { return !vacuum_running; });
+            }
+        });
+    }
+
+    void stopVacuum() {
+        {
+            std::lock_guard<std::mutex> lock(vacuum_mutex);
+            vacuum_running = false;
+        }
+        vacuum_cv.notify_all();
+        if (vacuum_thread.joinable()) {
+            vacuum_thread.join();
+        }
+    }
+
+    // Index every tuple of the table by its key attribute
+    void rebuildIndexes() {
+        hash_index.clear();
+        std::vector<std::pair<int, TupleID>> entries;
+        ScanOperator scanOp(buffer_manager);
+        Batch batch;
+        scanOp.open();
+        while (scanOp.nextBatch(batch)) {
+            const auto& keys = batch.columns[0].ints;
+            const auto& tuple_ids = scanOp.getBatchTupleIDs();
+            for (size_t row = 0; row < batch.size(); ++row) {
+                hash_index.insert(keys[row], tuple_ids[row]);
+                entries.emplace_back(keys[row], tuple_ids[row]);
+            }
+        }
+        scanOp.close();
+
+        btree_index.clear();
+        std::sort(entries.begin(), entries.end());
+        btree_index.bulkLoad(entries);
+    }
+
+    // The learned index is built from the key order of the B+-tree
+    void buildLearnedIndex() {
+        std::vector<std::pair<int, TupleID>> entries;
+        entries.reserve(btree_index.size());
+        auto iterator = btree_index.scan(std::numeric_limits<int>::min(), std::numeric_limits<int>::max());
+        int key;
+        TupleID value;
+        while (iterator.next(key, value)) {
+            entries.emplace_back(key, value);
+        }
+        learned_index.build(entries);
+    }
+
+    // Make all inserts so far durable with a single log fsync
+    void commit() {
+        log_manager.flushAll();
+        uncommitted_inserts = 0;
+    }
+
+    // insert function
+    void insert(int key, int value) {
+        std::lock_guard<std::recursive_mutex> guard(latch);
+        tuple_insertion_attempt_counter += 1;
+
+        // Create a new tuple with the given key and value
+        auto newTuple = makeSalesTuple(key, value);
+        view_manager.applyInsert(newTuple->fields);
+        statistics.insert(newTuple->fields);
+        WriteTransaction write(transactions, buffer_manager);
+
+        InsertOperator insertOp(buffer_manager);
+        insertOp.setTupleToInsert(std::move(newTuple));
+        bool status = insertOp.next();
+
+        assert(status == true);
+        hash_index.insert(key, insertOp.getInsertedTupleID());
+        btree_index.insert(key, insertOp.getInsertedTupleID());
+        learned_index.insert(key, insertOp.getInsertedTupleID());
+
+        if (tuple_insertion_attempt_counter % 10 != 0) {
+            // Assuming you want to delete the first tuple from the first page
+            DeleteOperator delOp(buffer_manager, 0, 0); 
+            if (!delOp.next()) {
+                std::cerr << "Failed to delete tuple." << std::endl;
+            }
+            if (auto deleted = delOp.getDeletedTuple()) {
+                hash_index.remove(deleted->fields[0]->asInt(), makeTupleID(0, 0));
+                btree_index.remove(deleted->fields[0]->asInt(), makeTupleID(0, 0));
+                learned_index.remove(deleted->fields[0]->asInt(), makeTupleID(0, 0));
+                view_manager.applyDelete(deleted->fields);
+                statistics.remove(deleted->fields);
+            }
+        }
+
+        if (++uncommitted_inserts >= commit_interval) {
+            commit();
+        }
+
+    }
+
+    // Insert a row into a table of the catalog, returns where it went.
+    // Rows of the sales table also go to its indexes and views.
+    TupleID insert(const std::string& table_name, std::vector<std::unique_ptr<Field>> fields) {
+        std::lock_guard<std::recursive_mutex> guard(latch);
+        Table& table = catalog.get(table_name);
+        if (!table.schema.matches(fields)) {
+            throw std::runtime_error("Row does not match the schema " + table.schema.toString() + " of " +
+                                     table.name + ".");
+        }
+        auto tuple = std::make_unique<Tuple>();
+        tuple->fields = std::move(fields);
+        int key = (table.segment_id == 0) ? tuple->fields[0]->asInt() : 0;
+        table.statistics->insert(tuple->fields);
+        if (table.segment_id == 0) {
+            view_manager.applyInsert(tuple->fields);
+        }
+
+        WriteTransaction write(transactions, *table.buffer_manager);
+        InsertOperator insertOp(*table.buffer_manager);
+        insertOp.setTupleToInsert(std::move(tuple));
+        bool status = insertOp.next();
+        assert(status == true);
+        if (table.segment_id == 0) {
+            hash_index.insert(key, insertOp.getInsertedTupleID());
+            btree_index.insert(key, insertOp.getInsertedTupleID());
+            learned_index.insert(key, insertOp.getInsertedTupleID());
+        }
+
+        if (++uncommitted_inserts >= commit_interval) {
+            commit();
+        }
+        return insertOp.getInsertedTupleID();
+    }
+
+    // Delete a tuple of a slotted page table, returns false if there was
+    // none at tuple_id. The vacuum reclaims its space later.
+    bool remove(const std::string& table_name, TupleID tuple_id) {
+        std::lock_guard<std::recursive_mutex> guard(latch);
+        Table& table = catalog.get(table_name);
+        if (table.layout == PageLayout::PAX) {
+            throw std::runtime_error("PAX table " + table.name + " is append-only.");
+        }
+        if (tupleIDPage(tuple_id) >= table.buffer_manager->getNumPages()) {
+            return false;
+        }
+        WriteTransaction write(transactions, *table.buffer_manager);
+        DeleteOperator delOp(*table.buffer_manager, tupleIDPage(tuple_id), tupleIDSlot(tuple_id));
+        delOp.next();
+        auto deleted = delOp.getDeletedTuple();
+        if (!deleted) {
+            return false;
+        }
+        table.statistics->remove(deleted->fields);
+        if (table.segment_id == 0) {
+            int key = deleted->fields[0]->asInt();
+            hash_index.remove(key, tuple_id);
+            btree_index.remove(key, tuple_id);
+            learned_index.remove(key, tuple_id);
+            view_manager.applyDelete(deleted->fields);
+        }
+        if (++uncommitted_inserts >= commit_interval) {
+            commit();
+        }
+        return true;
+    }
+
+    // Insert (key, value) sales a batch at a time. Unlike insert(), no
+    // tuples are deleted along the way. Snapshots see all rows or none.
+    void insertBatch(const std::vector<std::pair<int, int>>& rows) {
+        std::lock_guard<std::recursive_mutex> guard(latch);
+        WriteTransaction write(transactions, buffer_manager);
+        InsertOperator insertOp(buffer_manager);
+        Batch output;
+        for (size_t start = 0; start < rows.size(); start += BATCH_SIZE) {
+            size_t end = std::min(rows.size(), start + BATCH_SIZE);
+            Batch batch;
+            for (size_t i = start; i < end; ++i) {
+                auto tuple = makeSalesTuple(rows[i].first, rows[i].second);
+                batch.appendTuple(tuple->fields);
+                view_manager.applyInsert(tuple->fields);
+                statistics.insert(tuple->fields);
+            }
+            insertOp.setBatchToInsert(std::move(batch));
+            bool status = insertOp.nextBatch(output);
+            assert(status == true);
+
+            const auto& tuple_ids = insertOp.getInsertedTupleIDs();
+            for (size_t i = 0; i < tuple_ids.size(); ++i) {
+                int key = rows[start + i].first;
+                hash_index.insert(key, tuple_ids[i]);
+                btree_index.insert(key, tuple_ids[i]);
+                learned_index.insert(key, tuple_ids[i]);
+            }
+            uncommitted_inserts += tuple_ids.size();
+            if (uncommitted_inserts >= commit_interval) {
+                commit();
+            }
+        }
+    }
+
+    // Insert (key, value) rows into a table whose first two columns are
+    // INT on num_threads workers; the other columns take the values of
+    // prototype as in bulkLoad(). Workers take PARALLEL_INSERT_BATCH rows
+    // at a time and pack them into pages of their own (PagePacker), then
+    // publish the batch: append its pages to the file and update the
+    // indexes, views and statistics for its rows. Publishing is one
+    // batch at a time. Like bulkLoad() the pages bypass the buffer pool
+    // and the log, and the file is synced before returning.
+    size_t insertParallel(const std::string& table_name, const std::vector<std::pair<int, int>>& rows,
+                          size_t num_threads, std::unique_ptr<Tuple> prototype = nullptr) {
+        std::lock_guard<std::recursive_mutex> guard(latch);
+        Table& table = catalog.get(table_name);
+        if (!prototype) {
+            prototype = (table.segment_id == 0) ? makeSalesTuple(0, 0) : table.schema.makeTuple();
+        }
+        if (!table.schema.matches(prototype->fields) || prototype->fields.size() < 2 ||
+            prototype->fields[0]->getType() != INT || prototype->fields[1]->getType() != INT) {
+            throw std::runtime_error("Parallel inserts need tuples of " + table.name +
+                                     " starting with two INT fields.");
+        }
+        // Only the key and value differ between tuples, serialize the rest once
+        const std::string serialized_prototype = prototype->serialize();
+        std::string suffix;
+        for (size_t i = 2; i < prototype->fields.size(); ++i) {
+            prototype->fields[i]->appendSerialized(suffix);
+        }
+
+        std::atomic<size_t> next_row{0};
+        std::mutex publish_latch;
+        auto work = [&](size_t) {
+            PagePacker packer(table.buffer_manager->getPaxLayout());
+            auto tuple = Tuple::deserialize(serialized_prototype.data(), serialized_prototype.size());
+            std::vector<std::pair<size_t, size_t>> positions;
+            std::vector<std::pair<int, TupleID>> entries;
+            std::string serialized;
+            while (true) {
+                size_t begin = next_row.fetch_add(PARALLEL_INSERT_BATCH);
+                if (begin >= rows.size()) {
+                    break;
+                }
+                size_t end = std::min(rows.size(), begin + PARALLEL_INSERT_BATCH);
+                packer.clear();
+                positions.clear();
+                for (size_t i = begin; i < end; ++i) {
+                    if (table.buffer_manager->getPaxLayout()) {
+                        tuple->fields[0]->setInt(rows[i].first);
+                        tuple->fields[1]->setInt(rows[i].second);
+                        positions.push_back(packer.append(tuple->fields));
+                        continue;
+                    }
+                    serialized.clear();
+                    Field::appendNumber(serialized, tuple->fields.size());
+                    Field::appendSerializedInt(serialized, rows[i].first);
+                    Field::appendSerializedInt(serialized, rows[i].second);
+                    serialized += suffix;
+                    positions.push_back(packer.append(serialized));
+                }
+
+                std::lock_guard<std::mutex> publish(publish_latch);
+                PageID first_page = table.buffer_manager->appendPages(packer.data(), packer.getNumPages());
+                entries.clear();
+                for (size_t i = begin; i < end; ++i) {
+                    const auto& [page, slot] = positions[i - begin];
+                    entries.emplace_back(rows[i].first, makeTupleID(first_page + page, slot));
+                    tuple->fields[0]->setInt(rows[i].first);
+                    tuple->fields[1]->setInt(rows[i].second);
+                    table.statistics->insert(tuple->fields);
+                    if (table.segment_id == 0) {
+                        view_manager.applyInsert(tuple->fields);
+                    }
+                }
+                if (table.segment_id != 0) {
+                    continue;
+                }
+                // In key order, consecutive B+-tree inserts mostly land in the same leaf
+                std::sort(entries.begin(), entries.end());
+                for (const auto& [key, tuple_id] : entries) {
+                    hash_index.insert(key, tuple_id);
+                    btree_index.insert(key, tuple_id);
+                    learned_index.insert(key, tuple_id);
+                }
+            }
+        };
+        std::vector<std::thread> workers;
+        for (size_t worker = 0; worker < std::max<size_t>(1, num_threads); ++worker) {
+            workers.emplace_back(work, worker);
+        }
+        for (auto& thread : workers) {
+            thread.join();
+        }
+        table.buffer_manager->sync();
+        return rows.size();
+    }
+
+    // Bulk load a "key value" file, then build the indexes and the
+    // materialized views in one pass over the new pages
+    size_t bulkLoad(const std::string& filename) {
+        std::lock_guard<std::recursive_mutex> guard(latch);
+        BulkLoader loader(buffer_manager);
+        size_t num_tuples = loader.load(filename);
+
+        std::vector<std::pair<int, TupleID>> entries;
+        entries.reserve(num_tuples);
+        loader.forEachLoadedTuple([this, &entries](TupleID tuple_id, const Tuple& tuple) {
+            hash_index.insert(tuple.fields[0]->asInt(), tuple_id);
+            entries.emplace_back(tuple.fields[0]->asInt(), tuple_id);
+            view_manager.applyInsert(tuple.fields);
+            statistics.insert(tuple.fields);
+        });
+        std::sort(entries.begin(), entries.end());
+        btree_index.bulkLoad(entries);
+        buildLearnedIndex();
+
+        std::cout << "Bulk load :: " << num_tuples << " tuples in "
+                  << loader.getNumPages() << " pages\n";
+        return num_tuples;
+    }
+
+    // Bulk load a "key value" file into a table whose first two columns
+    // are INT; its other columns take the values of prototype, by default
+    // 0 or empty
+    size_t bulkLoad(const std::string& table_name, const std::string& filename,
+                    std::unique_ptr<Tuple> prototype = nullptr) {
+        std::lock_guard<std::recursive_mutex> guard(latch);
+        Table& table = catalog.get(table_name);
+        if (table.segment_id == 0) {
+            return bulkLoad(filename);
+        }
+        if (prototype && !table.schema.matches(prototype->fields)) {
+            throw std::runtime_error("Prototype does not match the schema of " + table.name + ".");
+        }
+        BulkLoader loader(*table.buffer_manager, prototype ? std::move(prototype) : table.schema.makeTuple());
+        size_t num_tuples = loader.load(filename);
+        loader.forEachLoadedTuple([&table](TupleID, const Tuple& tuple) {
+            table.statistics->insert(tuple.fields);
+        });
+        std::cout << "Bulk load :: " << num_tuples << " tuples in " << loader.getNumPages()
+                  << " pages of " << table.name << "\n";
+        return num_tuples;
+    }
+
+    void executeQueries() {
+        std::vector<std::string> test_queries = {
+            "SUM{1} GROUP BY {1} WHERE {1} > 2 and {1} < 6",
+            "SUM{2} WHERE {1} > 2 and {1} < 4"
+        };
+
+        for (const auto& query : test_queries) {
+            executeStatement(query);
+        }
+        std::cout << "Answered from views: " << view_usage.answered << " of " << view_usage.queries << " queries";
+        for (const auto& [name, hits] : view_usage.hits) {
+            std::cout << ", " << name << ": " << hits;
+        }
+        std::cout << std::endl;
+    }
+
+    // Run a statement: ANALYZE (every table) or a query. The result
+    // batches go to consume if given, otherwise its rows are printed.
+    void executeStatement(const std::string& statement,
+                          const std::function<void(const Batch&)>& consume = nullptr) {
+        std::unique_lock<std::recursive_mutex> guard(latch);
+        if (statement == "ANALYZE") {
+            for (const auto& table : catalog.getTables()) {
+                analyze(table->name);
+                if (catalog.getTables().size() > 1) {
+                    std::cout << "Table " << table->name << "\n";
+                }
+                table->statistics->print();
+            }
+            return;
+        }
+        PreparedQuery& prepared = prepareQuery(statement);
+        if (!prepared.running) {
+            executePrepared(prepared, guard, consume);
+            return;
+        }
+        // Another thread is running the cached plan
+        PreparedQuery own;
+        own.components = prepared.components;
+        planQuery(own);
+        executePrepared(own, guard, consume);
+    }
+
+    // Rebuild the statistics the cost model plans the table's queries with
+    void analyze(const std::string& table_name = sales_table) {
+        std::lock_guard<std::recursive_mutex> guard(latch);
+        Table& table = catalog.get(table_name);
+        statistics_version++;
+        table.statistics->analyze([&table](const std::function<void(const Batch&)>& consume) {
+            ScanOperator scanOp(*table.buffer_manager);
+            Batch batch;
+            scanOp.open();
+            while (scanOp.nextBatch(batch)) {
+                consume(batch);
+            }
+            scanOp.close();
+        });
+    }
+
+    // A table of the catalog as a join input. Only the sales table has a
+    // key index.
+    Relation relation(const std::string& name) {
+        Table& table = catalog.get(name);
+        if (table.statistics->isStale()) {
+            analyze(name);
+        }
+        return Relation{name, *table.buffer_manager, (table.segment_id == 0) ? &btree_index : nullptr,
+                        *table.statistics};
+    }
+
+    // Fraction of the cross product of left and right with left_attr ==
+    // right_attr, assuming the keys spread uniformly over the values of
+    // the side with more distinct values
+    double estimateJoinSelectivity(const Relation& left, size_t left_attr,
+                                   const Relation& right, size_t right_attr) const {
+        const ColumnStatistics* left_column = left.statistics.getColumn(left_attr);
+        const ColumnStatistics* right_column = right.statistics.getColumn(right_attr);
+        if (!left_column || !right_column) {
+            return CostModel::DEFAULT_SELECTIVITY;
+        }
+        return 1.0 / std::max({1.0, left_column->estimateDistinct(), right_column->estimateDistinct()});
+    }
+
+    // A left-deep plan joining the relations on the equi-join predicates
+    // (whose selectivities it estimates), in the order of the join order
+    // optimizer. Each relation is joined through an index nested loop
+    // join into its key index or a hash join building on the smaller
+    // input, whichever is cheaper. The columns of the result are those
+    // of every relation, at the offsets returned in column_offsets.
+    QueryPlan planJoin(const std::vector<Relation>& relations, std::vector<JoinPredicate> joins,
+                       std::vector<size_t>& column_offsets) {
+        std::vector<double> cardinalities;
+        for (const auto& rel : relations) {
+            cardinalities.push_back(rel.statistics.isAnalyzed() ? rel.statistics.getRows()
+                : cost_model.estimateTableRows(rel.buffer_manager.getNumPages()));
+        }
+        for (auto& join : joins) {
+            join.selectivity = estimateJoinSelectivity(relations[join.left], join.left_attr,
+                                                       relations[join.right], join.right_attr);
+        }
+        std::vector<size_t> order = join_optimizer.optimizeJoinOrder(joins, cardinalities);
+
+        QueryPlan plan;
+        std::vector<bool> joined(relations.size(), false);
+        column_offsets.assign(relations.size(), 0);
+        size_t width = 0;
+        for (size_t table : order) {
+            const Relation& rel = relations[table];
+            size_t table_width = rel.statistics.getNumColumns();
+            if (plan.root == nullptr) {
+                plan.add(std::make_unique<ScanOperator>(rel.buffer_manager, &rel.statistics));
+                plan.access_path = rel.name;
+                joined[table] = true;
+                width = table_width;
+                continue;
+            }
+
+            // Join on one predicate with the joined relations, preferring
+            // one on the key, and check the others afterwards
+            std::vector<JoinPredicate> predicates;
+            for (const auto& join : joins) {
+                if (join.left == table && joined[join.right]) {
+                    predicates.push_back(join);
+                } else if (join.right == table && joined[join.left]) {
+                    predicates.push_back({join.right, join.right_attr, join.left, join.left_attr, join.selectivity});
+                }
+            }
+            std::stable_partition(predicates.begin(), predicates.end(),
+                                  [](const JoinPredicate& join) { return join.left_attr == 0; });
+
+            if (predicates.empty()) {
+                throw std::runtime_error("Cross product with " + rel.name + " is not supported.");
+            }
+            const JoinPredicate& key = predicates[0];
+            std::unique_ptr<Operator> scan = std::make_unique<ScanOperator>(rel.buffer_manager, &rel.statistics);
+            std::unique_ptr<Operator> joinOp;
+            std::string method;
+            size_t outer_attr = column_offsets[key.right] + key.right_attr;
+            bool build_new = scan->estimateRows(cost_model) < plan.root->estimateRows(cost_model);
+            if (build_new) {
+                joinOp = std::make_unique<HashJoinOperator>(*scan, *plan.root, key.left_attr, outer_attr, key.selectivity);
+            } else {
+                joinOp = std::make_unique<HashJoinOperator>(*plan.root, *scan, outer_attr, key.left_attr, key.selectivity);
+            }
+            method = "hash join";
+            if (key.left_attr == 0 && rel.key_index) {
+                auto indexJoin = std::make_unique<IndexNestedLoopJoinOperator<BTreeIndex>>(
+                    *plan.root, outer_attr, rel.buffer_manager, *rel.key_index, key.selectivity);
+                if (indexJoin->estimateCost(cost_model) < joinOp->estimateCost(cost_model)) {
+                    joinOp = std::move(indexJoin);
+                    build_new = false;
+                    method = "index nested loop join";
+                } else {
+                    plan.add(std::move(scan));
+                }
+            } else {
+                plan.add(std::move(scan));
+            }
+            plan.add(std::move(joinOp));
+            plan.access_path += ", " + method + " " + rel.name;
+
+            // The new columns come first when the new relation is the
+            // build input
+            if (build_new) {
+                for (size_t other = 0; other < relations.size(); ++other) {
+                    if (joined[other]) {
+                        column_offsets[other] += table_width;
+                    }
+                }
+                column_offsets[table] = 0;
+            } else {
+                column_offsets[table] = width;
+            }
+            joined[table] = true;
+            width += table_width;
+
+            if (predicates.size() > 1) {
+                auto condition = std::make_unique<ComplexPredicate>(ComplexPredicate::AND);
+                for (size_t i = 1; i < predicates.size(); ++i) {
+                    condition->addPredicate(std::make_unique<SimplePredicate>(
+                        SimplePredicate::Operand(column_offsets[table] + predicates[i].left_attr),
+                        SimplePredicate::Operand(column_offsets[predicates[i].right] + predicates[i].right_attr),
+                        SimplePredicate::EQ));
+                }
+                plan.add(std::make_unique<SelectOperator>(*plan.root, std::move(condition)));
+            }
+        }
+        return plan;
+    }
+
+    // The parsed query and a plan for it. Both come from the cache unless
+    // the statistics were rebuilt or views created since it was planned.
+    PreparedQuery& prepareQuery(const std::string& query) {
+        auto it = query_cache.find(query);
+        if (it == query_cache.end()) {
+            if (query_cache.size() >= QUERY_CACHE_CAPACITY) {
+                // Plans running on a snapshot stay
+                for (auto entry = query_cache.begin(); entry != query_cache.end();) {
+                    entry = entry->second.running ? std::next(entry) : query_cache.erase(entry);
+                }
+            }
+            PreparedQuery prepared;
+            prepared.components = parseQuery(query);
+            it = query_cache.emplace(query, std::move(prepared)).first;
+        }
+        PreparedQuery& prepared = it->second;
+        Table& table = catalog.get(prepared.components.table);
+        if (table.statistics->isStale()) {
+            analyze(table.name);
+        }
+        if (prepared.running) {
+            return prepared; // Not replanned while it runs
+        }
+        if (!prepared.plan.root || prepared.statistics_version != statistics_version ||
+            prepared.view_version != view_manager.getVersion()) {
+            planQuery(prepared);
+        } else {
+            view_manager.sync();
+        }
+        return prepared;
+    }
+
+    // Plan and run a query that is not cached
+    void executeQuery(const QueryComponents& components,
+                      const std::function<void(const Batch&)>& consume = nullptr) {
+        std::unique_lock<std::recursive_mutex> guard(latch);
+        Table& table = catalog.get(components.table);
+        if (table.statistics->isStale()) {
+            analyze(table.name);
+        }
+        PreparedQuery prepared;
+        prepared.components = components;
+        planQuery(prepared);
+        executePrepared(prepared, guard, consume);
+    }
+
+    // Run a plan; guard holds the latch. A plan that only scans the
+    // table runs on a snapshot with the latch released, next to writers.
+    void executePrepared(PreparedQuery& prepared, std::unique_lock<std::recursive_mutex>& guard,
+                         const std::function<void(const Batch&)>& consume = nullptr) {
+        view_usage.queries++;
+        if (prepared.view) {
+            view_usage.answered++;
+            view_usage.hits[prepared.view->getName()]++;
+        }
+        if (!consume) {
+            if (!prepared.plan.access_path.empty()) {
+                std::cout << "Using " << prepared.plan.access_path << " for query." << std::endl;
+            }
+            std::cout << "Estimated query cost: " << prepared.cost << std::endl;
+        }
+        ScanOperator* scan = prepared.plan.snapshot_scan;
+        if (!scan) {
+            runPlan(*prepared.plan.root, consume);
+            return;
+        }
+
+        Snapshot snapshot(transactions);
+        scan->setSnapshot(snapshot.timestamp, catalog.get(prepared.components.table).buffer_manager->getNumPages());
+        prepared.running = true;
+        auto finish = [&]() {
+            guard.lock();
+            scan->setSnapshot();
+            prepared.running = false;
+        };
+        guard.unlock();
+        try {
+            runPlan(*prepared.plan.root, consume);
+        } catch (...) {
+            finish();
+            throw;
+        }
+        finish();
+    }
+
+    // Plan the query with the cheapest of the table plan (index or full
+    // scan) and the plans over the views that can answer it. Only the
+    // sales table has indexes and views.
+    void planQuery(PreparedQuery& prepared) {
+        Table& table = catalog.get(prepared.components.table);
+        checkQuery(prepared.components, table.name, table.schema);
+        const QueryComponents& components = prepared.components;
+        CostModel table_model = cost_model;
+        if (table.segment_id != 0) {
+            table_model.setStatistics(table.statistics);
+        }
+
+        QueryPlan plan = components.approximate ? planApproximateQuery(components, table)
+                                                : planTableQuery(components, table, table_model);
+        double planCost = plan.root->estimateCost(table_model);
+        const MaterializedView* planView = nullptr;
+        for (const MaterializedView* view : view_manager.getViews()) {
+            if (table.segment_id != 0 || components.approximate) {
+                break;
+            }
+            auto rewrite = matchView(components, *view);
+            if (!rewrite) {
+                continue;
+            }
+            QueryPlan viewPlan = planViewQuery(*rewrite);
+            double viewCost = viewPlan.root->estimateCost(cost_model);
+            if (viewCost <= planCost) {
+                plan = std::move(viewPlan);
+                planCost = viewCost;
+                planView = view;
+            }
+        }
+
+        // Every plan produces the same columns, so they sort the same way
+        if (!components.orderBy.empty()) {
+            plan.add(std::make_unique<ExternalSortOperator>(*plan.root, components.orderBy));
+            planCost = plan.root->estimateCost(planView ? cost_model : table_model);
+        }
+        // Queries without an aggregate output the selected attributes of
+        // the tuples, which were sorted whole
+        if (!components.sumOperation && !components.groupBy) {
+            std::vector<size_t> attributes(components.selectAttributes.begin(), components.selectAttributes.end());
+            plan.add(std::make_unique<ProjectionOperator>(*plan.root, std::move(attributes)));
+        }
+
+        prepared.plan = std::move(plan);
+        prepared.cost = planCost;
+        prepared.view = planView;
+        prepared.statistics_version = statistics_version;
+        prepared.view_version = view_manager.getVersion();
+    }
+
+private:
+    // A full scan of the table, or an index scan of the sales table, with
+    // the WHERE clause and the aggregation on top. Aggregates scan only
+    // the attributes they reference; model is set to estimate such plans.
+    QueryPlan planTableQuery(const QueryComponents& components, Table& table, CostModel& model) {
+        QueryPlan plan;
+        std::vector<size_t> attributes = referencedAttributes(components);
+        auto scanOp = std::make_unique<ScanOperator>(*table.buffer_manager, nullptr, attributes);
+        std::unique_ptr<Operator> indexScan;
+        if (components.whereCondition && table.segment_id == 0) {
+            indexScan = planIndexScan(components, scanOp->estimateCost(model), plan.access_path);
+        }
+        auto column = [&attributes](int attr) {
+            return attributes.empty() ? static_cast<size_t>(attr) : projectedColumn(attributes, attr);
+        };
+        bool aggregate = components.sumOperation || components.groupBy;
+        if (indexScan) {
+            plan.add(std::move(indexScan));
+            attributes.clear();
+        } else {
+            std::unique_ptr<IPredicate> predicate;
+            if (components.whereCondition) {
+                scanOp->setBounds(createPredicate(*components.where)->getBounds());
+                predicate = createPredicate(
+                    attributes.empty() ? *components.where : projectCondition(*components.where, attributes));
+            }
+            // Aggregate INT and FLOAT values inside the scan, which leaves
+            // the aggregation only the partial rows to merge
+            const auto& columns = table.schema.columns;
+            model.setProjection(attributes);
+            if (components.sumOperation && columns[components.sumAttributeIndex].type != STRING &&
+                (!components.groupBy || columns[components.groupByAttributeIndex].type == INT)) {
+                std::vector<size_t> groupBy;
+                if (components.groupBy) {
+                    groupBy.push_back(column(components.groupByAttributeIndex));
+                }
+                std::vector<AggrFunc> aggrFuncs = {{components.aggregateType, column(components.sumAttributeIndex)}};
+                scanOp->pushAggregation(groupBy, aggrFuncs, {columns[components.sumAttributeIndex].type},
+                                        std::move(predicate));
+                plan.snapshot_scan = scanOp.get();
+                plan.add(std::move(scanOp));
+                std::vector<size_t> keys(groupBy.size());
+                std::iota(keys.begin(), keys.end(), 0);
+                plan.add(std::make_unique<HashAggregationOperator>(*plan.root, keys,
+                    ScanOperator::mergeFunctions(aggrFuncs, keys.size())));
+                return plan;
+            }
+            plan.snapshot_scan = scanOp.get();
+            plan.add(std::move(scanOp));
+            if (predicate) {
+                plan.add(std::make_unique<SelectOperator>(*plan.root, std::move(predicate)));
+            }
+        }
+
+        if (aggregate) {
+            // Aggregate large inputs on every core
+            size_t threads = (plan.root->estimateRows(model) >= PARALLEL_AGGREGATION_MIN_ROWS)
+                ? std::max(1u, std::thread::hardware_concurrency()) : 1;
+            plan.add(std::make_unique<HashAggregationOperator>(*plan.root,
+                components.groupBy ? std::vector<size_t>{column(components.groupByAttributeIndex)} : std::vector<size_t>{},
+                std::vector<AggrFunc>{{components.aggregateType, column(components.sumAttributeIndex)}},
+                threads));
+        }
+        return plan;
+    }
+
+    // An APPROX query, answered from the table's samples
+    QueryPlan planApproximateQuery(const QueryComponents& components, Table& table) {
+        QueryPlan plan;
+        plan.access_path = "sample of " + table.name;
+        plan.add(std::make_unique<ApproximateAggregationOperator>(
+            table.statistics->getSample(),
+            components.groupBy ? std::optional<size_t>(components.groupByAttributeIndex) : std::nullopt,
+            components.aggregateType, components.average, components.sumAttributeIndex,
+            components.whereCondition ? createPredicate(*components.where) : nullptr));
+        return plan;
+    }
+
+    QueryPlan planViewQuery(const ViewRewrite& rewrite) {
+        QueryPlan plan;
+        plan.access_path = "materialized view " + rewrite.view->getName();
+        plan.add(std::make_unique<ViewScanOperator>(*rewrite.view, rewrite.value));
+
+        if (rewrite.residual) {
+            plan.add(std::make_unique<SelectOperator>(*plan.root, makeRangePredicate(
+                rewrite.residualAttributeIndex, rewrite.lowerBound, rewrite.upperBound)));
+        }
+
+        if (rewrite.reaggregate) {
+            std::vector<size_t> groupByAttrs;
+            if (rewrite.groupBy) {
+                groupByAttrs.push_back(static_cast<size_t>(rewrite.groupByAttributeIndex));
+            }
+            std::vector<AggrFunc> aggrFuncs;
+            if (rewrite.aggregate) {
+                aggrFuncs.push_back({rewrite.aggregateType, static_cast<size_t>(rewrite.valueAttributeIndex)});
+            }
+            plan.add(std::make_unique<HashAggregationOperator>(*plan.root, groupByAttrs, aggrFuncs));
+        }
+        return plan;
+    }
+
+    // Execute the plan a batch at a time, passing every batch to consume
+    // or printing every row
+    void runPlan(Operator& rootOp, const std::function<void(const Batch&)>& consume) {
+        Batch batch;
+        rootOp.open();
+        while (rootOp.nextBatch(batch)) {
+            if (consume) {
+                consume(batch);
+                continue;
+            }
+            for (size_t row = 0; row < batch.size(); ++row) {
+                batch.printRow(row);
+            }
+        }
+        rootOp.close();
+    }
+
+    // The cheapest index scan answering the WHERE range on the key, or
+    // nullptr if no index beats a full scan of scanCost. Names the index
+    // in access_path.
+    std::unique_ptr<Operator> planIndexScan(const QueryComponents& components, double scanCost,
+                                            std::string& access_path) {
+        if (components.whereAttributeIndex != 0 ||
+            components.lowerBound == std::numeric_limits<int>::max() ||
+            components.upperBound == std::numeric_limits<int>::min()) {
+            return nullptr;
+        }
+        // The WHERE bounds are exclusive, index ranges are inclusive
+        int lower = components.lowerBound + 1;
+        int upper = components.upperBound - 1;
+        auto learnedScan = std::make_unique<IndexScanOperator<LearnedIndex>>(buffer_manager, learned_index, lower, upper);
+        auto btreeScan = std::make_unique<IndexScanOperator<BTreeIndex>>(buffer_manager, btree_index, lower, upper);
+        double learnedCost = learnedScan->estimateCost(cost_model);
+        double btreeCost = btreeScan->estimateCost(cost_model);
+        if (std::min(learnedCost, btreeCost) >= scanCost) {
+            return nullptr;
+        }
+        if (learnedCost <= btreeCost) {
+            access_path = "learned index scan";
+            return learnedScan;
+        }
+        access_path = "B+-tree index scan";
+        return btreeScan;
+    }
+};
+
+// Durable insert throughput for a range of group commit intervals
+void benchmarkDurableInserts(size_t num_inserts) {
+    const std::string bench_db = "bench_wal.dat";
+    const std::string bench_log = "bench_wal.log";
+    const std::vector<std::string> bench_files = {
+        bench_db, bench_log, indexFilename(bench_db, "_hash.idx"),
+        indexFilename(bench_db, "_hash.idx.dir"), indexFilename(bench_db, "_btree.idx")};
+    std::vector<std::pair<size_t, double>> results;
+    std::vector<size_t> fsyncs;
+
+    for (size_t interval : {1, 8, 64, 512, 4096}) {
+        for (const auto& file : bench_files) {
+            std::remove(file.c_str());
+        }
+
+        BuzzDB db(bench_db, bench_log, interval);
+        auto start = std::chrono::high_resolution_clock::now();
+        for (size_t i = 0; i < num_inserts; ++i) {
+            db.insert(1 + i % 9, 101 + i % 899);
+        }
+        db.commit();
+        auto end = std::chrono::high_resolution_clock::now();
+
+        std::chrono::duration<double> elapsed = end - start;
+        results.push_back({interval, num_inserts / elapsed.count()});
+        fsyncs.push_back(db.log_manager.getNumFsyncs());
+    }
+    for (const auto& file : bench_files) {
+        std::remove(file.c_str());
+    }
+
+    std::cout << "\n=== Durable insert throughput (" << num_inserts << " inserts) ===\n";
+    for (size_t i = 0; i < results.size(); ++i) {
+        std::cout << "Commit interval " << results[i].first << ": "
+                  << static_cast<size_t>(results[i].second) << " inserts/s, "
+                  << fsyncs[i] << " log fsyncs\n";
+    }
+}
+
+// Insert, lookup and delete throughput of the extendible hash index.
+// Every key is inserted twice to exercise duplicates.
+void benchmarkHashIndex(size_t num_keys) {
+    const std::string bench_index = "bench_hash.idx";
+    std::remove(bench_index.c_str());
+    std::remove((bench_index + ".dir").c_str());
+
+    HashIndex index(bench_index);
+    int distinct_keys = std::max<int>(1, num_keys / 2);
+    std::mt19937 gen(42);
+    std::uniform_int_distribution<int> key_distribution(0, distinct_keys - 1);
+    using clock = std::chrono::high_resolution_clock;
+    auto perSecond = [](size_t n, clock::time_point start) {
+        std::chrono::duration<double> elapsed = clock::now() - start;
+        return static_cast<size_t>(n / elapsed.count());
+    };
+
+    auto start = clock::now();
+    for (size_t i = 0; i < num_keys; ++i) {
+        index.insert(i % distinct_keys, i);
+    }
+    size_t insert_rate = perSecond(num_keys, start);
+
+    const size_t num_lookups = 1000000;
+    size_t found = 0;
+    start = clock::now();
+    for (size_t i = 0; i < num_lookups; ++i) {
+        found += index.getValues(key_distribution(gen)).size();
+    }
+    size_t lookup_rate = perSecond(num_lookups, start);
+
+    size_t num_deletes = num_keys / 10;
+    size_t deleted = 0;
+    start = clock::now();
+    for (size_t i = 0; i < num_deletes; ++i) {
+        deleted += index.remove(i % distinct_keys, i);
+    }
+    size_t delete_rate = perSecond(num_deletes, start);
+
+    std::cout << "\n=== Hash index (" << num_keys << " entries, " << distinct_keys << " distinct keys) ===\n";
+    index.print();
+    std::cout << "Inserts: " << insert_rate << "/s\n";
+    std::cout << "Lookups: " << lookup_rate << "/s, " << found << " values for " << num_lookups << " lookups\n";
+    std::cout << "Deletes: " << delete_rate << "/s, " << deleted << " of " << num_deletes << " found\n";
+}
+
+// Point lookups with concurrent readers, then range scans of growing
+// selectivity through the B+-tree and through a full scan
+void benchmarkBTreeIndex(size_t num_rows) {
+    const std::string bench_db = "bench_btree.dat";
+    const std::string bench_log = "bench_btree.log";
+    const std::string bench_input = "bench_btree.txt";
+    for (const auto& file : {bench_db, bench_log, bench_input, indexFilename(bench_db, "_hash.idx"),
+                             indexFilename(bench_db, "_hash.idx.dir"), indexFilename(bench_db, "_btree.idx")}) {
+        std::remove(file.c_str());
+    }
+
+    // Keys spread over [0, num_rows) so ranges can be made selective
+    int key_range = std::max<int>(1, num_rows);
+    std::mt19937 gen(42);
+    {
+        std::ofstream out(bench_input);
+        std::uniform_int_distribution<int> key_distribution(0, key_range - 1);
+        std::uniform_int_distribution<int> value_distribution(101, 999);
+        for (size_t i = 0; i < num_rows; ++i) {
+            out << key_distribution(gen) << " " << value_distribution(gen) << "\n";
+        }
+    }
+
+    using clock = std::chrono::high_resolution_clock;
+    auto seconds = [](clock::time_point start) {
+        return std::chrono::duration<double>(clock::now() - start).count();
+    };
+
+    std::cout << "\n=== B+-tree index (" << num_rows << " rows) ===\n";
+    BuzzDB db(bench_db, bench_log);
+    auto start = clock::now();
+    db.bulkLoad(bench_input);
+    std::cout << "Bulk load with index build: " << seconds(start) << " s\n";
+    db.btree_index.print();
+
+    const size_t lookups_per_thread = 200000;
+    for (size_t num_threads : {1, 2, 4, 8}) {
+        std::vector<std::thread> threads;
+        std::vector<size_t> found(num_threads, 0);
+        start = clock::now();
+        for (size_t t = 0; t < num_threads; ++t) {
+            threads.emplace_back([&db, &found, t, key_range]() {
+                std::mt19937 thread_gen(t);
+                std::uniform_int_distribution<int> key_distribution(0, key_range - 1);
+                for (size_t i = 0; i < lookups_per_thread; ++i) {
+                    found[t] += db.btree_index.getValues(key_distribution(thread_gen)).size();
+                }
+            });
+        }
+        for (auto& thread : threads) {
+            thread.join();
+        }
+        double elapsed = seconds(start);
+        std::cout << "Lookups, " << num_threads << " reader threads: "
+                  << static_cast<size_t>(num_threads * lookups_per_thread / elapsed) << "/s\n";
+    }
+
+    CostModel cost_model;
+    for (double selectivity : {0.0001, 0.001, 0.01, 0.1}) {
+        int width = std::max(1, static_cast<int>(key_range * selectivity));
+        int lower = std::uniform_int_distribution<int>(0, key_range - width)(gen);
+        int upper = lower + width - 1;
+
+        IndexScanOperator<BTreeIndex> indexScan(db.buffer_manager, db.btree_index, lower, upper);
+        double index_cost = indexScan.estimateCost(cost_model);
+        size_t index_rows = 0;
+        start = clock::now();
+        indexScan.open();
+        while (indexScan.next()) {
+            index_rows++;
+        }
+        indexScan.close();
+        double index_time = seconds(start);
+
+        ScanOperator scanOp(db.buffer_manager);
+        double scan_cost = scanOp.estimateCost(cost_model);
+        SelectOperator selectOp(scanOp, makeRangePredicate(0, lower - 1, upper + 1));
+        size_t scan_rows = 0;
+        start = clock::now();
+        selectOp.open();
+        while (selectOp.next()) {
+            scan_rows++;
+        }
+        selectOp.close();
+        double scan_time = seconds(start);
+
+        std::cout << "Selectivity " << selectivity * 100 << "%: index scan " << index_rows << " rows in "
+                  << index_time * 1000 << " ms (cost " << index_cost << "), full scan " << scan_rows
+                  << " rows in " << scan_time * 1000 << " ms (cost " << scan_cost << "), planner picks "
+                  << (index_cost < scan_cost ? "index scan" : "full scan") << "\n";
+    }
+}
+
+// Learned index lookups against the hash index and binary search over the
+// key column of a "key value" file
+void benchmarkLearnedIndex(std::string input_file) {
+    const std::string bench_db = "bench_learned.dat";
+    const std::string bench_log = "bench_learned.log";
+    for (const auto& file : {bench_db, bench_log, indexFilename(bench_db, "_hash.idx"),
+                             indexFilename(bench_db, "_hash.idx.dir"), indexFilename(bench_db, "_btree.idx")}) {
+        std::remove(file.c_str());
+    }
+    // Without a file: 1M sales with keys uniform over 1..10M
+    if (input_file.empty()) {
+        input_file = "bench_learned.txt";
+        std::mt19937 gen(42);
+        std::uniform_int_distribution<int> key_distribution(1, 10000000);
+        std::uniform_int_distribution<int> value_distribution(101, 999);
+        std::ofstream out(input_file);
+        for (size_t i = 0; i < 1000000; ++i) {
+            out << key_distribution(gen) << " " << value_distribution(gen) << "\n";
+        }
+    }
+
+    std::cout << "\n=== Learned index (key column of " << input_file << ") ===\n";
+    BuzzDB db(bench_db, bench_log);
+    db.bulkLoad(input_file);
+    db.learned_index.print();
+
+    // The sorted column for plain binary search
+    std::vector<int> column;
+    std::vector<TupleID> tuple_ids;
+    auto iterator = db.btree_index.scan(std::numeric_limits<int>::min(), std::numeric_limits<int>::max());
+    int key;
+    TupleID value;
+    while (iterator.next(key, value)) {
+        column.push_back(key);
+        tuple_ids.push_back(value);
+    }
+    if (column.empty()) {
+        return;
+    }
+
+    using clock = std::chrono::high_resolution_clock;
+    const size_t max_lookups = 1000000;
+    const double max_seconds = 2.0;
+    // Run lookup on random keys of the column's domain for max_lookups
+    // lookups or max_seconds, whichever comes first
+    auto measure = [&](const std::string& name, auto lookup) {
+        std::mt19937 gen(42);
+        std::uniform_int_distribution<int> key_distribution(column.front(), column.back());
+        size_t checksum = 0;
+        size_t lookups = 0;
+        auto start = clock::now();
+        std::chrono::duration<double> elapsed{};
+        while (lookups < max_lookups) {
+            checksum += lookup(key_distribution(gen));
+            if (++lookups % 1024 == 0 && (elapsed = clock::now() - start).count() > max_seconds) {
+                break;
+            }
+        }
+        elapsed = clock::now() - start;
+        std::cout << name << ": " << static_cast<size_t>(lookups / elapsed.count()) << " lookups/s ("
+                  << lookups << " lookups, checksum " << checksum << ")\n";
+    };
+
+    std::cout << "-- Search (position of the first match) --\n";
+    measure("Learned index", [&](int k) { return db.learned_index.lowerBound(k); });
+    measure("Binary search", [&](int k) {
+        return static_cast<size_t>(std::lower_bound(column.begin(), column.end(), k) - column.begin());
+    });
+
+    std::cout << "-- Lookup (all tuple ids of the key) --\n";
+    measure("Learned index", [&](int k) { return db.learned_index.getValues(k).size(); });
+    measure("Hash index", [&](int k) { return db.hash_index.getValues(k).size(); });
+    measure("Binary search", [&](int k) {
+        auto range = std::equal_range(column.begin(), column.end(), k);
+        std::vector<TupleID> values(tuple_ids.begin() + (range.first - column.begin()),
+                                    tuple_ids.begin() + (range.second - column.begin()));
+        return values.size();
+    });
+}
+
+// Aggregation query time when the plan is drained through next() /
+// getOutput(), through nextBatch() and through nextBatch() with a two
+// phase parallel aggregation on 4 threads
+void benchmarkBatchExecution(size_t num_rows) {
+    const std::string bench_db = "bench_batch.dat";
+    const std::string bench_log = "bench_batch.log";
+    for (const auto& file : {bench_db, bench_log, indexFilename(bench_db, "_hash.idx"),
+                             indexFilename(bench_db, "_hash.idx.dir"), indexFilename(bench_db, "_btree.idx")}) {
+        std::remove(file.c_str());
+    }
+
+    // Same distribution as generate-data
+    BuzzDB db(bench_db, bench_log, 4096);
+    std::mt19937 gen(42);
+    std::discrete_distribution<int> key_distribution({40, 20, 10, 10, 5, 5, 5, 3, 2});
+    std::uniform_int_distribution<int> value_distribution(101, 999);
+    std::vector<std::pair<int, int>> rows(num_rows);
+    for (auto& row : rows) {
+        row = {key_distribution(gen), value_distribution(gen)};
+    }
+    auto load_start = std::chrono::high_resolution_clock::now();
+    db.insertBatch(rows);
+    db.commit();
+    std::chrono::duration<double> load_time = std::chrono::high_resolution_clock::now() - load_start;
+    std::cout << "Inserted " << num_rows << " rows in " << db.buffer_manager.getNumPages() << " pages ("
+              << static_cast<size_t>(num_rows / load_time.count()) << " rows/s)\n";
+
+    const std::vector<std::string> queries = {
+        "SUM{2} GROUP BY {1}",
+        "SUM{1} GROUP BY {2}",
+        "SUM{2} GROUP BY {1} WHERE {1} > 0 and {1} < 4",
+        "SUM{2} WHERE {2} > 500 and {2} < 600",
+    };
+    const size_t parallel_threads = 4;
+    std::vector<std::tuple<std::string, double, double, double>> results;
+    for (const auto& query : queries) {
+        auto components = parseQuery(query);
+        double best[3] = {std::numeric_limits<double>::max(), std::numeric_limits<double>::max(),
+                          std::numeric_limits<double>::max()};
+        for (int run = 0; run < 3; ++run) {
+            for (int mode = 0; mode < 3; ++mode) {
+                bool batched = mode > 0;
+                ScanOperator scanOp(db.buffer_manager);
+                Operator* rootOp = &scanOp;
+                std::optional<SelectOperator> selectOp;
+                if (components.whereCondition) {
+                    selectOp.emplace(*rootOp, createPredicate(*components.where));
+                    rootOp = &*selectOp;
+                }
+                HashAggregationOperator aggOp(*rootOp,
+                    components.groupBy ? std::vector<size_t>{static_cast<size_t>(components.groupByAttributeIndex)} : std::vector<size_t>{},
+                    std::vector<AggrFunc>{{AggrFuncType::SUM, static_cast<size_t>(components.sumAttributeIndex)}},
+                    (mode == 2) ? parallel_threads : 1);
+
+                auto start = std::chrono::high_resolution_clock::now();
+                size_t groups = 0;
+                aggOp.open();
+                if (batched) {
+                    Batch batch;
+                    while (aggOp.nextBatch(batch)) {
+                        groups += batch.size();
+                    }
+                } else {
+                    while (aggOp.next()) {
+                        groups += !aggOp.getOutput().empty();
+                    }
+                }
+                aggOp.close();
+                std::chrono::duration<double, std::milli> elapsed = std::chrono::high_resolution_clock::now() - start;
+                best[mode] = std::min(best[mode], elapsed.count());
+                assert(groups > 0);
+            }
+        }
+        results.emplace_back(query, best[0], best[1], best[2]);
+    }
+
+    std::cout << "\n=== Aggregation query time, " << num_rows << " rows (best of 3) ===\n";
+    for (const auto& [query, tuple_ms, batch_ms, parallel_ms] : results) {
+        std::cout << query << "\n  next(): " << tuple_ms << " ms, nextBatch(): " << batch_ms
+                  << " ms (" << tuple_ms / batch_ms << "x), nextBatch() on " << parallel_threads
+                  << " threads: " << parallel_ms << " ms\n";
+    }
+}
+
+// Replays batches held in memory, to time operators without the scan
+class MemorySourceOperator : public Operator {
+private:
+    const std::vector<Batch>& batches;
+    size_t batch_index = 0;
+    size_t row = 0;
+    std::vector<std::unique_ptr<Field>> currentFields;
+
+public:
+    explicit MemorySourceOperator(const std::vector<Batch>& batches) : batches(batches) {}
+
+    void open() override {
+        batch_index = 0;
+        row = 0;
+    }
+
+    bool next() override {
+        for (; batch_index < batches.size(); ++batch_index, row = 0) {
+            if (row < batches[batch_index].size()) {
+                batches[batch_index].readTuple(row++, currentFields);
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void close() override {}
+
+    const std::vector<std::unique_ptr<Field>>& getOutput() override {
+        return currentFields;
+    }
+
+    bool nextBatch(Batch& batch) override {
+        if (batch_index >= batches.size()) {
+            batch.clear();
+            return false;
+        }
+        batch = batches[batch_index++];
+        return true;
+    }
+
+    double estimateCost(CostModel&) override {
+        return 0;
+    }
+};
+
+// SUM aggregation of in-memory (group, value) rows for a range of group
+// counts through next(), nextBatch() and nextBatch() on 4 threads
+void benchmarkAggregation(size_t num_rows) {
+    std::mt19937 gen(42);
+    std::uniform_int_distribution<int> value_distribution(101, 999);
+    const size_t parallel_threads = 4;
+
+    std::cout << "\n=== Hash aggregation, " << num_rows << " rows in memory ===\n";
+    for (size_t num_groups : {10, 1000, 100000, 1000000}) {
+        std::uniform_int_distribution<int> group_distribution(0, num_groups - 1);
+        std::vector<Batch> batches;
+        std::vector<std::unique_ptr<Field>> row;
+        row.push_back(std::make_unique<Field>(0));
+        row.push_back(std::make_unique<Field>(0));
+        for (size_t start = 0; start < num_rows; start += BATCH_SIZE) {
+            Batch batch;
+            for (size_t i = start; i < std::min(num_rows, start + BATCH_SIZE); ++i) {
+                row[0]->setInt(group_distribution(gen));
+                row[1]->setInt(value_distribution(gen));
+                batch.appendTuple(row);
+            }
+            batches.push_back(std::move(batch));
+        }
+
+        double best[3] = {std::numeric_limits<double>::max(), std::numeric_limits<double>::max(),
+                          std::numeric_limits<double>::max()};
+        size_t groups = 0;
+        for (int run = 0; run < 3; ++run) {
+            for (int mode = 0; mode < 3; ++mode) {
+                MemorySourceOperator source(batches);
+                HashAggregationOperator aggOp(source, {0}, {{AggrFuncType::SUM, 1}}, (mode == 2) ? parallel_threads : 1);
+                auto start = std::chrono::high_resolution_clock::now();
+                groups = 0;
+                aggOp.open();
+                if (mode > 0) {
+                    Batch batch;
+                    while (aggOp.nextBatch(batch)) {
+                        groups += batch.size();
+                    }
+                } else {
+                    while (aggOp.next()) {
+                        groups++;
+                    }
+                }
+                aggOp.close();
+                std::chrono::duration<double, std::milli> elapsed = std::chrono::high_resolution_clock::now() - start;
+                best[mode] = std::min(best[mode], elapsed.count());
+            }
+        }
+        std::cout << groups << " groups: next(): " << best[0] << " ms, nextBatch(): " << best[1]
+                  << " ms, nextBatch() on " << parallel_threads << " threads: " << best[2] << " ms\n";
+
+        if (num_groups < 1000000) {
+            continue;
+        }
+        // The same groups within memory budgets the table does not fit
+        for (size_t budget : {AGGREGATION_MEMORY_BUDGET, size_t(16) << 20, size_t(4) << 20}) {
+            double best_time = std::numeric_limits<double>::max();
+            size_t partitions = 0;
+            size_t pages = 0;
+            for (int run = 0; run < 3; ++run) {
+                MemorySourceOperator source(batches);
+                HashAggregationOperator aggOp(source, {0}, {{AggrFuncType::SUM, 1}}, 1, budget);
+                auto start = std::chrono::high_resolution_clock::now();
+                Batch batch;
+                aggOp.open();
+                while (aggOp.nextBatch(batch)) {
+                }
+                partitions = aggOp.getSpilledPartitions();
+                pages = aggOp.getPagesWritten();
+                aggOp.close();
+                std::chrono::duration<double, std::milli> elapsed = std::chrono::high_resolution_clock::now() - start;
+                best_time = std::min(best_time, elapsed.count());
+            }
+            std::cout << "  budget " << (budget >> 20) << " MB: " << best_time << " ms, " << partitions
+                      << " partitions, " << pages << " pages spilled\n";
+        }
+    }
+}
+
+// Cost of keeping views current per change against recomputing them
+void benchmarkViewMaintenance(size_t num_rows) {
+    const std::string bench_db = "bench_view.dat";
+    const std::string bench_log = "bench_view.log";
+    for (const auto& file : {bench_db, bench_log, indexFilename(bench_db, "_hash.idx"),
+                             indexFilename(bench_db, "_hash.idx.dir"), indexFilename(bench_db, "_btree.idx")}) {
+        std::remove(file.c_str());
+    }
+
+    BuzzDB db(bench_db, bench_log, 4096);
+    std::mt19937 gen(42);
+    std::uniform_int_distribution<int> key_distribution(0, 9);
+    std::uniform_int_distribution<int> value_distribution(101, 999);
+    std::vector<std::pair<int, int>> rows(num_rows);
+    for (auto& row : rows) {
+        row = {key_distribution(gen), value_distribution(gen)};
+    }
+    db.insertBatch(rows);
+    db.commit();
+
+    const size_t num_changes = 100000;
+    std::vector<std::unique_ptr<Tuple>> changes;
+    for (size_t i = 0; i < num_changes; ++i) {
+        changes.push_back(makeSalesTuple(key_distribution(gen), value_distribution(gen)));
+    }
+    auto since = [](auto start) {
+        return std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+    };
+
+    std::cout << "\n=== View maintenance, " << num_rows << " rows, " << num_changes << " changes ===\n";
+    const std::vector<std::string> definitions = {
+        "SUM{2} GROUP BY {1}", "COUNT{2} GROUP BY {1}", "MIN{2} GROUP BY {1}", "MAX{2} GROUP BY {1}"};
+    for (const auto& definition : definitions) {
+        MaterializedView view(definition, definition);
+        auto start = std::chrono::high_resolution_clock::now();
+        view.refresh(db.buffer_manager);
+        double refresh_ms = since(start);
+
+        start = std::chrono::high_resolution_clock::now();
+        for (const auto& change : changes) {
+            view.applyInsert(change->fields);
+        }
+        double insert_ns = since(start) * 1e6 / num_changes;
+
+        size_t deletes = 0;
+        start = std::chrono::high_resolution_clock::now();
+        for (const auto& change : changes) {
+            view.applyDelete(change->fields);
+            if (view.isStale()) {
+                break;
+            }
+            ++deletes;
+        }
+        double delete_ns = since(start) * 1e6 / std::max<size_t>(deletes, 1);
+
+        std::cout << definition << ": refresh " << refresh_ms << " ms, insert " << insert_ns
+                  << " ns, delete " << delete_ns << " ns";
+        if (view.isStale()) {
+            std::cout << " (stale after " << deletes << " deletes)";
+        }
+        std::cout << ", refresh = " << static_cast<size_t>(refresh_ms * 1e6 / insert_ns) << " inserts\n";
+    }
+
+    // All four views behind the manager, applied inline and in the background
+    for (size_t i = 1; i < definitions.size(); ++i) {
+        db.view_manager.createView(definitions[i], definitions[i]);
+    }
+    for (bool deferred : {false, true}) {
+        db.view_manager.setDeferred(deferred);
+        auto start = std::chrono::high_resolution_clock::now();
+        for (const auto& change : changes) {
+            db.view_manager.applyInsert(change->fields);
+        }
+        double enqueue_ms = since(start);
+        db.view_manager.sync();
+        std::cout << (deferred ? "Deferred" : "Immediate") << ", 4 views: " << enqueue_ms * 1e6 / num_changes
+                  << " ns per insert, " << since(start) << " ms until current\n";
+    }
+    db.view_manager.setDeferred(false);
+}
+
+#ifdef BUZZDB_COUNT_ALLOCATIONS
+// Heap allocations made by the process, for bench-alloc. Only compiled in
+// with -DBUZZDB_COUNT_ALLOCATIONS so other builds keep the default
+// allocator. Every replaceable new/delete goes through malloc/free so the
+// variants stay consistent (aligned ones use aligned_alloc). The replacements
+// are not inlined so the compiler does not see free() meet a new expression.
+std::atomic<size_t> heap_allocations{0};
+
+__attribute__((noinline)) void* countedAllocate(size_t size, size_t alignment) {
+    heap_allocations.fetch_add(1, std::memory_order_relaxed);
+    size = size ? size : 1;
+    if (alignment > alignof(std::max_align_t)) {
+        size = (size + alignment - 1) / alignment * alignment;
+        return std::aligned_alloc(alignment, size);
+    }
+    return std::malloc(size);
+}
+
+void* operator new(size_t size) {
+    if (void* pointer = countedAllocate(size, 0)) {
+        return pointer;
+    }
+    throw std::bad_alloc();
+}
+
+void* operator new[](size_t size) {
+    return operator new(size);
+}
+
+void* operator new(size_t size, std::align_val_t alignment) {
+    if (void* pointer = countedAllocate(size, static_cast<size_t>(alignment))) {
+        return pointer;
+    }
+    throw std::bad_alloc();
+}
+
+void* operator new[](size_t size, std::align_val_t alignment) {
+    return operator new(size, alignment);
+}
+
+void* operator new(size_t size, const std::nothrow_t&) noexcept {
+    return countedAllocate(size, 0);
+}
+
+void* operator new[](size_t size, const std::nothrow_t&) noexcept {
+    return countedAllocate(size, 0);
+}
+
+void* operator new(size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept {
+    return countedAllocate(size, static_cast<size_t>(alignment));
+}
+
+void* operator new[](size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept {
+    return countedAllocate(size, static_cast<size_t>(alignment));
+}
+
+__attribute__((noinline)) void operator delete(void* pointer) noexcept {
+    std::free(pointer);
+}
+
+void operator delete[](void* pointer) noexcept {
+    operator delete(pointer);
+}
+
+void operator delete(void* pointer, size_t) noexcept {
+    operator delete(pointer);
+}
+
+void operator delete[](void* pointer, size_t) noexcept {
+    operator delete(pointer);
+}
+
+void operator delete(void* pointer, std::align_val_t) noexcept {
+    operator delete(pointer);
+}
+
+void operator delete[](void* pointer, std::align_val_t) noexcept {
+    operator delete(pointer);
+}
+
+void operator delete(void* pointer, size_t, std::align_val_t) noexcept {
+    operator delete(pointer);
+}
+
+void operator delete[](void* pointer, size_t, std::align_val_t) noexcept {
+    operator delete(pointer);
+}
+
+void operator delete(void* pointer, const std::nothrow_t&) noexcept {
+    operator delete(pointer);
+}
+
+void operator delete[](void* pointer, const std::nothrow_t&) noexcept {
+    operator delete(pointer);
+}
+
+void operator delete(void* pointer, std::align_val_t, const std::nothrow_t&) noexcept {
+    operator delete(pointer);
+}
+
+void operator delete[](void* pointer, std::align_val_t, const std::nothrow_t&) noexcept {
+    operator delete(pointer);
+}
+
+size_t countedAllocations() {
+    return heap_allocations.load();
+}
+const bool counting_allocations = true;
+#else
+size_t countedAllocations() {
+    return 0;
+}
+const bool counting_allocations = false;
+#endif
+
+// Heap allocations per tuple when plans are drained through next() and
+// getOutput(), calling getOutput() twice per tuple as a consumer may
+void benchmarkAllocations(size_t num_rows) {
+    const std::string bench_db = "bench_alloc.dat";
+    const std::string bench_log = "bench_alloc.log";
+    for (const auto& file : {bench_db, bench_log, indexFilename(bench_db, "_hash.idx"),
+                             indexFilename(bench_db, "_hash.idx.dir"), indexFilename(bench_db, "_btree.idx")}) {
+        std::remove(file.c_str());
+    }
+
+    BuzzDB db(bench_db, bench_log, 4096);
+    std::mt19937 gen(42);
+    std::discrete_distribution<int> key_distribution({40, 20, 10, 10, 5, 5, 5, 3, 2});
+    std::uniform_int_distribution<int> value_distribution(101, 999);
+    std::vector<std::pair<int, int>> rows(num_rows);
+    for (auto& row : rows) {
+        row = {key_distribution(gen), value_distribution(gen)};
+    }
+    db.insertBatch(rows);
+    db.commit();
+
+    struct Plan {
+        std::string name;
+        bool select;
+        bool aggregate;
+    };
+    const std::vector<Plan> plans = {
+        {"Scan", false, false},
+        {"Scan + Select {1} > 0 and {1} < 4", true, false},
+        {"Scan + HashAggregation SUM{2} GROUP BY {1}", false, true},
+        {"Scan + Select + HashAggregation", true, true},
+    };
+
+    std::cout << "\n=== Heap allocations, " << num_rows << " rows ===\n";
+    if (!counting_allocations) {
+        std::cout << "Built without -DBUZZDB_COUNT_ALLOCATIONS, only timings are reported\n";
+    }
+    for (const auto& plan : plans) {
+        ScanOperator scanOp(db.buffer_manager);
+        Operator* rootOp = &scanOp;
+        std::optional<SelectOperator> selectOp;
+        std::optional<HashAggregationOperator> aggOp;
+        if (plan.select) {
+            selectOp.emplace(*rootOp, makeRangePredicate(0, 0, 4));
+            rootOp = &*selectOp;
+        }
+        if (plan.aggregate) {
+            aggOp.emplace(*rootOp, std::vector<size_t>{0}, std::vector<AggrFunc>{{AggrFuncType::SUM, 1}});
+            rootOp = &*aggOp;
+        }
+
+        size_t output_tuples = 0;
+        size_t empty_outputs = 0;
+        size_t allocations_before = countedAllocations();
+        auto start = std::chrono::high_resolution_clock::now();
+        rootOp->open();
+        while (rootOp->next()) {
+            output_tuples++;
+            empty_outputs += rootOp->getOutput().empty();
+            empty_outputs += rootOp->getOutput().empty();
+        }
+        rootOp->close();
+        std::chrono::duration<double, std::milli> elapsed = std::chrono::high_resolution_clock::now() - start;
+        size_t allocations = countedAllocations() - allocations_before;
+
+        std::cout << plan.name << ": " << output_tuples << " tuples out, ";
+        if (counting_allocations) {
+            std::cout << allocations << " allocations (" << static_cast<double>(allocations) / num_rows
+                      << " per input tuple), ";
+        }
+        std::cout << elapsed.count() << " ms";
+        if (empty_outputs > 0) {
+            std::cout << ", " << empty_outputs << " empty getOutput() results";
+        }
+        std::cout << "\n";
+    }
+}
+
+// Joins lineitems, orders, customers and regions (tables of one BuzzDB,
+// linked by foreign keys; regions covers a fifth of the customers'
+// region keys) with the optimizer's plan and with hash joins in the
+// order the query names them
+void benchmarkJoins(size_t num_rows) {
+    struct Table {
+        std::string name;
+        size_t rows;
+        int key_range;      // Keys are 0..rows-1, or drawn from this range
+        int value_range;    // Values are drawn from 0..value_range-1
+    };
+    size_t num_orders = std::max<size_t>(1, num_rows / 4);
+    size_t num_customers = std::max<size_t>(1, num_rows / 20);
+    const std::vector<Table> tables = {
+        {"lineitems", num_rows, static_cast<int>(num_orders), 50},
+        {"orders", num_orders, 0, static_cast<int>(num_customers)},
+        {"customers", num_customers, 0, 25},
+        {"regions", 5, 0, 1000},
+    };
+
+    const std::string bench_db = "bench_join.dat";
+    const std::string bench_log = "bench_join.log";
+    const std::string bench_input = "bench_join.txt";
+    for (const auto& file : {bench_db, bench_log, bench_input, indexFilename(bench_db, "_hash.idx"),
+                             indexFilename(bench_db, "_hash.idx.dir"), indexFilename(bench_db, "_btree.idx"),
+                             indexFilename(bench_db, ".catalog")}) {
+        std::remove(file.c_str());
+    }
+
+    std::mt19937 gen(42);
+    BuzzDB db(bench_db, bench_log);
+    for (const auto& table : tables) {
+        db.createTable(table.name, Schema::parse("key:INT,value:INT"));
+        {
+            std::ofstream out(bench_input);
+            std::uniform_int_distribution<int> key_distribution(0, std::max(1, table.key_range) - 1);
+            std::uniform_int_distribution<int> value_distribution(0, table.value_range - 1);
+            for (size_t i = 0; i < table.rows; ++i) {
+                out << (table.key_range ? key_distribution(gen) : static_cast<int>(i)) << " "
+                    << value_distribution(gen) << "\n";
+            }
+        }
+        db.bulkLoad(table.name, bench_input);
+    }
+
+    std::vector<Relation> relations;
+    for (const auto& table : tables) {
+        relations.push_back(db.relation(table.name));
+    }
+    // lineitems.{1} = orders.{1}, orders.{2} = customers.{1},
+    // customers.{2} = regions.{1}
+    const std::vector<JoinPredicate> joins = {{0, 0, 1, 0, 0}, {1, 1, 2, 0, 0}, {2, 1, 3, 0, 0}};
+    std::vector<double> selectivities;
+    for (const auto& join : joins) {
+        selectivities.push_back(db.estimateJoinSelectivity(relations[join.left], join.left_attr,
+                                                           relations[join.right], join.right_attr));
+    }
+
+    std::cout << "\n=== Joins (" << num_rows << " lineitems, " << num_orders << " orders, "
+              << num_customers << " customers, 5 regions) ===\n";
+    std::vector<size_t> column_offsets;
+    QueryPlan optimized = db.planJoin(relations, joins, column_offsets);
+
+    // Hash joins in query order, building on the joined relations
+    QueryPlan naive;
+    naive.access_path = "lineitems";
+    naive.add(std::make_unique<ScanOperator>(relations[0].buffer_manager, &relations[0].statistics));
+    size_t width = relations[0].statistics.getNumColumns();
+    for (size_t i = 1; i < relations.size(); ++i) {
+        Operator& joined = *naive.root;
+        Operator& scan = naive.add(std::make_unique<ScanOperator>(relations[i].buffer_manager, &relations[i].statistics));
+        // The previous relation's columns are the last ones joined
+        size_t left_offset = width - relations[i - 1].statistics.getNumColumns();
+        naive.add(std::make_unique<HashJoinOperator>(joined, scan, left_offset + joins[i - 1].left_attr,
+                                                     joins[i - 1].right_attr, selectivities[i - 1]));
+        naive.access_path += ", hash join " + tables[i].name;
+        width += relations[i].statistics.getNumColumns();
+    }
+
+    size_t expected_rows = 0;
+    for (auto* plan : {&optimized, &naive}) {
+        double estimated_rows = plan->root->estimateRows(db.cost_model);
+        double estimated_cost = plan->root->estimateCost(db.cost_model);
+        // The sum of all columns does not depend on their order
+        size_t output_rows = 0;
+        long long checksum = 0;
+        Batch batch;
+        auto start = std::chrono::high_resolution_clock::now();
+        plan->root->open();
+        while (plan->root->nextBatch(batch)) {
+            output_rows += batch.size();
+            for (const auto& column : batch.columns) {
+                checksum += std::accumulate(column.ints.begin(), column.ints.end(), 0LL);
+            }
+        }
+        plan->root->close();
+        std::chrono::duration<double, std::milli> elapsed = std::chrono::high_resolution_clock::now() - start;
+
+        std::cout << ((plan == &optimized) ? "Optimized" : "Query order") << ": " << plan->access_path << "\n"
+                  << "  estimated " << static_cast<size_t>(estimated_rows) << " rows, cost "
+                  << static_cast<size_t>(estimated_cost) << "; actual " << output_rows << " rows (checksum "
+                  << checksum << ") in " << elapsed.count() << " ms\n";
+        if (plan == &optimized) {
+            expected_rows = output_rows;
+        } else if (output_rows != expected_rows) {
+            std::cout << "  Results differ!\n";
+        }
+    }
+}
+
+// Sorts a table of (key, value) rows on value, then key descending,
+// entirely in memory and with a memory budget of 1/10 and 1/100 of the
+// input, run generation on 1 and 4 threads
+void benchmarkSort(size_t num_rows) {
+    const std::string bench_db = "bench_sort.dat";
+    const std::string bench_log = "bench_sort.log";
+    const std::string bench_input = "bench_sort.txt";
+    for (const auto& file : {bench_db, bench_log, bench_input, indexFilename(bench_db, "_hash.idx"),
+                             indexFilename(bench_db, "_hash.idx.dir"), indexFilename(bench_db, "_btree.idx")}) {
+        std::remove(file.c_str());
+    }
+    {
+        std::mt19937 gen(42);
+        std::uniform_int_distribution<int> distribution(0, 999999);
+        std::ofstream out(bench_input);
+        for (size_t i = 0; i < num_rows; ++i) {
+            out << distribution(gen) << " " << distribution(gen) << "\n";
+        }
+    }
+    BuzzDB db(bench_db, bench_log);
+    db.bulkLoad(bench_input);
+
+    // Size of the input in the sort buffer
+    size_t input_bytes = 0;
+    {
+        ScanOperator scanOp(db.buffer_manager);
+        Batch batch;
+        scanOp.open();
+        while (scanOp.nextBatch(batch)) {
+            input_bytes += ExternalSortOperator::memoryBytes(batch);
+        }
+        scanOp.close();
+    }
+
+    std::cout << "\n=== External sort, " << num_rows << " rows (" << db.buffer_manager.getNumPages()
+              << " pages, " << input_bytes / 1024 << " KB to sort) ===\n";
+    const std::vector<SortKey> keys = {{1, true}, {0, false}};
+    struct Setup {
+        size_t memory_budget;
+        size_t num_threads;
+    };
+    const std::vector<Setup> setups = {{input_bytes * 2, 1}, {input_bytes / 10, 1}, {input_bytes / 10, 4},
+                                       {input_bytes / 100, 1}, {input_bytes / 100, 4}};
+    for (const auto& setup : setups) {
+        ScanOperator scanOp(db.buffer_manager);
+        ExternalSortOperator sortOp(scanOp, keys, setup.memory_budget, setup.num_threads);
+        size_t rows = 0;
+        bool in_order = true;
+        Batch batch;
+        Batch previous;
+        auto start = std::chrono::high_resolution_clock::now();
+        sortOp.open();
+        while (sortOp.nextBatch(batch)) {
+            if (previous.size() > 0 && compareRows(previous, previous.size() - 1, batch, 0, keys) > 0) {
+                in_order = false;
+            }
+            for (size_t row = 1; row < batch.size(); ++row) {
+                in_order = in_order && compareRows(batch, row - 1, batch, row, keys) <= 0;
+            }
+            rows += batch.size();
+            std::swap(previous, batch);
+        }
+        size_t pages_written = sortOp.getPagesWritten();
+        sortOp.close();
+        std::chrono::duration<double, std::milli> elapsed = std::chrono::high_resolution_clock::now() - start;
+
+        std::cout << "Budget " << setup.memory_budget / 1024 << " KB, " << setup.num_threads << " thread(s): "
+                  << elapsed.count() << " ms, " << pages_written << " run pages written, " << rows << " rows"
+                  << (in_order && rows == num_rows ? "" : " NOT SORTED") << "\n";
+    }
+}
+
+// Parse, parse + plan and cached prepare latency of a set of queries
+void benchmarkQueryPreparation(size_t num_rows) {
+    const std::string bench_db = "bench_parse.dat";
+    const std::string bench_log = "bench_parse.log";
+    const std::string bench_input = "bench_parse.txt";
+    for (const auto& file : {bench_db, bench_log, bench_input, indexFilename(bench_db, "_hash.idx"),
+                             indexFilename(bench_db, "_hash.idx.dir"), indexFilename(bench_db, "_btree.idx")}) {
+        std::remove(file.c_str());
+    }
+    {
+        std::mt19937 gen(42);
+        std::uniform_int_distribution<int> key_distribution(1, 9);
+        std::uniform_int_distribution<int> value_distribution(101, 999);
+        std::ofstream out(bench_input);
+        for (size_t i = 0; i < num_rows; ++i) {
+            out << key_distribution(gen) << " " << value_distribution(gen) << "\n";
+        }
+    }
+    BuzzDB db(bench_db, bench_log);
+    db.bulkLoad(bench_input);
+    db.analyze();
+
+    const std::vector<std::string> queries = {
+        "SUM{1} GROUP BY {1} WHERE {1} > 2 and {1} < 6",
+        "SUM{2} WHERE {1} > 2 and {1} < 4",
+        "COUNT{2} WHERE {1} >= 3 AND {1} <= 5",
+        "SUM{2} GROUP BY {1} WHERE ({1} = 1 OR {1} = 7) AND {2} > 500 ORDER BY SUM{2} DESC",
+        "{1}, {2} WHERE {2} < 110 AND {1} <> 4 ORDER BY {2}, {1} DESC",
+    };
+    const size_t iterations = 10000;
+    using clock = std::chrono::high_resolution_clock;
+    auto microseconds = [iterations](clock::time_point start) {
+        std::chrono::duration<double, std::micro> elapsed = clock::now() - start;
+        return elapsed.count() / iterations;
+    };
+
+    std::cout << "\n=== Query preparation, " << num_rows << " rows, mean of " << iterations << " ===\n";
+    for (const auto& query : queries) {
+        auto start = clock::now();
+        size_t checksum = 0;
+        for (size_t i = 0; i < iterations; ++i) {
+            checksum += parseQuery(query).selectAttributes.size();
+        }
+        double parse_us = microseconds(start);
+
+        start = clock::now();
+        for (size_t i = 0; i < iterations; ++i) {
+            db.query_cache.clear();
+            checksum += db.prepareQuery(query).plan.operators.size();
+        }
+        double plan_us = microseconds(start);
+
+        start = clock::now();
+        for (size_t i = 0; i < iterations; ++i) {
+            checksum += db.prepareQuery(query).plan.operators.size();
+        }
+        double cached_us = microseconds(start);
+
+        std::cout << query << "\n  parse " << parse_us << " us, parse + plan " << plan_us << " us, cached "
+                  << cached_us << " us (" << checksum % 2 << ")\n";
+    }
+    std::cout << "\n";
+    for (const auto& query : queries) {
+        std::cout << query << "\n";
+        db.executeStatement(query);
+    }
+
+    // Tuples are projected to the select list
+    size_t width = 0;
+    db.executeStatement("{2}, {1} WHERE {1} > 3", [&width](const Batch& batch) {
+        width = batch.columns.size();
+    });
+    if (width != 2) {
+        throw std::runtime_error("{2}, {1} returned " + std::to_string(width) + " columns");
+    }
+    // Every malformed query is rejected
+    for (const char* query : {"SUM{2} GROUP BY {1} GROUP BY {2}", "{1} WHERE {1} > 1 WHERE {1} < 3",
+                              "SUM{2} GROUP BY {1} ORDER BY COUNT{2}", "SUM{2} ORDER BY MAX{2}",
+                              "SUM{2} GROUP BY {1} ORDER BY {2}", "{1} ORDER BY SUM{1}"}) {
+        try {
+            parseQuery(query);
+        } catch (const std::runtime_error& e) {
+            std::cout << e.what() << "\n";
+            continue;
+        }
+        throw std::runtime_error(std::string("Accepted malformed query: ") + query);
+    }
+}
+
+// Aggregates over one and two attributes and a scan of whole tuples on
+// the same sales rows stored as slotted pages and as PAX pages
+void benchmarkPax(size_t num_rows) {
+    const std::string bench_db = "bench_pax.dat";
+    const std::string bench_log = "bench_pax.log";
+    const std::string bench_input = "bench_pax.txt";
+    for (const auto& file : {bench_db, bench_log, bench_input, indexFilename(bench_db, "_hash.idx"),
+                             indexFilename(bench_db, "_hash.idx.dir"), indexFilename(bench_db, "_btree.idx"),
+                             indexFilename(bench_db, ".catalog")}) {
+        std::remove(file.c_str());
+    }
+    {
+        std::mt19937 gen(42);
+        std::uniform_int_distribution<int> key_distribution(1, 1000);
+        std::uniform_int_distribution<int> value_distribution(101, 999);
+        std::ofstream out(bench_input);
+        for (size_t i = 0; i < num_rows; ++i) {
+            out << key_distribution(gen) << " " << value_distribution(gen) << "\n";
+        }
+    }
+    BuzzDB db(bench_db, bench_log);
+    const std::vector<std::pair<std::string, PageLayout>> layouts = {
+        {"rows", PageLayout::ROW}, {"pax", PageLayout::PAX}};
+    for (const auto& [name, layout] : layouts) {
+        db.createTable(name, sales_schema, layout);
+        db.bulkLoad(name, bench_input, makeSalesTuple(0, 0));
+        db.analyze(name);
+    }
+
+    using clock = std::chrono::high_resolution_clock;
+    const size_t repetitions = 3;
+    // Fastest of the repetitions in ms, and the sum of the first column
+    auto run = [repetitions](Operator& root, double& checksum) {
+        double best = std::numeric_limits<double>::max();
+        for (size_t i = 0; i < repetitions; ++i) {
+            checksum = 0;
+            Batch batch;
+            auto start = clock::now();
+            root.open();
+            while (root.nextBatch(batch)) {
+                const ColumnVector& column = batch.columns[0];
+                checksum += std::accumulate(column.ints.begin(), column.ints.end(), 0.0);
+                checksum += std::accumulate(column.bigints.begin(), column.bigints.end(), 0.0);
+                checksum += std::accumulate(column.floats.begin(), column.floats.end(), 0.0);
+            }
+            root.close();
+            std::chrono::duration<double, std::milli> elapsed = clock::now() - start;
+            best = std::min(best, elapsed.count());
+        }
+        return best;
+    };
+
+    const std::vector<std::string> queries = {"SUM{2}", "SUM{3} GROUP BY {1}"};
+    std::cout << "\n=== Row vs PAX pages, " << num_rows << " sales, fastest of " << repetitions << " ===\n";
+    for (const auto& [name, layout] : layouts) {
+        Table& table = db.catalog.get(name);
+        std::cout << name << ": " << table.buffer_manager->getNumPages() << " pages\n";
+        for (const auto& query : queries) {
+            double checksum = 0;
+            double ms = run(*db.prepareQuery(query + " FROM " + name).plan.root, checksum);
+            std::cout << "  " << query << ": " << ms << " ms, " << num_rows / ms / 1000 << "M rows/s (" << checksum
+                      << ")\n";
+        }
+        ScanOperator scan(*table.buffer_manager, table.statistics);
+        double checksum = 0;
+        double ms = run(scan, checksum);
+        std::cout << "  all 4 attributes: " << ms << " ms, " << num_rows / ms / 1000 << "M rows/s (" << checksum
+                  << ")\n";
+    }
+}
+
+// A long insert/delete stream on a table of variable length rows, with
+// and without the background vacuum. Every round inserts rows and then
+// deletes as many random ones, after the first round which only inserts;
+// reports the pages, the time of a full scan and of the round after each.
+void benchmarkVacuum(size_t num_rows) {
+    const std::string bench_db = "bench_vacuum.dat";
+    const std::string bench_log = "bench_vacuum.log";
+    const size_t rounds = 10;
+    const size_t rows_per_round = std::max<size_t>(1, num_rows / rounds);
+    using clock = std::chrono::high_resolution_clock;
+
+    for (bool background : {false, true}) {
+        for (const auto& file : {bench_db, bench_log, indexFilename(bench_db, "_hash.idx"),
+                                 indexFilename(bench_db, "_hash.idx.dir"), indexFilename(bench_db, "_btree.idx"),
+                                 indexFilename(bench_db, ".catalog")}) {
+            std::remove(file.c_str());
+        }
+        BuzzDB db(bench_db, bench_log, 4096);
+        db.createTable("notes", Schema::parse("id:INT,text:STRING"));
+        BufferManager& pages = *db.catalog.get("notes").buffer_manager;
+        if (background) {
+            db.startVacuum();
+        }
+
+        std::cout << "\n=== " << (background ? "Background vacuum" : "No vacuum") << ", " << rounds << " rounds of "
+                  << rows_per_round << " inserts and deletes ===\n";
+        std::mt19937 gen(42);
+        std::uniform_int_distribution<size_t> length_distribution(1, 100);
+        std::vector<TupleID> live;
+        int next_id = 0;
+        for (size_t round = 0; round < rounds; ++round) {
+            auto start = clock::now();
+            for (size_t i = 0; i < rows_per_round; ++i) {
+                std::vector<std::unique_ptr<Field>> row;
+                row.push_back(std::make_unique<Field>(next_id));
+                row.push_back(std::make_unique<Field>(std::string(length_distribution(gen), 'a' + next_id % 26)));
+                next_id++;
+                live.push_back(db.insert("notes", std::move(row)));
+                if (round > 0) {
+                    std::uniform_int_distribution<size_t> victim(0, live.size() - 1);
+                    size_t index = victim(gen);
+                    db.remove("notes", live[index]);
+                    live[index] = live.back();
+                    live.pop_back();
+                }
+            }
+            std::chrono::duration<double, std::milli> workload = clock::now() - start;
+
+            size_t scanned = 0;
+            start = clock::now();
+            {
+                std::lock_guard<std::recursive_mutex> guard(db.latch);
+                ScanOperator scan(pages);
+                Batch batch;
+                scan.open();
+                while (scan.nextBatch(batch)) {
+                    scanned += batch.size();
+                }
+                scan.close();
+            }
+            std::chrono::duration<double, std::milli> scan_time = clock::now() - start;
+            std::cout << "round " << round << ": " << live.size() << " rows (" << scanned << " scanned) in "
+                      << pages.getNumPages() << " pages, " << pages.getNumPages() * PAGE_SIZE / 1024 << " KB; scan "
+                      << scan_time.count() << " ms, round " << workload.count() << " ms\n";
+        }
+        db.stopVacuum();
+        std::cout << "Vacuumed " << db.vacuumed_pages << " pages, reclaimed " << db.vacuumed_bytes / 1024 << " KB\n";
+    }
+}
+
+// Inserts into a table while 1-4 threads run an aggregation over it,
+// with the queries holding the database latch as before snapshots, and
+// on snapshots
+void benchmarkMvcc(size_t num_rows) {
+    const std::string bench_db = "bench_mvcc.dat";
+    const std::string bench_log = "bench_mvcc.log";
+    const std::string bench_input = "bench_mvcc.txt";
+    const std::string query = "SUM{2} FROM events";
+    const auto duration = std::chrono::seconds(2);
+    {
+        std::mt19937 gen(42);
+        std::uniform_int_distribution<int> distribution(1, 1000);
+        std::ofstream out(bench_input);
+        for (size_t i = 0; i < num_rows; ++i) {
+            out << distribution(gen) << " " << distribution(gen) << "\n";
+        }
+    }
+
+    std::cout << "\n=== " << num_rows << " rows, one inserting thread, " << query << " ===\n";
+    for (size_t readers : {0, 1, 2, 4}) {
+        for (bool snapshots : {false, true}) {
+            if (readers == 0 && snapshots) {
+                continue;
+            }
+            for (const auto& file : {bench_db, bench_log, indexFilename(bench_db, "_hash.idx"),
+                                     indexFilename(bench_db, "_hash.idx.dir"), indexFilename(bench_db, "_btree.idx"),
+                                     indexFilename(bench_db, ".catalog")}) {
+                std::remove(file.c_str());
+            }
+            BuzzDB db(bench_db, bench_log, 4096);
+            db.createTable("events", Schema::parse("key:INT,value:INT"));
+            db.bulkLoad("events", bench_input);
+            db.analyze("events");
+
+            std::atomic<bool> stop{false};
+            std::atomic<size_t> inserts{0};
+            std::atomic<size_t> queries{0};
+            std::vector<std::thread> threads;
+            threads.emplace_back([&]() {
+                std::mt19937 gen(7);
+                std::uniform_int_distribution<int> distribution(1, 1000);
+                while (!stop) {
+                    std::vector<std::unique_ptr<Field>> row;
+                    row.push_back(std::make_unique<Field>(distribution(gen)));
+                    row.push_back(std::make_unique<Field>(distribution(gen)));
+                    db.insert("events", std::move(row));
+                    inserts++;
+                }
+            });
+            for (size_t reader = 0; reader < readers; ++reader) {
+                threads.emplace_back([&]() {
+                    auto consume = [](const Batch&) {};
+                    while (!stop) {
+                        if (snapshots) {
+                            db.executeStatement(query, consume);
+                        } else {
+                            std::lock_guard<std::recursive_mutex> guard(db.latch);
+                            db.executeStatement(query, consume);
+                        }
+                        queries++;
+                    }
+                });
+            }
+            std::this_thread::sleep_for(duration);
+            stop = true;
+            for (auto& thread : threads) {
+                thread.join();
+            }
+            double seconds = std::chrono::duration<double>(duration).count();
+            std::cout << readers << " readers" << (readers ? (snapshots ? ", snapshots" : ", latched") : "")
+                      << ": " << inserts / seconds << " inserts/s, " << queries / seconds << " queries/s\n";
+        }
+    }
+}
+
+// The same sales in plain and compressed slotted and PAX tables: file
+// sizes, and the time of a full scan and SUM{2} with the pages cached by
+// the OS and after dropping them from the OS cache
+void benchmarkCompression(size_t num_rows) {
+    const std::string bench_db = "bench_compress.dat";
+    const std::string bench_log = "bench_compress.log";
+    const std::string bench_input = "bench_compress.txt";
+    for (const auto& file : {bench_db, bench_log, bench_input, indexFilename(bench_db, "_hash.idx"),
+                             indexFilename(bench_db, "_hash.idx.dir"), indexFilename(bench_db, "_btree.idx"),
+                             indexFilename(bench_db, ".catalog")}) {
+        std::remove(file.c_str());
+    }
+    {
+        std::mt19937 gen(42);
+        std::uniform_int_distribution<int> key_distribution(1, 1000);
+        std::uniform_int_distribution<int> value_distribution(101, 999);
+        std::ofstream out(bench_input);
+        for (size_t i = 0; i < num_rows; ++i) {
+            out << key_distribution(gen) << " " << value_distribution(gen) << "\n";
+        }
+    }
+    BuzzDB db(bench_db, bench_log);
+    struct Variant {
+        std::string name;
+        PageLayout layout;
+        bool compressed;
+    };
+    const std::vector<Variant> variants = {{"rows", PageLayout::ROW, false},
+                                           {"rows_lz", PageLayout::ROW, true},
+                                           {"pax", PageLayout::PAX, false},
+                                           {"pax_lz", PageLayout::PAX, true}};
+    for (const auto& variant : variants) {
+        db.createTable(variant.name, sales_schema, variant.layout, variant.compressed);
+        db.bulkLoad(variant.name, bench_input, makeSalesTuple(0, 0));
+        db.analyze(variant.name);
+    }
+
+    using clock = std::chrono::high_resolution_clock;
+    const size_t repetitions = 3;
+    // Fastest of the repetitions in ms; cold runs drop the file from the
+    // OS cache first
+    auto run = [&](Operator& root, BufferManager& pages, bool cold, double& checksum) {
+        double best = std::numeric_limits<double>::max();
+        for (size_t i = 0; i < repetitions; ++i) {
+            if (cold) {
+                pages.dropCache();
+            }
+            checksum = 0;
+            Batch batch;
+            auto start = clock::now();
+            root.open();
+            while (root.nextBatch(batch)) {
+                const ColumnVector& column = batch.columns[0];
+                checksum += std::accumulate(column.ints.begin(), column.ints.end(), 0.0);
+                checksum += std::accumulate(column.bigints.begin(), column.bigints.end(), 0.0);
+                checksum += std::accumulate(column.floats.begin(), column.floats.end(), 0.0);
+            }
+            root.close();
+            std::chrono::duration<double, std::milli> elapsed = clock::now() - start;
+            best = std::min(best, elapsed.count());
+        }
+        return best;
+    };
+
+    std::cout << "\n=== Plain vs compressed pages, " << num_rows << " sales, fastest of " << repetitions << " ===\n";
+    for (const auto& variant : variants) {
+        Table& table = db.catalog.get(variant.name);
+        BufferManager& pages = *table.buffer_manager;
+        pages.flushAll();
+        std::cout << variant.name << ": " << pages.getNumPages() << " pages, " << pages.getFileSize() / 1024
+                  << " KB\n";
+        for (bool cold : {false, true}) {
+            double checksum = 0;
+            double ms = run(*db.prepareQuery("SUM{2} FROM " + variant.name).plan.root, pages, cold, checksum);
+            std::cout << "  SUM{2} " << (cold ? "cold" : "warm") << ": " << ms << " ms (" << checksum << ")\n";
+            ScanOperator scan(pages, table.statistics);
+            ms = run(scan, pages, cold, checksum);
+            std::cout << "  scan " << (cold ? "cold" : "warm") << ": " << ms << " ms (" << checksum << ")\n";
+        }
+    }
+}
+
+// Aggregates over sales clustered by key in slotted and PAX tables, with
+// the aggregation above the scan and pushed into it, and a 1% key range
+// through a select and through page summaries
+void benchmarkPushdown(size_t num_rows) {
+    const std::string bench_db = "bench_pushdown.dat";
+    const std::string bench_log = "bench_pushdown.log";
+    const std::string bench_input = "bench_pushdown.txt";
+    for (const auto& file : {bench_db, bench_log, bench_input, indexFilename(bench_db, "_hash.idx"),
+                             indexFilename(bench_db, "_hash.idx.dir"), indexFilename(bench_db, "_btree.idx"),
+                             indexFilename(bench_db, ".catalog")}) {
+        std::remove(file.c_str());
+    }
+    {
+        std::mt19937 gen(42);
+        std::uniform_int_distribution<int> value_distribution(101, 999);
+        std::ofstream out(bench_input);
+        for (size_t i = 0; i < num_rows; ++i) {
+            out << 1 + i * 1000 / num_rows << " " << value_distribution(gen) << "\n";
+        }
+    }
+    BuzzDB db(bench_db, bench_log);
+    const std::vector<std::pair<std::string, PageLayout>> layouts = {
+        {"rows", PageLayout::ROW}, {"pax", PageLayout::PAX}};
+    for (const auto& [name, layout] : layouts) {
+        db.createTable(name, sales_schema, layout);
+        db.bulkLoad(name, bench_input, makeSalesTuple(0, 0));
+        db.analyze(name);
+    }
+
+    using clock = std::chrono::high_resolution_clock;
+    const size_t repetitions = 3;
+    // Time of the first run and fastest of the repetitions in ms, and the
+    // sum of the last column
+    auto run = [repetitions](Operator& root, double& first, double& checksum) {
+        double best = std::numeric_limits<double>::max();
+        for (size_t i = 0; i < repetitions; ++i) {
+            checksum = 0;
+            Batch batch;
+            auto start = clock::now();
+            root.open();
+            while (root.nextBatch(batch)) {
+                const ColumnVector& column = batch.columns.back();
+                checksum += std::accumulate(column.bigints.begin(), column.bigints.end(), 0.0);
+            }
+            root.close();
+            std::chrono::duration<double, std::milli> elapsed = clock::now() - start;
+            first = (i == 0) ? elapsed.count() : first;
+            best = std::min(best, elapsed.count());
+        }
+        return best;
+    };
+
+    // key and value; SUM{2}, SUM{2} GROUP BY {1} and SUM{2} WHERE {1} >= 500 and {1} <= 509
+    const std::vector<size_t> attributes = {0, 1};
+    const std::vector<AggrFunc> sum = {{AggrFuncType::SUM, 1}};
+    const int lower = 500;
+    const int upper = 509;
+    std::cout << "\n=== Aggregation in and above the scan, " << num_rows << " sales, fastest of " << repetitions
+              << " ===\n";
+    for (const auto& [name, layout] : layouts) {
+        Table& table = db.catalog.get(name);
+        BufferManager& pages = *table.buffer_manager;
+        std::cout << name << ": " << pages.getNumPages() << " pages\n";
+        double first = 0;
+        double checksum = 0;
+        for (bool grouped : {false, true}) {
+            std::vector<size_t> group_by = grouped ? std::vector<size_t>{0} : std::vector<size_t>{};
+            std::string query = grouped ? "SUM{2} GROUP BY {1}" : "SUM{2}";
+            ScanOperator scan(pages, table.statistics, attributes);
+            HashAggregationOperator aggregation(scan, group_by, sum);
+            double ms = run(aggregation, first, checksum);
+            std::cout << "  " << query << " above: " << ms << " ms (" << checksum << ")\n";
+
+            ScanOperator pushed_scan(pages, table.statistics, attributes);
+            pushed_scan.pushAggregation(group_by, sum, {INT});
+            std::vector<size_t> keys(group_by.size());
+            std::iota(keys.begin(), keys.end(), 0);
+            HashAggregationOperator merge(pushed_scan, keys, ScanOperator::mergeFunctions(sum, keys.size()));
+            ms = run(merge, first, checksum);
+            std::cout << "  " << query << " pushed: " << ms << " ms (" << checksum << ")\n";
+        }
+
+        ScanOperator scan(pages, table.statistics, attributes);
+        SelectOperator select(scan, makeRangePredicate(0, lower - 1, upper + 1));
+        HashAggregationOperator aggregation(select, {}, sum);
+        double ms = run(aggregation, first, checksum);
+        std::cout << "  SUM{2} WHERE 1% above: " << ms << " ms (" << checksum << ")\n";
+
+        ScanOperator pushed_scan(pages, table.statistics, attributes);
+        pushed_scan.setBounds(makeRangePredicate(0, lower - 1, upper + 1)->getBounds());
+        pushed_scan.pushAggregation({}, sum, {INT}, makeRangePredicate(0, lower - 1, upper + 1));
+        HashAggregationOperator merge(pushed_scan, {}, ScanOperator::mergeFunctions(sum, 0));
+        ms = run(merge, first, checksum);
+        std::cout << "  SUM{2} WHERE 1% pushed: " << ms << " ms, first run " << first << " ms, "
+                  << pushed_scan.getSkippedPages() << " pages skipped (" << checksum << ")\n";
+    }
+}
+
+// Approximate vs exact answers over sales with skewed keys, after
+// inserts and deletes the samples follow: latency, relative error, and
+// how often the 95% confidence interval holds the exact value
+void benchmarkApproximation(size_t num_rows) {
+    const std::string bench_db = "bench_approx.dat";
+    const std::string bench_log = "bench_approx.log";
+    const std::string bench_input = "bench_approx.txt";
+    for (const auto& file : {bench_db, bench_log, bench_input, indexFilename(bench_db, "_hash.idx"),
+                             indexFilename(bench_db, "_hash.idx.dir"), indexFilename(bench_db, "_btree.idx"),
+                             indexFilename(bench_db, ".catalog")}) {
+        std::remove(file.c_str());
+    }
+    // Keys 1-1000, the low ones far more frequent
+    std::mt19937 gen(42);
+    std::uniform_real_distribution<double> unit(0.0, 1.0);
+    std::uniform_int_distribution<int> value_distribution(101, 999);
+    auto key = [&]() {
+        double u = unit(gen);
+        return 1 + static_cast<int>(1000 * u * u * u);
+    };
+    {
+        std::ofstream out(bench_input);
+        for (size_t i = 0; i < num_rows; ++i) {
+            out << key() << " " << value_distribution(gen) << "\n";
+        }
+    }
+    BuzzDB db(bench_db, bench_log, 4096);
+    db.createTable("skewed", sales_schema);
+    db.bulkLoad("skewed", bench_input, makeSalesTuple(0, 0));
+    db.analyze("skewed");
+    Table& table = db.catalog.get("skewed");
+    for (size_t i = 0; i < num_rows / 50; ++i) {
+        db.insert("skewed", std::move(makeSalesTuple(key(), value_distribution(gen))->fields));
+        db.remove("skewed", makeTupleID(gen() % table.buffer_manager->getNumPages(), gen() % 26));
+    }
+    db.commit();
+
+    using clock = std::chrono::high_resolution_clock;
+    const size_t repetitions = 3;
+    // Group key (0 without GROUP BY) -> (value, error) of a query, and
+    // its fastest time of the repetitions in ms
+    auto run = [&db, repetitions](const std::string& query, bool grouped, double& ms) {
+        std::map<int, std::pair<double, double>> result;
+        ms = std::numeric_limits<double>::max();
+        for (size_t i = 0; i < repetitions; ++i) {
+            result.clear();
+            auto start = clock::now();
+            db.executeQuery(parseQuery(query), [&result, grouped](const Batch& batch) {
+                size_t column = grouped ? 1 : 0;
+                for (size_t row = 0; row < batch.size(); ++row) {
+                    auto value = [&batch, row](size_t i) {
+                        return ColumnStatistics::numericValue(batch.columns[i].getField(row));
+                    };
+                    result[grouped ? batch.columns[0].ints[row] : 0] = {
+                        value(column), (column + 1 < batch.columns.size()) ? value(column + 1) : 0.0};
+                }
+            });
+            std::chrono::duration<double, std::milli> elapsed = clock::now() - start;
+            ms = std::min(ms, elapsed.count());
+        }
+        return result;
+    };
+
+    // AVG is exactly SUM / COUNT
+    struct Query {
+        std::string aggregate;
+        std::string clauses;
+        bool grouped;
+    };
+    const std::vector<Query> queries = {
+        {"COUNT{2}", " WHERE {2} > 500 and {2} < 600", false},
+        {"SUM{2}", "", false},
+        {"AVG{2}", " WHERE {1} > 500", false},
+        {"SUM{2}", " GROUP BY {1}", true},
+        {"AVG{2}", " GROUP BY {1}", true}};
+    std::cout << "\n=== Approximate vs exact aggregates, " << num_rows << " sales with skewed keys, "
+              << num_rows / 50 << " inserts and deletes since ANALYZE, fastest of " << repetitions << " ===\n";
+    for (const auto& query : queries) {
+        const std::string from = " FROM skewed" + query.clauses;
+        double exact_ms = 0;
+        std::map<int, std::pair<double, double>> exact;
+        if (query.aggregate == "AVG{2}") {
+            double count_ms = 0;
+            exact = run("SUM{2}" + from, query.grouped, exact_ms);
+            auto counts = run("COUNT{2}" + from, query.grouped, count_ms);
+            exact_ms += count_ms;
+            for (auto& [group, value] : exact) {
+                value.first /= counts[group].first;
+            }
+        } else {
+            exact = run(query.aggregate + from, query.grouped, exact_ms);
+        }
+        double approx_ms = 0;
+        auto approx = run("APPROX " + query.aggregate + from, query.grouped, approx_ms);
+
+        double error_sum = 0;
+        double error_max = 0;
+        size_t covered = 0;
+        for (const auto& [group, value] : exact) {
+            auto estimate = approx.find(group);
+            double error = 1;
+            if (estimate != approx.end()) {
+                double difference = std::abs(estimate->second.first - value.first);
+                error = difference / std::abs(value.first);
+                // Estimates are FLOATs
+                covered += difference <= estimate->second.second + 1e-6 * std::abs(value.first);
+            }
+            error_sum += error;
+            error_max = std::max(error_max, error);
+        }
+        std::cout << query.aggregate << from.substr(12) << ": exact " << exact_ms << " ms, approx " << approx_ms
+                  << " ms, " << approx.size() << "/" << exact.size() << " groups, mean error "
+                  << 100 * error_sum / exact.size() << "%, max " << 100 * error_max << "%, "
+                  << 100.0 * covered / exact.size() << "% within the interval\n";
+    }
+}
+
+// Rows/s of inserting sales through insertBatch() and through
+// insertParallel() on 1-8 threads, into the sales table (three indexes
+// and the statistics to maintain) and into a table without indexes
+void benchmarkParallelInsert(size_t num_rows) {
+    const std::string bench_db = "bench_ingest.dat";
+    const std::string bench_log = "bench_ingest.log";
+    std::vector<std::pair<int, int>> rows(num_rows);
+    std::mt19937 gen(42);
+    std::uniform_int_distribution<int> key_distribution(1, 1000);
+    std::uniform_int_distribution<int> value_distribution(101, 999);
+    for (auto& row : rows) {
+        row = {key_distribution(gen), value_distribution(gen)};
+    }
+    auto reset = [&]() {
+        for (const auto& file : {bench_db, bench_log, indexFilename(bench_db, "_hash.idx"),
+                                 indexFilename(bench_db, "_hash.idx.dir"), indexFilename(bench_db, "_btree.idx"),
+                                 indexFilename(bench_db, ".catalog"), indexFilename(bench_db, "_plain.dat")}) {
+            std::remove(file.c_str());
+        }
+    };
+    using clock = std::chrono::high_resolution_clock;
+    auto perSecond = [num_rows](clock::time_point start) {
+        std::chrono::duration<double> elapsed = clock::now() - start;
+        return static_cast<size_t>(num_rows / elapsed.count());
+    };
+
+    std::cout << "\n=== Inserts of " << num_rows << " sales, rows/s ===\n";
+    reset();
+    {
+        BuzzDB db(bench_db, bench_log, PARALLEL_INSERT_BATCH);
+        auto start = clock::now();
+        db.insertBatch(rows);
+        db.commit();
+        std::cout << "insertBatch, sales: " << perSecond(start) << "\n";
+    }
+    for (size_t threads : {1, 2, 4, 8}) {
+        reset();
+        BuzzDB db(bench_db, bench_log);
+        db.createTable("plain", sales_schema);
+        auto start = clock::now();
+        db.insertParallel(sales_table, rows, threads);
+        size_t sales = perSecond(start);
+        start = clock::now();
+        db.insertParallel("plain", rows, threads, makeSalesTuple(0, 0));
+        size_t plain = perSecond(start);
+        std::cout << "insertParallel, " << threads << " threads: sales " << sales << ", without indexes " << plain
+                  << " (" << db.catalog.get("plain").buffer_manager->getNumPages() << " pages)\n";
+    }
+    reset();
+}
+
+int main(int argc, char* argv[]) {
+
+    std::string mode = (argc > 1) ? argv[1] : "";
+    if (mode == "bench-wal") {
+        benchmarkDurableInserts((argc > 2) ? std::stoul(argv[2]) : 10000);
+        return 0;
+    }
+    if (mode == "bench-hash") {
+        benchmarkHashIndex((argc > 2) ? std::stoul(argv[2]) : 4000000);
+        return 0;
+    }
+    if (mode == "bench-btree") {
+        benchmarkBTreeIndex((argc > 2) ? std::stoul(argv[2]) : 1000000);
+        return 0;
+    }
+    if (mode == "bench-learned") {
+        benchmarkLearnedIndex((argc > 2) ? argv[2] : "");
+        return 0;
+    }
+    if (mode == "bench-batch") {
+        benchmarkBatchExecution((argc > 2) ? std::stoul(argv[2]) : 1000000);
+        return 0;
+    }
+    if (mode == "bench-agg") {
+        benchmarkAggregation((argc > 2) ? std::stoul(argv[2]) : 4000000);
+        return 0;
+    }
+    if (mode == "bench-view") {
+        benchmarkViewMaintenance((argc > 2) ? std::stoul(argv[2]) : 1000000);
+        return 0;
+    }
+    if (mode == "bench-join") {
+        benchmarkJoins((argc > 2) ? std::stoul(argv[2]) : 1000000);
+        return 0;
+    }
+    if (mode == "bench-sort") {
+        benchmarkSort((argc > 2) ? std::stoul(argv[2]) : 1000000);
+        return 0;
+    }
+    if (mode == "bench-parse") {
+        benchmarkQueryPreparation((argc > 2) ? std::stoul(argv[2]) : 100000);
+        return 0;
+    }
+    if (mode == "bench-pax") {
+        benchmarkPax((argc > 2) ? std::stoul(argv[2]) : 1000000);
+        return 0;
+    }
+    if (mode == "bench-vacuum") {
+        benchmarkVacuum((argc > 2) ? std::stoul(argv[2]) : 200000);
+        return 0;
+    }
+    if (mode == "bench-mvcc") {
+        benchmarkMvcc((argc > 2) ? std::stoul(argv[2]) : 200000);
+        return 0;
+    }
+    if (mode == "bench-compress") {
+        benchmarkCompression((argc > 2) ? std::stoul(argv[2]) : 1000000);
+        return 0;
+    }
+    if (mode == "bench-pushdown") {
+        benchmarkPushdown((argc > 2) ? std::stoul(argv[2]) : 1000000);
+        return 0;
+    }
+    if (mode == "bench-approx") {
+        benchmarkApproximation((argc > 2) ? std::stoul(argv[2]) : 1000000);
+        return 0;
+    }
+    if (mode == "bench-ingest") {
+        benchmarkParallelInsert((argc > 2) ? std::stoul(argv[2]) : 1000000);
+        return 0;
+    }
+    if (mode == "bench-alloc") {
+        benchmarkAllocations((argc > 2) ? std::stoul(argv[2]) : 1000000);
+        return 0;
+    }
+    if (mode == "analyze") {
+        BuzzDB db;
+        db.executeStatement("ANALYZE");
+        return 0;
+    }
+    if (mode == "load") {
+        BuzzDB db;
+        auto start = std::chrono::high_resolution_clock::now();
+        db.bulkLoad((argc > 2) ? argv[2] : "output.txt");
+        auto end = std::chrono::high_resolution_clock::now();
+        std::cout << "Bulk load time: "
+                  << std::chrono::duration_cast<std::chrono::milliseconds>(end - start).count()
+                  << " ms" << std::endl;
+
+        std::cout << "sum_by_key:\n";
+        for (const auto& tuple : db.view_manager.getView("sum_by_key")->getData()) {
+            tuple->print();
+        }
+        return 0;
+    }
 
     BuzzDB db;
 
@@ -1,8 +1,9 @@
 #include <fstream>
 #include <random>
 #include <iostream>
+#include <cstdlib>
 
-int main() {
+int main(int argc, char* argv[]) {
     std::random_device rd;
     std::mt19937 gen(rd());
 
@@ -10,7 +11,8 @@ int main() {
     std::uniform_int_distribution<int> amountDistribution(101, 999);
     std::discrete_distribution<int> customerDistribution({40, 20, 10, 10, 5, 5, 5, 3, 2});
 
-    int number_of_sales = 10 * 1000;
+    // Number of sales can be passed as the first argument
+    int number_of_sales = (argc > 1) ? std::atoi(argv[1]) : 10 * 1000;
 
     std::ofstream outputFile("output.txt");
     if (outputFile.is_open()) {
@@ -6,13 +6,25 @@
 
 void LinearRegression::fit(const std::vector<double>& X, const std::vector<double>& y) {
     double n = X.size();
-    double sum_X = std::accumulate(X.begin(), X.end(), 0.0);
-    double sum_y = std::accumulate(y.begin(), y.end(), 0.0);
-    double sum_XY = std::inner_product(X.begin(), X.end(), y.begin(), 0.0);
-    double sum_X2 = std::inner_product(X.begin(), X.end(), X.begin(), 0.0);
+    if (n == 0) {
+        slope = 0;
+        intercept = 0;
+        return;
+    }
+    double mean_X = std::accumulate(X.begin(), X.end(), 0.0) / n;
+    double mean_y = std::accumulate(y.begin(), y.end(), 0.0) / n;
+
+    // Centered sums: the raw sum_X2 * n - sum_X^2 form cancels badly for
+    // large keys, and RMI leaf models may see a single distinct key.
+    double covariance = 0;
+    double variance = 0;
+    for (size_t i = 0; i < X.size(); ++i) {
+        covariance += (X[i] - mean_X) * (y[i] - mean_y);
+        variance += (X[i] - mean_X) * (X[i] - mean_X);
+    }
 
-    slope = (n * sum_XY - sum_X * sum_y) / (n * sum_X2 - sum_X * sum_X);
-    intercept = (sum_y - slope * sum_X) / n;
+    slope = variance == 0 ? 0 : covariance / variance;
+    intercept = mean_y - slope * mean_X;
 }
 
 double LinearRegression::predict(double x) const {
@@ -3,8 +3,14 @@
 #include <chrono>
 #include <random>
 #include <iomanip>
+#include <algorithm>
+#include <functional>
+#include <string>
+#include <climits>
 #include "binary_search.h"
 #include "learned_index.h"
+#include "rmi.h"
+#include "pgm_index.h"
 
 std::vector<int> generate_random_data(int size, int max_value) {
     std::vector<int> data(size);
@@ -20,75 +26,202 @@ std::vector<int> generate_random_data(int size, int max_value) {
     return data;
 }
 
-int main() {
-    const int DATA_SIZE = 1000000;
-    const int MAX_VALUE = 2000000;
-    const int NUM_SEARCHES = 1000;
+// Heavily skewed keys: dense near the low end, sparse in a long tail.
+std::vector<int> generate_lognormal_data(int size, int max_value) {
+    std::vector<int> data(size);
+    std::random_device rd;
+    std::mt19937 gen(rd());
+    std::lognormal_distribution<> dis(0.0, 2.0);
 
-    std::vector<int> data = generate_random_data(DATA_SIZE, MAX_VALUE);
-    LearnedIndex learned_index(data);
+    for (int& num : data) {
+        double value = dis(gen) * (max_value / 1000.0);
+        num = static_cast<int>(std::min(value, static_cast<double>(INT_MAX)));
+    }
 
-    std::vector<int> search_keys = generate_random_data(NUM_SEARCHES, MAX_VALUE);
+    std::sort(data.begin(), data.end());
+    return data;
+}
 
-    // Learned Index Search
-    int learned_total_ops = 0;
-    int learned_search_not_found = 0;
-    auto learned_start = std::chrono::high_resolution_clock::now();
+// Runs every key through search(key, ops) and prints the usual stats.
+void report(const std::string& name, const std::vector<int>& search_keys,
+            const std::function<int(int, int&)>& search) {
+    long long total_ops = 0;
+    int not_found = 0;
+    auto start = std::chrono::high_resolution_clock::now();
 
     for (int key : search_keys) {
-        int pos = learned_index.search(key, "binary");
-        if(pos == -1){
-            learned_search_not_found++;
+        int ops = 0;
+        int pos = search(key, ops);
+        if (pos == -1) {
+            not_found++;
         }
+        total_ops += ops;
+    }
+
+    auto end = std::chrono::high_resolution_clock::now();
+    std::chrono::duration<double, std::milli> duration = end - start;
+
+    int num_searches = search_keys.size();
+    std::cout << name << ":" << std::endl;
+    std::cout << "  Total operations: " << total_ops << std::endl;
+    std::cout << "  Avg operations per search: " << static_cast<double>(total_ops) / num_searches << std::endl;
+    std::cout << "  Total time: " << duration.count() << " ms" << std::endl;
+    std::cout << "  Avg time per search: " << duration.count() * 1e6 / num_searches << " ns" << std::endl;
+    std::cout << "  Search not found: " << not_found << std::endl;
+    std::cout << std::endl;
+}
+
+void compare(const std::string& dataset, const std::vector<int>& data, int num_searches) {
+    LearnedIndex learned_index(data);
+    RecursiveModelIndex rmi2(data, {1, 1000});
+    RecursiveModelIndex rmi3(data, {1, 100, 10000});
+    PgmIndex pgm16(data, 16);
+    PgmIndex pgm64(data, 64);
 
-        learned_total_ops += learned_index.operations;
+    // Half of the lookups hit stored keys, half are drawn from the key range
+    std::mt19937 gen(42);
+    std::uniform_int_distribution<> pick(0, data.size() - 1);
+    std::uniform_int_distribution<> any(data.front(), data.back());
+    std::vector<int> search_keys(num_searches);
+    for (int i = 0; i < num_searches; ++i) {
+        search_keys[i] = i % 2 == 0 ? data[pick(gen)] : any(gen);
     }
 
-    auto learned_end = std::chrono::high_resolution_clock::now();
-    std::chrono::duration<double, std::milli> learned_duration = learned_end - learned_start;
+    std::cout << "=== " << dataset << " keys, data size: " << data.size()
+              << ", searches performed: " << num_searches << " ===" << std::endl;
+    std::cout << "RMI {1, 1000}: " << rmi2.model_size() << " bytes of models, mean search window "
+              << rmi2.mean_search_window() << std::endl;
+    std::cout << "RMI {1, 100, 10000}: " << rmi3.model_size() << " bytes of models, mean search window "
+              << rmi3.mean_search_window() << std::endl;
+    std::cout << "PGM-index epsilon 16: " << pgm16.num_segments() << " segments, " << pgm16.num_levels()
+              << " levels, " << pgm16.index_size() << " bytes" << std::endl;
+    std::cout << "PGM-index epsilon 64: " << pgm64.num_segments() << " segments, " << pgm64.num_levels()
+              << " levels, " << pgm64.index_size() << " bytes" << std::endl;
+    std::cout << std::endl;
 
-    // Binary Search
-    int binary_total_ops = 0;
-    int bin_search_not_found = 0;
-    auto binary_start = std::chrono::high_resolution_clock::now();
+    report("Binary Search", search_keys, [&](int key, int& ops) {
+        return binary_search(data, key, ops);
+    });
+    report("Learned Index (Simple linear regression + linear search)", search_keys, [&](int key, int& ops) {
+        int pos = learned_index.search(key, "linear");
+        ops = learned_index.operations;
+        return pos;
+    });
+    report("Learned Index (Simple linear regression + binary search)", search_keys, [&](int key, int& ops) {
+        int pos = learned_index.search(key, "binary");
+        ops = learned_index.operations;
+        return pos;
+    });
+    report("RMI {1, 1000} + binary search", search_keys, [&](int key, int& ops) {
+        int pos = rmi2.search(key, "binary");
+        ops = rmi2.operations;
+        return pos;
+    });
+    report("RMI {1, 1000} + exponential search", search_keys, [&](int key, int& ops) {
+        int pos = rmi2.search(key, "exponential");
+        ops = rmi2.operations;
+        return pos;
+    });
+    report("RMI {1, 100, 10000} + binary search", search_keys, [&](int key, int& ops) {
+        int pos = rmi3.search(key, "binary");
+        ops = rmi3.operations;
+        return pos;
+    });
+    report("RMI {1, 100, 10000} + exponential search", search_keys, [&](int key, int& ops) {
+        int pos = rmi3.search(key, "exponential");
+        ops = rmi3.operations;
+        return pos;
+    });
+    report("PGM-index epsilon 16", search_keys, [&](int key, int& ops) {
+        int pos = pgm16.search(key);
+        ops = pgm16.operations;
+        return pos;
+    });
+    report("PGM-index epsilon 64", search_keys, [&](int key, int& ops) {
+        int pos = pgm64.search(key);
+        ops = pgm64.operations;
+        return pos;
+    });
+}
 
+double time_searches(const std::vector<int>& search_keys, const std::function<int(int)>& search,
+                     int& not_found) {
+    not_found = 0;
+    auto start = std::chrono::high_resolution_clock::now();
     for (int key : search_keys) {
-        int ops;
-        int pos = binary_search(data, key, ops);
-        if(pos == 1){
-            bin_search_not_found++;
+        if (search(key) == -1) {
+            not_found++;
+        }
+    }
+    auto end = std::chrono::high_resolution_clock::now();
+    std::chrono::duration<double, std::nano> duration = end - start;
+    return duration.count() / search_keys.size();
+}
+
+// Space and lookup latency of binary search, the single regression and the
+// PGM-index as the number of (uniform) keys grows. Only stored keys are
+// looked up, so every "not found" is a miss of the index itself.
+void compare_scaling(const std::vector<int>& sizes, int num_searches) {
+    std::cout << "Keys | Index | Index bytes | ns per search | Not found" << std::endl;
+    for (int size : sizes) {
+        std::vector<int> data = generate_random_data(size, 2 * size);
+        std::mt19937 gen(42);
+        std::uniform_int_distribution<> pick(0, size - 1);
+        std::vector<int> search_keys(num_searches);
+        for (int& key : search_keys) {
+            key = data[pick(gen)];
+        }
+
+        int not_found;
+        double ns = time_searches(search_keys, [&](int key) {
+            int ops;
+            return binary_search(data, key, ops);
+        }, not_found);
+        std::cout << size << " | Binary search | 0 | " << ns << " | " << not_found << std::endl;
+
+        {
+            LearnedIndex learned_index(data);
+            ns = time_searches(search_keys, [&](int key) {
+                return learned_index.search(key, "binary");
+            }, not_found);
+            std::cout << size << " | Linear regression + binary search | " << sizeof(LinearRegression)
+                      << " | " << ns << " | " << not_found << std::endl;
+        }
+
+        for (int epsilon : {16, 64, 256}) {
+            PgmIndex pgm(data, epsilon);
+            ns = time_searches(search_keys, [&](int key) {
+                return pgm.search(key);
+            }, not_found);
+            std::cout << size << " | PGM-index epsilon " << epsilon << " (" << pgm.num_segments()
+                      << " segments, " << pgm.num_levels() << " levels) | " << pgm.index_size()
+                      << " | " << ns << " | " << not_found << std::endl;
         }
-        binary_total_ops += ops;
     }
+}
 
-    auto binary_end = std::chrono::high_resolution_clock::now();
-    std::chrono::duration<double, std::milli> binary_duration = binary_end - binary_start;
+int main(int argc, char* argv[]) {
+    const int DATA_SIZE = 1000000;
+    const int MAX_VALUE = 2000000;
+    const int NUM_SEARCHES = 100000;
 
-    // Print results
     std::cout << std::fixed << std::setprecision(2);
-    std::cout << "Comparison of Learned Index vs Binary Search" << std::endl;
-    std::cout << "Data size: " << DATA_SIZE << ", Searches performed: " << NUM_SEARCHES << std::endl;
-    std::cout << std::endl;
-    std::cout << "Learned Index (Simple linear regression + linear search):" << std::endl;
-    std::cout << "  Total operations: " << learned_total_ops << std::endl;
-    std::cout << "  Avg operations per search: " << static_cast<double>(learned_total_ops) / NUM_SEARCHES << std::endl;
-    std::cout << "  Total time: " << learned_duration.count() << " ms" << std::endl;
-    std::cout << "  Avg time per search: " << learned_duration.count() / NUM_SEARCHES << " ms" << std::endl;
-    std::cout << "  Search not found: " << learned_search_not_found << std::endl;
-    std::cout << std::endl;
-    std::cout << "Learned Index (Simple linear regression + binary search):" << std::endl;
-    std::cout << "  Total operations: " << learned_total_ops << std::endl;
-    std::cout << "  Avg operations per search: " << static_cast<double>(learned_total_ops) / NUM_SEARCHES << std::endl;
-    std::cout << "  Total time: " << learned_duration.count() << " ms" << std::endl;
-    std::cout << "  Avg time per search: " << learned_duration.count() / NUM_SEARCHES << " ms" << std::endl;
-    std::cout << "  Search not found: " << learned_search_not_found << std::endl;
+    // ./learned_index_program scale [max keys]: 1M, 10M, 100M keys by default
+    if (argc > 1 && std::string(argv[1]) == "scale") {
+        int max_keys = argc > 2 ? std::stoi(argv[2]) : 100000000;
+        std::vector<int> sizes;
+        for (int size = 1000000; size <= max_keys; size *= 10) {
+            sizes.push_back(size);
+        }
+        compare_scaling(sizes, NUM_SEARCHES);
+        return 0;
+    }
+
+    std::cout << "Comparison of Learned Index, RMI, PGM-index and Binary Search" << std::endl;
     std::cout << std::endl;
-    std::cout << "Binary Search:" << std::endl;
-    std::cout << "  Total operations: " << binary_total_ops << std::endl;
-    std::cout << "  Avg operations per search: " << static_cast<double>(binary_total_ops) / NUM_SEARCHES << std::endl;
-    std::cout << "  Total time: " << binary_duration.count() << " ms" << std::endl;
-    std::cout << "  Avg time per search: " << binary_duration.count() / NUM_SEARCHES << " ms" << std::endl;
-    std::cout << "  Search not found: " << bin_search_not_found << std::endl;
+
+    compare("Uniform", generate_random_data(DATA_SIZE, MAX_VALUE), NUM_SEARCHES);
+    compare("Lognormal", generate_lognormal_data(DATA_SIZE, MAX_VALUE), NUM_SEARCHES);
 
     return 0;
-}
\ No newline at end of file
+}
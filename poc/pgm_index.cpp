@@ -0,0 +1,149 @@
+#include "pgm_index.h"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <stdexcept>
+
+PgmIndex::PgmIndex(const std::vector<int>& input_data, int epsilon, int recursive_epsilon)
+    : data(input_data), epsilon(epsilon), recursive_epsilon(recursive_epsilon), operations(0) {
+    if (epsilon < 0 || recursive_epsilon < 0) {
+        throw std::invalid_argument("PGM epsilon must not be negative");
+    }
+    if (data.empty()) {
+        return;
+    }
+
+    levels.push_back(build_level(data, epsilon));
+    while (levels.back().size() > 1) {
+        std::vector<int> keys(levels.back().size());
+        for (size_t i = 0; i < keys.size(); ++i) {
+            keys[i] = levels.back()[i].key;
+        }
+        levels.push_back(build_level(keys, recursive_epsilon));
+    }
+}
+
+// Shrinking cone: a segment is anchored at its first key and keeps the range
+// of slopes that still predict every key seen so far within +-epsilon. When
+// a key leaves that range the segment is closed and a new one starts there.
+// Duplicate keys are mapped to the position of their first copy.
+std::vector<PgmIndex::Segment> PgmIndex::build_level(const std::vector<int>& keys, int epsilon) {
+    std::vector<Segment> segments;
+    const double infinity = std::numeric_limits<double>::infinity();
+    Segment current{0, keys[0], 0};
+    double slope_low = 0;
+    double slope_high = infinity;
+
+    for (size_t i = 1; i < keys.size(); ++i) {
+        if (keys[i] == keys[i - 1]) {
+            continue;
+        }
+        double dx = static_cast<double>(keys[i]) - current.key;
+        double dy = static_cast<double>(i) - current.position;
+        double low = (dy - epsilon) / dx;
+        double high = (dy + epsilon) / dx;
+
+        if (low > slope_high || high < slope_low) {
+            current.slope = slope_high == infinity ? 0 : (slope_low + slope_high) / 2;
+            segments.push_back(current);
+            current = Segment{0, keys[i], static_cast<int>(i)};
+            slope_low = 0;
+            slope_high = infinity;
+        } else {
+            slope_low = std::max(slope_low, low);
+            slope_high = std::min(slope_high, high);
+        }
+    }
+
+    current.slope = slope_high == infinity ? 0 : (slope_low + slope_high) / 2;
+    segments.push_back(current);
+    return segments;
+}
+
+// Position predicted by a segment, clamped so it never passes the start of
+// the next segment. That keeps keys that fall in the gap after a segment's
+// last key within epsilon of their true position as well.
+int PgmIndex::predict(const std::vector<Segment>& level, size_t segment, int key, int size) {
+    const Segment& s = level[segment];
+    double predicted = s.position + s.slope * (static_cast<double>(key) - s.key);
+    double upper = segment + 1 < level.size() ? level[segment + 1].position : size - 1;
+    predicted = std::max(static_cast<double>(s.position), std::min(predicted, upper));
+    return static_cast<int>(std::lround(predicted));
+}
+
+/**
+ * @brief Search for a key in the PGM index.
+ *
+ * Starting at the single root segment, each level predicts the position of
+ * the covering segment in the level below and binary searches the
+ * 2 * epsilon + 3 slots around it. The bottom level does the same on the
+ * data.
+ *
+ * @param key The key to search for.
+ * @return The index of the element if found, -1 otherwise.
+ */
+int PgmIndex::search(int key) const {
+    operations = 0;
+    if (data.empty() || key < data.front()) {
+        return -1;
+    }
+
+    size_t segment = 0;
+    for (size_t level = levels.size() - 1; level > 0; --level) {
+        const std::vector<Segment>& below = levels[level - 1];
+        int size = below.size();
+        int pos = predict(levels[level], segment, key, size);
+        int left = std::max(0, pos - recursive_epsilon - 1);
+        int right = std::min(size - 1, pos + recursive_epsilon + 1);
+
+        // Last segment below whose first key is <= key
+        segment = left;
+        while (left <= right) {
+            ++operations;
+            int mid = left + (right - left) / 2;
+            if (below[mid].key <= key) {
+                segment = mid;
+                left = mid + 1;
+            } else {
+                right = mid - 1;
+            }
+        }
+    }
+
+    int size = data.size();
+    int pos = predict(levels[0], segment, key, size);
+    int left = std::max(0, pos - epsilon - 1);
+    int right = std::min(size - 1, pos + epsilon + 1);
+    while (left <= right) {
+        ++operations;
+        int mid = left + (right - left) / 2;
+
+        if (data[mid] == key) {
+            return mid;
+        }
+
+        if (data[mid] < key) {
+            left = mid + 1;
+        } else {
+            right = mid - 1;
+        }
+    }
+
+    return -1;
+}
+
+size_t PgmIndex::num_segments() const {
+    return levels.empty() ? 0 : levels[0].size();
+}
+
+size_t PgmIndex::num_levels() const {
+    return levels.size();
+}
+
+size_t PgmIndex::index_size() const {
+    size_t segments = 0;
+    for (const auto& level : levels) {
+        segments += level.size();
+    }
+    return segments * sizeof(Segment);
+}
@@ -0,0 +1,44 @@
+#ifndef PGM_INDEX_H
+#define PGM_INDEX_H
+
+#include <vector>
+#include <cstddef>
+
+// Piecewise-linear learned index in the style of the PGM-index. The keys are
+// covered by linear segments built in one pass so that every segment
+// predicts the position of each of its keys within +-epsilon. The first keys
+// of the segments are indexed the same way, level by level, until a single
+// segment remains. A lookup therefore does one small binary search of
+// O(log epsilon) steps per level and never misses a stored key.
+class PgmIndex {
+private:
+    struct Segment {
+        double slope;
+        int key;       // first key covered by the segment
+        int position;  // position of that key in the level below
+    };
+
+    std::vector<int> data;
+    // levels[0] covers data, levels.back() holds a single segment
+    std::vector<std::vector<Segment>> levels;
+    int epsilon;
+    int recursive_epsilon;
+
+    static std::vector<Segment> build_level(const std::vector<int>& keys, int epsilon);
+    static int predict(const std::vector<Segment>& level, size_t segment, int key, int size);
+
+public:
+    mutable int operations;
+
+    // epsilon bounds the error of the segments over the data;
+    // recursive_epsilon bounds the error of the upper levels.
+    PgmIndex(const std::vector<int>& input_data, int epsilon, int recursive_epsilon = 4);
+    int search(int key) const;
+
+    size_t num_segments() const;
+    size_t num_levels() const;
+    // Bytes used by the segments (the keys are not counted).
+    size_t index_size() const;
+};
+
+#endif // PGM_INDEX_H
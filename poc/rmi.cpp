@@ -0,0 +1,195 @@
+#include "rmi.h"
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+#include <string>
+
+// Clamps a (possibly wild) model output to a valid slot in [0, size).
+static int clamp_slot(double value, int size) {
+    if (!(value > 0)) {
+        return 0;
+    }
+    if (value >= size - 1) {
+        return size - 1;
+    }
+    return static_cast<int>(value);
+}
+
+RecursiveModelIndex::RecursiveModelIndex(const std::vector<int>& input_data,
+                                         const std::vector<int>& sizes)
+    : data(input_data), stage_sizes(sizes), mean_window(0), operations(0) {
+    if (stage_sizes.empty() || stage_sizes[0] != 1) {
+        throw std::invalid_argument("RMI needs a first stage with a single model");
+    }
+    for (int size : stage_sizes) {
+        if (size < 1) {
+            throw std::invalid_argument("RMI stage sizes must be positive");
+        }
+    }
+
+    int n = data.size();
+    // Model of the current stage that each key is routed to
+    std::vector<int> assignment(n, 0);
+
+    for (size_t s = 0; s < stage_sizes.size(); ++s) {
+        int size = stage_sizes[s];
+        std::vector<std::vector<double>> X(size);
+        std::vector<std::vector<double>> y(size);
+        for (int i = 0; i < n; ++i) {
+            X[assignment[i]].push_back(data[i]);
+            y[assignment[i]].push_back(i);
+        }
+
+        stages.emplace_back(size);
+        for (int m = 0; m < size; ++m) {
+            stages[s][m].fit(X[m], y[m]);
+        }
+
+        if (s + 1 < stage_sizes.size()) {
+            double scale = static_cast<double>(stage_sizes[s + 1]) / std::max(n, 1);
+            for (int i = 0; i < n; ++i) {
+                double predicted = stages[s][assignment[i]].predict(data[i]);
+                assignment[i] = clamp_slot(predicted * scale, stage_sizes[s + 1]);
+            }
+        }
+    }
+
+    // Record the error range of every leaf model over the keys it serves
+    int leaves = stage_sizes.back();
+    bounds.assign(leaves, ErrorBounds{0, 0});
+    std::vector<bool> seen(leaves, false);
+    for (int i = 0; i < n; ++i) {
+        int predicted_pos;
+        int leaf = route(data[i], predicted_pos);
+        int error = i - predicted_pos;
+        if (!seen[leaf]) {
+            bounds[leaf] = ErrorBounds{error, error};
+            seen[leaf] = true;
+        } else {
+            bounds[leaf].min_error = std::min(bounds[leaf].min_error, error);
+            bounds[leaf].max_error = std::max(bounds[leaf].max_error, error);
+        }
+    }
+
+    double total_window = 0;
+    for (int i = 0; i < n; ++i) {
+        int predicted_pos;
+        const ErrorBounds& b = bounds[route(data[i], predicted_pos)];
+        total_window += b.max_error - b.min_error + 1;
+    }
+    mean_window = n > 0 ? total_window / n : 0;
+}
+
+// Walks the stages for a key; returns the leaf model and its predicted position.
+int RecursiveModelIndex::route(int key, int& predicted_pos) const {
+    int n = data.size();
+    int model = 0;
+    double predicted = 0;
+    for (size_t s = 0; s < stages.size(); ++s) {
+        predicted = stages[s][model].predict(key);
+        if (s + 1 < stages.size()) {
+            double scale = static_cast<double>(stage_sizes[s + 1]) / std::max(n, 1);
+            model = clamp_slot(predicted * scale, stage_sizes[s + 1]);
+        }
+    }
+    predicted_pos = clamp_slot(std::round(predicted), std::max(n, 1));
+    return model;
+}
+
+int RecursiveModelIndex::binary_search(int key, int left, int right) const {
+    while (left <= right) {
+        ++operations;
+        int mid = left + (right - left) / 2;
+
+        if (data[mid] == key) {
+            return mid;
+        }
+
+        if (data[mid] < key) {
+            left = mid + 1;
+        } else {
+            right = mid - 1;
+        }
+    }
+
+    return -1;
+}
+
+// Gallops away from the prediction in doubling steps until the key is
+// bracketed, then binary searches the bracket. Cheaper than a plain binary
+// search when the prediction is close, never leaves [left, right].
+int RecursiveModelIndex::exponential_search(int key, int pos, int left, int right) const {
+    ++operations;
+    if (data[pos] == key) {
+        return pos;
+    }
+
+    int step = 1;
+    if (data[pos] < key) {
+        int low = pos + 1;
+        while (pos + step <= right) {
+            ++operations;
+            if (data[pos + step] >= key) {
+                break;
+            }
+            low = pos + step + 1;
+            step *= 2;
+        }
+        return binary_search(key, low, std::min(right, pos + step));
+    }
+
+    int high = pos - 1;
+    while (pos - step >= left) {
+        ++operations;
+        if (data[pos - step] <= key) {
+            break;
+        }
+        high = pos - step - 1;
+        step *= 2;
+    }
+    return binary_search(key, std::max(left, pos - step), high);
+}
+
+/**
+ * @brief Search for a key in the recursive model index.
+ *
+ * The key is routed through the stages to a leaf model, whose prediction
+ * plus the leaf's recorded error bounds gives a window that is guaranteed to
+ * contain every stored copy of the key.
+ *
+ * @param key The key to search for.
+ * @param type "binary" or "exponential" last-mile search within the window.
+ * @return The index of the element if found, -1 otherwise.
+ */
+int RecursiveModelIndex::search(int key, std::string type) const {
+    operations = 0;
+    if (data.empty()) {
+        return -1;
+    }
+
+    int pos;
+    const ErrorBounds& b = bounds[route(key, pos)];
+    int last = static_cast<int>(data.size()) - 1;
+    int left = std::max(0, pos + b.min_error);
+    int right = std::min(last, pos + b.max_error);
+    if (left > right) {
+        return -1;
+    }
+
+    if (type == "exponential") {
+        return exponential_search(key, std::max(left, std::min(pos, right)), left, right);
+    }
+    return binary_search(key, left, right);
+}
+
+size_t RecursiveModelIndex::model_size() const {
+    size_t models = 0;
+    for (const auto& stage : stages) {
+        models += stage.size();
+    }
+    return models * sizeof(LinearRegression) + bounds.size() * sizeof(ErrorBounds);
+}
+
+double RecursiveModelIndex::mean_search_window() const {
+    return mean_window;
+}
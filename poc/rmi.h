@@ -0,0 +1,44 @@
+#ifndef RMI_H
+#define RMI_H
+
+#include <vector>
+#include <string>
+#include "learned_index.h"
+
+// Recursive model index. Stage 0 is one linear model over the whole key
+// space; every later stage picks one of its models from the position the
+// previous stage predicted. The leaf models remember the smallest and
+// largest position error they made at build time, so the last-mile search
+// only looks inside [prediction + min_error, prediction + max_error].
+class RecursiveModelIndex {
+private:
+    struct ErrorBounds {
+        int min_error;
+        int max_error;
+    };
+
+    std::vector<int> data;
+    std::vector<int> stage_sizes;
+    std::vector<std::vector<LinearRegression>> stages;
+    std::vector<ErrorBounds> bounds;
+    double mean_window;
+
+    int route(int key, int& predicted_pos) const;
+    int binary_search(int key, int left, int right) const;
+    int exponential_search(int key, int pos, int left, int right) const;
+
+public:
+    mutable int operations;
+
+    // stage_sizes lists the number of models per stage, e.g. {1, 1000} or
+    // {1, 100, 10000}. The first stage must have exactly one model.
+    RecursiveModelIndex(const std::vector<int>& input_data, const std::vector<int>& stage_sizes);
+    int search(int key, std::string type = "binary") const;
+
+    // Bytes used by the models and error bounds (the keys are not counted).
+    size_t model_size() const;
+    // Average width of the last-mile search window over all stored keys.
+    double mean_search_window() const;
+};
+
+#endif // RMI_H
@@ -1,4 +1,6 @@
 g++ -std=c++14 -c learned_index.cpp
+g++ -std=c++14 -c rmi.cpp
+g++ -std=c++14 -c pgm_index.cpp
 g++ -std=c++14 -c main.cpp
-g++ learned_index.o main.o -o learned_index_program
+g++ learned_index.o rmi.o pgm_index.o main.o -o learned_index_program
 ./learned_index_program
\ No newline at end of file
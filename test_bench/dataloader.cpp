@@ -214,6 +214,14 @@ Schema loadIMDBData(const std::string& schemaFile, const std::string& dataDir) {
         loadDataFromFile(schema, tableName, dataFile);
         std::cout<<"Table size "<<tableName<<": "<<schema.getTableSize(tableName)<<std::endl;
 
+        // Learned indexes on the id columns, built once the table is loaded
+        auto table = schema.getTable(tableName);
+        if (table->getColumnType("id") == FieldType::INTEGER) {
+            table->buildLearnedIndex("id");
+            std::cout<<"Learned index on "<<tableName<<".id: max error "
+                     <<table->getLearnedIndex("id")->getMaxError()<<std::endl;
+        }
+
     }
 
     return schema;
@@ -23,6 +23,22 @@ private:
             filteredTable->addColumn(col.name, col.baseTableName, col.type);
         }
 
+        // Only the base table itself is indexed, filtered and joined
+        // copies are scanned
+        int lower, upper;
+        auto index = table->getLearnedIndex(column);
+        if (index && table == schema->getTable(baseTableName) && value.getType() == FieldType::INTEGER &&
+            predicateToRange(op, value.getIntValue(), lower, upper)) {
+            // Keep the rows in table order, as a scan would
+            auto rows = index->rangeLookup(lower, upper);
+            std::sort(rows.begin(), rows.end());
+            for (size_t row : rows) {
+                filteredTable->data.push_back(table->data[row]);
+            }
+            filteredTable->recomputeHistogramsForIntegerColumn();
+            return filteredTable;
+        }
+
         // Apply filter condition
         for (const auto& row : table->data) {
             int colIndex = table->getColumnIndex(column, baseTableName);
@@ -0,0 +1,163 @@
+// learned_index.h
+#pragma once
+#include <vector>
+#include <set>
+#include <utility>
+#include <algorithm>
+#include <cmath>
+#include <climits>
+#include <cstddef>
+
+// Read-optimized secondary index on an integer column, mapping keys to row
+// positions. The (key, row) pairs are kept in sorted arrays and a linear
+// model fitted at build time predicts the position of a key; the largest
+// prediction error over all possible keys bounds the last-mile binary
+// search. Rows added after the build go to a sorted delta that is merged
+// in once it outgrows 1/16 of the index.
+class LearnedIndex {
+private:
+    static constexpr size_t MIN_MERGE_THRESHOLD = 1024;
+
+    std::vector<int> keys;
+    std::vector<size_t> rows;
+    std::set<std::pair<int, size_t>> delta;
+    double slope = 0.0;
+    double intercept = 0.0;
+    double maxError = 0.0;
+
+    double predict(int key) const {
+        return slope * key + intercept;
+    }
+
+    // Least squares fit; maxError is taken at both ends of every key gap
+    void fit() {
+        size_t n = keys.size();
+        slope = 0.0;
+        intercept = 0.0;
+        maxError = 0.0;
+        if (n == 0) {
+            return;
+        }
+
+        double meanKey = 0.0;
+        for (int key : keys) {
+            meanKey += key;
+        }
+        meanKey /= n;
+        double meanPosition = (n - 1) / 2.0;
+        double covariance = 0.0, variance = 0.0;
+        for (size_t i = 0; i < n; ++i) {
+            double diff = keys[i] - meanKey;
+            covariance += diff * (i - meanPosition);
+            variance += diff * diff;
+        }
+        if (variance > 0) {
+            slope = covariance / variance;
+        }
+        intercept = meanPosition - slope * meanKey;
+
+        for (size_t i = 0; i < n; ++i) {
+            if (i > 0 && keys[i] == keys[i - 1]) {
+                continue;
+            }
+            maxError = std::max(maxError, std::abs(predict(keys[i]) - i));
+            if (i > 0) {
+                maxError = std::max(maxError, std::abs(predict(keys[i - 1] + 1) - i));
+            }
+        }
+    }
+
+    // Position of the first key > upper, galloping forward from first
+    size_t endPosition(size_t first, int upper) const {
+        size_t low = first, high = first, step = 1;
+        while (high < keys.size() && keys[high] <= upper) {
+            low = high + 1;
+            high = first + step;
+            step *= 2;
+        }
+        high = std::min(high, keys.size());
+        return std::upper_bound(keys.begin() + low, keys.begin() + high, upper) - keys.begin();
+    }
+
+    void merge() {
+        std::vector<std::pair<int, size_t>> entries;
+        entries.reserve(keys.size() + delta.size());
+        for (size_t i = 0; i < keys.size(); ++i) {
+            entries.emplace_back(keys[i], rows[i]);
+        }
+        entries.insert(entries.end(), delta.begin(), delta.end());
+        std::inplace_merge(entries.begin(), entries.begin() + keys.size(), entries.end());
+        build(std::move(entries));
+    }
+
+public:
+    // Build from (key, row) pairs in any order
+    void build(std::vector<std::pair<int, size_t>> entries) {
+        std::sort(entries.begin(), entries.end());
+        keys.resize(entries.size());
+        rows.resize(entries.size());
+        for (size_t i = 0; i < entries.size(); ++i) {
+            keys[i] = entries[i].first;
+            rows[i] = entries[i].second;
+        }
+        delta.clear();
+        fit();
+    }
+
+    void insert(int key, size_t row) {
+        delta.insert({key, row});
+        if (delta.size() > std::max(MIN_MERGE_THRESHOLD, keys.size() / 16)) {
+            merge();
+        }
+    }
+
+    // Position in the sorted arrays of the first entry with a key >= key
+    size_t lowerBound(int key) const {
+        if (keys.empty() || key <= keys.front()) {
+            return 0;
+        }
+        if (key > keys.back()) {
+            return keys.size();
+        }
+        // One position of slack on each side for rounding
+        double predicted = predict(key);
+        double first = std::max(0.0, std::floor(predicted - maxError) - 1);
+        double last = std::max(0.0, std::ceil(predicted + maxError) + 2);
+        auto begin = keys.begin() + std::min(static_cast<size_t>(first), keys.size());
+        auto end = keys.begin() + std::min(static_cast<size_t>(last), keys.size());
+        return std::lower_bound(begin, end, key) - keys.begin();
+    }
+
+    // Rows with lower <= key <= upper, in key order
+    std::vector<size_t> rangeLookup(int lower, int upper) const {
+        if (lower > upper) {
+            return {};
+        }
+        size_t first = lowerBound(lower);
+        std::vector<size_t> result(rows.begin() + first, rows.begin() + endPosition(first, upper));
+        if (!delta.empty()) {
+            auto end = (upper == INT_MAX) ? delta.end() : delta.lower_bound({upper + 1, 0});
+            for (auto it = delta.lower_bound({lower, 0}); it != end; ++it) {
+                result.push_back(it->second);
+            }
+        }
+        return result;
+    }
+
+    std::vector<size_t> lookup(int key) const {
+        return rangeLookup(key, key);
+    }
+
+    size_t size() const {
+        return keys.size() + delta.size();
+    }
+
+    double getMaxError() const {
+        return maxError;
+    }
+
+    // Probes of the last-mile binary search
+    double searchCost() const {
+        return std::log2(2 * maxError + 4);
+    }
+};
@@ -6,6 +6,8 @@
 #include <iostream>
 #include <string>
 #include <vector>
+#include <random>
+#include <unordered_map>
 
 extern "C" {
     Schema* createAndLoadIMDBData();
@@ -69,7 +71,66 @@ void processQuery(const std::vector<std::string>& queryLines, Schema* schema) {
     }
 }
 
-int main() {
+// Lookups of random keys through the learned index on tableName.columnName,
+// a hash index and binary search over the sorted column
+void benchmarkLearnedIndex(Schema* schema, const std::string& tableName, const std::string& columnName) {
+    auto table = schema->getTable(tableName);
+    auto index = table->getLearnedIndex(columnName);
+    if (!index || table->data.empty()) {
+        std::cerr << "No learned index on " << tableName << "." << columnName << std::endl;
+        return;
+    }
+
+    int columnIndex = table->getColumnIndex(columnName, tableName);
+    std::vector<std::pair<int, size_t>> sorted;
+    std::unordered_multimap<int, size_t> hashIndex;
+    for (size_t row = 0; row < table->data.size(); ++row) {
+        int key = table->data[row][columnIndex].getIntValue();
+        sorted.emplace_back(key, row);
+        hashIndex.emplace(key, row);
+    }
+    std::sort(sorted.begin(), sorted.end());
+    std::vector<int> keys;
+    std::vector<size_t> rows;
+    for (const auto& [key, row] : sorted) {
+        keys.push_back(key);
+        rows.push_back(row);
+    }
+
+    const size_t numLookups = 1000000;
+    auto measure = [&](const std::string& name, auto lookup) {
+        std::mt19937 gen(42);
+        std::uniform_int_distribution<int> keyDistribution(keys.front(), keys.back());
+        size_t found = 0;
+        auto startTime = std::chrono::high_resolution_clock::now();
+        for (size_t i = 0; i < numLookups; ++i) {
+            found += lookup(keyDistribution(gen)).size();
+        }
+        auto endTime = std::chrono::high_resolution_clock::now();
+        double seconds = std::chrono::duration<double>(endTime - startTime).count();
+        std::cout << "  " << name << ": " << static_cast<size_t>(numLookups / seconds)
+                  << " lookups/s (" << found << " rows found)\n";
+    };
+
+    std::cout << "\n=== Learned index on " << tableName << "." << columnName << " ("
+              << table->data.size() << " rows, max error " << index->getMaxError() << ") ===\n";
+    measure("Learned index", [&](int key) { return index->lookup(key); });
+    measure("Hash index", [&](int key) {
+        std::vector<size_t> result;
+        auto range = hashIndex.equal_range(key);
+        for (auto it = range.first; it != range.second; ++it) {
+            result.push_back(it->second);
+        }
+        return result;
+    });
+    measure("Binary search", [&](int key) {
+        auto range = std::equal_range(keys.begin(), keys.end(), key);
+        return std::vector<size_t>(rows.begin() + (range.first - keys.begin()),
+                                   rows.begin() + (range.second - keys.begin()));
+    });
+}
+
+int main(int argc, char* argv[]) {
     // Load the IMDB data
     Schema* schema = createAndLoadIMDBData();
     if (!schema) {
@@ -78,6 +139,14 @@ int main() {
     }
 
     std::cout << "IMDB data loaded successfully." << std::endl;
+
+    if (argc > 1 && std::string(argv[1]) == "bench-index") {
+        for (const std::string tableName : {"movie", "actor", "director"}) {
+            benchmarkLearnedIndex(schema, tableName, "id");
+        }
+        delete schema;
+        return 0;
+    }
     
     // Main loop
     while (true) {
@@ -8,6 +8,7 @@
 #include <chrono>
 #include <unordered_set>
 #include <iostream>
+#include <functional>
 
 #ifdef __GNUC__
 #define UNUSED(x) (void)(x)
@@ -32,7 +33,8 @@ protected:
         const std::string& tableName, 
         const std::string& column,
         Predicate::Op op,
-        const Field& value) {
+        const Field& value,
+        bool onBaseTable = true) {
         
         const double SCAN_COST_FACTOR = 1.0;
         auto table = schema->getTable(tableName);
@@ -41,6 +43,14 @@ protected:
         size_t inputSize = table->data.size();
         
         double cost = (inputSize * SCAN_COST_FACTOR) + (inputSize * selectivity);
+
+        // A learned index replaces the scan with a bounded search
+        int lower, upper;
+        auto index = table->getLearnedIndex(column);
+        if (onBaseTable && index && value.getType() == FieldType::INTEGER &&
+            predicateToRange(op, value.getIntValue(), lower, upper)) {
+            cost = std::min(cost, index->searchCost() + (inputSize * selectivity));
+        }
         
         return CostAndSelectivity(cost, selectivity);
     }
@@ -158,14 +168,17 @@ public:
             componentExecutionOrder.push_back(join);
         }
 
-        // Then estimate filter costs
+        // Then estimate filter costs, filters now run on joined tables
         executionSteps.push_back("Estimating filter costs:");
+        std::unordered_set<std::string> filteredTables;
         for (const auto& filter : components.scalarFilters) {
+            bool onBaseTable = components.joins.empty() && filteredTables.insert(filter->lhsTable).second;
             auto costAndSel = estimateFilterCostAndSelectivity(
                 filter->lhsTable,
                 filter->lhsColumn,
                 filter->predicate,
-                filter->rhsValue);
+                filter->rhsValue,
+                onBaseTable);
             
             totalCost += costAndSel.cost;
             
@@ -218,12 +231,16 @@ public:
         
         // Estimate filter costs first
         executionSteps.push_back("Estimating filter costs:");
+        // A second filter on a table runs on the first one's output
+        std::unordered_set<std::string> filteredTables;
         for (const auto& filter : components.scalarFilters) {
+            bool onBaseTable = filteredTables.insert(filter->lhsTable).second;
             auto costAndSel = estimateFilterCostAndSelectivity(
                 filter->lhsTable,
                 filter->lhsColumn,
                 filter->predicate,
-                filter->rhsValue);
+                filter->rhsValue,
+                onBaseTable);
             
             totalCost += costAndSel.cost;
             
@@ -329,12 +346,16 @@ public:
         
         // First apply filters
         executionSteps.push_back("Estimating filter costs:");
+        // A second filter on a table runs on the first one's output
+        std::unordered_set<std::string> filteredTables;
         for (const auto& filter : components.scalarFilters) {
+            bool onBaseTable = filteredTables.insert(filter->lhsTable).second;
             auto costAndSel = estimateFilterCostAndSelectivity(
                 filter->lhsTable,
                 filter->lhsColumn,
                 filter->predicate,
-                filter->rhsValue);
+                filter->rhsValue,
+                onBaseTable);
             
             totalCost += costAndSel.cost;
             
@@ -486,12 +507,16 @@ public:
 
         // First apply filters
         executionSteps.push_back("Estimating filter costs:");
+        // A second filter on a table runs on the first one's output
+        std::unordered_set<std::string> filteredTables;
         for (const auto& filter : components.scalarFilters) {
+            bool onBaseTable = filteredTables.insert(filter->lhsTable).second;
             auto costAndSel = estimateFilterCostAndSelectivity(
                 filter->lhsTable,
                 filter->lhsColumn,
                 filter->predicate,
-                filter->rhsValue);
+                filter->rhsValue,
+                onBaseTable);
             
             totalCost += costAndSel.cost;
             
@@ -597,12 +622,16 @@ public:
 
         // Apply filters first
         executionSteps.push_back("Estimating filter costs:");
+        // A second filter on a table runs on the first one's output
+        std::unordered_set<std::string> filteredTables;
         for (const auto& filter : components.scalarFilters) {
+            bool onBaseTable = filteredTables.insert(filter->lhsTable).second;
             auto costAndSel = estimateFilterCostAndSelectivity(
                 filter->lhsTable,
                 filter->lhsColumn,
                 filter->predicate,
-                filter->rhsValue);
+                filter->rhsValue,
+                onBaseTable);
             
             totalCost += costAndSel.cost;
             
@@ -8,6 +8,10 @@
 #include <memory>
 #include <iostream>
 #include <stdexcept>
+#include <variant>
+#include <algorithm>
+#include <climits>
+#include "learned_index.h"
 
 
 enum class FieldType {
@@ -175,6 +179,25 @@ private:
     Field operand;
 };
 
+// Inclusive key range matched by an integer predicate, false if the
+// predicate is not a range (NOT_EQUALS)
+inline bool predicateToRange(Predicate::Op op, int value, int& lower, int& upper) {
+    lower = INT_MIN;
+    upper = INT_MAX;
+    switch (op) {
+        case Predicate::Op::EQUALS: lower = upper = value; return true;
+        case Predicate::Op::GREATER_THAN:
+            if (value == INT_MAX) { lower = 1; upper = 0; } else { lower = value + 1; }
+            return true;
+        case Predicate::Op::GREATER_THAN_OR_EQ: lower = value; return true;
+        case Predicate::Op::LESS_THAN:
+            if (value == INT_MIN) { lower = 1; upper = 0; } else { upper = value - 1; }
+            return true;
+        case Predicate::Op::LESS_THAN_OR_EQ: upper = value; return true;
+        default: return false;
+    }
+}
+
 class IntHistogram {
 private:
     std::vector<int> buckets;
@@ -327,6 +350,8 @@ public:
     std::string name;
     std::vector<Column> columns;
     std::vector<std::vector<Field>> data;
+    // Secondary indexes by column name, row positions refer to data
+    std::unordered_map<std::string, std::shared_ptr<LearnedIndex>> learnedIndexes;
 
     Table(const std::string& name) : name(name) {}
 
@@ -356,6 +381,30 @@ public:
             }
         }
         data.push_back(row);
+        for (auto& [columnName, index] : learnedIndexes) {
+            index->insert(row[getColumnIndex(columnName, name)].getIntValue(), data.size() - 1);
+        }
+    }
+
+    // Build a learned index over an integer column from the current rows
+    void buildLearnedIndex(const std::string& columnName) {
+        int columnIndex = getColumnIndex(columnName, name);
+        if (columns[columnIndex].type != FieldType::INTEGER) {
+            throw std::runtime_error("Learned index needs an integer column: " + columnName);
+        }
+        std::vector<std::pair<int, size_t>> entries;
+        entries.reserve(data.size());
+        for (size_t row = 0; row < data.size(); ++row) {
+            entries.emplace_back(data[row][columnIndex].getIntValue(), row);
+        }
+        auto index = std::make_shared<LearnedIndex>();
+        index->build(std::move(entries));
+        learnedIndexes[columnName] = index;
+    }
+
+    std::shared_ptr<LearnedIndex> getLearnedIndex(const std::string& columnName) const {
+        auto it = learnedIndexes.find(columnName);
+        return it == learnedIndexes.end() ? nullptr : it->second;
     }
 
     int getColumnIndex(const std::string& columnName, const std::string& tableName) const {
@@ -406,7 +455,8 @@ public:
     Table(Table&& other) noexcept
         : name(std::move(other.name)),
           columns(std::move(other.columns)),
-          data(std::move(other.data)) {}
+          data(std::move(other.data)),
+          learnedIndexes(std::move(other.learnedIndexes)) {}
 
     // Implement move assignment operator for Table
     Table& operator=(Table&& other) noexcept {
@@ -414,6 +464,7 @@ public:
             name = std::move(other.name);
             columns = std::move(other.columns);
             data = std::move(other.data);
+            learnedIndexes = std::move(other.learnedIndexes);
         }
         return *this;
     }